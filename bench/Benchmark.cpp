@@ -0,0 +1,126 @@
+#include "Benchmark.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace CJ {
+
+namespace {
+
+double percentile(const std::vector<double>& sorted, double fraction) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    size_t rank = static_cast<size_t>(fraction * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return traits_type::not_eof(c); }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+NullBuffer nullBuffer;
+
+} // namespace
+
+Benchmark::Benchmark(std::string name, std::string database, size_t scale)
+    : m_name(std::move(name)), m_database(std::move(database)), m_scale(scale) {}
+
+BenchmarkResult Benchmark::run(size_t count, size_t batch, const Operation& op) {
+    BenchmarkResult result;
+    result.name = m_name;
+    result.database = m_database;
+    result.scale = m_scale;
+    result.operations = count;
+    result.batch = std::max<size_t>(1, batch);
+
+    std::vector<double> samples;
+    samples.reserve(count / result.batch + 1);
+    Clock::time_point started = Clock::now();
+    for (size_t first = 0; first < count; first += result.batch) {
+        size_t last = std::min(count, first + result.batch);
+        Clock::time_point sampleStart = Clock::now();
+        for (size_t i = first; i < last; ++i) {
+            op(i);
+        }
+        std::chrono::duration<double, std::nano> elapsed = Clock::now() - sampleStart;
+        samples.push_back(elapsed.count() / static_cast<double>(last - first));
+    }
+    result.seconds = std::chrono::duration<double>(Clock::now() - started).count();
+
+    std::sort(samples.begin(), samples.end());
+    if (count > 0) {
+        result.nsPerOp = result.seconds * 1e9 / static_cast<double>(count);
+        result.opsPerSecond = result.seconds > 0.0 ? static_cast<double>(count) / result.seconds : 0.0;
+        result.p50 = percentile(samples, 0.50);
+        result.p90 = percentile(samples, 0.90);
+        result.p99 = percentile(samples, 0.99);
+        result.max = samples.back();
+    }
+    return result;
+}
+
+std::string jsonEscape(const std::string& text) {
+    std::string escaped;
+    escaped.reserve(text.size());
+    for (char c : text) {
+        switch (c) {
+            case '"': escaped += "\\\""; break;
+            case '\\': escaped += "\\\\"; break;
+            case '\n': escaped += "\\n"; break;
+            case '\r': escaped += "\\r"; break;
+            case '\t': escaped += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char code[8];
+                    std::snprintf(code, sizeof(code), "\\u%04x", c);
+                    escaped += code;
+                } else {
+                    escaped += c;
+                }
+        }
+    }
+    return escaped;
+}
+
+void writeJson(std::ostream& out, const std::vector<BenchmarkResult>& results, const std::string& label) {
+    std::ostringstream json;
+    json << std::fixed << std::setprecision(1);
+    json << "{\n  \"label\": \"" << jsonEscape(label) << "\",\n  \"results\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchmarkResult& r = results[i];
+        json << (i ? ",\n" : "\n")
+             << "    {\"name\": \"" << jsonEscape(r.name) << "\", \"database\": \"" << jsonEscape(r.database)
+             << "\", \"scale\": " << r.scale << ", \"operations\": " << r.operations
+             << ", \"seconds\": " << std::setprecision(6) << r.seconds << std::setprecision(1)
+             << ", \"ns_per_op\": " << r.nsPerOp << ", \"ops_per_sec\": " << r.opsPerSecond
+             << ", \"batch\": " << r.batch << ", \"p50_ns\": " << r.p50 << ", \"p90_ns\": " << r.p90
+             << ", \"p99_ns\": " << r.p99 << ", \"max_ns\": " << r.max << "}";
+    }
+    json << "\n  ]\n}\n";
+    out << json.str();
+}
+
+void writeTable(std::ostream& out, const std::vector<BenchmarkResult>& results) {
+    out << std::left << std::setw(26) << "benchmark" << std::setw(8) << "db" << std::right
+        << std::setw(8) << "scale" << std::setw(12) << "ns/op" << std::setw(14) << "ops/s"
+        << std::setw(12) << "p50" << std::setw(12) << "p99" << "\n";
+    out << std::fixed << std::setprecision(0);
+    for (const auto& r : results) {
+        out << std::left << std::setw(26) << r.name << std::setw(8) << r.database << std::right
+            << std::setw(8) << r.scale << std::setw(12) << r.nsPerOp << std::setw(14) << r.opsPerSecond
+            << std::setw(12) << r.p50 << std::setw(12) << r.p99 << "\n";
+    }
+}
+
+QuietOutput::QuietOutput() : m_saved(std::cout.rdbuf(&nullBuffer)) {}
+
+QuietOutput::~QuietOutput() {
+    std::cout.rdbuf(m_saved);
+}
+
+} // namespace CJ
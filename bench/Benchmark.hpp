@@ -0,0 +1,63 @@
+#pragma once
+#include <chrono>
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace CJ {
+
+struct BenchmarkResult {
+    std::string name;
+    std::string database;       // "memory", "file" or "none"
+    size_t scale = 0;           // entities in the data set
+    size_t operations = 0;
+    double seconds = 0.0;
+    double nsPerOp = 0.0;
+    double opsPerSecond = 0.0;
+    // Per-operation latency in ns, taken over samples of `batch` operations each
+    size_t batch = 1;
+    double p50 = 0.0;
+    double p90 = 0.0;
+    double p99 = 0.0;
+    double max = 0.0;
+};
+
+// Times a benchmark body one sample at a time. Each sample runs `batch`
+// consecutive operations so that calls much shorter than the clock
+// resolution are still measured; the percentiles are per operation.
+class Benchmark {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Operation = std::function<void(size_t index)>;
+
+    Benchmark(std::string name, std::string database, size_t scale);
+
+    // Runs op(0) .. op(count - 1) in samples of `batch`
+    BenchmarkResult run(size_t count, size_t batch, const Operation& op);
+
+private:
+    std::string m_name;
+    std::string m_database;
+    size_t m_scale;
+};
+
+void writeJson(std::ostream& out, const std::vector<BenchmarkResult>& results,
+               const std::string& label);
+void writeTable(std::ostream& out, const std::vector<BenchmarkResult>& results);
+std::string jsonEscape(const std::string& text);
+
+// Sends std::cout to nowhere while alive, to keep library chatter out of the report
+class QuietOutput {
+public:
+    QuietOutput();
+    ~QuietOutput();
+
+    QuietOutput(const QuietOutput&) = delete;
+    QuietOutput& operator=(const QuietOutput&) = delete;
+
+private:
+    std::streambuf* m_saved;
+};
+
+} // namespace CJ
@@ -0,0 +1,296 @@
+#include "Benchmark.hpp"
+#include "../include/DatabaseManager.hpp"
+#include "../include/EntityStore.hpp"
+#include "../include/StationRegistry.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+using namespace CJ;
+
+namespace {
+
+struct Options {
+    std::vector<size_t> scales = {1000, 10000, 100000};
+    std::vector<std::string> databases = {"memory"};
+    std::string filter;
+    std::string label = "train_simulation";
+    std::string output;     // JSON file; stdout if empty
+};
+
+void usage() {
+    std::cerr << "Usage: train_bench [--scales 1000,10000,100000] [--db memory|file|both]\n"
+                 "                   [--filter TEXT] [--label TEXT] [--out FILE]\n"
+                 "Writes JSON results to stdout (or FILE) and a summary table to stderr.\n";
+}
+
+bool parseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            return false;
+        }
+        std::string value = argv[++i];
+        if (arg == "--scales") {
+            options.scales.clear();
+            std::stringstream list(value);
+            std::string item;
+            while (std::getline(list, item, ',')) {
+                options.scales.push_back(std::stoul(item));
+            }
+        } else if (arg == "--db") {
+            if (value == "both") {
+                options.databases = {"memory", "file"};
+            } else if (value == "memory" || value == "file") {
+                options.databases = {value};
+            } else {
+                return false;
+            }
+        } else if (arg == "--filter") {
+            options.filter = value;
+        } else if (arg == "--label") {
+            options.label = value;
+        } else if (arg == "--out") {
+            options.output = value;
+        } else {
+            return false;
+        }
+    }
+    return !options.scales.empty();
+}
+
+std::string stationName(size_t index) {
+    return "Bench Station " + std::to_string(index);
+}
+
+// Enough stations that (first stop, departure) stays unique for `scale` routes
+size_t stationPoolSize(size_t scale) {
+    return std::max<size_t>(100, scale / 10);
+}
+
+Route makeRoute(size_t index, size_t stations) {
+    size_t slot = index / stations;
+    int depHour = static_cast<int>((slot / 60) % 24);
+    int depMinute = static_cast<int>(slot % 60);
+    std::vector<std::string> stops = {
+        stationName(index % stations),
+        stationName((index * 7 + 1) % stations),
+        stationName((index * 13 + 2) % stations),
+        stationName((index * 31 + 3) % stations),
+    };
+    return Route(depHour, depMinute, (depHour + 2) % 24, depMinute, 120, nullptr, nullptr, nullptr, stops);
+}
+
+class Suite {
+public:
+    explicit Suite(const Options& options) : m_options(options) {}
+
+    void run() {
+        for (const std::string& database : m_options.databases) {
+            for (size_t scale : m_options.scales) {
+                runDatabaseBenchmarks(database, scale);
+            }
+        }
+        for (size_t scale : m_options.scales) {
+            runMemoryBenchmarks(scale);
+        }
+    }
+
+    const std::vector<BenchmarkResult>& getResults() const { return m_results; }
+
+private:
+    bool selected(const std::string& name) const {
+        return m_options.filter.empty() || name.find(m_options.filter) != std::string::npos;
+    }
+
+    void record(const BenchmarkResult& result) {
+        m_results.push_back(result);
+        std::cerr << "  " << result.name << " [" << result.database << ", " << result.scale << "]: "
+                  << static_cast<uint64_t>(result.nsPerOp) << " ns/op\n";
+    }
+
+    // A fresh database for each scale, so earlier rows do not skew the next run
+    bool openDatabase(DatabaseManager& db, const std::string& database) {
+        std::string path = DatabaseManager::IN_MEMORY;
+        if (database == "file") {
+            std::filesystem::path file = std::filesystem::temp_directory_path() / "train_bench.db";
+            std::error_code ec;
+            std::filesystem::remove(file, ec);
+            std::filesystem::remove(file.string() + "-journal", ec);
+            path = file.string();
+        }
+        QuietOutput quiet;
+        return db.connect(path);
+    }
+
+    void runDatabaseBenchmarks(const std::string& database, size_t scale) {
+        DatabaseManager db;
+        if (!openDatabase(db, database)) {
+            throw std::runtime_error("Cannot open " + database + " database");
+        }
+        const size_t stations = stationPoolSize(scale);
+        std::vector<Route> routes;
+        routes.reserve(scale);
+        for (size_t i = 0; i < scale; ++i) {
+            routes.push_back(makeRoute(i, stations));
+        }
+
+        if (selected("db.save_train")) {
+            Benchmark bench("db.save_train", database, scale);
+            record(bench.run(scale, 1, [&](size_t i) {
+                Train train("Bench_" + std::to_string(i), 120, 300, static_cast<int>(i + 1), 6);
+                if (!db.saveTrain(train)) {
+                    throw std::runtime_error("saveTrain failed");
+                }
+            }));
+        }
+
+        // Later benchmarks read what this one wrote, so it always runs
+        {
+            Benchmark bench("db.save_route", database, scale);
+            BenchmarkResult result = bench.run(scale, 1, [&](size_t i) {
+                if (!db.saveRoute(routes[i])) {
+                    throw std::runtime_error("saveRoute failed");
+                }
+            });
+            if (selected("db.save_route")) {
+                record(result);
+            }
+        }
+
+        if (selected("db.load_routes")) {
+            size_t repetitions = std::clamp<size_t>(1000000 / scale, 5, 200);
+            std::vector<Route> loaded;
+            Benchmark bench("db.load_routes", database, scale);
+            record(bench.run(repetitions, 1, [&](size_t) {
+                if (!db.loadRoutes(loaded) || loaded.size() != scale) {
+                    throw std::runtime_error("loadRoutes failed");
+                }
+            }));
+        }
+
+        if (selected("db.station_by_name")) {
+            std::mt19937 random(7);
+            std::vector<std::string> names;
+            for (size_t i = 0; i < std::min<size_t>(scale, 4096); ++i) {
+                names.push_back(stationName(random() % stations));
+            }
+            Station station(nullptr, 1, std::vector<std::shared_ptr<Route>>{}, nullptr, nullptr, stationName(0));
+            Benchmark bench("db.station_by_name", database, scale);
+            record(bench.run(scale, 1, [&](size_t i) {
+                if (!db.getStationByName(names[i % names.size()], station)) {
+                    throw std::runtime_error("getStationByName failed");
+                }
+            }));
+        }
+    }
+
+    void runMemoryBenchmarks(size_t scale) {
+        const size_t stations = stationPoolSize(scale);
+        StationRegistry& registry = StationRegistry::global();
+
+        if (selected("memory.station_find")) {
+            EntityStore<StationId, Station> store;
+            for (size_t i = 0; i < stations; ++i) {
+                std::string name = stationName(i);
+                store.insert(registry.intern(name),
+                             Station(nullptr, 2, std::vector<std::shared_ptr<Route>>{}, nullptr, nullptr, name));
+            }
+            // Mixed case and spacing, as typed at the prompt
+            std::mt19937 random(11);
+            std::vector<std::string> queries;
+            for (size_t i = 0; i < 4096; ++i) {
+                std::string name = stationName(random() % stations);
+                if (i % 2) {
+                    std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+                }
+                queries.push_back(i % 3 ? name : "  " + name);
+            }
+            size_t found = 0;
+            Benchmark bench("memory.station_find", "none", scale);
+            record(bench.run(scale * 10, 64, [&](size_t i) {
+                found += store.find(registry.find(queries[i % queries.size()])) != nullptr;
+            }));
+            if (found != scale * 10) {
+                throw std::runtime_error("station lookup missed");
+            }
+        }
+
+        if (selected("route.construct")) {
+            std::vector<Route> routes;
+            routes.reserve(scale);
+            Benchmark bench("route.construct", "none", scale);
+            record(bench.run(scale, 16, [&](size_t i) {
+                routes.push_back(makeRoute(i, stations));
+            }));
+        }
+
+        if (selected("route.reject_invalid")) {
+            std::vector<std::string> stops = {stationName(0), stationName(1)};
+            size_t rejected = 0;
+            Benchmark bench("route.reject_invalid", "none", scale);
+            record(bench.run(scale, 16, [&](size_t i) {
+                try {
+                    Route route(static_cast<int>(i % 24), 75, 10, 0, 60, nullptr, nullptr, nullptr, stops);
+                } catch (const std::invalid_argument&) {
+                    ++rejected;
+                }
+            }));
+            if (rejected != scale) {
+                throw std::runtime_error("invalid route accepted");
+            }
+        }
+
+        if (selected("route.stop_times")) {
+            std::vector<Route> routes;
+            routes.reserve(scale);
+            for (size_t i = 0; i < scale; ++i) {
+                routes.push_back(makeRoute(i, stations));
+            }
+            size_t stops = 0;
+            Benchmark bench("route.stop_times", "none", scale);
+            record(bench.run(scale, 16, [&](size_t i) {
+                stops += routes[i].calculateStopTimes().size();
+            }));
+        }
+    }
+
+    const Options& m_options;
+    std::vector<BenchmarkResult> m_results;
+};
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        usage();
+        return 2;
+    }
+
+    try {
+        Suite suite(options);
+        suite.run();
+
+        if (options.output.empty()) {
+            writeJson(std::cout, suite.getResults(), options.label);
+        } else {
+            std::ofstream out(options.output);
+            if (!out) {
+                std::cerr << "Cannot write " << options.output << std::endl;
+                return 1;
+            }
+            writeJson(out, suite.getResults(), options.label);
+        }
+        std::cerr << "\n";
+        writeTable(std::cerr, suite.getResults());
+    } catch (const std::exception& e) {
+        std::cerr << "Benchmark failed: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
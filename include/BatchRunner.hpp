@@ -0,0 +1,74 @@
+#pragma once
+#include <iosfwd>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Train.hpp"
+#include "Station.hpp"
+#include "Route.hpp"
+
+namespace CJ {
+
+// Runs a line-oriented command script against Management, without menus.
+// One command per line; '#' starts a comment and names containing spaces are
+// written in double quotes:
+//
+//   add-train ID NAME SPEED CAPACITY WAGONS
+//   add-station NAME PLATFORMS
+//   add-route HH:MM HH:MM TRAIN_ID|- STOP STOP [STOP...]
+//   assign TRAIN_ID ROUTE_NUMBER
+//   commit
+//   query train ID
+//   query station NAME
+//   query departures|arrivals STATION HH:MM [COUNT]
+//   query journey FROM TO HH:MM
+//   query shortest FROM TO
+//   import-gtfs DIRECTORY
+//   export DIRECTORY [csv|ndjson]
+//   validate
+//   simulate
+//
+// Consecutive add-* commands are collected and written with
+// Management::importBatch in one transaction. The batch is written at
+// `commit`, before any other command, every BATCH_LIMIT rows and at the end.
+// Errors are reported with their line number and do not stop the script.
+class BatchRunner {
+public:
+    static constexpr size_t BATCH_LIMIT = 10000;
+
+    // Returns true if every command succeeded
+    bool run(std::istream& in);
+
+    size_t getCommandCount() const { return m_commands; }
+    size_t getErrorCount() const { return m_errors; }
+
+    static std::vector<std::string> tokenize(const std::string& line);
+
+private:
+    void execute(const std::vector<std::string>& args);
+    void addTrain(const std::vector<std::string>& args);
+    void addStation(const std::vector<std::string>& args);
+    void addRoute(const std::vector<std::string>& args);
+    void assign(const std::vector<std::string>& args);
+    void query(const std::vector<std::string>& args);
+    void commit();
+    void error(size_t line, const std::string& message);
+
+    std::vector<Train> m_trains;
+    std::vector<Station> m_stations;
+    std::vector<Route> m_routes;
+    // Script line of each pending row, for error messages
+    std::vector<size_t> m_trainLines;
+    std::vector<size_t> m_stationLines;
+    std::vector<size_t> m_routeLines;
+    std::unordered_map<int, size_t> m_pendingTrains;    // ID -> index in m_trains
+
+    size_t m_line = 0;
+    size_t m_commands = 0;
+    size_t m_errors = 0;
+    size_t m_trainsImported = 0;
+    size_t m_stationsImported = 0;
+    size_t m_routesImported = 0;
+};
+
+} // namespace CJ
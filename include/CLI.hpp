@@ -31,6 +31,7 @@ private:
     static void handleTrainOperations(DatabaseManager& db);
     static void handleStationOperations(DatabaseManager& db);
     static void handleRouteOperations(DatabaseManager& db);
+    static void handleDiagnostics();
 
 public:
     static void run();
@@ -4,33 +4,186 @@
 #include <string>
 #include <sqlite3.h>
 #include <memory>
+#include <array>
+#include <mutex>
+#include <chrono>
+#include <iosfwd>
+#include <unordered_map>
 #include "Train.hpp"
 #include "Station.hpp"
 #include "Route.hpp"
 
 namespace CJ {
+    struct ImportFailure {
+        std::string entity;     // "train", "station" or "route"
+        size_t index;           // position in the input vector
+        std::string message;
+    };
+
+    struct ImportReport {
+        size_t trainsImported = 0;
+        size_t stationsImported = 0;
+        size_t routesImported = 0;
+        std::vector<ImportFailure> failures;
+        bool committed = false;
+    };
+
+    // sqlite3_trace_v2 totals for one statement template
+    struct StatementProfile {
+        std::string sql;            // literals replaced by '?'
+        uint64_t calls = 0;
+        uint64_t totalNs = 0;
+        uint64_t maxNs = 0;
+        uint64_t rows = 0;
+    };
+
+    // Tables covered by the keyset-paged export reads
+    enum class ExportTable {
+        Trains,
+        Stations,
+        Routes,
+        Assignments     // keyed by train ID, then route ID
+    };
+
+    struct ExportStation {
+        int id = 0;
+        std::string name;
+        int platformCount = 0;
+    };
+
+    struct ExportRoute {
+        int id = 0;
+        int depHour = 0;
+        int depMinute = 0;
+        int arrHour = 0;
+        int arrMinute = 0;
+        int duration = 0;
+        std::vector<std::string> stops;     // in stop order
+    };
+
     class DatabaseManager{
     private:
+        // Statements compiled once in connect() and reused by every CRUD call
+        enum class StatementId {
+            SaveTrain,
+            InsertTrain,
+            DeleteTrain,
+            DeleteTrainAssignments,
+            GetTrainById,
+            FindStation,
+            InsertStation,
+            DeleteStation,
+            StationInUse,
+            GetStationByName,
+            FindRoute,
+            InsertRoute,
+            InsertRouteStop,
+            AssignTrainToRoute,
+            GetTrainsForRoute,
+            GetRouteIdsForTrain,
+            GetRouteStopIds,
+            GetRoutesThroughStation,
+            LoadRoutesWithStops,
+            GetRoutesForTrain,
+            LoadAssignments,
+            ExportTrainKeys,
+            ExportStationKeys,
+            ExportRouteKeys,
+            ExportAssignmentKeys,
+            ExportTrainPage,
+            ExportStationPage,
+            ExportRoutePage,
+            ExportAssignmentPage,
+            BeginTransaction,
+            CommitTransaction,
+            RollbackTransaction,
+            SavepointRow,
+            ReleaseRow,
+            RollbackRow,
+            Count
+        };
+
         sqlite3* m_db;
         bool m_isConnected;
+        std::string m_path;
+        std::array<sqlite3_stmt*, static_cast<size_t>(StatementId::Count)> m_statements;
 
         static int callback(void* data, int argc, char** argv, char** azColName); 
         bool executeQuery(const std::string& query);
+        enum class RouteWriteResult {
+            Written,
+            Duplicate,
+            Failed
+        };
+
         bool prepareDatabase();
+        int querySchemaVersion();
+        bool migrateFromV1();
+        bool prepareStatements();
+        void finalizeStatements();
+        sqlite3_stmt* getStatement(StatementId id);
+        bool runStatement(StatementId id);
 
-        std::string generateRouteIdentifier(const std::vector<std::string>& stops) const;
+        bool insertTrain(const Train& train, StatementId id = StatementId::SaveTrain);
+        bool findStationId(const std::string& name, int& stationId);
+        bool stationExists(const std::string& name);
+        bool insertStation(const Station& station);
+        bool resolveStopIds(const std::vector<std::string>& stops, std::vector<int>& stationIds);
+        bool findRouteId(const Route& route, int originId, int destinationId, int& routeId);
+        bool insertRouteRows(const Route& route, const std::vector<int>& stationIds, int& routeId);
+        bool insertAssignment(int trainId, int routeId);
+        RouteWriteResult writeRoute(const Route& route, int assignTrainId, int& routeId, std::string& error);
+        bool selectIds(StatementId id, int key, std::vector<int>& ids);
+
+        bool m_profiling = false;
+        mutable std::mutex m_profileMutex;
+        std::unordered_map<std::string, StatementProfile> m_profiles;   // by template
+        // Start and rows so far of each running statement. SQLite's own profile
+        // times come from the VFS clock, which has only millisecond resolution.
+        struct RunningStatement {
+            std::chrono::steady_clock::time_point started;
+            uint64_t rows = 0;
+        };
+        std::unordered_map<sqlite3_stmt*, RunningStatement> m_running;
+
+        static int traceCallback(unsigned type, void* context, void* statement, void* detail);
+        void registerTrace();
 
-        std::string escapeString(const std::string& str) const;
 
     public:
         DatabaseManager();
         ~DatabaseManager();
 
+        static constexpr const char* IN_MEMORY = ":memory:";
+
+        // A bare file name is placed in ./database
         bool connect(const std::string& dbPath = "train_system.db");
         bool disconnect();
         bool isConnected() const;
+        const std::string& getDatabasePath() const;
         bool displayDatabaseContents();
         void cleanupDatabase();
+
+        // Per-statement timing through sqlite3_trace_v2; off by default. The
+        // setting survives reconnects, the totals survive disconnect().
+        void setProfiling(bool enabled);
+        bool isProfiling() const;
+        // Highest total time first; every template if topN is 0
+        std::vector<StatementProfile> getStatementProfiles(size_t topN = 0) const;
+        void resetStatementProfiles();
+        static void printStatementProfiles(std::ostream& out, const std::vector<StatementProfile>& profiles);
+        static std::string normalizeSql(const std::string& sql);
+
+        bool beginTransaction();
+        bool commitTransaction();
+        bool rollbackTransaction();
+
+        // Writes everything in one transaction, skipping and reporting rows that fail.
+        // Routes with an assigned train are linked to it in the same transaction.
+        bool importBatch(const std::vector<Train>& trains,
+                         const std::vector<Station>& stations,
+                         const std::vector<Route>& routes,
+                         ImportReport& report);
         
         bool saveTrain(const Train& train);
         bool loadTrains(std::vector<Train>& trains);
@@ -44,12 +197,36 @@ namespace CJ {
         bool deleteStation(const std::string& name);
         bool getStationByName(const std::string& name, Station& station);
 
+        // A route is identified by its first stop, last stop and departure time.
+        // Stops that are not stations yet are added with one platform.
         bool saveRoute(const Route& route);
+        bool saveRoute(const Route& route, int& routeId);
         bool loadRoutes(std::vector<Route>& routes);
 
-        bool assignTrainToRoute(int trainId, const std::vector<std::string>& routeStops);
-        bool getTrainsForRoute(const std::vector<std::string>& routeStops, std::vector<int>& trainIds);
+        bool assignTrainToRoute(int trainId, int routeId);
         bool getRoutesForTrain(int trainId, std::vector<std::vector<std::string>>& routes);
+
+        // Integer-keyed lookups over the v2 schema, no names involved
+        bool getStationId(const std::string& name, int& stationId);
+        bool getRouteId(const Route& route, int& routeId);
+        bool getTrainsForRoute(int routeId, std::vector<int>& trainIds);
+        bool getRouteIdsForTrain(int trainId, std::vector<int>& routeIds);
+        bool getRouteStopIds(int routeId, std::vector<int>& stationIds);
+        bool getRoutesThroughStation(int stationId, std::vector<int>& routeIds);
+        // Pairs of train ID and index of the route in loadRoutes() order
+        bool loadAssignments(std::vector<std::pair<int, size_t>>& assignments);
+
+        // Keyset-paged reads for exports. A page holds up to `limit` rows with
+        // keys above `after` and at most `last`, in key order. Each page is a
+        // single statement, so no read transaction stays open between pages.
+        // The key range is empty (first > last) if the table is.
+        bool getExportKeyRange(ExportTable table, int& first, int& last);
+        bool readTrainPage(int after, int last, size_t limit, std::vector<Train>& page);
+        bool readStationPage(int after, int last, size_t limit, std::vector<ExportStation>& page);
+        bool readRoutePage(int after, int last, size_t limit, std::vector<ExportRoute>& page);
+        // Pairs of train ID and route ID, after the given pair
+        bool readAssignmentPage(std::pair<int, int> after, int lastTrainId, size_t limit,
+                                std::vector<std::pair<int, int>>& page);
     };
 
 }
@@ -0,0 +1,69 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "Route.hpp"
+
+namespace CJ {
+
+// One train calling at a station: `stop` is the position in the route's stop list
+struct BoardEntry {
+    int time;           // seconds since midnight of the query day; past 86400 for tomorrow
+    uint32_t trip;
+    uint32_t stop;
+};
+
+// A board entry with its station, as stored in snapshot images
+struct StationBoardEntry {
+    StationId station;
+    BoardEntry entry;
+};
+
+// Per-station departure and arrival times, each kept as one array sorted by
+// time of day, so the next N trains after a time are a binary search and a
+// copy. Routes are added and removed in place; a removed trip's number is not
+// reused. A bulk add appends its entries and sorts each station once.
+class DepartureBoard {
+public:
+    void clear();
+
+    // Returns the trip number reported in board entries
+    uint32_t addRoute(const Route& route);
+    // Adds routes[first] onwards in order; returns the trip number of the first
+    uint32_t addRoutes(const std::vector<Route>& routes, size_t first = 0);
+    void removeRoute(uint32_t trip);
+    size_t getTripCount() const;
+
+    // Every station's entries in board order, station by station
+    std::vector<StationBoardEntry> getDepartures() const;
+    std::vector<StationBoardEntry> getArrivals() const;
+    // Takes back those lists for `routes` without sorting; the board must be empty
+    void restore(const std::vector<Route>& routes, const StationBoardEntry* departures, size_t departureCount,
+                 const StationBoardEntry* arrivals, size_t arrivalCount);
+
+    // The next `count` trains at or after `time`, running on into the next day
+    std::vector<BoardEntry> nextDepartures(StationId station, int time, size_t count) const;
+    std::vector<BoardEntry> nextArrivals(StationId station, int time, size_t count) const;
+
+private:
+    struct StationBoard {
+        std::vector<BoardEntry> departures;     // sorted by (time, trip, stop)
+        std::vector<BoardEntry> arrivals;
+    };
+
+    struct Call {
+        StationId station;
+        BoardEntry departure;   // time is -1 if the train only arrives
+        BoardEntry arrival;     // time is -1 if the train only departs
+    };
+
+    uint32_t appendRoute(const Route& route, bool keepSorted);
+
+    static void insert(std::vector<BoardEntry>& entries, const BoardEntry& entry);
+    static void erase(std::vector<BoardEntry>& entries, const BoardEntry& entry);
+    static std::vector<BoardEntry> next(const std::vector<BoardEntry>& entries, int time, size_t count);
+
+    std::vector<StationBoard> m_stations;       // indexed by StationId
+    std::vector<std::vector<Call>> m_trips;     // empty once removed
+};
+
+} // namespace CJ
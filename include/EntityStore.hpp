@@ -0,0 +1,157 @@
+#pragma once
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <cstdint>
+#include <limits>
+#include <utility>
+
+namespace CJ {
+
+// Stable reference to an entity in an EntityStore. The generation changes every
+// time a slot is reused, so a handle to a removed entity never resolves to the
+// entity that took its place.
+struct EntityHandle {
+    uint32_t index = std::numeric_limits<uint32_t>::max();
+    uint32_t generation = 0;
+
+    bool isValid() const { return index != std::numeric_limits<uint32_t>::max(); }
+    bool operator==(const EntityHandle& other) const {
+        return index == other.index && generation == other.generation;
+    }
+    bool operator!=(const EntityHandle& other) const { return !(*this == other); }
+};
+
+// Entities kept contiguous in insertion order (until removals swap the last
+// one into the gap), with a hash index by key and generational handles.
+// Insert, lookup by key or handle and removal are all O(1).
+template <typename Key, typename T, typename Hash = std::hash<Key>>
+class EntityStore {
+public:
+    using const_iterator = typename std::vector<T>::const_iterator;
+
+    // Returns an invalid handle if the key is already present
+    EntityHandle insert(const Key& key, T value) {
+        if (m_index.find(key) != m_index.end()) {
+            return EntityHandle{};
+        }
+
+        uint32_t slot;
+        if (!m_freeSlots.empty()) {
+            slot = m_freeSlots.back();
+            m_freeSlots.pop_back();
+        } else {
+            slot = static_cast<uint32_t>(m_slots.size());
+            m_slots.push_back(Slot{});
+        }
+        m_slots[slot].dense = static_cast<uint32_t>(m_values.size());
+
+        m_values.push_back(std::move(value));
+        m_keys.push_back(key);
+        m_denseToSlot.push_back(slot);
+        m_index.emplace(key, slot);
+        return EntityHandle{slot, m_slots[slot].generation};
+    }
+
+    bool erase(EntityHandle handle) {
+        if (!isAlive(handle)) {
+            return false;
+        }
+        uint32_t dense = m_slots[handle.index].dense;
+        uint32_t last = static_cast<uint32_t>(m_values.size() - 1);
+
+        m_index.erase(m_keys[dense]);
+        if (dense != last) {
+            m_values[dense] = std::move(m_values[last]);
+            m_keys[dense] = std::move(m_keys[last]);
+            m_denseToSlot[dense] = m_denseToSlot[last];
+            m_slots[m_denseToSlot[dense]].dense = dense;
+        }
+        m_values.pop_back();
+        m_keys.pop_back();
+        m_denseToSlot.pop_back();
+
+        m_slots[handle.index].dense = NO_ENTRY;
+        ++m_slots[handle.index].generation;
+        m_freeSlots.push_back(handle.index);
+        return true;
+    }
+
+    bool eraseKey(const Key& key) {
+        return erase(handleOf(key));
+    }
+
+    EntityHandle handleOf(const Key& key) const {
+        auto it = m_index.find(key);
+        if (it == m_index.end()) {
+            return EntityHandle{};
+        }
+        return EntityHandle{it->second, m_slots[it->second].generation};
+    }
+
+    bool isAlive(EntityHandle handle) const {
+        return handle.index < m_slots.size() &&
+               m_slots[handle.index].generation == handle.generation &&
+               m_slots[handle.index].dense != NO_ENTRY;
+    }
+
+    bool contains(const Key& key) const { return m_index.find(key) != m_index.end(); }
+
+    // Pointers stay valid until the next insert or erase
+    T* get(EntityHandle handle) {
+        return isAlive(handle) ? &m_values[m_slots[handle.index].dense] : nullptr;
+    }
+    const T* get(EntityHandle handle) const {
+        return isAlive(handle) ? &m_values[m_slots[handle.index].dense] : nullptr;
+    }
+    T* find(const Key& key) { return get(handleOf(key)); }
+    const T* find(const Key& key) const { return get(handleOf(key)); }
+
+    void reserve(size_t count) {
+        m_values.reserve(count);
+        m_keys.reserve(count);
+        m_denseToSlot.reserve(count);
+        m_slots.reserve(count);
+        m_index.reserve(count);
+    }
+
+    void clear() {
+        // Slots are kept with bumped generations so old handles stay dead
+        for (uint32_t slot : m_denseToSlot) {
+            m_slots[slot].dense = NO_ENTRY;
+            ++m_slots[slot].generation;
+            m_freeSlots.push_back(slot);
+        }
+        m_values.clear();
+        m_keys.clear();
+        m_denseToSlot.clear();
+        m_index.clear();
+    }
+
+    size_t size() const { return m_values.size(); }
+    bool empty() const { return m_values.empty(); }
+
+    // Dense view for scans; order is not preserved across erase
+    const std::vector<T>& values() const { return m_values; }
+    const std::vector<Key>& keys() const { return m_keys; }
+
+    const_iterator begin() const { return m_values.begin(); }
+    const_iterator end() const { return m_values.end(); }
+
+private:
+    static constexpr uint32_t NO_ENTRY = std::numeric_limits<uint32_t>::max();
+
+    struct Slot {
+        uint32_t dense = NO_ENTRY;
+        uint32_t generation = 0;
+    };
+
+    std::vector<T> m_values;               // dense
+    std::vector<Key> m_keys;               // parallel to m_values
+    std::vector<uint32_t> m_denseToSlot;   // parallel to m_values
+    std::vector<Slot> m_slots;
+    std::vector<uint32_t> m_freeSlots;
+    std::unordered_map<Key, uint32_t, Hash> m_index;
+};
+
+} // namespace CJ
@@ -0,0 +1,188 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Exporter.hpp"
+#include "Simulation.hpp"
+
+namespace CJ {
+
+// What the producer does when a reader is a whole ring behind
+enum class OverflowPolicy {
+    Block,          // wait for the reader, so it sees every event
+    Drop            // overwrite; the reader skips ahead and counts the loss
+};
+
+// Single-producer, multi-consumer ring of simulation events. Every reader sees
+// every event through its own cursor. Slots are guarded by a sequence number
+// like a seqlock, so a Drop reader that is lapped while copying a slot notices
+// and retries instead of returning a torn event. Only Block readers hold the
+// producer back, and it checks their cursors only when it seems a lap ahead.
+class EventRing {
+public:
+    // Rounded up to a power of two
+    explicit EventRing(size_t capacity = 1u << 16);
+
+    EventRing(const EventRing&) = delete;
+    EventRing& operator=(const EventRing&) = delete;
+
+    // Readers are added before the first publish; returns the reader's index
+    size_t addReader(OverflowPolicy policy);
+    size_t getCapacity() const { return m_mask + 1; }
+
+    // Producer side
+    void publish(const SimulationEvent& event);
+    // Readers drain what is left and then read() returns 0
+    void close();
+    // Rewinds every cursor for another run; no reader may be reading
+    void reset();
+
+    // Reader side: copies up to max events, waiting while there are none.
+    // Returns 0 once the ring is closed and drained. dropped grows by the
+    // number of events this reader skipped because it was lapped.
+    size_t read(size_t reader, SimulationEvent* events, size_t max, uint64_t& dropped);
+
+    uint64_t getPublished() const { return m_head.load(std::memory_order_acquire); }
+    uint64_t getProducerWaits() const { return m_producerWaits; }
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> sequence{0};  // event number + 1 once written, 0 while writing
+        std::atomic<uint64_t> words[2];
+    };
+
+    struct alignas(64) Reader {
+        std::atomic<uint64_t> cursor{0};    // next event number to read
+        OverflowPolicy policy = OverflowPolicy::Block;
+    };
+
+    void waitForReaders(uint64_t sequence);
+    void wakeReaders();
+
+    std::vector<Slot> m_slots;
+    uint64_t m_mask;
+    std::vector<std::unique_ptr<Reader>> m_readers;
+
+    // Producer state on its own line, away from the readers' cursors
+    alignas(64) std::atomic<uint64_t> m_head{0};
+    uint64_t m_gate = 0;                    // lowest Block cursor last seen
+    uint64_t m_producerWaits = 0;
+    std::atomic<bool> m_closed{false};
+
+    alignas(64) std::atomic<unsigned> m_sleepers{0};
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wake;
+};
+
+// Receives events on a thread of its own, in time order
+class EventSink {
+public:
+    virtual ~EventSink() = default;
+
+    virtual const std::string& getName() const = 0;
+    virtual void write(const Simulation& simulation, const SimulationEvent* events, size_t count) = 0;
+    // Called once the run has ended; false if output was lost
+    virtual bool finish() { return true; }
+};
+
+// One JSON object per event:
+// {"time":"08:30:00","seconds":30600,"event":"departure","route":5,"stop":0,"station":"Warsaw Central","train":1001}
+class NdjsonEventSink : public EventSink {
+public:
+    explicit NdjsonEventSink(const std::string& path);
+
+    // False if the file cannot be created
+    bool open();
+
+    const std::string& getName() const override { return m_path; }
+    void write(const Simulation& simulation, const SimulationEvent* events, size_t count) override;
+    bool finish() override;
+
+private:
+    std::string m_path;
+    BufferedWriter m_writer;
+};
+
+// Human-readable lines on stdout, flushed after each batch
+class ConsoleEventSink : public EventSink {
+public:
+    const std::string& getName() const override { return m_name; }
+    void write(const Simulation& simulation, const SimulationEvent* events, size_t count) override;
+
+private:
+    std::string m_name = "stdout";
+    std::string m_line;
+};
+
+// Hands batches to a function in the same process
+class CallbackEventSink : public EventSink {
+public:
+    using Callback = std::function<void(const Simulation&, const SimulationEvent*, size_t)>;
+
+    CallbackEventSink(std::string name, Callback callback);
+
+    const std::string& getName() const override { return m_name; }
+    void write(const Simulation& simulation, const SimulationEvent* events, size_t count) override;
+
+private:
+    std::string m_name;
+    Callback m_callback;
+};
+
+struct EventSinkStats {
+    std::string name;
+    OverflowPolicy policy = OverflowPolicy::Block;
+    uint64_t delivered = 0;
+    uint64_t dropped = 0;
+    std::string error;          // first failure; its events are still read and discarded
+};
+
+// Fans the events of a simulation run out to sinks through an EventRing. Each
+// sink drains the ring on a dedicated thread rather than on the task
+// scheduler, so a blocked producer can never starve its own consumers.
+class EventStream {
+public:
+    explicit EventStream(size_t capacity = 1u << 16);
+    ~EventStream();
+
+    EventStream(const EventStream&) = delete;
+    EventStream& operator=(const EventStream&) = delete;
+
+    // Before start()
+    void addSink(std::unique_ptr<EventSink> sink, OverflowPolicy policy = OverflowPolicy::Block);
+    bool hasSinks() const { return !m_sinks.empty(); }
+
+    // The simulation must outlive finish()
+    void start(const Simulation& simulation);
+    void publish(const SimulationEvent& event) { m_ring.publish(event); }
+    // Waits until every sink has drained the ring and finished
+    void finish();
+
+    std::vector<EventSinkStats> getStats() const;
+    uint64_t getProducerWaits() const { return m_ring.getProducerWaits(); }
+
+    static bool parsePolicy(const std::string& text, OverflowPolicy& policy);
+    static const char* policyName(OverflowPolicy policy);
+
+private:
+    struct SinkState {
+        std::unique_ptr<EventSink> sink;
+        size_t reader = 0;
+        std::thread thread;
+        EventSinkStats stats;
+    };
+
+    void drain(SinkState& state, const Simulation& simulation);
+
+    EventRing m_ring;
+    std::vector<std::unique_ptr<SinkState>> m_sinks;
+    bool m_running = false;
+};
+
+} // namespace CJ
@@ -0,0 +1,109 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "DatabaseManager.hpp"
+
+namespace CJ {
+
+// Appends to a file through a large in-memory buffer, so rows cost a memcpy
+// and the file sees one write per buffer rather than one per line
+class BufferedWriter {
+public:
+    explicit BufferedWriter(size_t bufferBytes = 1u << 20);
+    ~BufferedWriter();
+
+    BufferedWriter(const BufferedWriter&) = delete;
+    BufferedWriter& operator=(const BufferedWriter&) = delete;
+
+    bool open(const std::string& path);
+    // Flushes and closes; false if any write failed
+    bool close();
+
+    void write(std::string_view text);
+    void put(char c);
+    void writeInt(long long value);
+    uint64_t getBytesWritten() const { return m_bytesWritten; }
+
+private:
+    void flushBuffer();
+
+    std::FILE* m_file = nullptr;
+    std::vector<char> m_buffer;
+    size_t m_used = 0;
+    uint64_t m_bytesWritten = 0;
+    bool m_failed = false;
+};
+
+enum class ExportFormat {
+    Csv,
+    Ndjson
+};
+
+struct ExportOptions {
+    std::string directory;
+    ExportFormat format = ExportFormat::Csv;
+    std::string databasePath;   // empty: Management's database, after flushing write-behind
+    size_t pageRows = 4096;     // rows per database read
+    unsigned chunks = 1;        // files per table, split by key range and written in parallel
+};
+
+struct ExportReport {
+    uint64_t trains = 0;
+    uint64_t stations = 0;
+    uint64_t routes = 0;
+    uint64_t assignments = 0;
+    size_t files = 0;
+    uint64_t bytesWritten = 0;
+    double seconds = 0.0;
+};
+
+// Dumps trains, stations, routes with their stops in order, and train
+// assignments to one file per table (trains.csv, ...), or `chunks` files per
+// table (trains-000.csv, ...) covering consecutive key ranges.
+//
+// Rows are read in keyset pages on connections of the exporter's own, so
+// memory does not depend on table size and writers are only held up for
+// the length of one page read. The dump is consistent per page, not across
+// the whole export. Chunks are exported in parallel on the task scheduler,
+// one connection per task.
+class Exporter {
+public:
+    explicit Exporter(const ExportOptions& options);
+
+    // False if the database cannot be opened or a file cannot be written
+    bool run(ExportReport& report);
+    const std::string& getError() const { return m_error; }
+
+    // "csv" or "ndjson"
+    static bool parseFormat(const std::string& name, ExportFormat& format);
+    static void printReport(std::ostream& out, const ExportReport& report);
+
+    // CSV field quoted as RFC 4180 needs, JSON string with quotes
+    static void writeCsvField(BufferedWriter& out, std::string_view text);
+    static void writeJsonString(BufferedWriter& out, std::string_view text);
+
+private:
+    struct ChunkResult {
+        uint64_t rows = 0;
+        uint64_t bytesWritten = 0;
+        std::string error;
+    };
+
+    std::string fileName(ExportTable table, unsigned chunk) const;
+    void exportChunk(DatabaseManager& database, ExportTable table, unsigned chunk, int first, int last,
+                     ChunkResult& result) const;
+    bool writeTrains(DatabaseManager& database, BufferedWriter& out, int after, int last, uint64_t& rows) const;
+    bool writeStations(DatabaseManager& database, BufferedWriter& out, int after, int last, uint64_t& rows) const;
+    bool writeRoutes(DatabaseManager& database, BufferedWriter& out, int after, int last, uint64_t& rows) const;
+    bool writeAssignments(DatabaseManager& database, BufferedWriter& out, int after, int last,
+                          uint64_t& rows) const;
+
+    ExportOptions m_options;
+    std::string m_error;
+};
+
+} // namespace CJ
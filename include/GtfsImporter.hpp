@@ -0,0 +1,150 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "Train.hpp"
+#include "Station.hpp"
+#include "Route.hpp"
+#include "StationRegistry.hpp"
+
+namespace CJ {
+
+// Reads a CSV file in chunks of whole lines. Lines and fields are views into
+// the chunk buffer and stay valid until the next chunk is read. Quoted fields
+// may contain commas but not line breaks.
+class CsvChunkReader {
+public:
+    explicit CsvChunkReader(size_t chunkBytes = 16u << 20);
+
+    // Opens the file and reads its header row
+    bool open(const std::string& path);
+    // Position of a header column, or -1
+    int column(const std::string& name) const;
+
+    // Next chunk of complete lines; false once the file is exhausted
+    bool nextChunk(std::vector<std::string_view>& lines);
+    uint64_t getBytesRead() const { return m_bytesRead; }
+
+    // Splits one line into fields. Quoted fields with "" escapes are
+    // unescaped into scratch, which must not be touched while fields are used.
+    static void splitLine(std::string_view line, std::vector<std::string_view>& fields, std::string& scratch);
+
+private:
+    std::ifstream m_file;
+    std::vector<char> m_buffer;
+    // Unfinished line at the end of the last chunk, moved to the front of the
+    // buffer on the next read
+    size_t m_carryStart = 0;
+    size_t m_carry = 0;
+    size_t m_chunkBytes;
+    uint64_t m_bytesRead = 0;
+    std::vector<std::string> m_header;
+};
+
+struct GtfsImportOptions {
+    std::string directory;
+    size_t chunkBytes = 16u << 20;
+    size_t routesPerBatch = 100000;
+    int firstTrainId = 0;           // 0: one past the highest existing train ID
+};
+
+struct GtfsImportReport {
+    size_t stationsImported = 0;
+    size_t trainsImported = 0;
+    size_t routesImported = 0;
+    size_t trips = 0;
+    uint64_t stopTimeRows = 0;
+    size_t skippedTrips = 0;        // fewer than two stations, or no usable times
+    size_t duplicateTrips = 0;      // same stations and departure as an earlier trip
+    size_t splitTrips = 0;          // rows not grouped together in stop_times.txt
+    uint64_t unknownReferences = 0; // rows naming an unknown trip or stop
+    size_t failures = 0;            // rows the database rejected
+    std::string firstFailure;       // reason the first of them was rejected
+    uint64_t bytesRead = 0;
+    double seconds = 0.0;
+};
+
+// Imports a GTFS feed (stops.txt, routes.txt, trips.txt, stop_times.txt)
+// through Management's bulk path. Stops sharing a parent station become one
+// station with a platform per child stop, each GTFS route becomes a train and
+// each trip a route from its first to its last stop.
+//
+// stop_times.txt is streamed: each chunk is parsed in parallel on the task
+// scheduler and merged in file order, and a trip is finished once a chunk
+// passes without rows for it. Memory therefore depends on the chunk size and
+// on routesPerBatch, not on the file size, provided the rows of each trip are
+// together as GTFS producers write them. Rows of a trip that turn up after it
+// was finished are counted in splitTrips and dropped.
+class GtfsImporter {
+public:
+    explicit GtfsImporter(const GtfsImportOptions& options);
+
+    // False if a file is missing or malformed or a batch could not be committed
+    bool run(GtfsImportReport& report);
+    const std::string& getError() const { return m_error; }
+
+    static void printReport(std::ostream& out, const GtfsImportReport& report);
+
+private:
+    struct StopTimeRow {
+        uint32_t trip;          // UINT32_MAX if the row is unusable
+        uint32_t sequence;
+        uint32_t stop;
+        int32_t arrival;        // seconds after midnight of the service day, -1 if empty
+        int32_t departure;
+    };
+
+    struct OpenTrip {
+        std::vector<StopTimeRow> rows;
+        size_t lastChunk = 0;
+    };
+
+    // Keys of the ID maps point into m_ids, so lookups need no copies
+    using IdMap = std::unordered_map<std::string_view, uint32_t>;
+
+    bool fail(const std::string& message);
+    std::string path(const char* file) const;
+    std::string_view keep(std::string_view id);
+
+    bool readStops();
+    bool readRoutes();
+    bool readTrips();
+    bool readStopTimes(GtfsImportReport& report);
+    void parseRows(const std::vector<std::string_view>& lines, std::vector<StopTimeRow>& rows,
+                   int tripColumn, int sequenceColumn, int stopColumn, int arrivalColumn,
+                   int departureColumn) const;
+    void finishTrip(uint32_t trip, OpenTrip& open, GtfsImportReport& report);
+    bool flushRoutes(GtfsImportReport& report);
+    bool importBatch(const std::vector<Train>& trains, const std::vector<Station>& stations,
+                     const std::vector<Route>& routes, GtfsImportReport& report);
+
+    GtfsImportOptions m_options;
+    std::string m_error;
+    std::deque<std::string> m_ids;
+
+    IdMap m_stopIndex;
+    std::vector<std::string> m_stopStation;     // station name of each stop
+    std::vector<StationId> m_stopStationId;
+    std::vector<Station> m_stations;
+
+    IdMap m_routeIndex;
+    std::vector<Train> m_trains;
+    std::vector<std::shared_ptr<Train>> m_trainPtrs;
+
+    IdMap m_tripIndex;
+    std::vector<uint32_t> m_tripRoute;
+    std::vector<bool> m_tripFinished;
+    std::vector<bool> m_tripSplit;
+
+    std::vector<Route> m_pendingRoutes;
+    std::unordered_set<uint64_t> m_departures;  // origin, destination and minute of imported trips
+};
+
+} // namespace CJ
@@ -0,0 +1,133 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "TaskScheduler.hpp"
+
+namespace CJ {
+
+struct HttpRequest {
+    std::string method;
+    std::string version;        // "HTTP/1.1" or "HTTP/1.0"
+    std::string path;           // percent-decoded, without the query string
+    std::string query;          // as sent, after '?'
+    std::string body;
+    bool keepAlive = true;
+
+    // Decoded value of a query string parameter, or the fallback
+    std::string parameter(std::string_view name, const std::string& fallback = "") const;
+    bool hasParameter(std::string_view name) const;
+
+    static std::string decode(std::string_view text, bool plusIsSpace);
+
+private:
+    bool findParameter(std::string_view name, std::string* value) const;
+};
+
+struct HttpResponse {
+    int status = 200;
+    std::string contentType = "application/json";
+    std::string body;
+};
+
+struct HttpServerOptions {
+    std::string address = "127.0.0.1";
+    uint16_t port = 8080;                   // 0 picks a free port
+    size_t maxHeaderBytes = 16u << 10;      // request line and headers
+    size_t maxBodyBytes = 1u << 20;
+    size_t maxConnections = 10000;
+    size_t maxPipelined = 64;               // requests handed to one worker task
+};
+
+// HTTP/1.1 server on non-blocking sockets and one epoll loop. The loop only
+// accepts, reads, parses and writes; requests are handled on the task
+// scheduler. Connections are kept alive and may pipeline: every complete
+// request in a connection's input goes to one worker task, and the next
+// batch is dispatched when its responses have been queued, so responses
+// always leave in request order.
+class HttpServer {
+public:
+    using Handler = std::function<void(const HttpRequest&, HttpResponse&)>;
+
+    explicit HttpServer(Handler handler, const HttpServerOptions& options = HttpServerOptions());
+    ~HttpServer();
+
+    HttpServer(const HttpServer&) = delete;
+    HttpServer& operator=(const HttpServer&) = delete;
+
+    // Binds and listens; false with getError() set
+    bool start();
+    // Runs the event loop on the calling thread until stop()
+    void run();
+    // Safe from other threads and from signal handlers
+    void stop();
+
+    uint16_t getPort() const { return m_port; }
+    const std::string& getError() const { return m_error; }
+
+    static const char* reasonPhrase(int status);
+
+private:
+    struct Connection {
+        int fd = -1;
+        uint64_t serial = 0;            // tells a reused descriptor apart
+        std::string input;
+        std::string output;
+        size_t outputSent = 0;
+        bool busy = false;              // a batch is with the workers
+        bool closing = false;           // close once idle with output sent
+        bool reading = true;
+        uint32_t events = 0;            // registered with epoll
+    };
+
+    struct Completion {
+        int fd;
+        uint64_t serial;
+        std::string output;
+        bool close;
+    };
+
+    enum class ParseResult {
+        Complete,
+        Incomplete,
+        Invalid
+    };
+
+    ParseResult parseRequest(const std::string& input, size_t& offset, HttpRequest& request,
+                             int& errorStatus) const;
+    static void writeResponse(std::string& output, const HttpRequest& request, const HttpResponse& response);
+
+    void acceptConnections();
+    // These return false once they have closed the connection
+    bool readFrom(Connection& connection);
+    bool dispatch(Connection& connection);
+    bool flush(Connection& connection);
+    void updateInterest(Connection& connection);
+    void closeConnection(int fd);
+    void drainCompletions();
+    bool fail(Connection& connection, int status);
+
+    Handler m_handler;
+    HttpServerOptions m_options;
+    std::string m_error;
+    uint16_t m_port = 0;
+
+    int m_listenFd = -1;
+    int m_epollFd = -1;
+    int m_wakeFd = -1;                  // eventfd: completions or stop
+    std::atomic<bool> m_stopping{false};
+    uint64_t m_nextSerial = 1;
+    std::unordered_map<int, std::unique_ptr<Connection>> m_connections;
+
+    std::mutex m_completionMutex;
+    std::vector<Completion> m_completions;
+    std::unique_ptr<TaskGroup> m_workers;
+};
+
+} // namespace CJ
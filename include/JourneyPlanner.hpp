@@ -0,0 +1,68 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "Route.hpp"
+
+namespace CJ {
+
+// One ride on one trip, boarding at `from` and alighting at `to`
+struct JourneyLeg {
+    uint32_t trip;      // index of the route the planner was built from
+    StationId from;
+    StationId to;
+    int departure;      // seconds since midnight
+    int arrival;
+};
+
+struct Journey {
+    std::vector<JourneyLeg> legs;
+
+    int departure() const { return legs.empty() ? 0 : legs.front().departure; }
+    int arrival() const { return legs.empty() ? 0 : legs.back().arrival; }
+    size_t transfers() const { return legs.empty() ? 0 : legs.size() - 1; }
+};
+
+struct JourneyRequest {
+    StationId from;
+    StationId to;
+    int departAfter;    // seconds since midnight
+};
+
+// Earliest-arrival journeys with the Connection Scan Algorithm. Every pair of
+// consecutive stops of every route becomes one connection; the connections are
+// stored in one array sorted by departure, so a query is a single forward scan
+// from the first connection after the requested time.
+class JourneyPlanner {
+public:
+    static constexpr int DEFAULT_MIN_CHANGE_SECONDS = 5 * 60;
+
+    struct Connection {
+        int departure;
+        int arrival;
+        StationId from;
+        StationId to;
+        uint32_t trip;
+    };
+
+    explicit JourneyPlanner(const std::vector<Route>& routes);
+
+    // False if `to` cannot be reached. minChangeSeconds applies when changing
+    // trains, not at the origin. Safe to call from several threads.
+    bool earliestArrival(StationId from, StationId to, int departAfter, Journey& journey,
+                         int minChangeSeconds = DEFAULT_MIN_CHANGE_SECONDS) const;
+    // Answers every request on the shared TaskScheduler. A journey is left
+    // without legs where there is no connection.
+    std::vector<Journey> earliestArrivals(const std::vector<JourneyRequest>& requests,
+                                          int minChangeSeconds = DEFAULT_MIN_CHANGE_SECONDS) const;
+
+    size_t getConnectionCount() const;
+    size_t getTripCount() const;
+    const std::vector<Connection>& getConnections() const;
+
+private:
+    std::vector<Connection> m_connections;  // sorted by departure, then arrival
+    size_t m_tripCount = 0;
+    StationId m_stationLimit = 0;           // one past the highest StationId used
+};
+
+} // namespace CJ
@@ -2,24 +2,59 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include <mutex>
+#include "EntityStore.hpp"
 #include "Train.hpp"
 #include "Station.hpp"
 #include "Route.hpp"
 #include "DatabaseManager.hpp" 
+#include "PersistenceWorker.hpp"
+#include "Simulation.hpp"
+#include "EventStream.hpp"
+#include "PlatformConflictChecker.hpp"
+#include "NetworkSnapshot.hpp"
 
 namespace CJ {
 
 class Management {
 private:
     friend class CLI;
-    static std::vector<Train> m_trains;
-    static std::vector<Station> m_stations;
+    static EntityStore<int, Train> m_trains;            // by train ID
+    static EntityStore<StationId, Station> m_stations;  // by interned name
     static std::vector<Route> m_routes;
+    static PlatformConflictChecker m_platforms;         // trip i is m_routes[i]
+    static DepartureBoard m_departureBoard;             // trip i is m_routes[i]
+    // Writers work on the members above under m_writeMutex and publish a new
+    // snapshot when done; readers only ever touch m_current
+    static std::mutex m_writeMutex;
+    static std::shared_ptr<const NetworkSnapshot> m_current;
+    static uint64_t m_version;
+    static uint64_t m_snapshotStamp;            // database stamp the snapshot file matches
     static DatabaseManager m_dbManager;
+    static std::unique_ptr<PersistenceWorker> m_writeBehind;
     static Management* instance;
     DatabaseManager m_database;
     Management() = default;  // Private constructor
 
+    static void syncWriteBehind();
+    static void loadNetworkFromDatabase();
+    static void reloadFromDatabase();           // with m_writeMutex held
+    static bool flushLocked();                  // with m_writeMutex held
+    static bool loadNetworkFromSnapshot(const std::string& path);
+    static void applyAssignments(const std::vector<std::pair<int, size_t>>& assignments);
+    static void replaceTrains(std::vector<Train>& trains);
+    static void replaceStations(std::vector<Station>& stations);
+    static void resetTimetableIndexes();        // empty, with the stations' platform counts
+    static void rebuildTimetableIndexes();
+
+    enum Changes : unsigned {
+        TrainsChanged = 1,
+        StationsChanged = 2,
+        TimetableChanged = 4,
+        EverythingChanged = TrainsChanged | StationsChanged | TimetableChanged
+    };
+    static void publish(unsigned changes);
+
 public:
     static Management& getInstance() {
         if (instance == nullptr) {
@@ -30,9 +65,16 @@ public:
 
     DatabaseManager& getDatabase() { return m_database; }
 
+    // Current version of the network. Safe from any thread and never blocks on
+    // writers; the snapshot stays valid however long it is held.
+    static std::shared_ptr<const NetworkSnapshot> snapshot();
+
     static void addRoute(int depHour, int depMin, int arrHour, int arrMin,
                          Train& trainName, int duration,
                          const std::vector<std::string>& intermediateStops);
+    // Saves the route with its assigned train, if any; throws if it is a
+    // duplicate or would need more platforms than a station has
+    static void addRoute(const Route& route);
     static void displayAllRoutes();
     
 
@@ -40,6 +82,7 @@ public:
                         int wagonCount);
     static bool deleteTrain(int id);
     static void displayTrainInfo(int id);
+    static const Train* findTrain(int id);
     
 
     static void addStation(std::shared_ptr<Train> trainName, int platformCount,
@@ -48,15 +91,87 @@ public:
                          const std::string& name);
     static bool removeStation(const std::string& name);
     static void displayStationInfo(const std::string& name);
+    // Case-insensitive, constant time; nullptr if there is no such station
+    static const Station* findStation(const std::string& name);
     
 
+    // Assigns a train to the route listed as number routeIndex + 1; false if
+    // either does not exist or the database write fails
+    static bool assignTrain(int trainId, size_t routeIndex);
+
+    // Bulk path: one transaction for the whole batch, failed rows are listed in the report
+    static bool importBatch(const std::vector<Train>& trains,
+                            const std::vector<Station>& stations,
+                            const std::vector<Route>& routes,
+                            ImportReport& report);
+
     static bool initializeSystem();
+    static void shutdownSystem();
+
+    static std::string getDatabasePath();
+
+    // Binary image of the database next to it, used for fast startup while it
+    // still matches the database file. Written on shutdown or on demand.
+    static std::string getSnapshotPath();
+    static bool saveSnapshot(const std::string& path = "");
+
+    // Write-behind mode: mutations update memory at once and are persisted by a
+    // background thread in grouped transactions. flush() and waitForDurability()
+    // return false if a queued change failed to save; the network is then
+    // reloaded from the database, so the change is gone from memory as well.
+    static bool enableWriteBehind();
+    static void disableWriteBehind();
+    static bool isWriteBehindEnabled();
+    static bool flush();
+    // Ticket covering everything queued so far, for waitForDurability()
+    static uint64_t durabilityBarrier();
+    static bool waitForDurability(uint64_t barrier);
+
+    // Platform capacity of the whole timetable; addRoute checks single routes
+    static std::vector<PlatformConflict> validatePlatforms();
+    static void printPlatformConflicts(const std::vector<PlatformConflict>& conflicts);
+
+    // Earliest arrival at `to` leaving `from` no earlier than the given time
+    static bool planJourney(const std::string& from, const std::string& to,
+                            int departHour, int departMinute, Journey& journey);
+    // Every journey not beaten on both arrival time and number of transfers
+    static std::vector<Journey> planJourneyOptions(const std::string& from, const std::string& to,
+                                                   int departHour, int departMinute);
+    static void printJourney(const Journey& journey);
+
+    // Next trains leaving or reaching a station from the given time on, from
+    // an in-memory index kept current as routes are added
+    static std::vector<BoardEntry> nextDepartures(const std::string& station, int hour, int minute,
+                                                  size_t count);
+    static std::vector<BoardEntry> nextArrivals(const std::string& station, int hour, int minute,
+                                                size_t count);
+    static void printBoard(const std::vector<BoardEntry>& entries, bool departures);
+
+    // Fastest scheduled running time between two stations ignoring departure
+    // times, in seconds, or RailGraph::UNREACHABLE. The contraction hierarchy
+    // behind it is cached in a file next to the database.
+    static int shortestRunningTime(const std::string& from, const std::string& to,
+                                   std::vector<std::string>* path = nullptr);
+    static std::string getHierarchyPath();
+
+    // Runs one operating day of the loaded timetable and prints the report.
+    // Events go to the stream's sinks as they happen if one is given.
+    static SimulationStats runSimulation(EventStream* events = nullptr);
+
+    // SQL statement profiling on the main database connection
+    static void setStatementProfiling(bool enabled);
+    static bool isStatementProfiling();
+    static std::vector<StatementProfile> getStatementProfiles(size_t topN = 0);
+    static void resetStatementProfiles();
+    static bool writeStatementProfiles(const std::string& path, size_t topN = 0);
+
     static std::string formatStationName(const std::string& name);
     static bool compareStationNames(const std::string& name1, const std::string& name2);
 
 
-    static const std::vector<Train>& getTrains() { return m_trains; }
-    static const std::vector<Station>& getStations() { return m_stations; }
+    // Writer-side state, for the thread making edits; other threads use snapshot()
+    static const std::vector<Train>& getTrains() { return m_trains.values(); }
+    static const std::vector<Station>& getStations() { return m_stations.values(); }
     static const std::vector<Route>& getRoutes() { return m_routes; }
 };
 
@@ -0,0 +1,147 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace CJ {
+
+// Log-linear latency buckets in the style of HdrHistogram: 16 sub-buckets per
+// power of two keep every bucket within about 6% of the values it holds, and
+// values are recorded in nanoseconds up to 2^40 (about 18 minutes).
+struct HistogramLayout {
+    static constexpr int SUB_BUCKET_BITS = 4;
+    static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static constexpr int MAX_EXPONENT = 40;
+    static constexpr size_t BUCKETS = (MAX_EXPONENT - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    static size_t bucketOf(uint64_t value);
+    static uint64_t lowerBound(size_t bucket);
+    static uint64_t upperBound(size_t bucket);
+};
+
+// Merged view of one metric across all threads
+struct MetricSummary {
+    std::string name;
+    bool histogram = false;
+    uint64_t count = 0;         // counter value, or number of samples
+    uint64_t sum = 0;           // histogram only, in ns
+    uint64_t min = 0;
+    uint64_t max = 0;
+    std::vector<uint64_t> buckets;
+
+    double mean() const;
+    // Upper bound of the bucket holding the given fraction of samples
+    uint64_t percentile(double fraction) const;
+};
+
+// Process-wide counters and latency histograms. Metrics are registered once by
+// name and then updated through their index. Each thread writes its own shard
+// with plain relaxed stores, so updates never contend; reports merge the
+// shards. Shards of threads that have exited are folded into a retired total.
+class MetricsRegistry {
+public:
+    using MetricId = size_t;
+    static constexpr size_t MAX_METRICS = 256;
+
+    static MetricsRegistry& global();
+
+    // Same name, same ID; throws std::length_error when the registry is full
+    MetricId counter(const std::string& name);
+    MetricId histogram(const std::string& name);
+
+    void add(MetricId id, uint64_t amount = 1);
+    void record(MetricId id, uint64_t nanoseconds);
+
+    std::vector<MetricSummary> collect() const;
+    void reset();
+
+    void writeText(std::ostream& out) const;
+    void writeJson(std::ostream& out) const;
+    // JSON if the path ends in ".json", text otherwise
+    bool writeFile(const std::string& path) const;
+
+    MetricsRegistry(const MetricsRegistry&) = delete;
+    MetricsRegistry& operator=(const MetricsRegistry&) = delete;
+
+private:
+    struct HistogramShard {
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> sum{0};
+        std::atomic<uint64_t> min{UINT64_MAX};
+        std::atomic<uint64_t> max{0};
+        std::array<std::atomic<uint64_t>, HistogramLayout::BUCKETS> buckets{};
+    };
+
+    // Written only by its owning thread; read by collect()
+    struct Shard {
+        std::array<std::atomic<uint64_t>, MAX_METRICS> counters{};
+        std::array<std::atomic<HistogramShard*>, MAX_METRICS> histograms{};
+        ~Shard();
+    };
+
+    struct Definition {
+        std::string name;
+        bool histogram;
+    };
+
+    friend struct ShardOwner;
+
+    MetricsRegistry() = default;
+    MetricId define(const std::string& name, bool histogram);
+    Shard& localShard();
+    void retire(Shard* shard);
+    void mergeInto(const Shard& shard, std::vector<MetricSummary>& totals) const;
+
+    mutable std::mutex m_mutex;
+    std::vector<Definition> m_definitions;
+    std::vector<Shard*> m_shards;
+    std::vector<MetricSummary> m_retired;
+};
+
+// Records the lifetime of the scope in a histogram
+class ScopedTimer {
+public:
+    explicit ScopedTimer(MetricsRegistry::MetricId id)
+        : m_id(id), m_start(std::chrono::steady_clock::now()) {}
+    ~ScopedTimer() {
+        auto elapsed = std::chrono::steady_clock::now() - m_start;
+        MetricsRegistry::global().record(
+            m_id, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    MetricsRegistry::MetricId m_id;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+} // namespace CJ
+
+// Instrumentation points. Each resolves its name once, on first use; build with
+// -DCJ_DISABLE_METRICS to compile them out entirely.
+#define CJ_METRIC_CONCAT_(a, b) a##b
+#define CJ_METRIC_CONCAT(a, b) CJ_METRIC_CONCAT_(a, b)
+
+#ifndef CJ_DISABLE_METRICS
+#define CJ_TIMED(name)                                                                              \
+    static const ::CJ::MetricsRegistry::MetricId CJ_METRIC_CONCAT(cjMetricId_, __LINE__) =          \
+        ::CJ::MetricsRegistry::global().histogram(name);                                            \
+    ::CJ::ScopedTimer CJ_METRIC_CONCAT(cjMetricTimer_, __LINE__)(CJ_METRIC_CONCAT(cjMetricId_, __LINE__))
+#define CJ_COUNT(name, amount)                                                                      \
+    do {                                                                                            \
+        static const ::CJ::MetricsRegistry::MetricId cjMetricId_ =                                  \
+            ::CJ::MetricsRegistry::global().counter(name);                                          \
+        ::CJ::MetricsRegistry::global().add(cjMetricId_, static_cast<uint64_t>(amount));           \
+    } while (false)
+#else
+#define CJ_TIMED(name) static_cast<void>(0)
+#define CJ_COUNT(name, amount) static_cast<void>(0)
+#endif
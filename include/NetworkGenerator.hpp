@@ -0,0 +1,59 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <utility>
+#include "Train.hpp"
+#include "Station.hpp"
+#include "Route.hpp"
+
+namespace CJ {
+
+struct GeneratorOptions {
+    uint64_t seed = 1;
+    size_t stations = 1000;
+    size_t trains = 200;
+    size_t routes = 5000;
+    size_t hubs = 0;            // 0: one hub per 40 stations
+    int firstTrainId = 10000;
+};
+
+// Routes carry their assigned train; assignments lists the same links as
+// (train ID, route index) for the snapshot writer
+struct GeneratedNetwork {
+    std::vector<Train> trains;
+    std::vector<Station> stations;
+    std::vector<Route> routes;
+    std::vector<std::pair<int, size_t>> assignments;
+};
+
+// Deterministic synthetic network for scale testing: the same options give the
+// same network. Hubs are joined by trunk lines and each hub serves branch lines
+// through the stations of its region, so every station is on at least one line.
+// Departures cluster around the morning and evening peaks, trunk services run
+// faster and more often than branch services, and each station gets at least
+// as many platforms as it ever has trains at once.
+class NetworkGenerator {
+public:
+    explicit NetworkGenerator(const GeneratorOptions& options);
+
+    GeneratedNetwork generate() const;
+
+    // Snapshot not tied to any database (source stamp 0), for tools that read
+    // snapshot files directly
+    static bool writeSnapshot(const GeneratedNetwork& network, const std::string& path);
+
+private:
+    struct Line {
+        std::vector<size_t> stops;      // station indices
+        std::vector<int> legMinutes;    // running time of each leg
+        bool trunk;
+    };
+
+    std::vector<std::string> makeStationNames(uint64_t& state, size_t hubs) const;
+    std::vector<Line> makeLines(uint64_t& state, size_t hubs) const;
+
+    GeneratorOptions m_options;
+};
+
+} // namespace CJ
@@ -0,0 +1,79 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+#include "EntityStore.hpp"
+#include "Train.hpp"
+#include "Station.hpp"
+#include "Route.hpp"
+#include "DepartureBoard.hpp"
+#include "JourneyPlanner.hpp"
+#include "RaptorRouter.hpp"
+#include "RailGraph.hpp"
+
+namespace CJ {
+
+// Routes and everything derived from them. Snapshots share one Timetable until
+// the routes change. The routers are built on first use, once, by whichever
+// reader gets there first.
+class Timetable {
+public:
+    Timetable(std::vector<Route> routes, DepartureBoard departureBoard, std::string hierarchyPath);
+
+    const std::vector<Route>& getRoutes() const { return m_routes; }
+    const DepartureBoard& getDepartureBoard() const { return m_departureBoard; }
+
+    const JourneyPlanner& getJourneyPlanner() const;
+    const RaptorRouter& getRaptorRouter() const;
+    // Loads the contraction hierarchy from the hierarchy path, or builds and saves it
+    const RailGraph& getRailGraph() const;
+
+private:
+    std::vector<Route> m_routes;
+    DepartureBoard m_departureBoard;    // trip i is m_routes[i]
+    std::string m_hierarchyPath;
+
+    mutable std::once_flag m_journeyPlannerOnce;
+    mutable std::once_flag m_raptorRouterOnce;
+    mutable std::once_flag m_railGraphOnce;
+    mutable std::unique_ptr<JourneyPlanner> m_journeyPlanner;
+    mutable std::unique_ptr<RaptorRouter> m_raptorRouter;
+    mutable std::unique_ptr<RailGraph> m_railGraph;
+};
+
+// Immutable view of the whole network at one version. Readers hold it through
+// a shared_ptr and never see a later edit; it is freed when the last reader
+// lets go. Parts an edit did not touch are shared with the previous version.
+class NetworkSnapshot {
+public:
+    using TrainStore = EntityStore<int, Train>;
+    using StationStore = EntityStore<StationId, Station>;
+
+    NetworkSnapshot(uint64_t version, std::shared_ptr<const TrainStore> trains,
+                    std::shared_ptr<const StationStore> stations,
+                    std::shared_ptr<const Timetable> timetable);
+
+    uint64_t getVersion() const { return m_version; }
+
+    const std::vector<Train>& getTrains() const { return m_trains->values(); }
+    const std::vector<Station>& getStations() const { return m_stations->values(); }
+    const std::vector<Route>& getRoutes() const { return m_timetable->getRoutes(); }
+    const Timetable& getTimetable() const { return *m_timetable; }
+
+    const Train* findTrain(int id) const { return m_trains->find(id); }
+    const Station* findStation(StationId id) const { return m_stations->find(id); }
+
+    const std::shared_ptr<const TrainStore>& shareTrains() const { return m_trains; }
+    const std::shared_ptr<const StationStore>& shareStations() const { return m_stations; }
+    const std::shared_ptr<const Timetable>& shareTimetable() const { return m_timetable; }
+
+private:
+    uint64_t m_version;
+    std::shared_ptr<const TrainStore> m_trains;
+    std::shared_ptr<const StationStore> m_stations;
+    std::shared_ptr<const Timetable> m_timetable;
+};
+
+} // namespace CJ
@@ -0,0 +1,67 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include "DatabaseManager.hpp"
+
+namespace CJ {
+
+// Applies queued database writes on a dedicated thread with its own connection.
+// Whatever is queued while a batch commits is grouped into the next transaction.
+class PersistenceWorker {
+public:
+    using Operation = std::function<bool(DatabaseManager&)>;
+
+    PersistenceWorker();
+    ~PersistenceWorker();
+
+    PersistenceWorker(const PersistenceWorker&) = delete;
+    PersistenceWorker& operator=(const PersistenceWorker&) = delete;
+
+    bool start(const std::string& dbPath = "train_system.db");
+    void stop();
+    bool isRunning() const;
+
+    // Returns a ticket that waitFor() can use as a durability barrier
+    uint64_t enqueue(Operation operation, const std::string& description);
+    void waitFor(uint64_t ticket);
+    void flush();
+    uint64_t lastTicket() const;
+
+    // Failures so far, and the ones not yet taken
+    size_t getFailedCount() const;
+    bool hasErrors() const;
+    std::vector<std::string> takeErrors();
+
+private:
+    struct PendingWrite {
+        uint64_t ticket;
+        Operation operation;
+        std::string description;
+    };
+
+    static constexpr size_t MAX_BATCH_SIZE = 4096;
+
+    void run();
+    void applyBatch(std::vector<PendingWrite>& batch);
+
+    DatabaseManager m_database;
+    std::thread m_thread;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_workAvailable;
+    std::condition_variable m_batchCommitted;
+    std::deque<PendingWrite> m_queue;
+    uint64_t m_nextTicket;
+    uint64_t m_completedTicket;
+    bool m_running;
+    bool m_stopping;
+    size_t m_failedCount;
+    std::vector<std::string> m_errors;
+};
+
+} // namespace CJ
@@ -0,0 +1,97 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdint>
+#include "Route.hpp"
+
+namespace CJ {
+
+// Window in which more trains occupy a station than it has platforms.
+// doubleBooked platforms have to take two trains at once during it.
+struct PlatformConflict {
+    StationId station;
+    int start;                      // seconds since midnight, inclusive
+    int end;                        // exclusive, at most 24:00
+    int trainsPresent;
+    int platformCount;
+    int doubleBooked;
+    std::vector<uint32_t> trips;    // trips at the station during the window
+
+    std::string describe() const;
+};
+
+// One platform occupancy window in flat form, as stored in snapshot images
+struct PlatformWindow {
+    StationId station;
+    int start;
+    int end;
+    uint32_t trip;
+};
+
+// Per-station index of platform occupancy windows, sorted by start time. A
+// train holds a platform from arrival to departure at intermediate stops and
+// for Route::DWELL_SECONDS before leaving its first stop and after reaching
+// its last. Each station also tracks its longest window, which bounds how far
+// back an overlapping window can start, so one route is checked with a binary
+// search instead of a rescan. A bulk add appends the windows of all its routes
+// and sorts each station once, instead of inserting window by window.
+class PlatformConflictChecker {
+public:
+    void clear();
+
+    // Stations without a count are treated as having one platform
+    void setPlatformCount(StationId station, int platformCount);
+    int getPlatformCount(StationId station) const;
+
+    // Returns the trip number used in conflict reports
+    uint32_t addRoute(const Route& route);
+    // Same trip numbers as adding the routes one by one; returns the first
+    uint32_t addRoutes(const std::vector<Route>& routes);
+    void removeLastRoute();
+    // Drops the trips from firstTrip on whose keep flag is false and renumbers
+    // the rest in order; keep[i] is for trip firstTrip + i
+    void keepRoutes(uint32_t firstTrip, const std::vector<bool>& keep);
+    size_t getTripCount() const;
+
+    // The index in flat form: every station's windows in start order, and
+    // every trip's windows in the order addRoute made them
+    std::vector<PlatformWindow> getWindowsByStation() const;
+    std::vector<PlatformWindow> getWindowsByTrip() const;
+    // Takes back both lists of an index with `tripCount` trips without
+    // sorting; platform counts are kept and there must be no trips yet
+    void restoreWindows(const PlatformWindow* byStation, const PlatformWindow* byTrip, size_t windowCount,
+                        size_t tripCount);
+
+    // Conflicts the given trip takes part in; O(k log k) in the windows it overlaps
+    std::vector<PlatformConflict> checkTrip(uint32_t trip) const;
+    // Counts only the other trips whose flag in `counted` is set
+    std::vector<PlatformConflict> checkTrip(uint32_t trip, const std::vector<bool>& counted) const;
+    // Whole timetable, one sweep per station: O(n log n)
+    std::vector<PlatformConflict> validateAll() const;
+
+private:
+    struct Occupancy {
+        int start;
+        int end;
+        uint32_t trip;
+    };
+
+    struct StationTimeline {
+        std::vector<Occupancy> windows;     // sorted by start
+        int longestWindow = 0;
+        int platformCount = 1;
+    };
+
+    StationTimeline& timeline(StationId station);
+    uint32_t appendRoute(const Route& route, bool keepSorted);
+    // Adds a window of the newest trip, in order or at the end
+    void insertWindow(StationId station, const Occupancy& window, bool keepSorted);
+    std::vector<PlatformConflict> checkTrip(uint32_t trip, const std::vector<bool>* counted) const;
+    void sweep(StationId station, const std::vector<Occupancy>& windows,
+               std::vector<PlatformConflict>& conflicts) const;
+
+    std::vector<StationTimeline> m_stations;        // indexed by StationId
+    std::vector<std::vector<std::pair<StationId, Occupancy>>> m_trips;
+};
+
+} // namespace CJ
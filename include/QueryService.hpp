@@ -0,0 +1,37 @@
+#pragma once
+#include <string>
+#include "HttpServer.hpp"
+#include "NetworkSnapshot.hpp"
+
+namespace CJ {
+
+// Read-only JSON endpoints over Management's in-memory network, for
+// HttpServer. Each request works on one snapshot, so it never sees an edit
+// half done and never waits for a writer.
+//
+//   GET /health
+//   GET /stations                  GET /stations/{name}
+//   GET /trains                    GET /trains/{id}
+//   GET /routes?offset=0&limit=100
+//   GET /departures?station=NAME&time=HH:MM[&count=10]
+//   GET /arrivals?station=NAME&time=HH:MM[&count=10]
+//   GET /journey?from=NAME&to=NAME&time=HH:MM      earliest arrival
+//   GET /journeys?from=NAME&to=NAME&time=HH:MM     every trade-off of arrival and transfers
+//   GET /metrics
+//
+// Route numbers are the 1-based numbers shown by List Routes.
+class QueryService {
+public:
+    void handle(const HttpRequest& request, HttpResponse& response) const;
+
+private:
+    void stations(const NetworkSnapshot& network, const std::string& name, HttpResponse& response) const;
+    void trains(const NetworkSnapshot& network, const std::string& id, HttpResponse& response) const;
+    void routes(const NetworkSnapshot& network, const HttpRequest& request, HttpResponse& response) const;
+    void board(const NetworkSnapshot& network, const HttpRequest& request, bool departures,
+               HttpResponse& response) const;
+    void journey(const NetworkSnapshot& network, const HttpRequest& request, bool allOptions,
+                 HttpResponse& response) const;
+};
+
+} // namespace CJ
@@ -0,0 +1,68 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdint>
+#include "Route.hpp"
+
+namespace CJ {
+
+// Station network implied by the routes: one node per station that appears in
+// a route, one directed edge per pair of consecutive stops weighted with the
+// fastest scheduled running time between them, stored as CSR arrays.
+//
+// Point-to-point queries run plain Dijkstra until buildContractionHierarchy()
+// has been called (or a hierarchy loaded); from then on they run a
+// bidirectional search over the upward edges of the hierarchy only.
+class RailGraph {
+public:
+    static constexpr int UNREACHABLE = -1;
+    static constexpr uint32_t FORMAT_VERSION = 1;
+
+    explicit RailGraph(const std::vector<Route>& routes);
+
+    size_t getNodeCount() const;
+    size_t getEdgeCount() const;
+    size_t getShortcutCount() const;
+
+    // Seconds of running time, or UNREACHABLE. The path lists every station passed.
+    int dijkstra(StationId from, StationId to, std::vector<StationId>* path = nullptr) const;
+    int shortestPath(StationId from, StationId to, std::vector<StationId>* path = nullptr) const;
+
+    void buildContractionHierarchy();
+    bool hasContractionHierarchy() const;
+
+    // Hierarchy files are tied to the graph they were built from by a
+    // fingerprint of station names and edges; load refuses any other file.
+    bool saveHierarchy(const std::string& path) const;
+    bool loadHierarchy(const std::string& path);
+    uint64_t getFingerprint() const;
+
+private:
+    static constexpr uint32_t NO_NODE = UINT32_MAX;
+
+    struct Csr {
+        std::vector<uint32_t> offsets;      // node n owns [offsets[n], offsets[n + 1])
+        std::vector<uint32_t> targets;
+        std::vector<int> weights;
+        std::vector<uint32_t> middles;      // contracted node a shortcut skips, or NO_NODE
+
+        void clear();
+    };
+
+    uint32_t nodeOf(StationId station) const;
+    int hierarchyQuery(uint32_t source, uint32_t target, std::vector<StationId>* path) const;
+    void unpackEdge(uint32_t from, uint32_t to, uint32_t middle, std::vector<uint32_t>& nodes) const;
+
+    std::vector<StationId> m_stations;      // node -> station
+    std::vector<uint32_t> m_nodes;          // station -> node, NO_NODE if not in the graph
+    Csr m_graph;
+    uint64_t m_fingerprint = 0;
+
+    // Contraction hierarchy
+    std::vector<uint32_t> m_rank;
+    Csr m_upward;                           // u -> v with rank(v) > rank(u), stored at u
+    Csr m_downward;                         // u -> v with rank(u) > rank(v), stored at v
+    size_t m_shortcutCount = 0;
+};
+
+} // namespace CJ
@@ -0,0 +1,94 @@
+#pragma once
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include "Route.hpp"
+#include "JourneyPlanner.hpp"
+
+namespace CJ {
+
+// Leaving at `departure` gets to the station by `arrival` with `transfers` changes
+struct ProfileEntry {
+    int departure;
+    int arrival;
+    uint32_t transfers;
+};
+
+// All stations reached from one origin within a departure window
+struct StationProfiles {
+    StationId origin;
+    std::vector<std::vector<ProfileEntry>> entries;     // indexed by StationId
+};
+
+struct ProfileQuery {
+    StationId origin;
+    int windowStart;    // seconds since midnight
+    int windowEnd;
+};
+
+// Round-based routing (RAPTOR). Routes with the same stop sequence form a trip
+// pattern with one shared stop list and a block of stop times; round k scans
+// every pattern touched in round k - 1, so round k holds the best journeys with
+// k - 1 transfers. Patterns are split where a trip would overtake another, which
+// keeps departures at every stop sorted; times are stored stop by stop, so the
+// binary search for a trip to board stays within a cache line or two.
+class RaptorRouter {
+public:
+    static constexpr uint32_t DEFAULT_MAX_TRANSFERS = 4;
+
+    explicit RaptorRouter(const std::vector<Route>& routes);
+
+    // Pareto set of arrival time against transfers, fewest transfers first
+    std::vector<Journey> query(StationId from, StationId to, int departAfter,
+                               uint32_t maxTransfers = DEFAULT_MAX_TRANSFERS,
+                               int minChangeSeconds = JourneyPlanner::DEFAULT_MIN_CHANGE_SECONDS) const;
+
+    // Every journey that is not beaten on departure, arrival and transfers by
+    // another, for departures within [windowStart, windowEnd]; latest departure
+    // first. A journey leaving after windowEnd is kept if it beats those inside.
+    std::vector<Journey> profile(StationId from, StationId to, int windowStart, int windowEnd,
+                                 uint32_t maxTransfers = DEFAULT_MAX_TRANSFERS,
+                                 int minChangeSeconds = JourneyPlanner::DEFAULT_MIN_CHANGE_SECONDS) const;
+
+    // One-to-many profiles for every query, run on the shared TaskScheduler in at
+    // most threadCount tasks (0: no limit, 1: on the calling thread). The sink is
+    // called once per query, possibly from several threads.
+    using ProfileSink = std::function<void(size_t queryIndex, const StationProfiles& profiles)>;
+    void runProfiles(const std::vector<ProfileQuery>& queries, const ProfileSink& sink,
+                     unsigned threadCount = 0, uint32_t maxTransfers = DEFAULT_MAX_TRANSFERS,
+                     int minChangeSeconds = JourneyPlanner::DEFAULT_MIN_CHANGE_SECONDS) const;
+
+    size_t getPatternCount() const;
+    size_t getStationLimit() const;
+
+    struct Pattern {
+        uint32_t firstStop;     // into m_patternStops
+        uint32_t stopCount;
+        uint32_t firstTrip;     // into m_patternTrips
+        uint32_t tripCount;
+        uint32_t firstTime;     // into m_times, stop-major
+    };
+
+    struct PatternStop {
+        uint32_t pattern;
+        uint32_t stopIndex;
+    };
+
+private:
+    friend struct RaptorScan;
+
+    const StopTime& timeAt(const Pattern& pattern, uint32_t trip, uint32_t stop) const {
+        return m_times[pattern.firstTime + stop * pattern.tripCount + trip];
+    }
+    std::vector<int> departuresFrom(StationId origin, int windowStart, int windowEnd) const;
+
+    std::vector<Pattern> m_patterns;
+    std::vector<StationId> m_patternStops;
+    std::vector<uint32_t> m_patternTrips;       // route index of each trip
+    std::vector<StopTime> m_times;
+    // Patterns serving each station, CSR: station s owns [offsets[s], offsets[s + 1])
+    std::vector<uint32_t> m_stationOffsets;
+    std::vector<PatternStop> m_stationPatterns;
+};
+
+} // namespace CJ
@@ -2,11 +2,18 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include "StationRegistry.hpp"
  
 namespace CJ {
  
 class Train;
 class Station;
+
+// Seconds since midnight of the day the route departs; past 86400 after midnight
+struct StopTime {
+    int arrival;
+    int departure;
+};
  
 class Route {
     private:
@@ -18,9 +25,11 @@ class Route {
         std::shared_ptr<Train> m_assignedTrain;
         std::shared_ptr<Station> m_startStation;
         std::shared_ptr<Station> m_endStation;
-        std::vector<std::string> m_intermediateStops;
+        std::vector<StationId> m_stopIds;  // interned in StationRegistry::global()
     
     public:
+        static constexpr int DWELL_SECONDS = 60;
+
         Route(int depHour, int depMin, int arrHour, int arrMin,int duration,
               std::shared_ptr<Train> trainPtr, std::shared_ptr<Station> startStation,
               std::shared_ptr<Station> endStation,
@@ -32,6 +41,8 @@ class Route {
     void setArrivalTimeMinute(int arrivalTimeMinute);
     void setDuration(int duration);
     void setIntermediateStops(const std::vector<std::string>& intermediateStops);
+    // IDs already interned in StationRegistry::global()
+    void setStopIds(std::vector<StationId> stopIds);
     void setTrainAssignment(std::shared_ptr<Train> train);
  
 
@@ -41,11 +52,15 @@ class Route {
     int getArrivalTimeMinute() const;
     int getDuration() const;
     std::shared_ptr<Train> getAssignedTrain() const;
-    const std::vector<std::string>& getIntermediateStops() const;
+    std::vector<std::string> getIntermediateStops() const;
+    const std::vector<StationId>& getStopIds() const;
  
 
     void addIntermediateStop(const std::string& stationName);
     int calculateTravelTime() const;
+    // One entry per stop. Running time is split evenly between the legs and each
+    // intermediate stop gets DWELL_SECONDS (less if the schedule is too tight).
+    std::vector<StopTime> calculateStopTimes() const;
     std::string getStartStation() const;
     std::string getEndStation() const;
  
@@ -0,0 +1,73 @@
+#pragma once
+#include <vector>
+#include <array>
+#include <functional>
+#include <cstdint>
+#include "Route.hpp"
+
+namespace CJ {
+
+enum class SimulationEventType : uint8_t {
+    Arrival,        // train reaches the last stop
+    Stop,           // train reaches an intermediate stop
+    Dwell,          // train leaves an intermediate stop after dwelling
+    Departure,      // train leaves the first stop
+    Count
+};
+
+struct SimulationEvent {
+    int time;       // seconds since midnight
+    uint32_t trip;  // index of the route the simulation was built from
+    uint32_t stop;  // position in the route's stop list
+    SimulationEventType type;
+};
+
+struct SimulationStats {
+    uint64_t eventsProcessed = 0;
+    std::array<uint64_t, static_cast<size_t>(SimulationEventType::Count)> eventsByType{};
+    size_t tripsRun = 0;
+    size_t peakTrainsInService = 0;
+    size_t peakQueueSize = 0;
+    int firstEventTime = 0;
+    int lastEventTime = 0;
+    double elapsedSeconds = 0.0;
+    double eventsPerSecond = 0.0;
+};
+
+// Discrete-event run of the timetable. Stop times are computed once when the
+// simulation is built; the event queue is a binary heap holding only the next
+// event of each active trip, so it never grows beyond the number of trips.
+class Simulation {
+public:
+    static constexpr int DAY_SECONDS = 24 * 60 * 60;
+
+    using EventCallback = std::function<void(const SimulationEvent&)>;
+
+    explicit Simulation(const std::vector<Route>& routes);
+
+    // Called for every event in time order; leave unset for a headless run
+    void setEventCallback(EventCallback callback);
+
+    // Runs every trip departing in [startTime, endTime) to completion
+    SimulationStats run(int startTime = 0, int endTime = DAY_SECONDS);
+
+    size_t getTripCount() const;
+    int getTrainId(uint32_t trip) const;
+    StationId getStation(uint32_t trip, uint32_t stop) const;
+    const StopTime& getStopTime(uint32_t trip, uint32_t stop) const;
+    uint32_t getStopCount(uint32_t trip) const;
+
+    static const char* eventTypeName(SimulationEventType type);
+
+private:
+    bool nextEvent(const SimulationEvent& event, SimulationEvent& next) const;
+
+    // Flat timetable: trip i owns [m_tripOffsets[i], m_tripOffsets[i + 1])
+    std::vector<uint32_t> m_tripOffsets;
+    std::vector<StopTime> m_stopTimes;
+    std::vector<StationId> m_stopStations;
+    std::vector<int> m_trainIds;            // 0 if no train is assigned
+    EventCallback m_callback;
+};
+
+} // namespace CJ
@@ -0,0 +1,127 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include "Train.hpp"
+#include "Station.hpp"
+#include "Route.hpp"
+#include "PlatformConflictChecker.hpp"
+#include "DepartureBoard.hpp"
+
+namespace CJ {
+
+struct TrainView {
+    int id;
+    int speed;
+    int capacity;
+    int wagonCount;
+    std::string_view name;
+};
+
+struct StationView {
+    std::string_view name;
+    int platformCount;
+};
+
+struct RouteView {
+    int depHour;
+    int depMinute;
+    int arrHour;
+    int arrMinute;
+    int duration;
+    uint32_t firstStop;
+    uint32_t stopCount;
+};
+
+struct AssignmentView {
+    int trainId;
+    uint32_t routeIndex;
+};
+
+// Timetable indexes saved with the network, so loading does not rebuild them
+struct SnapshotIndexes {
+    std::vector<PlatformWindow> windowsByStation;
+    std::vector<PlatformWindow> windowsByTrip;
+    std::vector<StationBoardEntry> departures;
+    std::vector<StationBoardEntry> arrivals;
+};
+
+// Read-only binary image of the network. The file is memory mapped and every
+// accessor returns views into the mapping, so nothing is decoded or copied
+// until the caller asks for it. SQLite stays the source of truth: the snapshot
+// records a stamp of the database file it was taken from and callers should
+// only trust it while that stamp still matches.
+//
+// Route stops are StationIds into the image's own name table, which holds the
+// names of StationRegistry::global() in ID order. A loader that interns those
+// names into an empty registry gets the same IDs back, and can then take the
+// stops and the saved indexes as they are.
+class Snapshot {
+public:
+    static constexpr uint32_t FORMAT_VERSION = 2;
+
+    Snapshot();
+    ~Snapshot();
+    Snapshot(const Snapshot&) = delete;
+    Snapshot& operator=(const Snapshot&) = delete;
+
+    static bool write(const std::string& path,
+                      const std::vector<Train>& trains,
+                      const std::vector<Station>& stations,
+                      const std::vector<Route>& routes,
+                      const std::vector<std::pair<int, size_t>>& assignments,
+                      uint64_t sourceStamp,
+                      const SnapshotIndexes* indexes = nullptr);
+
+    // Size and modification time of a file folded into one value
+    static uint64_t fileStamp(const std::string& path);
+
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const;
+
+    uint64_t getSourceStamp() const;
+    size_t getTrainCount() const;
+    size_t getStationCount() const;
+    size_t getRouteCount() const;
+    size_t getAssignmentCount() const;
+    size_t getNameCount() const;
+
+    TrainView getTrain(size_t index) const;
+    StationView getStation(size_t index) const;
+    RouteView getRoute(size_t index) const;
+    StationId getRouteStop(const RouteView& route, size_t stop) const;
+    AssignmentView getAssignment(size_t index) const;
+    std::string_view getName(StationId id) const;
+
+    // False if the image was written without indexes
+    bool hasIndexes() const;
+    size_t getWindowCount() const;
+    const PlatformWindow* getWindowsByStation() const;
+    const PlatformWindow* getWindowsByTrip() const;
+    size_t getDepartureCount() const;
+    const StationBoardEntry* getDepartures() const;
+    size_t getArrivalCount() const;
+    const StationBoardEntry* getArrivals() const;
+
+private:
+    struct Header;
+
+    const Header* header() const;
+    std::string_view stringAt(uint32_t offset, uint32_t length) const;
+    bool validate() const;
+
+    const unsigned char* m_data;
+    size_t m_size;
+#ifdef _WIN32
+    void* m_file;
+    void* m_mapping;
+#else
+    int m_fd;
+#endif
+};
+
+} // namespace CJ
@@ -0,0 +1,45 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <shared_mutex>
+#include <cstdint>
+#include <limits>
+
+namespace CJ {
+
+using StationId = uint32_t;
+constexpr StationId INVALID_STATION_ID = std::numeric_limits<StationId>::max();
+
+// Process-wide symbol table for station names. Each distinct name gets a dense
+// StationId the first time it is seen. Names match case-insensitively with runs
+// of whitespace treated as one space, the same rule as formatStationName.
+// Lookups hash the raw text, so they do not allocate.
+class StationRegistry {
+public:
+    static StationRegistry& global();
+
+    StationId intern(std::string_view name);
+    StationId find(std::string_view name) const;
+    // Spelling used when the name was first interned
+    const std::string& getName(StationId id) const;
+    size_t size() const;
+
+    static bool equalNames(std::string_view name1, std::string_view name2);
+    static uint64_t hashName(std::string_view name);
+
+private:
+    StationRegistry();
+
+    StationId findLocked(std::string_view name, uint64_t hash) const;
+    void insertSlot(StationId id, uint64_t hash);
+    void grow();
+
+    mutable std::shared_mutex m_mutex;
+    std::deque<std::string> m_names;     // deque keeps references stable as it grows
+    std::vector<uint64_t> m_hashes;      // per id, reused when rehashing
+    std::vector<StationId> m_slots;      // open addressing, linear probing
+};
+
+} // namespace CJ
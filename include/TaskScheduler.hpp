@@ -0,0 +1,99 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+
+namespace CJ {
+
+class TaskGroup;
+
+// Work-stealing thread pool. Each worker owns a deque: it pushes and pops its
+// own tasks at the back and steals from the front of the others' when it runs
+// dry. Tasks submitted from outside the pool go to a shared queue. A thread
+// waiting on a TaskGroup runs queued tasks instead of sleeping, so groups may
+// be nested and waited on from inside a task.
+class TaskScheduler {
+public:
+    using Task = std::function<void()>;
+
+    // 0 uses one worker per core
+    explicit TaskScheduler(unsigned threadCount = 0);
+    ~TaskScheduler();
+
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    // Shared pool sized to the machine, started on first use
+    static TaskScheduler& global();
+
+    unsigned getThreadCount() const;
+
+    // Runs body(first, last) over [begin, end) in chunks of `grain` indices
+    // starting at begin (0 picks a size giving a few chunks per worker), or in
+    // at most maxTasks chunks if that is set. The calling thread takes part.
+    // Returns when all chunks are done; the first exception body threw is rethrown.
+    void parallelFor(size_t begin, size_t end, size_t grain,
+                     const std::function<void(size_t first, size_t last)>& body, size_t maxTasks = 0);
+
+private:
+    friend class TaskGroup;
+
+    struct Job {
+        Task task;
+        TaskGroup* group;
+    };
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    void submit(Job job);
+    bool runOne(unsigned self);
+    bool takeJob(unsigned self, Job& job);
+    void workerLoop(unsigned index);
+    static void execute(Job& job);
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::vector<std::thread> m_threads;
+    std::mutex m_injectMutex;
+    std::deque<Job> m_inject;
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wake;
+    std::atomic<size_t> m_queued{0};
+    bool m_stopping = false;
+};
+
+// Tasks that are waited on together. The destructor waits too.
+class TaskGroup {
+public:
+    explicit TaskGroup(TaskScheduler& scheduler = TaskScheduler::global());
+    ~TaskGroup();
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    void run(TaskScheduler::Task task);
+    // Helps run queued tasks until every task of the group has finished, then
+    // rethrows the first exception one of them threw
+    void wait();
+
+private:
+    friend class TaskScheduler;
+
+    void finished(std::exception_ptr error);
+
+    TaskScheduler& m_scheduler;
+    std::atomic<size_t> m_pending{0};
+    std::mutex m_mutex;
+    std::condition_variable m_done;
+    std::exception_ptr m_error;
+};
+
+} // namespace CJ
@@ -0,0 +1,311 @@
+#include "../include/BatchRunner.hpp"
+#include "../include/Management.hpp"
+#include "../include/GtfsImporter.hpp"
+#include "../include/Exporter.hpp"
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+
+namespace CJ {
+
+namespace {
+
+int parseInt(const std::string& text, const char* what) {
+    size_t used = 0;
+    int value = 0;
+    try {
+        value = std::stoi(text, &used);
+    } catch (const std::exception&) {
+        used = 0;
+    }
+    if (used == 0 || used != text.size()) {
+        throw std::invalid_argument(std::string("invalid ") + what + " '" + text + "'");
+    }
+    return value;
+}
+
+void parseTime(const std::string& text, int& hour, int& minute) {
+    size_t colon = text.find(':');
+    if (colon == std::string::npos) {
+        throw std::invalid_argument("invalid time '" + text + "', expected HH:MM");
+    }
+    hour = parseInt(text.substr(0, colon), "hour");
+    minute = parseInt(text.substr(colon + 1), "minute");
+    if (hour < 0 || hour > 23 || minute < 0 || minute > 59) {
+        throw std::invalid_argument("invalid time '" + text + "'");
+    }
+}
+
+void expectArgs(const std::vector<std::string>& args, size_t min, size_t max, const char* usage) {
+    if (args.size() < min || args.size() > max) {
+        throw std::invalid_argument(std::string("usage: ") + usage);
+    }
+}
+
+} // namespace
+
+std::vector<std::string> BatchRunner::tokenize(const std::string& line) {
+    std::vector<std::string> tokens;
+    size_t i = 0;
+    while (i < line.size()) {
+        while (i < line.size() && std::isspace(static_cast<unsigned char>(line[i]))) {
+            ++i;
+        }
+        if (i == line.size() || line[i] == '#') {
+            break;
+        }
+        std::string token;
+        if (line[i] == '"') {
+            size_t close = line.find('"', i + 1);
+            if (close == std::string::npos) {
+                throw std::invalid_argument("unterminated quote");
+            }
+            token = line.substr(i + 1, close - i - 1);
+            i = close + 1;
+        } else {
+            while (i < line.size() && !std::isspace(static_cast<unsigned char>(line[i]))) {
+                token += line[i++];
+            }
+        }
+        tokens.push_back(std::move(token));
+    }
+    return tokens;
+}
+
+bool BatchRunner::run(std::istream& in) {
+    std::string line;
+    while (std::getline(in, line)) {
+        ++m_line;
+        try {
+            std::vector<std::string> args = tokenize(line);
+            if (args.empty()) {
+                continue;
+            }
+            ++m_commands;
+            execute(args);
+        } catch (const std::exception& e) {
+            error(m_line, e.what());
+        }
+    }
+    commit();
+
+    std::cout << "Batch finished: " << m_commands << " commands, " << m_trainsImported << " trains, "
+              << m_stationsImported << " stations and " << m_routesImported << " routes imported, "
+              << m_errors << " errors" << std::endl;
+    return m_errors == 0;
+}
+
+void BatchRunner::execute(const std::vector<std::string>& args) {
+    const std::string& command = args[0];
+    if (command == "add-train") {
+        addTrain(args);
+    } else if (command == "add-station") {
+        addStation(args);
+    } else if (command == "add-route") {
+        addRoute(args);
+    } else {
+        // Everything else sees the writes that came before it
+        commit();
+        if (command == "commit") {
+            expectArgs(args, 1, 1, "commit");
+        } else if (command == "assign") {
+            assign(args);
+        } else if (command == "query") {
+            query(args);
+        } else if (command == "validate") {
+            expectArgs(args, 1, 1, "validate");
+            Management::printPlatformConflicts(Management::validatePlatforms());
+        } else if (command == "import-gtfs") {
+            expectArgs(args, 2, 2, "import-gtfs DIRECTORY");
+            GtfsImportOptions options;
+            options.directory = args[1];
+            GtfsImporter importer(options);
+            GtfsImportReport report;
+            if (!importer.run(report)) {
+                throw std::runtime_error(importer.getError());
+            }
+            GtfsImporter::printReport(std::cout, report);
+        } else if (command == "export") {
+            expectArgs(args, 2, 3, "export DIRECTORY [csv|ndjson]");
+            ExportOptions options;
+            options.directory = args[1];
+            if (args.size() == 3 && !Exporter::parseFormat(args[2], options.format)) {
+                throw std::invalid_argument("unknown export format '" + args[2] + "'");
+            }
+            Exporter exporter(options);
+            ExportReport report;
+            if (!exporter.run(report)) {
+                throw std::runtime_error(exporter.getError());
+            }
+            Exporter::printReport(std::cout, report);
+        } else if (command == "simulate") {
+            expectArgs(args, 1, 2, "simulate [EVENTS.ndjson]");
+            EventStream events;
+            if (args.size() == 2) {
+                auto sink = std::make_unique<NdjsonEventSink>(args[1]);
+                if (!sink->open()) {
+                    throw std::runtime_error("cannot create event log " + args[1]);
+                }
+                events.addSink(std::move(sink));
+            }
+            Management::runSimulation(&events);
+            for (const auto& sink : events.getStats()) {
+                if (!sink.error.empty()) {
+                    throw std::runtime_error(sink.error);
+                }
+            }
+        } else {
+            throw std::invalid_argument("unknown command '" + command + "'");
+        }
+    }
+
+    if (m_trains.size() + m_stations.size() + m_routes.size() >= BATCH_LIMIT) {
+        commit();
+    }
+}
+
+void BatchRunner::addTrain(const std::vector<std::string>& args) {
+    expectArgs(args, 6, 6, "add-train ID NAME SPEED CAPACITY WAGONS");
+    int id = parseInt(args[1], "train ID");
+    if (id <= 0) {
+        throw std::invalid_argument("train ID must be positive");
+    }
+    if (Management::findTrain(id) || m_pendingTrains.count(id)) {
+        throw std::invalid_argument("train " + args[1] + " already exists");
+    }
+    m_trains.emplace_back(args[2], parseInt(args[3], "speed"), parseInt(args[4], "capacity"), id,
+                          parseInt(args[5], "wagon count"));
+    m_pendingTrains[id] = m_trains.size() - 1;
+    m_trainLines.push_back(m_line);
+}
+
+void BatchRunner::addStation(const std::vector<std::string>& args) {
+    expectArgs(args, 3, 3, "add-station NAME PLATFORMS");
+    int platforms = parseInt(args[2], "platform count");
+    if (platforms <= 0) {
+        throw std::invalid_argument("platform count must be positive");
+    }
+    m_stations.emplace_back(nullptr, platforms, std::vector<std::shared_ptr<Route>>{}, nullptr, nullptr, args[1]);
+    m_stationLines.push_back(m_line);
+}
+
+void BatchRunner::addRoute(const std::vector<std::string>& args) {
+    if (args.size() < 6) {
+        throw std::invalid_argument("usage: add-route HH:MM HH:MM TRAIN_ID|- STOP STOP [STOP...]");
+    }
+    int depHour, depMinute, arrHour, arrMinute;
+    parseTime(args[1], depHour, depMinute);
+    parseTime(args[2], arrHour, arrMinute);
+    // Overnight routes arrive the next day
+    int duration = (arrHour * 60 + arrMinute - depHour * 60 - depMinute + 24 * 60) % (24 * 60);
+
+    std::shared_ptr<Train> train;
+    if (args[3] != "-") {
+        int id = parseInt(args[3], "train ID");
+        auto pending = m_pendingTrains.find(id);
+        if (pending != m_pendingTrains.end()) {
+            train = std::make_shared<Train>(m_trains[pending->second]);
+        } else if (const Train* existing = Management::findTrain(id)) {
+            train = std::make_shared<Train>(*existing);
+        } else {
+            throw std::invalid_argument("train " + args[3] + " not found");
+        }
+    }
+
+    std::vector<std::string> stops(args.begin() + 4, args.end());
+    m_routes.emplace_back(depHour, depMinute, arrHour, arrMinute, duration, train, nullptr, nullptr, stops);
+    m_routeLines.push_back(m_line);
+}
+
+void BatchRunner::assign(const std::vector<std::string>& args) {
+    expectArgs(args, 3, 3, "assign TRAIN_ID ROUTE_NUMBER");
+    int trainId = parseInt(args[1], "train ID");
+    int routeNumber = parseInt(args[2], "route number");
+    if (routeNumber <= 0 || !Management::assignTrain(trainId, static_cast<size_t>(routeNumber - 1))) {
+        throw std::invalid_argument("cannot assign train " + args[1] + " to route " + args[2]);
+    }
+}
+
+void BatchRunner::query(const std::vector<std::string>& args) {
+    if (args.size() < 2) {
+        throw std::invalid_argument("usage: query train|station|departures|arrivals|journey|shortest ...");
+    }
+    const std::string& what = args[1];
+    if (what == "train") {
+        expectArgs(args, 3, 3, "query train ID");
+        Management::displayTrainInfo(parseInt(args[2], "train ID"));
+    } else if (what == "station") {
+        expectArgs(args, 3, 3, "query station NAME");
+        Management::displayStationInfo(args[2]);
+    } else if (what == "departures" || what == "arrivals") {
+        expectArgs(args, 4, 5, "query departures|arrivals STATION HH:MM [COUNT]");
+        int hour, minute;
+        parseTime(args[3], hour, minute);
+        size_t count = args.size() == 5 ? static_cast<size_t>(std::max(1, parseInt(args[4], "count"))) : 10;
+        bool departures = what == "departures";
+        Management::printBoard(departures ? Management::nextDepartures(args[2], hour, minute, count)
+                                          : Management::nextArrivals(args[2], hour, minute, count),
+                               departures);
+    } else if (what == "journey") {
+        expectArgs(args, 5, 5, "query journey FROM TO HH:MM");
+        int hour, minute;
+        parseTime(args[4], hour, minute);
+        Journey journey;
+        if (!Management::planJourney(args[2], args[3], hour, minute, journey)) {
+            throw std::invalid_argument("no journey from " + args[2] + " to " + args[3]);
+        }
+        Management::printJourney(journey);
+    } else if (what == "shortest") {
+        expectArgs(args, 4, 4, "query shortest FROM TO");
+        std::vector<std::string> path;
+        int seconds = Management::shortestRunningTime(args[2], args[3], &path);
+        if (seconds == RailGraph::UNREACHABLE) {
+            throw std::invalid_argument("no connection from " + args[2] + " to " + args[3]);
+        }
+        std::cout << "Shortest running time: " << seconds / 60 << " min via";
+        for (const auto& stop : path) {
+            std::cout << " " << stop << (&stop == &path.back() ? "" : " ->");
+        }
+        std::cout << "\n";
+    } else {
+        throw std::invalid_argument("unknown query '" + what + "'");
+    }
+}
+
+void BatchRunner::commit() {
+    if (m_trains.empty() && m_stations.empty() && m_routes.empty()) {
+        return;
+    }
+    ImportReport report;
+    bool committed = Management::importBatch(m_trains, m_stations, m_routes, report);
+    if (committed) {
+        m_trainsImported += report.trainsImported;
+        m_stationsImported += report.stationsImported;
+        m_routesImported += report.routesImported;
+        for (const auto& failure : report.failures) {
+            const std::vector<size_t>& lines = failure.entity == "train" ? m_trainLines
+                                             : failure.entity == "station" ? m_stationLines : m_routeLines;
+            error(lines[failure.index], failure.message);
+        }
+    } else {
+        error(m_line, "batch of " + std::to_string(m_trains.size() + m_stations.size() + m_routes.size()) +
+                      " rows was not committed");
+    }
+
+    m_trains.clear();
+    m_stations.clear();
+    m_routes.clear();
+    m_trainLines.clear();
+    m_stationLines.clear();
+    m_routeLines.clear();
+    m_pendingTrains.clear();
+}
+
+void BatchRunner::error(size_t line, const std::string& message) {
+    ++m_errors;
+    std::cerr << "line " << line << ": " << message << std::endl;
+}
+
+} // namespace CJ
@@ -1,4 +1,5 @@
 #include "../include/CLI.hpp"
+#include "../include/Metrics.hpp"
 #include <algorithm>
 
 namespace CJ {
@@ -44,9 +45,7 @@ void CLI::getNewValidId(int& id) {
     while (true) {
         if (std::cin >> id && id > 0) {
             std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
-            auto it = std::find_if(CJ::Management::m_trains.begin(), CJ::Management::m_trains.end(),
-                                [id](const Train& train) { return train.getId() == id; });
-            if (it == CJ::Management::m_trains.end()) {
+            if (!CJ::Management::findTrain(id)) {
                 break;
             }
             std::cout << "Train with ID " << id << " already exists. Please enter a new ID: ";
@@ -79,11 +78,7 @@ std::string CLI::formatStationName(const std::string& name) {
 }
 
 bool CLI::isStationNameTaken(const std::string& name) {
-    std::string formattedName = formatStationName(name);
-    return std::any_of(CJ::Management::m_stations.begin(), CJ::Management::m_stations.end(),
-        [&formattedName](const Station& station) {
-            return formatStationName(station.getName()) == formattedName;
-        });
+    return CJ::Management::findStation(name) != nullptr;
 }
 
 template <typename T>
@@ -103,7 +98,7 @@ bool CLI::displayUsedObjects(const std::string& prompt,
 }
 
 bool CLI::compareStationNames(const std::string& name1, const std::string& name2) {
-    return formatStationName(name1) == formatStationName(name2);
+    return StationRegistry::equalNames(name1, name2);
 }
 
 void CLI::displayMainMenu() {
@@ -111,8 +106,9 @@ void CLI::displayMainMenu() {
               << "1. Train Operations\n"
               << "2. Station Operations\n"
               << "3. Route Operations\n"
-              << "4. Exit\n"
-              << "Enter your choice (1-4): ";
+              << "4. Diagnostics\n"
+              << "5. Exit\n"
+              << "Enter your choice (1-5): ";
 }
 
 void CLI::handleTrainOperations(DatabaseManager& db) {
@@ -129,7 +125,7 @@ void CLI::handleTrainOperations(DatabaseManager& db) {
 
         switch (choice) {
             case 1: {
-                displayUsedObjects<Train>("Used Train IDs:", CJ::Management::m_trains,
+                displayUsedObjects<Train>("Used Train IDs:", CJ::Management::getTrains(),
                     [](const Train& train) { return std::to_string(train.getId()); });
 
                 std::cout << "Enter train name: ";
@@ -153,7 +149,7 @@ void CLI::handleTrainOperations(DatabaseManager& db) {
                 break;
             }
             case 2: {
-                if (!displayUsedObjects<Train>("Train IDs possible to delete:", CJ::Management::m_trains,
+                if (!displayUsedObjects<Train>("Train IDs possible to delete:", CJ::Management::getTrains(),
                     [](const Train& train) { return std::to_string(train.getId()); })) {
                     break;
                 }
@@ -169,7 +165,7 @@ void CLI::handleTrainOperations(DatabaseManager& db) {
                 break;
             }
             case 3: {
-                if (!displayUsedObjects<Train>("Train IDs possible to display:", CJ::Management::m_trains,
+                if (!displayUsedObjects<Train>("Train IDs possible to display:", CJ::Management::getTrains(),
                     [](const Train& train) { return std::to_string(train.getId()); })) {
                     break;
                 }
@@ -194,15 +190,16 @@ void CLI::handleStationOperations(DatabaseManager& db) {
                   << "1. Add New Station\n"
                   << "2. Remove Station\n"
                   << "3. Display Station Information\n"
-                  << "4. Return to Main Menu\n"
-                  << "Enter your choice (1-4): ";
+                  << "4. Departure Board\n"
+                  << "5. Return to Main Menu\n"
+                  << "Enter your choice (1-5): ";
 
         int choice;
         getIntInput(choice);
 
         switch (choice) {
             case 1: {
-                displayUsedObjects<Station>("Used Station Names:", CJ::Management::m_stations,
+                displayUsedObjects<Station>("Used Station Names:", CJ::Management::getStations(),
                     [](const Station& station) { return station.getName(); });
 
                 std::cout << "Enter station name: ";
@@ -222,7 +219,7 @@ void CLI::handleStationOperations(DatabaseManager& db) {
                 break;
             }
             case 2: {
-                if (!displayUsedObjects<Station>("Used Station Names:", CJ::Management::m_stations,
+                if (!displayUsedObjects<Station>("Used Station Names:", CJ::Management::getStations(),
                     [](const Station& station) { return station.getName(); })) {
                     std::cout << "No stations available to remove.\n";
                     break;
@@ -239,7 +236,7 @@ void CLI::handleStationOperations(DatabaseManager& db) {
                 break;
             }
             case 3: {
-                if (!displayUsedObjects<Station>("Used Station Names:", CJ::Management::m_stations,
+                if (!displayUsedObjects<Station>("Used Station Names:", CJ::Management::getStations(),
                     [](const Station& station) { return station.getName(); })) {
                     std::cout << "No stations available to display.\n";
                     break;
@@ -250,20 +247,42 @@ void CLI::handleStationOperations(DatabaseManager& db) {
                 name = formatStationName(name); // Format the input name
                 
                 // Find the station in the Management's stations
-                auto it = std::find_if(CJ::Management::m_stations.begin(), 
-                                      CJ::Management::m_stations.end(),
-                                      [&name](const Station& s) {
-                                          return compareStationNames(s.getName(), name);
-                                      });
+                const Station* station = CJ::Management::findStation(name);
                 
-                if (it == CJ::Management::m_stations.end()) {
+                if (!station) {
                     std::cout << "Station '" << name << "' not found.\n";
                 } else {
-                    CJ::Management::displayStationInfo(it->getName());
+                    CJ::Management::displayStationInfo(station->getName());
                 }
                 break;
             }
-            case 4:
+            case 4: {
+                std::cout << "Enter station name: ";
+                std::string name = getStringInput();
+                const Station* station = CJ::Management::findStation(name);
+                if (!station) {
+                    std::cout << "Station '" << name << "' not found.\n";
+                    break;
+                }
+
+                std::cout << "From hour (0-23): ";
+                int hour;
+                getValidIntInput(0, 23, hour);
+                std::cout << "From minute (0-59): ";
+                int minute;
+                getValidIntInput(0, 59, minute);
+                std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+
+                const size_t boardSize = 10;
+                std::cout << "\nDepartures from " << station->getName() << ":\n";
+                CJ::Management::printBoard(
+                    CJ::Management::nextDepartures(station->getName(), hour, minute, boardSize), true);
+                std::cout << "\nArrivals at " << station->getName() << ":\n";
+                CJ::Management::printBoard(
+                    CJ::Management::nextArrivals(station->getName(), hour, minute, boardSize), false);
+                break;
+            }
+            case 5:
                 return;
             default:
                 std::cout << "Invalid choice. Please try again.\n";
@@ -276,7 +295,9 @@ void CLI::handleRouteOperations(DatabaseManager& db) {
         std::cout << "\nRoute Operations:\n";
         std::cout << "1. Add Route\n";
         std::cout << "2. List Routes\n";
-        std::cout << "3. Back to Main Menu\n";
+        std::cout << "3. Plan Journey\n";
+        std::cout << "4. Shortest Running Time\n";
+        std::cout << "5. Back to Main Menu\n";
         std::cout << "Choose an option: ";
 
         int choice;
@@ -310,14 +331,10 @@ void CLI::handleRouteOperations(DatabaseManager& db) {
                             stationName = CJ::Management::formatStationName(stationName);
                             
                             // Check if station exists
-                            auto it = std::find_if(CJ::Management::m_stations.begin(), 
-                                                 CJ::Management::m_stations.end(),
-                                                 [&stationName](const Station& s) {
-                                                     return CJ::Management::compareStationNames(s.getName(), stationName);
-                                                 });
+                            const Station* station = CJ::Management::findStation(stationName);
                             
-                            if (it != CJ::Management::m_stations.end()) {
-                                stops.push_back(it->getName()); // Use the exact name from the database
+                            if (station) {
+                                stops.push_back(station->getName()); // Use the exact name from the database
                                 break;
                             }
                             std::cout << "Station '" << stationName << "' not found. Please try again.\n";
@@ -357,13 +374,11 @@ void CLI::handleRouteOperations(DatabaseManager& db) {
                 // Create and save the route
                 Route newRoute(depHour, depMin, arrHour, arrMin, duration, 
                              nullptr, nullptr, nullptr, stops);
-                
+
                 try {
-                    if (db.saveRoute(newRoute)) {
-                        std::cout << "Route added successfully!\n";
-                    } else {
-                        std::cout << "Failed to save route. Please check the input values.\n";
-                    }
+                    // Checks platform capacity and keeps the in-memory network in step
+                    CJ::Management::addRoute(newRoute);
+                    std::cout << "Route added successfully!\n";
                 } catch (const std::runtime_error& e) {
                     std::cout << "Error: " << e.what() << "\n";
                 }
@@ -395,7 +410,57 @@ void CLI::handleRouteOperations(DatabaseManager& db) {
                 }
                 break;
             }
-            case 3:
+            case 3: {
+                std::cout << "Enter departure station: ";
+                std::string from = getStringInput();
+                std::cout << "Enter destination station: ";
+                std::string to = getStringInput();
+
+                std::cout << "Depart after hour (0-23): ";
+                int hour;
+                getValidIntInput(0, 23, hour);
+                std::cout << "Depart after minute (0-59): ";
+                int minute;
+                getValidIntInput(0, 59, minute);
+                std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+
+                Journey journey;
+                if (CJ::Management::planJourney(from, to, hour, minute, journey)) {
+                    std::cout << "\nFastest journey:\n";
+                    CJ::Management::printJourney(journey);
+
+                    for (const auto& option : CJ::Management::planJourneyOptions(from, to, hour, minute)) {
+                        if (option.transfers() < journey.transfers()) {
+                            std::cout << "\nWith fewer transfers:\n";
+                            CJ::Management::printJourney(option);
+                        }
+                    }
+                } else {
+                    std::cout << "No connection from '" << from << "' to '" << to << "' after that time.\n";
+                }
+                break;
+            }
+            case 4: {
+                std::cout << "Enter departure station: ";
+                std::string from = getStringInput();
+                std::cout << "Enter destination station: ";
+                std::string to = getStringInput();
+
+                std::vector<std::string> path;
+                int seconds = CJ::Management::shortestRunningTime(from, to, &path);
+                if (seconds == CJ::RailGraph::UNREACHABLE) {
+                    std::cout << "No rail connection from '" << from << "' to '" << to << "'.\n";
+                    break;
+                }
+                std::cout << "\nShortest running time: " << seconds / 3600 << "h "
+                          << (seconds / 60) % 60 << "min\nVia: ";
+                for (size_t i = 0; i < path.size(); ++i) {
+                    std::cout << (i ? " -> " : "") << path[i];
+                }
+                std::cout << "\n";
+                break;
+            }
+            case 5:
                 return;
             default:
                 std::cout << "Invalid option. Please try again.\n";
@@ -403,6 +468,53 @@ void CLI::handleRouteOperations(DatabaseManager& db) {
     }
 }
 
+void CLI::handleDiagnostics() {
+    while (true) {
+        std::cout << "\n=== Diagnostics ===\n"
+                  << "1. " << (Management::isStatementProfiling() ? "Stop" : "Start") << " SQL Profiling\n"
+                  << "2. Show Slowest SQL Statements\n"
+                  << "3. Save SQL Profile to File\n"
+                  << "4. Show Metrics\n"
+                  << "5. Return to Main Menu\n"
+                  << "Enter your choice (1-5): ";
+
+        int choice;
+        getIntInput(choice);
+
+        switch (choice) {
+            case 1:
+                Management::setStatementProfiling(!Management::isStatementProfiling());
+                std::cout << "SQL profiling " << (Management::isStatementProfiling() ? "started" : "stopped") << ".\n";
+                break;
+            case 2: {
+                std::cout << "How many statements? ";
+                int count;
+                getValidIntInput(1, 1000, count);
+                std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+                DatabaseManager::printStatementProfiles(std::cout, Management::getStatementProfiles(count));
+                break;
+            }
+            case 3: {
+                std::cout << "Enter file name: ";
+                std::string path = getStringInput();
+                if (Management::writeStatementProfiles(path)) {
+                    std::cout << "SQL profile written to " << path << "\n";
+                } else {
+                    std::cout << "Could not write " << path << "\n";
+                }
+                break;
+            }
+            case 4:
+                MetricsRegistry::global().writeText(std::cout);
+                break;
+            case 5:
+                return;
+            default:
+                std::cout << "Invalid choice. Please try again.\n";
+        }
+    }
+}
+
 void CLI::run() {
     DatabaseManager& db = Management::getInstance().getDatabase();
     
@@ -422,6 +534,9 @@ void CLI::run() {
                 handleRouteOperations(db);
                 break;
             case 4:
+                handleDiagnostics();
+                break;
+            case 5:
                 std::cout << "Thank you for using the Train Management System!\n";
                 return;
             default:
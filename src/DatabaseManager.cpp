@@ -1,12 +1,40 @@
 #include "../include/DatabaseManager.hpp"
 #include "../include/Management.hpp"
+#include "../include/Metrics.hpp"
 #include <iostream>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
 #include <sstream>
 #include <filesystem>
+#include <iomanip>
 
 namespace CJ {
 
-DatabaseManager::DatabaseManager() : m_db(nullptr), m_isConnected(false) {
+namespace {
+    // Resets a cached statement when the calling scope ends so it can be rebound
+    // on the next call and does not keep a read transaction open.
+    struct StatementGuard {
+        sqlite3_stmt* stmt;
+        ~StatementGuard() {
+            if (stmt) {
+                sqlite3_reset(stmt);
+            }
+        }
+    };
+
+    int bindText(sqlite3_stmt* stmt, int index, const std::string& value) {
+        return sqlite3_bind_text(stmt, index, value.c_str(), static_cast<int>(value.size()), SQLITE_STATIC);
+    }
+
+    // Error output, counted in the db.errors metric
+    std::ostream& reportError() {
+        CJ_COUNT("db.errors", 1);
+        return std::cerr;
+    }
+}
+
+DatabaseManager::DatabaseManager() : m_db(nullptr), m_isConnected(false), m_statements{} {
 }
 
 DatabaseManager::~DatabaseManager() {
@@ -14,21 +42,31 @@ DatabaseManager::~DatabaseManager() {
 }
 
 bool DatabaseManager::connect(const std::string& dbPath) {
+    CJ_TIMED("db.connect");
     if (m_isConnected) {
         return true;
     }
 
-    std::filesystem::path dbDir = std::filesystem::current_path() / "database";
-    
-    std::error_code ec;
-    if (!std::filesystem::exists(dbDir)) {
-        if (!std::filesystem::create_directory(dbDir, ec)) {
-            std::cerr << "Error creating directory: " << ec.message() << std::endl;
-            return false;
+    // A bare file name lives in the database directory; ":memory:" is a
+    // private in-memory database, gone when the connection closes
+    std::string fullPath = dbPath;
+    if (dbPath != IN_MEMORY) {
+        std::filesystem::path requested(dbPath);
+        if (!requested.has_parent_path()) {
+            requested = std::filesystem::current_path() / "database" / requested;
+        }
+
+        std::error_code ec;
+        std::filesystem::path dbDir = requested.parent_path();
+        if (!std::filesystem::exists(dbDir)) {
+            if (!std::filesystem::create_directories(dbDir, ec)) {
+                reportError() << "Error creating directory: " << ec.message() << std::endl;
+                return false;
+            }
         }
+        fullPath = requested.string();
     }
 
-    std::string fullPath = (dbDir / "train_system.db").string();
     std::cout << "Attempting to create/open database at: " << fullPath << std::endl;
 
     int rc = sqlite3_open_v2(fullPath.c_str(), &m_db, 
@@ -36,17 +74,30 @@ bool DatabaseManager::connect(const std::string& dbPath) {
                            nullptr);
     
     if (rc != SQLITE_OK) {
-        std::cerr << "Error opening database: " << sqlite3_errmsg(m_db) << std::endl;
+        reportError() << "Error opening database: " << sqlite3_errmsg(m_db) << std::endl;
         sqlite3_close(m_db);
         m_db = nullptr;
         return false;
     }
 
+    registerTrace();
+
+    // Several connections may share the file (e.g. the write-behind worker), so
+    // wait for a competing writer instead of failing with SQLITE_BUSY
+    sqlite3_busy_timeout(m_db, 5000);
+
     m_isConnected = true;
+    m_path = fullPath;
     std::cout << "Database connected successfully to: " << fullPath << std::endl;
     
     if (!prepareDatabase()) {
-        std::cerr << "Failed to initialize database tables" << std::endl;
+        reportError() << "Failed to initialize database tables" << std::endl;
+        disconnect();
+        return false;
+    }
+
+    if (!prepareStatements()) {
+        reportError() << "Failed to prepare database statements" << std::endl;
         disconnect();
         return false;
     }
@@ -55,13 +106,20 @@ bool DatabaseManager::connect(const std::string& dbPath) {
 }
 
 bool DatabaseManager::disconnect() {
+    CJ_TIMED("db.disconnect");
     if (!m_isConnected) {
         return true;
     }
 
+    finalizeStatements();
+    {
+        std::lock_guard<std::mutex> lock(m_profileMutex);
+        m_running.clear();
+    }
+
     int rc = sqlite3_close(m_db);
     if (rc != SQLITE_OK) {
-        std::cerr << "Error closing database: " << sqlite3_errmsg(m_db) << std::endl;
+        reportError() << "Error closing database: " << sqlite3_errmsg(m_db) << std::endl;
         return false;
     }
 
@@ -70,10 +128,158 @@ bool DatabaseManager::disconnect() {
     return true;
 }
 
+void DatabaseManager::registerTrace() {
+    if (m_profiling) {
+        sqlite3_trace_v2(m_db, SQLITE_TRACE_STMT | SQLITE_TRACE_ROW | SQLITE_TRACE_PROFILE, traceCallback, this);
+    } else {
+        sqlite3_trace_v2(m_db, 0, nullptr, nullptr);
+    }
+}
+
+int DatabaseManager::traceCallback(unsigned type, void* context, void* statement, void* detail) {
+    auto* self = static_cast<DatabaseManager*>(context);
+    auto* stmt = static_cast<sqlite3_stmt*>(statement);
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(self->m_profileMutex);
+    if (type == SQLITE_TRACE_STMT) {
+        // Also fires for each trigger subprogram; only the outermost start counts
+        const char* text = static_cast<const char*>(detail);
+        if (std::strncmp(text, "--", 2) != 0 || !self->m_running.count(stmt)) {
+            self->m_running[stmt] = RunningStatement{now, 0};
+        }
+        return 0;
+    }
+    auto running = self->m_running.find(stmt);
+    if (type == SQLITE_TRACE_ROW) {
+        if (running != self->m_running.end()) {
+            ++running->second.rows;
+        }
+        return 0;
+    }
+    if (type != SQLITE_TRACE_PROFILE || running == self->m_running.end()) {
+        return 0;
+    }
+
+    const char* sql = sqlite3_sql(stmt);
+    std::string key = normalizeSql(sql ? sql : "");
+    StatementProfile& profile = self->m_profiles[key];
+    if (profile.calls == 0) {
+        profile.sql = key;
+    }
+    uint64_t elapsed = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(now - running->second.started).count());
+    ++profile.calls;
+    profile.totalNs += elapsed;
+    profile.maxNs = std::max(profile.maxNs, elapsed);
+    profile.rows += running->second.rows;
+    self->m_running.erase(running);
+    return 0;
+}
+
+// Statements built by concatenation differ only in their literals, so those
+// are folded to '?' to group them with their template
+std::string DatabaseManager::normalizeSql(const std::string& sql) {
+    std::string normalized;
+    normalized.reserve(sql.size());
+    for (size_t i = 0; i < sql.size();) {
+        char c = sql[i];
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            while (i < sql.size() && std::isspace(static_cast<unsigned char>(sql[i]))) {
+                ++i;
+            }
+            if (!normalized.empty()) {
+                normalized += ' ';
+            }
+        } else if (c == '\'') {
+            for (++i; i < sql.size(); ++i) {
+                if (sql[i] == '\'') {
+                    if (i + 1 < sql.size() && sql[i + 1] == '\'') {
+                        ++i;    // '' inside a literal
+                    } else {
+                        break;
+                    }
+                }
+            }
+            ++i;
+            normalized += '?';
+        } else if (std::isdigit(static_cast<unsigned char>(c)) &&
+                   (normalized.empty() || !(std::isalnum(static_cast<unsigned char>(normalized.back())) ||
+                                            std::strchr("_?:@$", normalized.back())))) {
+            while (i < sql.size() && (std::isalnum(static_cast<unsigned char>(sql[i])) || sql[i] == '.')) {
+                ++i;
+            }
+            normalized += '?';
+        } else {
+            normalized += c;
+            ++i;
+        }
+    }
+    while (!normalized.empty() && normalized.back() == ' ') {
+        normalized.pop_back();
+    }
+    return normalized;
+}
+
+void DatabaseManager::setProfiling(bool enabled) {
+    m_profiling = enabled;
+    if (m_isConnected) {
+        registerTrace();
+    }
+}
+
+bool DatabaseManager::isProfiling() const {
+    return m_profiling;
+}
+
+std::vector<StatementProfile> DatabaseManager::getStatementProfiles(size_t topN) const {
+    std::vector<StatementProfile> profiles;
+    {
+        std::lock_guard<std::mutex> lock(m_profileMutex);
+        profiles.reserve(m_profiles.size());
+        for (const auto& entry : m_profiles) {
+            profiles.push_back(entry.second);
+        }
+    }
+    std::sort(profiles.begin(), profiles.end(), [](const StatementProfile& a, const StatementProfile& b) {
+        return a.totalNs != b.totalNs ? a.totalNs > b.totalNs : a.sql < b.sql;
+    });
+    if (topN && profiles.size() > topN) {
+        profiles.resize(topN);
+    }
+    return profiles;
+}
+
+void DatabaseManager::resetStatementProfiles() {
+    std::lock_guard<std::mutex> lock(m_profileMutex);
+    m_profiles.clear();
+}
+
+void DatabaseManager::printStatementProfiles(std::ostream& out, const std::vector<StatementProfile>& profiles) {
+    if (profiles.empty()) {
+        out << "No SQL statements recorded.\n";
+        return;
+    }
+    std::ostringstream text;
+    text << std::right << std::setw(8) << "calls" << std::setw(12) << "total ms" << std::setw(11) << "mean us"
+         << std::setw(11) << "max us" << std::setw(10) << "rows" << "  statement\n";
+    text << std::fixed << std::setprecision(1);
+    for (const auto& profile : profiles) {
+        std::string sql = profile.sql.size() > 100 ? profile.sql.substr(0, 97) + "..." : profile.sql;
+        text << std::setw(8) << profile.calls << std::setw(12) << profile.totalNs / 1e6
+             << std::setw(11) << profile.totalNs / 1e3 / static_cast<double>(profile.calls)
+             << std::setw(11) << profile.maxNs / 1e3 << std::setw(10) << profile.rows << "  " << sql << "\n";
+    }
+    out << text.str();
+}
+
 bool DatabaseManager::isConnected() const {
     return m_isConnected;
 }
 
+const std::string& DatabaseManager::getDatabasePath() const {
+    return m_path;
+}
+
 int DatabaseManager::callback(void* data, int argc, char** argv, char** azColName) {
     std::vector<std::string>* result = static_cast<std::vector<std::string>*>(data);
     
@@ -86,7 +292,7 @@ int DatabaseManager::callback(void* data, int argc, char** argv, char** azColNam
 
 bool DatabaseManager::executeQuery(const std::string& query) {
     if (!m_isConnected) {
-        std::cerr << "Database not connected" << std::endl;
+        reportError() << "Database not connected" << std::endl;
         return false;
     }
 
@@ -94,7 +300,7 @@ bool DatabaseManager::executeQuery(const std::string& query) {
     int rc = sqlite3_exec(m_db, query.c_str(), nullptr, nullptr, &errMsg);
     
     if (rc != SQLITE_OK) {
-        std::cerr << "SQL error: " << errMsg << std::endl;
+        reportError() << "SQL error: " << errMsg << std::endl;
         sqlite3_free(errMsg);
         return false;
     }
@@ -109,88 +315,347 @@ void DatabaseManager::cleanupDatabase() {
         disconnect();
     }
 
-    std::filesystem::path dbPath = std::filesystem::current_path() / "database" / "train_system.db";
+    // Only the file this connection opened; nothing was written for ":memory:"
+    if (m_path.empty() || m_path == IN_MEMORY) {
+        return;
+    }
+    std::filesystem::path dbPath = m_path;
     if (std::filesystem::exists(dbPath)) {
         try {
             std::filesystem::remove(dbPath);
             std::cout << "Database file deleted successfully.\n";
         } catch (const std::filesystem::filesystem_error& e) {
-            std::cerr << "Failed to delete database file: " << e.what() << "\n";
+            reportError() << "Failed to delete database file: " << e.what() << "\n";
         }
     }
 }
 
-bool DatabaseManager::prepareDatabase() {
-    if (!m_isConnected) {
-        std::cerr << "Database not connected" << std::endl;
-        return false;
-    }
+namespace {
+    constexpr int SCHEMA_VERSION = 2;
 
-    std::string createTrainsTable = 
+    // Schema v2: integer surrogate keys everywhere, so joins compare integers
+    // and route_stops/train_routes are clustered on their lookup keys
+    const char* const CREATE_SCHEMA_V2 =
         "CREATE TABLE IF NOT EXISTS trains ("
         "id INTEGER PRIMARY KEY,"
         "name TEXT NOT NULL,"
         "speed INTEGER NOT NULL,"
         "capacity INTEGER NOT NULL,"
         "wagon_count INTEGER NOT NULL"
-        ");";
-    
-    std::string createStationsTable = 
+        ");"
         "CREATE TABLE IF NOT EXISTS stations ("
-        "name TEXT PRIMARY KEY,"
+        "station_id INTEGER PRIMARY KEY,"
+        "name TEXT NOT NULL UNIQUE COLLATE NOCASE,"
         "platform_count INTEGER NOT NULL"
-        ");";
-    
-        std::string createRoutesTable = 
+        ");"
         "CREATE TABLE IF NOT EXISTS routes ("
-        "identifier TEXT UNIQUE,"
         "route_id INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "origin_id INTEGER NOT NULL REFERENCES stations(station_id),"
+        "destination_id INTEGER NOT NULL REFERENCES stations(station_id),"
         "dep_hour INTEGER NOT NULL,"
         "dep_minute INTEGER NOT NULL,"
         "arr_hour INTEGER NOT NULL,"
         "arr_minute INTEGER NOT NULL,"
-        "duration INTEGER NOT NULL"
-        ");";
-
-    std::string createRouteStopsTable = 
+        "duration INTEGER NOT NULL,"
+        "UNIQUE (origin_id, destination_id, dep_hour, dep_minute)"
+        ");"
         "CREATE TABLE IF NOT EXISTS route_stops ("
-        "route_id INTEGER,"
-        "station_name TEXT,"  
-        "stop_order INTEGER,"
-        "PRIMARY KEY (route_id, stop_order),"
-        "FOREIGN KEY (route_id) REFERENCES routes(route_id),"
-        "FOREIGN KEY (station_name) REFERENCES stations(name)"
-        ");";
-    
-    std::string createTrainRoutesTable = 
+        "route_id INTEGER NOT NULL REFERENCES routes(route_id),"
+        "stop_order INTEGER NOT NULL,"
+        "station_id INTEGER NOT NULL REFERENCES stations(station_id),"
+        "PRIMARY KEY (route_id, stop_order)"
+        ") WITHOUT ROWID;"
         "CREATE TABLE IF NOT EXISTS train_routes ("
-        "train_id INTEGER,"
-        "route_id TEXT,"
-        "PRIMARY KEY (train_id, route_id),"
-        "FOREIGN KEY (train_id) REFERENCES trains(id),"
-        "FOREIGN KEY (route_id) REFERENCES routes(identifier)"
-        ");";
+        "train_id INTEGER NOT NULL REFERENCES trains(id),"
+        "route_id INTEGER NOT NULL REFERENCES routes(route_id),"
+        "PRIMARY KEY (train_id, route_id)"
+        ") WITHOUT ROWID;"
+        // Reverse lookups: routes through a station, trains on a route
+        "CREATE INDEX IF NOT EXISTS idx_route_stops_station ON route_stops(station_id, route_id, stop_order);"
+        "CREATE INDEX IF NOT EXISTS idx_train_routes_route ON train_routes(route_id, train_id);";
+
+    // v1 keyed stations by name and linked routes through the text identifier
+    // "<first>_to_<last>". Stops that were never added as stations become
+    // stations with one platform; routes without stops are dropped.
+    const char* const MIGRATE_V1_TO_V2 =
+        "ALTER TABLE stations RENAME TO stations_v1;"
+        "ALTER TABLE routes RENAME TO routes_v1;"
+        "ALTER TABLE route_stops RENAME TO route_stops_v1;"
+        "ALTER TABLE train_routes RENAME TO train_routes_v1;"
+        "DROP INDEX IF EXISTS idx_stations_name_nocase;"
+        "DROP INDEX IF EXISTS idx_routes_identifier_nocase;"
+        "DROP INDEX IF EXISTS idx_route_stops_route_order;";
+
+    const char* const COPY_V1_DATA =
+        "INSERT OR IGNORE INTO stations (name, platform_count) "
+        "SELECT name, platform_count FROM stations_v1 ORDER BY rowid;"
+        "INSERT OR IGNORE INTO stations (name, platform_count) "
+        "SELECT DISTINCT station_name, 1 FROM route_stops_v1 WHERE station_name IS NOT NULL;"
+        "INSERT OR IGNORE INTO routes (route_id, origin_id, destination_id, dep_hour, dep_minute, "
+        "arr_hour, arr_minute, duration) "
+        "SELECT r.route_id, o.station_id, d.station_id, r.dep_hour, r.dep_minute, "
+        "r.arr_hour, r.arr_minute, r.duration FROM routes_v1 r "
+        "JOIN (SELECT route_id, MIN(stop_order) AS first_stop, MAX(stop_order) AS last_stop "
+        "      FROM route_stops_v1 GROUP BY route_id) b ON b.route_id = r.identifier "
+        "JOIN route_stops_v1 fs ON fs.route_id = r.identifier AND fs.stop_order = b.first_stop "
+        "JOIN route_stops_v1 ls ON ls.route_id = r.identifier AND ls.stop_order = b.last_stop "
+        "JOIN stations o ON o.name = fs.station_name "
+        "JOIN stations d ON d.name = ls.station_name "
+        "ORDER BY r.route_id;"
+        "INSERT INTO route_stops (route_id, stop_order, station_id) "
+        "SELECT r.route_id, s.stop_order, st.station_id FROM routes_v1 r "
+        "JOIN routes nr ON nr.route_id = r.route_id "
+        "JOIN route_stops_v1 s ON s.route_id = r.identifier "
+        "JOIN stations st ON st.name = s.station_name;"
+        "INSERT OR IGNORE INTO train_routes (train_id, route_id) "
+        "SELECT tr.train_id, r.route_id FROM train_routes_v1 tr "
+        "JOIN routes_v1 r ON r.identifier = tr.route_id "
+        "JOIN routes nr ON nr.route_id = r.route_id;"
+        "DROP TABLE train_routes_v1;"
+        "DROP TABLE route_stops_v1;"
+        "DROP TABLE routes_v1;"
+        "DROP TABLE stations_v1;";
+}
 
+int DatabaseManager::querySchemaVersion() {
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(m_db, "PRAGMA user_version;", -1, &stmt, nullptr) != SQLITE_OK) {
+        return -1;
+    }
+    int version = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int(stmt, 0) : -1;
+    sqlite3_finalize(stmt);
+
+    if (version == 0) {
+        // Databases from before versioning have no user_version but do have tables
+        if (sqlite3_prepare_v2(m_db, "SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = 'stations';",
+                               -1, &stmt, nullptr) != SQLITE_OK) {
+            return -1;
+        }
+        version = sqlite3_step(stmt) == SQLITE_ROW ? 1 : 0;
+        sqlite3_finalize(stmt);
+    }
+    return version;
+}
+
+bool DatabaseManager::migrateFromV1() {
+    std::cout << "Migrating database schema from version 1 to " << SCHEMA_VERSION << "..." << std::endl;
 
-    bool success = executeQuery(createStationsTable) &&
-                  executeQuery(createTrainsTable) &&
-                  executeQuery(createRoutesTable) &&
-                  executeQuery(createRouteStopsTable) &&
-                  executeQuery(createTrainRoutesTable);
+    bool success = executeQuery("BEGIN IMMEDIATE;") &&
+                   executeQuery(MIGRATE_V1_TO_V2) &&
+                   executeQuery(CREATE_SCHEMA_V2) &&
+                   executeQuery(COPY_V1_DATA) &&
+                   executeQuery("PRAGMA user_version = " + std::to_string(SCHEMA_VERSION) + ";") &&
+                   executeQuery("COMMIT;");
+
+    if (!success) {
+        executeQuery("ROLLBACK;");
+        reportError() << "Schema migration failed, database left unchanged" << std::endl;
+    }
+    return success;
+}
+
+bool DatabaseManager::prepareDatabase() {
+    if (!m_isConnected) {
+        reportError() << "Database not connected" << std::endl;
+        return false;
+    }
+
+    int version = querySchemaVersion();
+    if (version < 0) {
+        reportError() << "Failed to read database schema version: " << sqlite3_errmsg(m_db) << std::endl;
+        return false;
+    }
+    if (version > SCHEMA_VERSION) {
+        reportError() << "Database schema version " << version << " is newer than supported version "
+                  << SCHEMA_VERSION << std::endl;
+        return false;
+    }
+    if (version == 1) {
+        // Keep the user's data on failure rather than deleting the file
+        return migrateFromV1();
+    }
+
+    bool success = executeQuery(CREATE_SCHEMA_V2) &&
+                   (version == SCHEMA_VERSION ||
+                    executeQuery("PRAGMA user_version = " + std::to_string(SCHEMA_VERSION) + ";"));
 
     if (success) {
         std::cout << "Database tables created successfully!" << std::endl; 
     } else {
         cleanupDatabase();
-        std::cerr << "Failed to create database tables" << std::endl;
+        reportError() << "Failed to create database tables" << std::endl;
     }
 
     return success;
 }
 
+bool DatabaseManager::prepareStatements() {
+    static const char* const sql[] = {
+        // SaveTrain
+        "INSERT OR REPLACE INTO trains (id, name, speed, capacity, wagon_count) "
+        "VALUES (?1, ?2, ?3, ?4, ?5);",
+        // InsertTrain
+        "INSERT INTO trains (id, name, speed, capacity, wagon_count) VALUES (?1, ?2, ?3, ?4, ?5);",
+        // DeleteTrain
+        "DELETE FROM trains WHERE id = ?1;",
+        // DeleteTrainAssignments
+        "DELETE FROM train_routes WHERE train_id = ?1;",
+        // GetTrainById
+        "SELECT id, name, speed, capacity, wagon_count FROM trains WHERE id = ?1;",
+        // FindStation
+        "SELECT station_id FROM stations WHERE name = ?1;",
+        // InsertStation
+        "INSERT INTO stations (name, platform_count) VALUES (?1, ?2);",
+        // DeleteStation
+        "DELETE FROM stations WHERE station_id = ?1;",
+        // StationInUse
+        "SELECT 1 FROM route_stops WHERE station_id = ?1 LIMIT 1;",
+        // GetStationByName
+        "SELECT name, platform_count FROM stations WHERE name = ?1;",
+        // FindRoute
+        "SELECT route_id FROM routes "
+        "WHERE origin_id = ?1 AND destination_id = ?2 AND dep_hour = ?3 AND dep_minute = ?4;",
+        // InsertRoute
+        "INSERT INTO routes (origin_id, destination_id, dep_hour, dep_minute, arr_hour, arr_minute, duration) "
+        "VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7);",
+        // InsertRouteStop
+        "INSERT INTO route_stops (route_id, stop_order, station_id) VALUES (?1, ?2, ?3);",
+        // AssignTrainToRoute
+        "INSERT OR REPLACE INTO train_routes (train_id, route_id) VALUES (?1, ?2);",
+        // GetTrainsForRoute
+        "SELECT train_id FROM train_routes WHERE route_id = ?1;",
+        // GetRouteIdsForTrain
+        "SELECT route_id FROM train_routes WHERE train_id = ?1 ORDER BY route_id;",
+        // GetRouteStopIds
+        "SELECT station_id FROM route_stops WHERE route_id = ?1 ORDER BY stop_order;",
+        // GetRoutesThroughStation
+        "SELECT DISTINCT route_id FROM route_stops WHERE station_id = ?1 ORDER BY route_id;",
+        // LoadRoutesWithStops
+        "SELECT r.route_id, r.dep_hour, r.dep_minute, r.arr_hour, r.arr_minute, r.duration, "
+        "st.name FROM routes r "
+        "LEFT JOIN route_stops s ON s.route_id = r.route_id "
+        "LEFT JOIN stations st ON st.station_id = s.station_id "
+        "ORDER BY r.route_id, s.stop_order;",
+        // GetRoutesForTrain
+        "SELECT tr.route_id, st.name FROM train_routes tr "
+        "JOIN route_stops s ON s.route_id = tr.route_id "
+        "JOIN stations st ON st.station_id = s.station_id "
+        "WHERE tr.train_id = ?1 "
+        "ORDER BY tr.route_id, s.stop_order;",
+        // LoadAssignments
+        "SELECT tr.train_id, r.route_rank FROM "
+        "(SELECT route_id, ROW_NUMBER() OVER (ORDER BY route_id) - 1 AS route_rank FROM routes) r "
+        "JOIN train_routes tr ON tr.route_id = r.route_id "
+        "ORDER BY r.route_rank;",
+        // ExportTrainKeys
+        "SELECT MIN(id), MAX(id) FROM trains;",
+        // ExportStationKeys
+        "SELECT MIN(station_id), MAX(station_id) FROM stations;",
+        // ExportRouteKeys
+        "SELECT MIN(route_id), MAX(route_id) FROM routes;",
+        // ExportAssignmentKeys
+        "SELECT MIN(train_id), MAX(train_id) FROM train_routes;",
+        // ExportTrainPage
+        "SELECT id, name, speed, capacity, wagon_count FROM trains "
+        "WHERE id > ?1 AND id <= ?2 ORDER BY id LIMIT ?3;",
+        // ExportStationPage
+        "SELECT station_id, name, platform_count FROM stations "
+        "WHERE station_id > ?1 AND station_id <= ?2 ORDER BY station_id LIMIT ?3;",
+        // ExportRoutePage
+        "SELECT r.route_id, r.dep_hour, r.dep_minute, r.arr_hour, r.arr_minute, r.duration, st.name FROM "
+        "(SELECT * FROM routes WHERE route_id > ?1 AND route_id <= ?2 ORDER BY route_id LIMIT ?3) r "
+        "LEFT JOIN route_stops s ON s.route_id = r.route_id "
+        "LEFT JOIN stations st ON st.station_id = s.station_id "
+        "ORDER BY r.route_id, s.stop_order;",
+        // ExportAssignmentPage
+        "SELECT train_id, route_id FROM train_routes "
+        "WHERE train_id <= ?3 AND (train_id > ?1 OR (train_id = ?1 AND route_id > ?2)) "
+        "ORDER BY train_id, route_id LIMIT ?4;",
+        // BeginTransaction
+        "BEGIN IMMEDIATE;",
+        // CommitTransaction
+        "COMMIT;",
+        // RollbackTransaction
+        "ROLLBACK;",
+        // SavepointRow
+        "SAVEPOINT row_write;",
+        // ReleaseRow
+        "RELEASE row_write;",
+        // RollbackRow
+        "ROLLBACK TO row_write;"
+    };
+    static_assert(sizeof(sql) / sizeof(sql[0]) == static_cast<size_t>(StatementId::Count),
+                  "Every StatementId needs its SQL text");
+
+    for (size_t i = 0; i < m_statements.size(); ++i) {
+        int rc = sqlite3_prepare_v3(m_db, sql[i], -1, SQLITE_PREPARE_PERSISTENT,
+                                    &m_statements[i], nullptr);
+        if (rc != SQLITE_OK) {
+            reportError() << "Failed to prepare statement: " << sqlite3_errmsg(m_db) << std::endl;
+            finalizeStatements();
+            return false;
+        }
+    }
+    return true;
+}
+
+void DatabaseManager::finalizeStatements() {
+    for (auto& stmt : m_statements) {
+        if (stmt) {
+            sqlite3_finalize(stmt);
+            stmt = nullptr;
+        }
+    }
+}
+
+sqlite3_stmt* DatabaseManager::getStatement(StatementId id) {
+    sqlite3_stmt* stmt = m_statements[static_cast<size_t>(id)];
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    return stmt;
+}
+
+bool DatabaseManager::runStatement(StatementId id) {
+    sqlite3_stmt* stmt = getStatement(id);
+    StatementGuard guard{stmt};
+    return sqlite3_step(stmt) == SQLITE_DONE;
+}
+
+bool DatabaseManager::beginTransaction() {
+    CJ_TIMED("db.begin_transaction");
+    if (!m_isConnected) {
+        return false;
+    }
+    if (!runStatement(StatementId::BeginTransaction)) {
+        reportError() << "Failed to begin transaction: " << sqlite3_errmsg(m_db) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool DatabaseManager::commitTransaction() {
+    CJ_TIMED("db.commit_transaction");
+    if (!m_isConnected) {
+        return false;
+    }
+    if (!runStatement(StatementId::CommitTransaction)) {
+        reportError() << "Failed to commit transaction: " << sqlite3_errmsg(m_db) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool DatabaseManager::rollbackTransaction() {
+    CJ_TIMED("db.rollback_transaction");
+    if (!m_isConnected) {
+        return false;
+    }
+    return runStatement(StatementId::RollbackTransaction);
+}
+
 bool DatabaseManager::displayDatabaseContents() {
     if (!m_isConnected) {
-        std::cerr << "Not connected to database" << std::endl;
+        reportError() << "Not connected to database" << std::endl;
         return false;
     }
 
@@ -227,7 +692,7 @@ bool DatabaseManager::displayDatabaseContents() {
             nullptr, &errMsg);
 
         if (rc != SQLITE_OK) {
-            std::cerr << "SQL error: " << errMsg << std::endl;
+            reportError() << "SQL error: " << errMsg << std::endl;
             sqlite3_free(errMsg);
             return false;
         }
@@ -235,38 +700,34 @@ bool DatabaseManager::displayDatabaseContents() {
     return true;
 }
 
-std::string DatabaseManager::generateRouteIdentifier(const std::vector<std::string>& stops) const {
-    if (stops.empty()) {
-        return "";
-    }
-    
-    std::stringstream ss;
-    ss << stops.front() << "_to_" << stops.back();
-    
-    return ss.str();
+bool DatabaseManager::insertTrain(const Train& train, StatementId id) {
+    sqlite3_stmt* stmt = getStatement(id);
+    StatementGuard guard{stmt};
+
+    const std::string name = train.getTrainName();
+    sqlite3_bind_int(stmt, 1, train.getId());
+    bindText(stmt, 2, name);
+    sqlite3_bind_int(stmt, 3, train.getSpeed());
+    sqlite3_bind_int(stmt, 4, train.getCapacity());
+    sqlite3_bind_int(stmt, 5, train.getWagonCount());
+    return sqlite3_step(stmt) == SQLITE_DONE;
 }
 
 bool DatabaseManager::saveTrain(const Train& train) {
-    std::string sql = "INSERT OR REPLACE INTO trains "
-                     "(id, name, speed, capacity, wagon_count) VALUES ("
-                     + std::to_string(train.getId()) + ", '"
-                     + train.getTrainName() + "', "
-                     + std::to_string(train.getSpeed()) + ", "
-                     + std::to_string(train.getCapacity()) + ", "
-                     + std::to_string(train.getWagonCount()) + ");";
+    CJ_TIMED("db.save_train");
+    if (!m_isConnected) {
+        return false;
+    }
 
-    char* errMsg = nullptr;
-    int rc = sqlite3_exec(m_db, sql.c_str(), nullptr, nullptr, &errMsg);
-    
-    if (rc != SQLITE_OK) {
-        std::cerr << "SQL error: " << errMsg << std::endl;
-        sqlite3_free(errMsg);
+    if (!insertTrain(train)) {
+        reportError() << "SQL error: " << sqlite3_errmsg(m_db) << std::endl;
         return false;
     }
     return true;
 }
 
 bool DatabaseManager::loadTrains(std::vector<Train>& trains) {
+    CJ_TIMED("db.load_trains");
     const char* sql = "SELECT id, name, speed, capacity, wagon_count FROM trains;";
     
     sqlite3_stmt* stmt;
@@ -289,38 +750,42 @@ bool DatabaseManager::loadTrains(std::vector<Train>& trains) {
 }
 
 bool DatabaseManager::deleteTrain(int id) {
+    CJ_TIMED("db.delete_train");
     if (!m_isConnected) {
         return false;
     }
     
-    std::stringstream query;
-    query << "DELETE FROM trains WHERE id = " << id << ";";
-    
-    return executeQuery(query.str());
+    // Assignments are removed with the train so they cannot dangle
+    for (StatementId statement : {StatementId::DeleteTrainAssignments, StatementId::DeleteTrain}) {
+        sqlite3_stmt* stmt = getStatement(statement);
+        StatementGuard guard{stmt};
+        sqlite3_bind_int(stmt, 1, id);
+
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            reportError() << "SQL error: " << sqlite3_errmsg(m_db) << std::endl;
+            return false;
+        }
+    }
+    return true;
 }
 
 bool DatabaseManager::updateTrain(const Train& train) {
+    CJ_TIMED("db.update_train");
     return saveTrain(train); 
 }
 
 bool DatabaseManager::getTrainById(int id, Train& train) {
+    CJ_TIMED("db.train_by_id");
     if (!m_isConnected) {
         return false;
     }
     
-    std::stringstream query;
-    query << "SELECT id, name, speed, capacity, wagon_count "
-          << "FROM trains WHERE id = " << id << ";";
-    
-    sqlite3_stmt* stmt;
-    int rc = sqlite3_prepare_v2(m_db, query.str().c_str(), -1, &stmt, nullptr);
-    if (rc != SQLITE_OK) {
-        std::cerr << "Failed to prepare statement: " << sqlite3_errmsg(m_db) << std::endl;
-        return false;
-    }
+    sqlite3_stmt* stmt = getStatement(StatementId::GetTrainById);
+    StatementGuard guard{stmt};
+    sqlite3_bind_int(stmt, 1, id);
     
     bool found = false;
-    if ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
         std::string name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
         int speed = std::max(1, sqlite3_column_int(stmt, 2));
         int capacity = std::max(1, sqlite3_column_int(stmt, 3));
@@ -330,63 +795,75 @@ bool DatabaseManager::getTrainById(int id, Train& train) {
             train = Train(name, speed, capacity, id, wagonCount);
             found = true;
         } catch (const std::exception& e) {
-            std::cerr << "Error creating train object: " << e.what() << std::endl;
+            reportError() << "Error creating train object: " << e.what() << std::endl;
             found = false;
         }
     }
     
-    sqlite3_finalize(stmt);
     return found;
 }
 
-std::string DatabaseManager::escapeString(const std::string& str) const {
-    std::string escaped = str;
-    size_t pos = 0;
+bool DatabaseManager::findStationId(const std::string& name, int& stationId) {
+    sqlite3_stmt* stmt = getStatement(StatementId::FindStation);
+    StatementGuard guard{stmt};
+    bindText(stmt, 1, name);
+    if (sqlite3_step(stmt) != SQLITE_ROW) {
+        return false;
+    }
+    stationId = sqlite3_column_int(stmt, 0);
+    return true;
+}
+
+bool DatabaseManager::stationExists(const std::string& name) {
+    int stationId;
+    return findStationId(name, stationId);
+}
 
-    while ((pos = escaped.find('\'', pos)) != std::string::npos) {
-        escaped.insert(pos, 1, '\'');
-        pos += 2;
+bool DatabaseManager::getStationId(const std::string& name, int& stationId) {
+    CJ_TIMED("db.station_id");
+    if (!m_isConnected) {
+        return false;
     }
-    
-    return escaped;
+    return findStationId(name, stationId);
+}
+
+bool DatabaseManager::insertStation(const Station& station) {
+    sqlite3_stmt* stmt = getStatement(StatementId::InsertStation);
+    StatementGuard guard{stmt};
+    bindText(stmt, 1, station.getName());
+    sqlite3_bind_int(stmt, 2, station.getPlatformCount());
+    return sqlite3_step(stmt) == SQLITE_DONE;
 }
 
 bool DatabaseManager::saveStation(const Station& station) {
+    CJ_TIMED("db.save_station");
     if (!m_isConnected) return false;
 
-    std::stringstream checkQuery;
-    checkQuery << "SELECT name FROM stations WHERE name COLLATE NOCASE = '" 
-               << escapeString(station.getName()) << "';";
-
-    sqlite3_stmt* stmt;
-    int rc = sqlite3_prepare_v2(m_db, checkQuery.str().c_str(), -1, &stmt, nullptr);
-    if (rc == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
-        sqlite3_finalize(stmt);
+    if (stationExists(station.getName())) {
         throw std::runtime_error("Station '" + station.getName() + "' already exists");
     }
-    sqlite3_finalize(stmt);
 
-    std::stringstream query;
-    query << "INSERT INTO stations (name, platform_count) VALUES ("
-          << "'" << escapeString(station.getName()) << "', "
-          << station.getPlatformCount() << ");";
-    
-    return executeQuery(query.str());
+    if (!insertStation(station)) {
+        reportError() << "SQL error: " << sqlite3_errmsg(m_db) << std::endl;
+        return false;
+    }
+    return true;
 }
 
 bool DatabaseManager::loadStations(std::vector<Station>& stations) {
+    CJ_TIMED("db.load_stations");
     if (!m_isConnected) {
         return false;
     }
 
     stations.clear();
 
-    const char* query = "SELECT name, platform_count FROM stations;";
+    const char* query = "SELECT name, platform_count FROM stations ORDER BY station_id;";
 
     sqlite3_stmt* stmt;
     int rc = sqlite3_prepare_v2(m_db, query, -1, &stmt, nullptr);
     if (rc != SQLITE_OK) {
-        std::cerr << "Failed to prepare statement: " << sqlite3_errmsg(m_db) << std::endl;
+        reportError() << "Failed to prepare statement: " << sqlite3_errmsg(m_db) << std::endl;
         return false;
     }
 
@@ -402,248 +879,595 @@ bool DatabaseManager::loadStations(std::vector<Station>& stations) {
 }
 
 bool DatabaseManager::updateStation(const Station& station) {
+    CJ_TIMED("db.update_station");
     return saveStation(station); 
 }
 
 bool DatabaseManager::deleteStation(const std::string& name) {
+    CJ_TIMED("db.delete_station");
     if (!m_isConnected) {
         return false;
     }
     
-    std::stringstream query;
-    query << "DELETE FROM stations WHERE name = '" << name << "';";
+    int stationId;
+    if (!findStationId(name, stationId)) {
+        return true;  // nothing to delete
+    }
+
+    // Routes refer to stops by station_id, so a station in use has to stay
+    {
+        sqlite3_stmt* stmt = getStatement(StatementId::StationInUse);
+        StatementGuard guard{stmt};
+        sqlite3_bind_int(stmt, 1, stationId);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            reportError() << "Station '" << name << "' is a stop on existing routes and cannot be removed" << std::endl;
+            return false;
+        }
+    }
     
-    return executeQuery(query.str());
+    sqlite3_stmt* stmt = getStatement(StatementId::DeleteStation);
+    StatementGuard guard{stmt};
+    sqlite3_bind_int(stmt, 1, stationId);
+
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        reportError() << "SQL error: " << sqlite3_errmsg(m_db) << std::endl;
+        return false;
+    }
+    return true;
 }
 
 bool DatabaseManager::getStationByName(const std::string& name, Station& station) {
+    CJ_TIMED("db.station_by_name");
     if (!m_isConnected) return false;
 
-    std::stringstream query;
-    query << "SELECT * FROM stations WHERE name COLLATE NOCASE = '" 
-          << escapeString(name) << "';";
-
-    sqlite3_stmt* stmt;
-    int rc = sqlite3_prepare_v2(m_db, query.str().c_str(), -1, &stmt, nullptr);
-    
-    if (rc == SQLITE_OK) {
-        if (sqlite3_step(stmt) == SQLITE_ROW) {
-            station = Station(
-                nullptr,
-                sqlite3_column_int(stmt, 1),  
-                {},
-                nullptr,
-                nullptr,
-                reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0))  
-            );
-            sqlite3_finalize(stmt);
-            return true;
-        }
+    sqlite3_stmt* stmt = getStatement(StatementId::GetStationByName);
+    StatementGuard guard{stmt};
+    bindText(stmt, 1, name);
+
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        station = Station(
+            nullptr,
+            sqlite3_column_int(stmt, 1),  
+            {},
+            nullptr,
+            nullptr,
+            reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0))  
+        );
+        return true;
     }
     
-    sqlite3_finalize(stmt);
     return false;
 }
 
 bool DatabaseManager::loadRoutes(std::vector<Route>& routes) {
+    CJ_TIMED("db.load_routes");
     if (!m_isConnected) {
         return false;
     }
 
-    const char* query = "SELECT identifier, dep_hour, dep_minute, arr_hour, "
-                       "arr_minute, duration FROM routes;";
-    
-    sqlite3_stmt* stmt;
-    int rc = sqlite3_prepare_v2(m_db, query, -1, &stmt, nullptr);
-    if (rc != SQLITE_OK) {
+    routes.clear();
+
+    // One ordered pass over routes joined with their stops; consecutive rows
+    // with the same route_id are folded into a single Route
+    sqlite3_stmt* stmt = getStatement(StatementId::LoadRoutesWithStops);
+    StatementGuard guard{stmt};
+
+    sqlite3_int64 currentRouteId = 0;
+    bool haveRoute = false;
+    int depHour = 0, depMin = 0, arrHour = 0, arrMin = 0, duration = 0;
+    std::vector<std::string> stops;
+
+    auto finishRoute = [&]() {
+        if (haveRoute) {
+            routes.emplace_back(depHour, depMin, arrHour, arrMin, duration,
+                                nullptr, nullptr, nullptr, stops);
+        }
+    };
+
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        sqlite3_int64 routeId = sqlite3_column_int64(stmt, 0);
+        if (!haveRoute || routeId != currentRouteId) {
+            finishRoute();
+            haveRoute = true;
+            currentRouteId = routeId;
+            depHour = sqlite3_column_int(stmt, 1);
+            depMin = sqlite3_column_int(stmt, 2);
+            arrHour = sqlite3_column_int(stmt, 3);
+            arrMin = sqlite3_column_int(stmt, 4);
+            duration = sqlite3_column_int(stmt, 5);
+            stops.clear();
+        }
+
+        const unsigned char* stationName = sqlite3_column_text(stmt, 6);
+        if (stationName) {
+            stops.emplace_back(reinterpret_cast<const char*>(stationName),
+                               static_cast<size_t>(sqlite3_column_bytes(stmt, 6)));
+        }
+    }
+    finishRoute();
+
+    if (rc != SQLITE_DONE) {
+        reportError() << "Failed to load routes: " << sqlite3_errmsg(m_db) << std::endl;
         return false;
     }
+    return true;
+}
 
-    routes.clear();
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        std::string identifier = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
-        int depHour = sqlite3_column_int(stmt, 1);
-        int depMin = sqlite3_column_int(stmt, 2);
-        int arrHour = sqlite3_column_int(stmt, 3);
-        int arrMin = sqlite3_column_int(stmt, 4);
-        int duration = sqlite3_column_int(stmt, 5);
-
-        // Get stops for this route
-        std::vector<std::string> stops;
-        std::stringstream stopsQuery;
-        stopsQuery << "SELECT station_name FROM route_stops WHERE route_id = '" 
-                  << escapeString(identifier) << "' ORDER BY stop_order;";
-
-        sqlite3_stmt* stopsStmt;
-        rc = sqlite3_prepare_v2(m_db, stopsQuery.str().c_str(), -1, &stopsStmt, nullptr);
-        if (rc == SQLITE_OK) {
-            while (sqlite3_step(stopsStmt) == SQLITE_ROW) {
-                const char* stationName = reinterpret_cast<const char*>(
-                    sqlite3_column_text(stopsStmt, 0));
-                stops.push_back(stationName);
+bool DatabaseManager::resolveStopIds(const std::vector<std::string>& stops, std::vector<int>& stationIds) {
+    stationIds.clear();
+    stationIds.reserve(stops.size());
+    for (const auto& stop : stops) {
+        int stationId;
+        if (!findStationId(stop, stationId)) {
+            // Stops that were never added as stations get a one-platform entry
+            sqlite3_stmt* stmt = getStatement(StatementId::InsertStation);
+            StatementGuard guard{stmt};
+            bindText(stmt, 1, stop);
+            sqlite3_bind_int(stmt, 2, 1);
+            if (sqlite3_step(stmt) != SQLITE_DONE) {
+                return false;
             }
-            sqlite3_finalize(stopsStmt);
+            stationId = static_cast<int>(sqlite3_last_insert_rowid(m_db));
+        }
+        stationIds.push_back(stationId);
+    }
+    return true;
+}
 
-            routes.emplace_back(depHour, depMin, arrHour, arrMin, duration, 
-                              nullptr, nullptr, nullptr, stops);
+bool DatabaseManager::findRouteId(const Route& route, int originId, int destinationId, int& routeId) {
+    sqlite3_stmt* stmt = getStatement(StatementId::FindRoute);
+    StatementGuard guard{stmt};
+    sqlite3_bind_int(stmt, 1, originId);
+    sqlite3_bind_int(stmt, 2, destinationId);
+    sqlite3_bind_int(stmt, 3, route.getDepartureTimeHour());
+    sqlite3_bind_int(stmt, 4, route.getDepartureTimeMinute());
+    if (sqlite3_step(stmt) != SQLITE_ROW) {
+        return false;
+    }
+    routeId = sqlite3_column_int(stmt, 0);
+    return true;
+}
+
+bool DatabaseManager::insertRouteRows(const Route& route, const std::vector<int>& stationIds, int& routeId) {
+    // Insert the route
+    {
+        sqlite3_stmt* stmt = getStatement(StatementId::InsertRoute);
+        StatementGuard guard{stmt};
+        sqlite3_bind_int(stmt, 1, stationIds.front());
+        sqlite3_bind_int(stmt, 2, stationIds.back());
+        sqlite3_bind_int(stmt, 3, route.getDepartureTimeHour());
+        sqlite3_bind_int(stmt, 4, route.getDepartureTimeMinute());
+        sqlite3_bind_int(stmt, 5, route.getArrivalTimeHour());
+        sqlite3_bind_int(stmt, 6, route.getArrivalTimeMinute());
+        sqlite3_bind_int(stmt, 7, route.getDuration());
+
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            return false;
         }
+        routeId = static_cast<int>(sqlite3_last_insert_rowid(m_db));
     }
 
-    sqlite3_finalize(stmt);
+    // Insert stops, rebinding the same statement for every stop
+    sqlite3_stmt* stopStmt = getStatement(StatementId::InsertRouteStop);
+    StatementGuard stopGuard{stopStmt};
+    sqlite3_bind_int(stopStmt, 1, routeId);
+    for (size_t i = 0; i < stationIds.size(); ++i) {
+        sqlite3_reset(stopStmt);
+        sqlite3_bind_int(stopStmt, 2, static_cast<int>(i));
+        sqlite3_bind_int(stopStmt, 3, stationIds[i]);
+
+        if (sqlite3_step(stopStmt) != SQLITE_DONE) {
+            return false;
+        }
+    }
     return true;
 }
 
-bool DatabaseManager::saveRoute(const Route& route) {
-    if (!m_isConnected) return false;
+bool DatabaseManager::insertAssignment(int trainId, int routeId) {
+    sqlite3_stmt* stmt = getStatement(StatementId::AssignTrainToRoute);
+    StatementGuard guard{stmt};
+    sqlite3_bind_int(stmt, 1, trainId);
+    sqlite3_bind_int(stmt, 2, routeId);
+    return sqlite3_step(stmt) == SQLITE_DONE;
+}
 
-    // Generate identifier from stops
-    std::string identifier = generateRouteIdentifier(route.getIntermediateStops());
+DatabaseManager::RouteWriteResult DatabaseManager::writeRoute(const Route& route, int assignTrainId,
+                                                              int& routeId, std::string& error) {
+    const auto& stops = route.getIntermediateStops();
+    if (stops.empty()) {
+        error = "Route has no stops";
+        return RouteWriteResult::Failed;
+    }
 
-    // Check if route already exists
-    std::stringstream checkQuery;
-    checkQuery << "SELECT identifier FROM routes WHERE identifier COLLATE NOCASE = '" 
-               << escapeString(identifier) << "';";
+    // A savepoint nests inside a caller's transaction and starts one otherwise
+    if (!runStatement(StatementId::SavepointRow)) {
+        error = sqlite3_errmsg(m_db);
+        return RouteWriteResult::Failed;
+    }
 
-    sqlite3_stmt* stmt;
-    int rc = sqlite3_prepare_v2(m_db, checkQuery.str().c_str(), -1, &stmt, nullptr);
-    if (rc == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
-        sqlite3_finalize(stmt);
-        throw std::runtime_error("Route from '" + route.getIntermediateStops().front() + 
-                               "' to '" + route.getIntermediateStops().back() + "' already exists");
+    std::vector<int> stationIds;
+    RouteWriteResult result = RouteWriteResult::Written;
+    int existingId;
+    if (!resolveStopIds(stops, stationIds)) {
+        result = RouteWriteResult::Failed;
+    } else if (findRouteId(route, stationIds.front(), stationIds.back(), existingId)) {
+        result = RouteWriteResult::Duplicate;
+    } else if (!insertRouteRows(route, stationIds, routeId) ||
+               (assignTrainId > 0 && !insertAssignment(assignTrainId, routeId))) {
+        result = RouteWriteResult::Failed;
     }
-    sqlite3_finalize(stmt);
 
-    // Start transaction
-    if (!executeQuery("BEGIN TRANSACTION;")) {
-        return false;
+    if (result == RouteWriteResult::Written) {
+        runStatement(StatementId::ReleaseRow);
+        return result;
     }
 
-    // Insert the route
-    std::stringstream routeQuery;
-    routeQuery << "INSERT INTO routes (identifier, dep_hour, dep_minute, arr_hour, arr_minute, duration) "
-               << "VALUES ('" << escapeString(identifier) << "', "
-               << route.getDepartureTimeHour() << ", "
-               << route.getDepartureTimeMinute() << ", "
-               << route.getArrivalTimeHour() << ", "
-               << route.getArrivalTimeMinute() << ", "
-               << route.getDuration() << ");";
-
-    if (!executeQuery(routeQuery.str())) {
-        executeQuery("ROLLBACK;");
-        return false;
+    if (result == RouteWriteResult::Duplicate) {
+        std::stringstream message;
+        message << "Route from '" << stops.front() << "' to '" << stops.back() << "' departing at "
+                << std::setfill('0') << std::setw(2) << route.getDepartureTimeHour() << ":"
+                << std::setw(2) << route.getDepartureTimeMinute() << " already exists";
+        error = message.str();
+    } else {
+        error = sqlite3_errmsg(m_db);
     }
+    runStatement(StatementId::RollbackRow);
+    runStatement(StatementId::ReleaseRow);
+    return result;
+}
 
-    // Insert stops
-    const auto& stops = route.getIntermediateStops();
-    for (size_t i = 0; i < stops.size(); ++i) {
-        std::stringstream stopQuery;
-        stopQuery << "INSERT INTO route_stops (route_id, station_name, stop_order) VALUES ('"
-                 << escapeString(identifier) << "', '"
-                 << escapeString(stops[i]) << "', "
-                 << i << ");";
-
-        if (!executeQuery(stopQuery.str())) {
-            executeQuery("ROLLBACK;");
+bool DatabaseManager::saveRoute(const Route& route) {
+    int routeId;
+    return saveRoute(route, routeId);
+}
+
+bool DatabaseManager::saveRoute(const Route& route, int& routeId) {
+    CJ_TIMED("db.save_route");
+    if (!m_isConnected) return false;
+
+    std::string error;
+    switch (writeRoute(route, 0, routeId, error)) {
+        case RouteWriteResult::Written:
+            return true;
+        case RouteWriteResult::Duplicate:
+            throw std::runtime_error(error);
+        default:
+            reportError() << "SQL error: " << error << std::endl;
             return false;
-        }
     }
-
-    return executeQuery("COMMIT;");
 }
 
-bool DatabaseManager::assignTrainToRoute(int trainId, const std::vector<std::string>& routeStops) {
-    if (!m_isConnected || routeStops.empty()) {
+bool DatabaseManager::getRouteId(const Route& route, int& routeId) {
+    CJ_TIMED("db.route_id");
+    const auto& stops = route.getIntermediateStops();
+    if (!m_isConnected || stops.empty()) {
         return false;
     }
-    
-    std::string routeId = generateRouteIdentifier(routeStops);
-    
-    std::stringstream query;
-    query << "INSERT OR REPLACE INTO train_routes (train_id, route_id) VALUES ("
-          << trainId << ", '" << routeId << "');";
-    
-    return executeQuery(query.str());
+
+    int originId, destinationId;
+    return findStationId(stops.front(), originId) &&
+           findStationId(stops.back(), destinationId) &&
+           findRouteId(route, originId, destinationId, routeId);
 }
 
-bool DatabaseManager::getTrainsForRoute(const std::vector<std::string>& routeStops, std::vector<int>& trainIds) {
-    if (!m_isConnected || routeStops.empty()) {
+bool DatabaseManager::assignTrainToRoute(int trainId, int routeId) {
+    CJ_TIMED("db.assign_train");
+    if (!m_isConnected) {
         return false;
     }
     
-    trainIds.clear();
-    
-    std::string routeId = generateRouteIdentifier(routeStops);
-    
-    std::stringstream query;
-    query << "SELECT train_id FROM train_routes WHERE route_id = '" << routeId << "';";
-    
-    sqlite3_stmt* stmt;
-    int rc = sqlite3_prepare_v2(m_db, query.str().c_str(), -1, &stmt, nullptr);
-    if (rc != SQLITE_OK) {
-        std::cerr << "Failed to prepare statement: " << sqlite3_errmsg(m_db) << std::endl;
+    if (!insertAssignment(trainId, routeId)) {
+        reportError() << "SQL error: " << sqlite3_errmsg(m_db) << std::endl;
         return false;
     }
-    
+    return true;
+}
+
+bool DatabaseManager::selectIds(StatementId id, int key, std::vector<int>& ids) {
+    ids.clear();
+
+    sqlite3_stmt* stmt = getStatement(id);
+    StatementGuard guard{stmt};
+    sqlite3_bind_int(stmt, 1, key);
+
+    int rc;
     while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
-        int trainId = sqlite3_column_int(stmt, 0);
-        trainIds.push_back(trainId);
+        ids.push_back(sqlite3_column_int(stmt, 0));
     }
-    
-    sqlite3_finalize(stmt);
-    return rc != SQLITE_ERROR;
+
+    if (rc != SQLITE_DONE) {
+        reportError() << "SQL error: " << sqlite3_errmsg(m_db) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool DatabaseManager::getTrainsForRoute(int routeId, std::vector<int>& trainIds) {
+    CJ_TIMED("db.trains_for_route");
+    return m_isConnected && selectIds(StatementId::GetTrainsForRoute, routeId, trainIds);
+}
+
+bool DatabaseManager::getRouteIdsForTrain(int trainId, std::vector<int>& routeIds) {
+    CJ_TIMED("db.route_ids_for_train");
+    return m_isConnected && selectIds(StatementId::GetRouteIdsForTrain, trainId, routeIds);
+}
+
+bool DatabaseManager::getRouteStopIds(int routeId, std::vector<int>& stationIds) {
+    CJ_TIMED("db.route_stop_ids");
+    return m_isConnected && selectIds(StatementId::GetRouteStopIds, routeId, stationIds);
+}
+
+bool DatabaseManager::getRoutesThroughStation(int stationId, std::vector<int>& routeIds) {
+    CJ_TIMED("db.routes_through_station");
+    return m_isConnected && selectIds(StatementId::GetRoutesThroughStation, stationId, routeIds);
 }
 
 bool DatabaseManager::getRoutesForTrain(int trainId, std::vector<std::vector<std::string>>& routes) {
+    CJ_TIMED("db.routes_for_train");
     if (!m_isConnected) {
         return false;
     }
     
     routes.clear();
     
-    std::stringstream routeQuery;
-    routeQuery << "SELECT route_id FROM train_routes WHERE train_id = " << trainId << ";";
-    
-    sqlite3_stmt* routeStmt;
-    int rc = sqlite3_prepare_v2(m_db, routeQuery.str().c_str(), -1, &routeStmt, nullptr);
-    if (rc != SQLITE_OK) {
-        std::cerr << "Failed to prepare statement: " << sqlite3_errmsg(m_db) << std::endl;
+    sqlite3_stmt* stmt = getStatement(StatementId::GetRoutesForTrain);
+    StatementGuard guard{stmt};
+    sqlite3_bind_int(stmt, 1, trainId);
+
+    sqlite3_int64 currentRouteId = 0;
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        sqlite3_int64 routeId = sqlite3_column_int64(stmt, 0);
+        if (routes.empty() || currentRouteId != routeId) {
+            currentRouteId = routeId;
+            routes.emplace_back();
+        }
+        routes.back().emplace_back(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)),
+                                   static_cast<size_t>(sqlite3_column_bytes(stmt, 1)));
+    }
+
+    if (rc != SQLITE_DONE) {
+        reportError() << "Failed to load routes for train: " << sqlite3_errmsg(m_db) << std::endl;
         return false;
     }
-    
-    std::vector<std::string> routeIds;
-    while ((rc = sqlite3_step(routeStmt)) == SQLITE_ROW) {
-        std::string routeId = reinterpret_cast<const char*>(sqlite3_column_text(routeStmt, 0));
-        routeIds.push_back(routeId);
+    return true;
+}
+
+bool DatabaseManager::loadAssignments(std::vector<std::pair<int, size_t>>& assignments) {
+    CJ_TIMED("db.load_assignments");
+    if (!m_isConnected) {
+        return false;
     }
-    
-    sqlite3_finalize(routeStmt);
-    
-    for (const auto& routeId : routeIds) {
-        std::stringstream stopsQuery;
-        stopsQuery << "SELECT stop_name FROM route_stops WHERE route_id = '" << routeId 
-                   << "' ORDER BY stop_order;";
-        
-        sqlite3_stmt* stopsStmt;
-        rc = sqlite3_prepare_v2(m_db, stopsQuery.str().c_str(), -1, &stopsStmt, nullptr);
-        if (rc != SQLITE_OK) {
-            std::cerr << "Failed to prepare statement: " << sqlite3_errmsg(m_db) << std::endl;
-            return false;
+
+    assignments.clear();
+
+    // Same ordering as loadRoutes, so a route's rank is its index there
+    sqlite3_stmt* stmt = getStatement(StatementId::LoadAssignments);
+    StatementGuard guard{stmt};
+
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        assignments.emplace_back(sqlite3_column_int(stmt, 0),
+                                 static_cast<size_t>(sqlite3_column_int64(stmt, 1)));
+    }
+
+    if (rc != SQLITE_DONE) {
+        reportError() << "Failed to load assignments: " << sqlite3_errmsg(m_db) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool DatabaseManager::getExportKeyRange(ExportTable table, int& first, int& last) {
+    CJ_TIMED("db.export_key_range");
+    first = 1;
+    last = 0;
+    if (!m_isConnected) {
+        return false;
+    }
+
+    static const StatementId statements[] = {
+        StatementId::ExportTrainKeys,
+        StatementId::ExportStationKeys,
+        StatementId::ExportRouteKeys,
+        StatementId::ExportAssignmentKeys
+    };
+    sqlite3_stmt* stmt = getStatement(statements[static_cast<size_t>(table)]);
+    StatementGuard guard{stmt};
+    if (sqlite3_step(stmt) != SQLITE_ROW) {
+        reportError() << "SQL error: " << sqlite3_errmsg(m_db) << std::endl;
+        return false;
+    }
+    // MIN and MAX are NULL for an empty table
+    if (sqlite3_column_type(stmt, 0) != SQLITE_NULL) {
+        first = sqlite3_column_int(stmt, 0);
+        last = sqlite3_column_int(stmt, 1);
+    }
+    return true;
+}
+
+bool DatabaseManager::readTrainPage(int after, int last, size_t limit, std::vector<Train>& page) {
+    CJ_TIMED("db.export_train_page");
+    page.clear();
+    if (!m_isConnected) {
+        return false;
+    }
+
+    sqlite3_stmt* stmt = getStatement(StatementId::ExportTrainPage);
+    StatementGuard guard{stmt};
+    sqlite3_bind_int(stmt, 1, after);
+    sqlite3_bind_int(stmt, 2, last);
+    sqlite3_bind_int64(stmt, 3, static_cast<sqlite3_int64>(limit));
+
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        page.emplace_back(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)), sqlite3_column_int(stmt, 2),
+                          sqlite3_column_int(stmt, 3), sqlite3_column_int(stmt, 0), sqlite3_column_int(stmt, 4));
+    }
+
+    if (rc != SQLITE_DONE) {
+        reportError() << "Failed to read trains: " << sqlite3_errmsg(m_db) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool DatabaseManager::readStationPage(int after, int last, size_t limit, std::vector<ExportStation>& page) {
+    CJ_TIMED("db.export_station_page");
+    page.clear();
+    if (!m_isConnected) {
+        return false;
+    }
+
+    sqlite3_stmt* stmt = getStatement(StatementId::ExportStationPage);
+    StatementGuard guard{stmt};
+    sqlite3_bind_int(stmt, 1, after);
+    sqlite3_bind_int(stmt, 2, last);
+    sqlite3_bind_int64(stmt, 3, static_cast<sqlite3_int64>(limit));
+
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        ExportStation station;
+        station.id = sqlite3_column_int(stmt, 0);
+        station.name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        station.platformCount = sqlite3_column_int(stmt, 2);
+        page.push_back(std::move(station));
+    }
+
+    if (rc != SQLITE_DONE) {
+        reportError() << "Failed to read stations: " << sqlite3_errmsg(m_db) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool DatabaseManager::readRoutePage(int after, int last, size_t limit, std::vector<ExportRoute>& page) {
+    CJ_TIMED("db.export_route_page");
+    page.clear();
+    if (!m_isConnected) {
+        return false;
+    }
+
+    // One row per stop, so the route and its stops come from the same read
+    sqlite3_stmt* stmt = getStatement(StatementId::ExportRoutePage);
+    StatementGuard guard{stmt};
+    sqlite3_bind_int(stmt, 1, after);
+    sqlite3_bind_int(stmt, 2, last);
+    sqlite3_bind_int64(stmt, 3, static_cast<sqlite3_int64>(limit));
+
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        int routeId = sqlite3_column_int(stmt, 0);
+        if (page.empty() || page.back().id != routeId) {
+            ExportRoute route;
+            route.id = routeId;
+            route.depHour = sqlite3_column_int(stmt, 1);
+            route.depMinute = sqlite3_column_int(stmt, 2);
+            route.arrHour = sqlite3_column_int(stmt, 3);
+            route.arrMinute = sqlite3_column_int(stmt, 4);
+            route.duration = sqlite3_column_int(stmt, 5);
+            page.push_back(std::move(route));
         }
-        
-        std::vector<std::string> stops;
-        while ((rc = sqlite3_step(stopsStmt)) == SQLITE_ROW) {
-            std::string stopName = reinterpret_cast<const char*>(sqlite3_column_text(stopsStmt, 0));
-            stops.push_back(stopName);
+        if (const unsigned char* stop = sqlite3_column_text(stmt, 6)) {
+            page.back().stops.emplace_back(reinterpret_cast<const char*>(stop));
         }
-        
-        sqlite3_finalize(stopsStmt);
-        
-        if (!stops.empty()) {
-            routes.push_back(stops);
+    }
+
+    if (rc != SQLITE_DONE) {
+        reportError() << "Failed to read routes: " << sqlite3_errmsg(m_db) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool DatabaseManager::readAssignmentPage(std::pair<int, int> after, int lastTrainId, size_t limit,
+                                         std::vector<std::pair<int, int>>& page) {
+    CJ_TIMED("db.export_assignment_page");
+    page.clear();
+    if (!m_isConnected) {
+        return false;
+    }
+
+    sqlite3_stmt* stmt = getStatement(StatementId::ExportAssignmentPage);
+    StatementGuard guard{stmt};
+    sqlite3_bind_int(stmt, 1, after.first);
+    sqlite3_bind_int(stmt, 2, after.second);
+    sqlite3_bind_int(stmt, 3, lastTrainId);
+    sqlite3_bind_int64(stmt, 4, static_cast<sqlite3_int64>(limit));
+
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        page.emplace_back(sqlite3_column_int(stmt, 0), sqlite3_column_int(stmt, 1));
+    }
+
+    if (rc != SQLITE_DONE) {
+        reportError() << "Failed to read assignments: " << sqlite3_errmsg(m_db) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool DatabaseManager::importBatch(const std::vector<Train>& trains,
+                                  const std::vector<Station>& stations,
+                                  const std::vector<Route>& routes,
+                                  ImportReport& report) {
+    CJ_TIMED("db.import_batch");
+    report = ImportReport{};
+    if (!m_isConnected) {
+        return false;
+    }
+
+    if (!beginTransaction()) {
+        return false;
+    }
+
+    auto fail = [&report](const char* entity, size_t index, const std::string& message) {
+        report.failures.push_back({entity, index, message});
+    };
+
+    // A plain INSERT, so an ID that is already taken fails instead of replacing the stored train
+    for (size_t i = 0; i < trains.size(); ++i) {
+        if (insertTrain(trains[i], StatementId::InsertTrain)) {
+            ++report.trainsImported;
+        } else if (sqlite3_extended_errcode(m_db) == SQLITE_CONSTRAINT_PRIMARYKEY) {
+            fail("train", i, "Train with ID " + std::to_string(trains[i].getId()) + " already exists");
+        } else {
+            fail("train", i, sqlite3_errmsg(m_db));
         }
     }
-    
+
+    for (size_t i = 0; i < stations.size(); ++i) {
+        if (stationExists(stations[i].getName())) {
+            fail("station", i, "Station '" + stations[i].getName() + "' already exists");
+        } else if (insertStation(stations[i])) {
+            ++report.stationsImported;
+        } else {
+            fail("station", i, sqlite3_errmsg(m_db));
+        }
+    }
+
+    // writeRoute puts each route and its stops under a savepoint so a bad stop
+    // only discards that route, not the whole batch
+    std::string error;
+    for (size_t i = 0; i < routes.size(); ++i) {
+        auto train = routes[i].getAssignedTrain();
+        int routeId;
+        if (writeRoute(routes[i], train ? train->getId() : 0, routeId, error) == RouteWriteResult::Written) {
+            ++report.routesImported;
+        } else {
+            fail("route", i, error);
+        }
+    }
+
+    if (!commitTransaction()) {
+        rollbackTransaction();
+        report.trainsImported = report.stationsImported = report.routesImported = 0;
+        return false;
+    }
+
+    report.committed = true;
     return true;
 }
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,222 @@
+#include "../include/DepartureBoard.hpp"
+#include "../include/Metrics.hpp"
+#include "../include/TaskScheduler.hpp"
+#include <algorithm>
+
+namespace CJ {
+
+namespace {
+
+constexpr int DAY_SECONDS = 24 * 60 * 60;
+
+bool earlier(const BoardEntry& a, const BoardEntry& b) {
+    if (a.time != b.time) return a.time < b.time;
+    if (a.trip != b.trip) return a.trip < b.trip;
+    return a.stop < b.stop;
+}
+
+} // namespace
+
+void DepartureBoard::clear() {
+    m_stations.clear();
+    m_trips.clear();
+}
+
+uint32_t DepartureBoard::addRoute(const Route& route) {
+    return appendRoute(route, true);
+}
+
+uint32_t DepartureBoard::addRoutes(const std::vector<Route>& routes, size_t first) {
+    CJ_TIMED("board.add_routes");
+    uint32_t firstTrip = static_cast<uint32_t>(m_trips.size());
+    std::vector<std::pair<size_t, size_t>> sortedSizes(m_stations.size());
+    for (size_t station = 0; station < m_stations.size(); ++station) {
+        sortedSizes[station] = {m_stations[station].departures.size(), m_stations[station].arrivals.size()};
+    }
+
+    m_trips.reserve(m_trips.size() + routes.size() - std::min(first, routes.size()));
+    for (size_t i = first; i < routes.size(); ++i) {
+        appendRoute(routes[i], false);
+    }
+
+    // New entries are sorted on their own and merged behind the existing ones
+    auto merge = [](std::vector<BoardEntry>& entries, size_t sorted) {
+        if (entries.size() > sorted) {
+            std::sort(entries.begin() + sorted, entries.end(), earlier);
+            std::inplace_merge(entries.begin(), entries.begin() + sorted, entries.end(), earlier);
+        }
+    };
+    TaskScheduler::global().parallelFor(0, m_stations.size(), 64, [&](size_t firstStation, size_t lastStation) {
+        for (size_t station = firstStation; station < lastStation; ++station) {
+            bool existed = station < sortedSizes.size();
+            merge(m_stations[station].departures, existed ? sortedSizes[station].first : 0);
+            merge(m_stations[station].arrivals, existed ? sortedSizes[station].second : 0);
+        }
+    });
+    return firstTrip;
+}
+
+uint32_t DepartureBoard::appendRoute(const Route& route, bool keepSorted) {
+    uint32_t trip = static_cast<uint32_t>(m_trips.size());
+    m_trips.emplace_back();
+
+    const std::vector<StationId>& stops = route.getStopIds();
+    if (stops.size() < 2) {
+        return trip;
+    }
+    std::vector<StopTime> times = route.calculateStopTimes();
+    std::vector<Call>& calls = m_trips.back();
+    calls.reserve(stops.size());
+
+    for (uint32_t i = 0; i < stops.size(); ++i) {
+        Call call{stops[i], BoardEntry{-1, trip, i}, BoardEntry{-1, trip, i}};
+        if (stops[i] >= m_stations.size()) {
+            m_stations.resize(stops[i] + 1);
+        }
+        StationBoard& board = m_stations[stops[i]];
+        if (i + 1 < stops.size()) {
+            call.departure.time = times[i].departure % DAY_SECONDS;
+            if (keepSorted) {
+                insert(board.departures, call.departure);
+            } else {
+                board.departures.push_back(call.departure);
+            }
+        }
+        if (i > 0) {
+            call.arrival.time = times[i].arrival % DAY_SECONDS;
+            if (keepSorted) {
+                insert(board.arrivals, call.arrival);
+            } else {
+                board.arrivals.push_back(call.arrival);
+            }
+        }
+        calls.push_back(call);
+    }
+    return trip;
+}
+
+void DepartureBoard::removeRoute(uint32_t trip) {
+    if (trip >= m_trips.size()) {
+        return;
+    }
+    for (const Call& call : m_trips[trip]) {
+        StationBoard& board = m_stations[call.station];
+        if (call.departure.time >= 0) {
+            erase(board.departures, call.departure);
+        }
+        if (call.arrival.time >= 0) {
+            erase(board.arrivals, call.arrival);
+        }
+    }
+    m_trips[trip].clear();
+    m_trips[trip].shrink_to_fit();
+}
+
+size_t DepartureBoard::getTripCount() const {
+    return m_trips.size();
+}
+
+std::vector<StationBoardEntry> DepartureBoard::getDepartures() const {
+    std::vector<StationBoardEntry> entries;
+    for (size_t station = 0; station < m_stations.size(); ++station) {
+        for (const auto& entry : m_stations[station].departures) {
+            entries.push_back({static_cast<StationId>(station), entry});
+        }
+    }
+    return entries;
+}
+
+std::vector<StationBoardEntry> DepartureBoard::getArrivals() const {
+    std::vector<StationBoardEntry> entries;
+    for (size_t station = 0; station < m_stations.size(); ++station) {
+        for (const auto& entry : m_stations[station].arrivals) {
+            entries.push_back({static_cast<StationId>(station), entry});
+        }
+    }
+    return entries;
+}
+
+void DepartureBoard::restore(const std::vector<Route>& routes, const StationBoardEntry* departures,
+                             size_t departureCount, const StationBoardEntry* arrivals, size_t arrivalCount) {
+    // The calls of each trip are laid out as addRoute makes them and then
+    // filled in from the station lists
+    m_trips.resize(routes.size());
+    for (uint32_t trip = 0; trip < routes.size(); ++trip) {
+        const std::vector<StationId>& stops = routes[trip].getStopIds();
+        if (stops.size() < 2) {
+            continue;
+        }
+        std::vector<Call>& calls = m_trips[trip];
+        calls.reserve(stops.size());
+        for (uint32_t i = 0; i < stops.size(); ++i) {
+            calls.push_back(Call{stops[i], BoardEntry{-1, trip, i}, BoardEntry{-1, trip, i}});
+        }
+    }
+
+    auto board = [this](StationId station) -> StationBoard& {
+        if (station >= m_stations.size()) {
+            m_stations.resize(station + 1);
+        }
+        return m_stations[station];
+    };
+    for (size_t i = 0; i < departureCount; ++i) {
+        const BoardEntry& entry = departures[i].entry;
+        board(departures[i].station).departures.push_back(entry);
+        m_trips[entry.trip][entry.stop].departure = entry;
+    }
+    for (size_t i = 0; i < arrivalCount; ++i) {
+        const BoardEntry& entry = arrivals[i].entry;
+        board(arrivals[i].station).arrivals.push_back(entry);
+        m_trips[entry.trip][entry.stop].arrival = entry;
+    }
+}
+
+std::vector<BoardEntry> DepartureBoard::nextDepartures(StationId station, int time, size_t count) const {
+    CJ_TIMED("board.next_departures");
+    if (station >= m_stations.size()) {
+        return {};
+    }
+    return next(m_stations[station].departures, time, count);
+}
+
+std::vector<BoardEntry> DepartureBoard::nextArrivals(StationId station, int time, size_t count) const {
+    CJ_TIMED("board.next_arrivals");
+    if (station >= m_stations.size()) {
+        return {};
+    }
+    return next(m_stations[station].arrivals, time, count);
+}
+
+void DepartureBoard::insert(std::vector<BoardEntry>& entries, const BoardEntry& entry) {
+    entries.insert(std::upper_bound(entries.begin(), entries.end(), entry, earlier), entry);
+}
+
+void DepartureBoard::erase(std::vector<BoardEntry>& entries, const BoardEntry& entry) {
+    auto it = std::lower_bound(entries.begin(), entries.end(), entry, earlier);
+    if (it != entries.end() && it->trip == entry.trip && it->stop == entry.stop) {
+        entries.erase(it);
+    }
+}
+
+std::vector<BoardEntry> DepartureBoard::next(const std::vector<BoardEntry>& entries, int time, size_t count) {
+    std::vector<BoardEntry> result;
+    count = std::min(count, entries.size());
+    result.reserve(count);
+
+    int timeOfDay = ((time % DAY_SECONDS) + DAY_SECONDS) % DAY_SECONDS;
+    int dayStart = time - timeOfDay;
+    auto it = std::lower_bound(entries.begin(), entries.end(), timeOfDay,
+                               [](const BoardEntry& entry, int t) { return entry.time < t; });
+    // Wraps to the start of the array for trains running the next day
+    while (result.size() < count) {
+        if (it == entries.end()) {
+            it = entries.begin();
+            dayStart += DAY_SECONDS;
+        }
+        result.push_back(BoardEntry{dayStart + it->time, it->trip, it->stop});
+        ++it;
+    }
+    return result;
+}
+
+} // namespace CJ
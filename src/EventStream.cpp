@@ -0,0 +1,358 @@
+#include "../include/EventStream.hpp"
+#include "../include/StationRegistry.hpp"
+#include "../include/Metrics.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+
+namespace CJ {
+
+namespace {
+
+// Readers and a blocked producer yield this many times before sleeping
+constexpr unsigned SPIN_LIMIT = 64;
+constexpr size_t SINK_BATCH = 1024;
+
+uint64_t packTime(const SimulationEvent& event) {
+    return static_cast<uint32_t>(event.time) | static_cast<uint64_t>(event.trip) << 32;
+}
+
+uint64_t packStop(const SimulationEvent& event) {
+    return event.stop | static_cast<uint64_t>(event.type) << 32;
+}
+
+SimulationEvent unpack(uint64_t time, uint64_t stop) {
+    return SimulationEvent{static_cast<int>(static_cast<uint32_t>(time)), static_cast<uint32_t>(time >> 32),
+                           static_cast<uint32_t>(stop), static_cast<SimulationEventType>(stop >> 32)};
+}
+
+// "HH:MM:SS", wrapping past midnight
+void appendClock(std::string& out, int seconds) {
+    int hour = seconds / 3600 % 24;
+    int minute = seconds / 60 % 60;
+    int second = seconds % 60;
+    char text[9] = {static_cast<char>('0' + hour / 10), static_cast<char>('0' + hour % 10), ':',
+                    static_cast<char>('0' + minute / 10), static_cast<char>('0' + minute % 10), ':',
+                    static_cast<char>('0' + second / 10), static_cast<char>('0' + second % 10), 0};
+    out.append(text, 8);
+}
+
+} // namespace
+
+EventRing::EventRing(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    m_slots = std::vector<Slot>(size);
+    m_mask = size - 1;
+}
+
+size_t EventRing::addReader(OverflowPolicy policy) {
+    m_readers.push_back(std::make_unique<Reader>());
+    m_readers.back()->policy = policy;
+    return m_readers.size() - 1;
+}
+
+void EventRing::publish(const SimulationEvent& event) {
+    uint64_t sequence = m_head.load(std::memory_order_relaxed);
+    if (sequence - m_gate > m_mask) {
+        waitForReaders(sequence);
+    }
+
+    // Seqlock write: a reader that sees either word of the new event also sees
+    // the zeroed sequence, so it cannot mistake a half-written slot for the old one
+    Slot& slot = m_slots[sequence & m_mask];
+    slot.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.words[0].store(packTime(event), std::memory_order_relaxed);
+    slot.words[1].store(packStop(event), std::memory_order_relaxed);
+    slot.sequence.store(sequence + 1, std::memory_order_release);
+    m_head.store(sequence + 1, std::memory_order_release);
+
+    if (m_sleepers.load(std::memory_order_relaxed) != 0) {
+        wakeReaders();
+    }
+}
+
+void EventRing::waitForReaders(uint64_t sequence) {
+    bool counted = false;
+    for (unsigned spin = 0;; ++spin) {
+        uint64_t lowest = sequence;
+        for (const auto& reader : m_readers) {
+            if (reader->policy == OverflowPolicy::Block) {
+                lowest = std::min(lowest, reader->cursor.load(std::memory_order_acquire));
+            }
+        }
+        m_gate = lowest;
+        if (sequence - lowest <= m_mask) {
+            return;
+        }
+        if (!counted) {
+            ++m_producerWaits;
+            counted = true;
+        }
+        // A reader asleep on a missed wake-up would otherwise hold us for its timeout
+        if (m_sleepers.load(std::memory_order_relaxed) != 0) {
+            wakeReaders();
+        }
+        if (spin < SPIN_LIMIT) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+}
+
+void EventRing::wakeReaders() {
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_sleepers.store(0, std::memory_order_relaxed);
+    }
+    m_wake.notify_all();
+}
+
+void EventRing::close() {
+    m_closed.store(true, std::memory_order_release);
+    wakeReaders();
+}
+
+void EventRing::reset() {
+    for (auto& slot : m_slots) {
+        slot.sequence.store(0, std::memory_order_relaxed);
+    }
+    for (auto& reader : m_readers) {
+        reader->cursor.store(0, std::memory_order_relaxed);
+    }
+    m_head.store(0, std::memory_order_relaxed);
+    m_gate = 0;
+    m_producerWaits = 0;
+    m_sleepers.store(0, std::memory_order_relaxed);
+    m_closed.store(false, std::memory_order_release);
+}
+
+size_t EventRing::read(size_t index, SimulationEvent* events, size_t max, uint64_t& dropped) {
+    Reader& reader = *m_readers[index];
+    uint64_t cursor = reader.cursor.load(std::memory_order_relaxed);
+    uint64_t capacity = getCapacity();
+
+    for (unsigned idle = 0;;) {
+        uint64_t head = m_head.load(std::memory_order_acquire);
+        if (head == cursor) {
+            if (m_closed.load(std::memory_order_acquire) && m_head.load(std::memory_order_acquire) == cursor) {
+                return 0;
+            }
+            if (++idle < SPIN_LIMIT) {
+                std::this_thread::yield();
+            } else {
+                // The timeout covers a wake-up the producer missed
+                std::unique_lock<std::mutex> lock(m_sleepMutex);
+                m_sleepers.fetch_add(1, std::memory_order_relaxed);
+                if (m_head.load(std::memory_order_acquire) == cursor && !m_closed.load(std::memory_order_acquire)) {
+                    m_wake.wait_for(lock, std::chrono::milliseconds(1));
+                }
+            }
+            continue;
+        }
+
+        // Only Drop readers fall a lap behind
+        if (head - cursor > capacity) {
+            dropped += head - capacity - cursor;
+            cursor = head - capacity;
+        }
+
+        size_t count = static_cast<size_t>(std::min<uint64_t>(max, head - cursor));
+        size_t copied = 0;
+        while (copied < count) {
+            const Slot& slot = m_slots[(cursor + copied) & m_mask];
+            uint64_t expected = cursor + copied + 1;
+            if (slot.sequence.load(std::memory_order_acquire) != expected) {
+                break;
+            }
+            uint64_t time = slot.words[0].load(std::memory_order_relaxed);
+            uint64_t stop = slot.words[1].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.sequence.load(std::memory_order_relaxed) != expected) {
+                break;
+            }
+            events[copied++] = unpack(time, stop);
+        }
+        if (copied == 0) {
+            // Lapped between loading the head and copying: look again
+            continue;
+        }
+        reader.cursor.store(cursor + copied, std::memory_order_release);
+        return copied;
+    }
+}
+
+NdjsonEventSink::NdjsonEventSink(const std::string& path) : m_path(path) {
+}
+
+bool NdjsonEventSink::open() {
+    return m_writer.open(m_path);
+}
+
+void NdjsonEventSink::write(const Simulation& simulation, const SimulationEvent* events, size_t count) {
+    const StationRegistry& registry = StationRegistry::global();
+    std::string clock;
+    for (size_t i = 0; i < count; ++i) {
+        const SimulationEvent& event = events[i];
+        clock.clear();
+        appendClock(clock, event.time);
+        m_writer.write("{\"time\":\"");
+        m_writer.write(clock);
+        m_writer.write("\",\"seconds\":");
+        m_writer.writeInt(event.time);
+        m_writer.write(",\"event\":\"");
+        m_writer.write(Simulation::eventTypeName(event.type));
+        m_writer.write("\",\"route\":");
+        m_writer.writeInt(event.trip + 1);
+        m_writer.write(",\"stop\":");
+        m_writer.writeInt(event.stop);
+        m_writer.write(",\"station\":");
+        Exporter::writeJsonString(m_writer, registry.getName(simulation.getStation(event.trip, event.stop)));
+        m_writer.write(",\"train\":");
+        int train = simulation.getTrainId(event.trip);
+        if (train) {
+            m_writer.writeInt(train);
+        } else {
+            m_writer.write("null");
+        }
+        m_writer.write("}\n");
+    }
+}
+
+bool NdjsonEventSink::finish() {
+    return m_writer.close();
+}
+
+void ConsoleEventSink::write(const Simulation& simulation, const SimulationEvent* events, size_t count) {
+    const StationRegistry& registry = StationRegistry::global();
+    for (size_t i = 0; i < count; ++i) {
+        const SimulationEvent& event = events[i];
+        m_line.clear();
+        appendClock(m_line, event.time);
+        m_line += "  ";
+        m_line += Simulation::eventTypeName(event.type);
+        m_line.append(m_line.size() < 21 ? 21 - m_line.size() : 1, ' ');
+        m_line += "route ";
+        m_line += std::to_string(event.trip + 1);
+        int train = simulation.getTrainId(event.trip);
+        if (train) {
+            m_line += " (train ";
+            m_line += std::to_string(train);
+            m_line += ')';
+        }
+        m_line += event.type == SimulationEventType::Departure || event.type == SimulationEventType::Dwell
+                      ? " leaves " : " reaches ";
+        m_line += registry.getName(simulation.getStation(event.trip, event.stop));
+        m_line += '\n';
+        std::fwrite(m_line.data(), 1, m_line.size(), stdout);
+    }
+    std::fflush(stdout);
+}
+
+CallbackEventSink::CallbackEventSink(std::string name, Callback callback)
+    : m_name(std::move(name)), m_callback(std::move(callback)) {
+}
+
+void CallbackEventSink::write(const Simulation& simulation, const SimulationEvent* events, size_t count) {
+    m_callback(simulation, events, count);
+}
+
+EventStream::EventStream(size_t capacity) : m_ring(capacity) {
+}
+
+EventStream::~EventStream() {
+    finish();
+}
+
+void EventStream::addSink(std::unique_ptr<EventSink> sink, OverflowPolicy policy) {
+    if (m_running) {
+        throw std::runtime_error("event sinks must be added before the stream starts");
+    }
+    auto state = std::make_unique<SinkState>();
+    state->stats.name = sink->getName();
+    state->stats.policy = policy;
+    state->sink = std::move(sink);
+    state->reader = m_ring.addReader(policy);
+    m_sinks.push_back(std::move(state));
+}
+
+void EventStream::start(const Simulation& simulation) {
+    finish();
+    m_ring.reset();
+    for (auto& state : m_sinks) {
+        state->stats.delivered = 0;
+        state->stats.dropped = 0;
+        state->stats.error.clear();
+        state->thread = std::thread(&EventStream::drain, this, std::ref(*state), std::cref(simulation));
+    }
+    m_running = true;
+}
+
+void EventStream::finish() {
+    if (!m_running) {
+        return;
+    }
+    m_ring.close();
+    for (auto& state : m_sinks) {
+        state->thread.join();
+    }
+    m_running = false;
+}
+
+void EventStream::drain(SinkState& state, const Simulation& simulation) {
+    std::vector<SimulationEvent> batch(SINK_BATCH);
+    EventSinkStats& stats = state.stats;
+    while (size_t count = m_ring.read(state.reader, batch.data(), batch.size(), stats.dropped)) {
+        // A failed sink keeps reading, so a Block reader never stalls the producer
+        if (!stats.error.empty()) {
+            continue;
+        }
+        try {
+            state.sink->write(simulation, batch.data(), count);
+            stats.delivered += count;
+        } catch (const std::exception& e) {
+            stats.error = e.what();
+        }
+    }
+
+    try {
+        if (!state.sink->finish() && stats.error.empty()) {
+            stats.error = "failed to write " + stats.name;
+        }
+    } catch (const std::exception& e) {
+        if (stats.error.empty()) {
+            stats.error = e.what();
+        }
+    }
+    CJ_COUNT("simulation.events_dropped", stats.dropped);
+}
+
+std::vector<EventSinkStats> EventStream::getStats() const {
+    std::vector<EventSinkStats> stats;
+    for (const auto& state : m_sinks) {
+        stats.push_back(state->stats);
+    }
+    return stats;
+}
+
+bool EventStream::parsePolicy(const std::string& text, OverflowPolicy& policy) {
+    if (text == "block") {
+        policy = OverflowPolicy::Block;
+    } else if (text == "drop") {
+        policy = OverflowPolicy::Drop;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* EventStream::policyName(OverflowPolicy policy) {
+    return policy == OverflowPolicy::Block ? "block" : "drop";
+}
+
+} // namespace CJ
@@ -0,0 +1,470 @@
+#include "../include/Exporter.hpp"
+#include "../include/Management.hpp"
+#include "../include/TaskScheduler.hpp"
+#include "../include/Metrics.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <ostream>
+
+namespace CJ {
+
+namespace {
+
+const char* const TABLE_NAMES[] = {"trains", "stations", "routes", "assignments"};
+constexpr unsigned TABLE_COUNT = 4;
+
+const char* const CSV_HEADERS[] = {
+    "id,name,speed,capacity,wagon_count\n",
+    "station_id,name,platform_count\n",
+    "route_id,origin,destination,departure,arrival,duration,stops\n",
+    "train_id,route_id\n"
+};
+
+void writeClock(BufferedWriter& out, int hour, int minute) {
+    char text[5] = {static_cast<char>('0' + hour / 10 % 10), static_cast<char>('0' + hour % 10), ':',
+                    static_cast<char>('0' + minute / 10 % 10), static_cast<char>('0' + minute % 10)};
+    out.write(std::string_view(text, sizeof(text)));
+}
+
+} // namespace
+
+BufferedWriter::BufferedWriter(size_t bufferBytes) : m_buffer(std::max<size_t>(bufferBytes, 64)) {
+}
+
+BufferedWriter::~BufferedWriter() {
+    close();
+}
+
+bool BufferedWriter::open(const std::string& path) {
+    close();
+    m_file = std::fopen(path.c_str(), "wb");
+    m_used = 0;
+    m_bytesWritten = 0;
+    m_failed = m_file == nullptr;
+    return m_file != nullptr;
+}
+
+bool BufferedWriter::close() {
+    if (!m_file) {
+        return !m_failed;
+    }
+    flushBuffer();
+    if (std::fclose(m_file) != 0) {
+        m_failed = true;
+    }
+    m_file = nullptr;
+    return !m_failed;
+}
+
+void BufferedWriter::flushBuffer() {
+    if (m_used > 0 && m_file && std::fwrite(m_buffer.data(), 1, m_used, m_file) != m_used) {
+        m_failed = true;
+    }
+    m_used = 0;
+}
+
+void BufferedWriter::write(std::string_view text) {
+    m_bytesWritten += text.size();
+    if (text.size() > m_buffer.size() - m_used) {
+        flushBuffer();
+        // Larger than the whole buffer: hand it to the file directly
+        if (text.size() > m_buffer.size()) {
+            if (m_file && std::fwrite(text.data(), 1, text.size(), m_file) != text.size()) {
+                m_failed = true;
+            }
+            return;
+        }
+    }
+    std::memcpy(m_buffer.data() + m_used, text.data(), text.size());
+    m_used += text.size();
+}
+
+void BufferedWriter::put(char c) {
+    if (m_used == m_buffer.size()) {
+        flushBuffer();
+    }
+    m_buffer[m_used++] = c;
+    ++m_bytesWritten;
+}
+
+void BufferedWriter::writeInt(long long value) {
+    char digits[24];
+    size_t length = 0;
+    unsigned long long magnitude = value < 0 ? 0ull - static_cast<unsigned long long>(value)
+                                             : static_cast<unsigned long long>(value);
+    do {
+        digits[sizeof(digits) - 1 - length++] = static_cast<char>('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+    if (value < 0) {
+        digits[sizeof(digits) - 1 - length++] = '-';
+    }
+    write(std::string_view(digits + sizeof(digits) - length, length));
+}
+
+Exporter::Exporter(const ExportOptions& options) : m_options(options) {
+    m_options.pageRows = std::max<size_t>(m_options.pageRows, 1);
+    m_options.chunks = std::max(m_options.chunks, 1u);
+}
+
+bool Exporter::parseFormat(const std::string& name, ExportFormat& format) {
+    if (name == "csv") {
+        format = ExportFormat::Csv;
+    } else if (name == "ndjson" || name == "jsonl") {
+        format = ExportFormat::Ndjson;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void Exporter::writeCsvField(BufferedWriter& out, std::string_view text) {
+    if (text.find_first_of(",\"\r\n") == std::string_view::npos) {
+        out.write(text);
+        return;
+    }
+    out.put('"');
+    for (char c : text) {
+        if (c == '"') {
+            out.put('"');
+        }
+        out.put(c);
+    }
+    out.put('"');
+}
+
+void Exporter::writeJsonString(BufferedWriter& out, std::string_view text) {
+    static const char HEX[] = "0123456789abcdef";
+    out.put('"');
+    size_t plain = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        out.write(text.substr(plain, i - plain));
+        plain = i + 1;
+        out.put('\\');
+        switch (c) {
+            case '"': out.put('"'); break;
+            case '\\': out.put('\\'); break;
+            case '\n': out.put('n'); break;
+            case '\r': out.put('r'); break;
+            case '\t': out.put('t'); break;
+            default:
+                out.write("u00");
+                out.put(HEX[c >> 4]);
+                out.put(HEX[c & 15]);
+        }
+    }
+    out.write(text.substr(plain));
+    out.put('"');
+}
+
+std::string Exporter::fileName(ExportTable table, unsigned chunk) const {
+    std::string name = TABLE_NAMES[static_cast<size_t>(table)];
+    if (m_options.chunks > 1) {
+        char suffix[16];
+        std::snprintf(suffix, sizeof(suffix), "-%03u", chunk);
+        name += suffix;
+    }
+    name += m_options.format == ExportFormat::Csv ? ".csv" : ".ndjson";
+    return (std::filesystem::path(m_options.directory) / name).string();
+}
+
+bool Exporter::run(ExportReport& report) {
+    CJ_TIMED("export.run");
+    auto started = std::chrono::steady_clock::now();
+    report = ExportReport{};
+    m_error.clear();
+
+    std::string databasePath = m_options.databasePath;
+    if (databasePath.empty()) {
+        // Queued write-behind changes belong in the dump
+        Management::flush();
+        databasePath = Management::getDatabasePath();
+    }
+    if (databasePath.empty() || databasePath == DatabaseManager::IN_MEMORY) {
+        m_error = "the export needs a database file";
+        return false;
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(m_options.directory, ec);
+    if (ec) {
+        m_error = "cannot create " + m_options.directory + ": " + ec.message();
+        return false;
+    }
+
+    // Key ranges are fixed up front, so rows added during the export are
+    // either in a chunk's range or left out, never written twice
+    int firstKeys[TABLE_COUNT];
+    int lastKeys[TABLE_COUNT];
+    {
+        DatabaseManager database;
+        if (!database.connect(databasePath)) {
+            m_error = "cannot open " + databasePath;
+            return false;
+        }
+        for (unsigned table = 0; table < TABLE_COUNT; ++table) {
+            if (!database.getExportKeyRange(static_cast<ExportTable>(table), firstKeys[table], lastKeys[table])) {
+                m_error = std::string("cannot read the key range of ") + TABLE_NAMES[table];
+                return false;
+            }
+        }
+    }
+
+    // Task t is chunk t / TABLE_COUNT of table t % TABLE_COUNT, so the large
+    // route chunks are spread over the workers
+    size_t tasks = static_cast<size_t>(m_options.chunks) * TABLE_COUNT;
+    std::vector<ChunkResult> results(tasks);
+    size_t workers = std::min<size_t>(tasks, TaskScheduler::global().getThreadCount());
+    TaskScheduler::global().parallelFor(0, tasks, 0, [&](size_t firstTask, size_t lastTask) {
+        // One connection per worker task rather than per chunk
+        DatabaseManager database;
+        if (!database.connect(databasePath)) {
+            for (size_t task = firstTask; task < lastTask; ++task) {
+                results[task].error = "cannot open " + databasePath;
+            }
+            return;
+        }
+        for (size_t task = firstTask; task < lastTask; ++task) {
+            unsigned table = static_cast<unsigned>(task % TABLE_COUNT);
+            unsigned chunk = static_cast<unsigned>(task / TABLE_COUNT);
+            int64_t first = firstKeys[table];
+            int64_t span = std::max<int64_t>(0, static_cast<int64_t>(lastKeys[table]) - first + 1);
+            int64_t low = first + span * chunk / m_options.chunks;
+            int64_t high = first + span * (chunk + 1) / m_options.chunks - 1;
+            exportChunk(database, static_cast<ExportTable>(table), chunk, static_cast<int>(low),
+                        static_cast<int>(high), results[task]);
+        }
+    }, workers);
+
+    uint64_t* rows[TABLE_COUNT] = {&report.trains, &report.stations, &report.routes, &report.assignments};
+    for (size_t task = 0; task < tasks; ++task) {
+        if (!results[task].error.empty() && m_error.empty()) {
+            m_error = results[task].error;
+        }
+        *rows[task % TABLE_COUNT] += results[task].rows;
+        report.bytesWritten += results[task].bytesWritten;
+    }
+    report.files = tasks;
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    return m_error.empty();
+}
+
+void Exporter::exportChunk(DatabaseManager& database, ExportTable table, unsigned chunk, int first, int last,
+                           ChunkResult& result) const {
+    std::string path = fileName(table, chunk);
+    BufferedWriter out;
+    if (!out.open(path)) {
+        result.error = "cannot write " + path;
+        return;
+    }
+    if (m_options.format == ExportFormat::Csv) {
+        out.write(CSV_HEADERS[static_cast<size_t>(table)]);
+    }
+
+    // Keyset paging starts just below the first key of the range
+    int after = first - 1;
+    bool read = true;
+    switch (table) {
+        case ExportTable::Trains: read = writeTrains(database, out, after, last, result.rows); break;
+        case ExportTable::Stations: read = writeStations(database, out, after, last, result.rows); break;
+        case ExportTable::Routes: read = writeRoutes(database, out, after, last, result.rows); break;
+        case ExportTable::Assignments: read = writeAssignments(database, out, after, last, result.rows); break;
+    }
+    result.bytesWritten = out.getBytesWritten();
+    if (!out.close()) {
+        result.error = "cannot write " + path;
+    } else if (!read) {
+        result.error = std::string("cannot read ") + TABLE_NAMES[static_cast<size_t>(table)];
+    }
+}
+
+bool Exporter::writeTrains(DatabaseManager& database, BufferedWriter& out, int after, int last,
+                           uint64_t& rows) const {
+    bool csv = m_options.format == ExportFormat::Csv;
+    std::vector<Train> page;
+    do {
+        if (!database.readTrainPage(after, last, m_options.pageRows, page)) {
+            return false;
+        }
+        for (const auto& train : page) {
+            if (csv) {
+                out.writeInt(train.getId());
+                out.put(',');
+                writeCsvField(out, train.getTrainName());
+                out.put(',');
+                out.writeInt(train.getSpeed());
+                out.put(',');
+                out.writeInt(train.getCapacity());
+                out.put(',');
+                out.writeInt(train.getWagonCount());
+            } else {
+                out.write("{\"id\":");
+                out.writeInt(train.getId());
+                out.write(",\"name\":");
+                writeJsonString(out, train.getTrainName());
+                out.write(",\"speed\":");
+                out.writeInt(train.getSpeed());
+                out.write(",\"capacity\":");
+                out.writeInt(train.getCapacity());
+                out.write(",\"wagon_count\":");
+                out.writeInt(train.getWagonCount());
+                out.put('}');
+            }
+            out.put('\n');
+        }
+        rows += page.size();
+        if (!page.empty()) {
+            after = page.back().getId();
+        }
+    } while (page.size() == m_options.pageRows);
+    return true;
+}
+
+bool Exporter::writeStations(DatabaseManager& database, BufferedWriter& out, int after, int last,
+                             uint64_t& rows) const {
+    bool csv = m_options.format == ExportFormat::Csv;
+    std::vector<ExportStation> page;
+    do {
+        if (!database.readStationPage(after, last, m_options.pageRows, page)) {
+            return false;
+        }
+        for (const auto& station : page) {
+            if (csv) {
+                out.writeInt(station.id);
+                out.put(',');
+                writeCsvField(out, station.name);
+                out.put(',');
+                out.writeInt(station.platformCount);
+            } else {
+                out.write("{\"station_id\":");
+                out.writeInt(station.id);
+                out.write(",\"name\":");
+                writeJsonString(out, station.name);
+                out.write(",\"platform_count\":");
+                out.writeInt(station.platformCount);
+                out.put('}');
+            }
+            out.put('\n');
+        }
+        rows += page.size();
+        if (!page.empty()) {
+            after = page.back().id;
+        }
+    } while (page.size() == m_options.pageRows);
+    return true;
+}
+
+bool Exporter::writeRoutes(DatabaseManager& database, BufferedWriter& out, int after, int last,
+                           uint64_t& rows) const {
+    bool csv = m_options.format == ExportFormat::Csv;
+    std::vector<ExportRoute> page;
+    std::string stops;
+    do {
+        if (!database.readRoutePage(after, last, m_options.pageRows, page)) {
+            return false;
+        }
+        for (const auto& route : page) {
+            std::string_view origin = route.stops.empty() ? std::string_view() : route.stops.front();
+            std::string_view destination = route.stops.empty() ? std::string_view() : route.stops.back();
+            if (csv) {
+                out.writeInt(route.id);
+                out.put(',');
+                writeCsvField(out, origin);
+                out.put(',');
+                writeCsvField(out, destination);
+                out.put(',');
+                writeClock(out, route.depHour, route.depMinute);
+                out.put(',');
+                writeClock(out, route.arrHour, route.arrMinute);
+                out.put(',');
+                out.writeInt(route.duration);
+                out.put(',');
+                // All stops in one field, separated by '|'
+                stops.clear();
+                for (const auto& stop : route.stops) {
+                    if (!stops.empty()) {
+                        stops += '|';
+                    }
+                    stops += stop;
+                }
+                writeCsvField(out, stops);
+            } else {
+                out.write("{\"route_id\":");
+                out.writeInt(route.id);
+                out.write(",\"origin\":");
+                writeJsonString(out, origin);
+                out.write(",\"destination\":");
+                writeJsonString(out, destination);
+                out.write(",\"departure\":\"");
+                writeClock(out, route.depHour, route.depMinute);
+                out.write("\",\"arrival\":\"");
+                writeClock(out, route.arrHour, route.arrMinute);
+                out.write("\",\"duration\":");
+                out.writeInt(route.duration);
+                out.write(",\"stops\":[");
+                for (size_t i = 0; i < route.stops.size(); ++i) {
+                    if (i > 0) {
+                        out.put(',');
+                    }
+                    writeJsonString(out, route.stops[i]);
+                }
+                out.write("]}");
+            }
+            out.put('\n');
+        }
+        rows += page.size();
+        if (!page.empty()) {
+            after = page.back().id;
+        }
+    } while (page.size() == m_options.pageRows);
+    return true;
+}
+
+bool Exporter::writeAssignments(DatabaseManager& database, BufferedWriter& out, int after, int last,
+                                uint64_t& rows) const {
+    bool csv = m_options.format == ExportFormat::Csv;
+    std::vector<std::pair<int, int>> page;
+    // Past every assignment of train `after`, which belongs to the chunk before
+    std::pair<int, int> key(after, INT32_MAX);
+    do {
+        if (!database.readAssignmentPage(key, last, m_options.pageRows, page)) {
+            return false;
+        }
+        for (const auto& [trainId, routeId] : page) {
+            if (csv) {
+                out.writeInt(trainId);
+                out.put(',');
+                out.writeInt(routeId);
+            } else {
+                out.write("{\"train_id\":");
+                out.writeInt(trainId);
+                out.write(",\"route_id\":");
+                out.writeInt(routeId);
+                out.put('}');
+            }
+            out.put('\n');
+        }
+        rows += page.size();
+        if (!page.empty()) {
+            key = page.back();
+        }
+    } while (page.size() == m_options.pageRows);
+    return true;
+}
+
+void Exporter::printReport(std::ostream& out, const ExportReport& report) {
+    out << "Exported " << report.trains << " trains, " << report.stations << " stations, " << report.routes
+        << " routes and " << report.assignments << " assignments to " << report.files << " files ("
+        << std::fixed << std::setprecision(1) << report.bytesWritten / (1024.0 * 1024.0) << " MB) in "
+        << std::setprecision(2) << report.seconds << " s" << std::defaultfloat << std::endl;
+}
+
+} // namespace CJ
@@ -0,0 +1,566 @@
+#include "../include/GtfsImporter.hpp"
+#include "../include/Management.hpp"
+#include "../include/TaskScheduler.hpp"
+#include "../include/Metrics.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <ostream>
+
+namespace CJ {
+
+namespace {
+
+std::string_view trim(std::string_view text) {
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) {
+        text.remove_prefix(1);
+    }
+    while (!text.empty() && (text.back() == ' ' || text.back() == '\t' || text.back() == '\r')) {
+        text.remove_suffix(1);
+    }
+    return text;
+}
+
+std::string_view field(const std::vector<std::string_view>& fields, int column) {
+    return column >= 0 && static_cast<size_t>(column) < fields.size() ? trim(fields[column]) : std::string_view();
+}
+
+// "H:MM:SS" as seconds; hours may pass 24 for trips running after midnight.
+// -1 if empty or malformed.
+int32_t parseGtfsTime(std::string_view text) {
+    int32_t parts[3] = {0, 0, 0};
+    int part = 0;
+    bool digits = false;
+    for (char c : text) {
+        if (c >= '0' && c <= '9') {
+            parts[part] = parts[part] * 10 + (c - '0');
+            digits = true;
+        } else if (c == ':' && digits && part < 2) {
+            ++part;
+            digits = false;
+        } else {
+            return -1;
+        }
+    }
+    if (part != 2 || !digits || parts[1] > 59 || parts[2] > 59) {
+        return -1;
+    }
+    return parts[0] * 3600 + parts[1] * 60 + parts[2];
+}
+
+uint32_t parseIndex(std::string_view text) {
+    uint32_t value = 0;
+    for (char c : text) {
+        if (c < '0' || c > '9') {
+            return UINT32_MAX;
+        }
+        value = value * 10 + static_cast<uint32_t>(c - '0');
+    }
+    return text.empty() ? UINT32_MAX : value;
+}
+
+} // namespace
+
+CsvChunkReader::CsvChunkReader(size_t chunkBytes) : m_chunkBytes(std::max<size_t>(chunkBytes, 4096)) {}
+
+bool CsvChunkReader::open(const std::string& path) {
+    m_file.open(path, std::ios::binary);
+    if (!m_file) {
+        return false;
+    }
+    std::string line;
+    if (!std::getline(m_file, line)) {
+        return false;
+    }
+    m_bytesRead = line.size() + 1;
+    if (line.compare(0, 3, "\xEF\xBB\xBF") == 0) {
+        line.erase(0, 3);
+    }
+    std::vector<std::string_view> fields;
+    std::string scratch;
+    splitLine(line, fields, scratch);
+    for (std::string_view name : fields) {
+        m_header.emplace_back(trim(name));
+    }
+    return true;
+}
+
+int CsvChunkReader::column(const std::string& name) const {
+    auto found = std::find(m_header.begin(), m_header.end(), name);
+    return found == m_header.end() ? -1 : static_cast<int>(found - m_header.begin());
+}
+
+bool CsvChunkReader::nextChunk(std::vector<std::string_view>& lines) {
+    lines.clear();
+    while (true) {
+        if (m_carryStart) {
+            std::memmove(m_buffer.data(), m_buffer.data() + m_carryStart, m_carry);
+            m_carryStart = 0;
+        }
+        if (m_buffer.size() < m_carry + m_chunkBytes) {
+            m_buffer.resize(m_carry + m_chunkBytes);
+        }
+        size_t got = 0;
+        if (m_file) {
+            m_file.read(m_buffer.data() + m_carry, static_cast<std::streamsize>(m_chunkBytes));
+            got = static_cast<size_t>(m_file.gcount());
+        }
+        m_bytesRead += got;
+        size_t size = m_carry + got;
+        if (size == 0) {
+            return false;
+        }
+
+        size_t end = size;
+        if (m_file) {
+            const char* data = m_buffer.data();
+            const char* last = nullptr;
+            for (size_t i = size; i > m_carry; --i) {
+                if (data[i - 1] == '\n') {
+                    last = data + i - 1;
+                    break;
+                }
+            }
+            if (!last) {
+                // One line longer than a chunk: keep it all and read more
+                m_carry = size;
+                continue;
+            }
+            end = static_cast<size_t>(last - data) + 1;
+        }
+
+        const char* data = m_buffer.data();
+        for (size_t start = 0; start < end;) {
+            const char* newline = static_cast<const char*>(std::memchr(data + start, '\n', end - start));
+            size_t stop = newline ? static_cast<size_t>(newline - data) : end;
+            std::string_view line(data + start, stop - start);
+            if (!line.empty() && line.back() == '\r') {
+                line.remove_suffix(1);
+            }
+            if (!line.empty()) {
+                lines.push_back(line);
+            }
+            start = stop + 1;
+        }
+        m_carryStart = end;
+        m_carry = size - end;
+        return true;
+    }
+}
+
+void CsvChunkReader::splitLine(std::string_view line, std::vector<std::string_view>& fields, std::string& scratch) {
+    fields.clear();
+    scratch.clear();
+    scratch.reserve(line.size());    // views into scratch must survive later appends
+    size_t i = 0;
+    while (true) {
+        if (i < line.size() && line[i] == '"') {
+            size_t j = i + 1;
+            bool escaped = false;
+            while (j < line.size()) {
+                if (line[j] == '"') {
+                    if (j + 1 < line.size() && line[j + 1] == '"') {
+                        escaped = true;
+                        j += 2;
+                        continue;
+                    }
+                    break;
+                }
+                ++j;
+            }
+            std::string_view raw = line.substr(i + 1, j - i - 1);
+            if (escaped) {
+                size_t start = scratch.size();
+                for (size_t k = 0; k < raw.size(); ++k) {
+                    scratch += raw[k];
+                    if (raw[k] == '"') {
+                        ++k;
+                    }
+                }
+                fields.emplace_back(scratch.data() + start, scratch.size() - start);
+            } else {
+                fields.push_back(raw);
+            }
+            size_t comma = j < line.size() ? line.find(',', j) : std::string_view::npos;
+            if (comma == std::string_view::npos) {
+                break;
+            }
+            i = comma + 1;
+            continue;
+        }
+        size_t comma = line.find(',', i);
+        if (comma == std::string_view::npos) {
+            fields.push_back(line.substr(i));
+            break;
+        }
+        fields.push_back(line.substr(i, comma - i));
+        i = comma + 1;
+    }
+}
+
+GtfsImporter::GtfsImporter(const GtfsImportOptions& options) : m_options(options) {}
+
+bool GtfsImporter::fail(const std::string& message) {
+    m_error = message;
+    return false;
+}
+
+std::string GtfsImporter::path(const char* file) const {
+    return (std::filesystem::path(m_options.directory) / file).string();
+}
+
+std::string_view GtfsImporter::keep(std::string_view id) {
+    m_ids.emplace_back(id);
+    return m_ids.back();
+}
+
+bool GtfsImporter::run(GtfsImportReport& report) {
+    CJ_TIMED("gtfs.import");
+    auto started = std::chrono::steady_clock::now();
+    report = GtfsImportReport();
+
+    if (!readStops() || !readRoutes() || !readTrips()) {
+        return false;
+    }
+    report.trips = m_tripRoute.size();
+
+    // Stations and trains first, so routes can refer to them
+    if (!importBatch(m_trains, m_stations, {}, report)) {
+        return false;
+    }
+    m_stations.clear();
+    m_stations.shrink_to_fit();
+
+    bool imported = readStopTimes(report) && flushRoutes(report);
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    return imported;
+}
+
+void GtfsImporter::printReport(std::ostream& out, const GtfsImportReport& report) {
+    out << "Imported " << report.stationsImported << " stations, " << report.trainsImported << " trains and "
+        << report.routesImported << " routes from " << report.trips << " trips ("
+        << report.stopTimeRows << " stop times, " << report.bytesRead / (1024 * 1024) << " MB) in "
+        << report.seconds << " s\n";
+    if (report.skippedTrips || report.duplicateTrips || report.splitTrips || report.unknownReferences ||
+        report.failures) {
+        out << "Skipped: " << report.skippedTrips << " unusable trips, " << report.duplicateTrips
+            << " duplicate trips, " << report.splitTrips << " trips with scattered rows, "
+            << report.unknownReferences << " rows with unknown IDs, " << report.failures
+            << " rows rejected by the database\n";
+        if (!report.firstFailure.empty()) {
+            out << "First rejected row: " << report.firstFailure << "\n";
+        }
+    }
+}
+
+bool GtfsImporter::readStops() {
+    CsvChunkReader reader(m_options.chunkBytes);
+    if (!reader.open(path("stops.txt"))) {
+        return fail("cannot read " + path("stops.txt"));
+    }
+    int idColumn = reader.column("stop_id");
+    int nameColumn = reader.column("stop_name");
+    int parentColumn = reader.column("parent_station");
+    int typeColumn = reader.column("location_type");
+    if (idColumn < 0 || nameColumn < 0) {
+        return fail("stops.txt needs stop_id and stop_name columns");
+    }
+
+    struct StopRow {
+        std::string name;
+        std::string_view parent;
+        bool boarding;
+    };
+    std::vector<StopRow> stops;
+    std::vector<std::string_view> lines, fields;
+    std::string scratch;
+    while (reader.nextChunk(lines)) {
+        for (std::string_view line : lines) {
+            CsvChunkReader::splitLine(line, fields, scratch);
+            std::string_view id = field(fields, idColumn);
+            std::string_view name = field(fields, nameColumn);
+            if (id.empty() || m_stopIndex.count(id)) {
+                continue;
+            }
+            std::string_view type = field(fields, typeColumn);
+            std::string_view parent = field(fields, parentColumn);
+            m_stopIndex.emplace(keep(id), static_cast<uint32_t>(stops.size()));
+            stops.push_back({std::string(name.empty() ? id : name), parent.empty() ? parent : keep(parent),
+                             type.empty() || type == "0"});
+        }
+    }
+
+    // A stop with a parent station belongs to it; every boarding point is a platform
+    StationRegistry& registry = StationRegistry::global();
+    std::unordered_map<StationId, size_t> stationSlot;
+    std::vector<int> platforms;
+    m_stopStation.resize(stops.size());
+    m_stopStationId.resize(stops.size());
+    for (size_t i = 0; i < stops.size(); ++i) {
+        auto parent = stops[i].parent.empty() ? m_stopIndex.end() : m_stopIndex.find(stops[i].parent);
+        const std::string& name = parent != m_stopIndex.end() ? stops[parent->second].name : stops[i].name;
+        StationId id = registry.intern(name);
+        m_stopStation[i] = name;
+        m_stopStationId[i] = id;
+        auto slot = stationSlot.emplace(id, platforms.size());
+        if (slot.second) {
+            platforms.push_back(0);
+        }
+        if (stops[i].boarding) {
+            ++platforms[slot.first->second];
+        }
+    }
+    std::vector<std::pair<size_t, StationId>> order;
+    order.reserve(stationSlot.size());
+    for (const auto& entry : stationSlot) {
+        order.emplace_back(entry.second, entry.first);
+    }
+    std::sort(order.begin(), order.end());
+    for (const auto& [slot, id] : order) {
+        const std::string& name = registry.getName(id);
+        if (!Management::findStation(name)) {
+            m_stations.emplace_back(nullptr, std::max(1, platforms[slot]), std::vector<std::shared_ptr<Route>>{},
+                                    nullptr, nullptr, name);
+        }
+    }
+    return true;
+}
+
+bool GtfsImporter::readRoutes() {
+    CsvChunkReader reader(m_options.chunkBytes);
+    if (!reader.open(path("routes.txt"))) {
+        return fail("cannot read " + path("routes.txt"));
+    }
+    int idColumn = reader.column("route_id");
+    int shortColumn = reader.column("route_short_name");
+    int longColumn = reader.column("route_long_name");
+    int typeColumn = reader.column("route_type");
+    if (idColumn < 0) {
+        return fail("routes.txt needs a route_id column");
+    }
+
+    int nextId = m_options.firstTrainId;
+    if (nextId <= 0) {
+        nextId = 1;
+        for (const Train& train : Management::snapshot()->getTrains()) {
+            nextId = std::max(nextId, train.getId() + 1);
+        }
+    }
+
+    std::vector<std::string_view> lines, fields;
+    std::string scratch;
+    while (reader.nextChunk(lines)) {
+        for (std::string_view line : lines) {
+            CsvChunkReader::splitLine(line, fields, scratch);
+            std::string_view id = field(fields, idColumn);
+            if (id.empty() || m_routeIndex.count(id)) {
+                continue;
+            }
+            std::string_view name = field(fields, shortColumn);
+            if (name.empty()) {
+                name = field(fields, longColumn);
+            }
+            if (name.empty()) {
+                name = id;
+            }
+            // Rolling stock by GTFS route type: 0 tram, 1 metro, 2 rail, others road
+            int type = static_cast<int>(parseIndex(field(fields, typeColumn)));
+            int speed = type == 2 ? 140 : (type == 1 ? 80 : 60);
+            int wagons = type == 2 ? 6 : (type == 1 ? 5 : (type == 0 ? 3 : 1));
+            m_routeIndex.emplace(keep(id), static_cast<uint32_t>(m_trains.size()));
+            m_trains.emplace_back(std::string(name), speed, wagons * 80, nextId++, wagons);
+        }
+    }
+    for (const Train& train : m_trains) {
+        m_trainPtrs.push_back(std::make_shared<Train>(train));
+    }
+    return true;
+}
+
+bool GtfsImporter::readTrips() {
+    CsvChunkReader reader(m_options.chunkBytes);
+    if (!reader.open(path("trips.txt"))) {
+        return fail("cannot read " + path("trips.txt"));
+    }
+    int tripColumn = reader.column("trip_id");
+    int routeColumn = reader.column("route_id");
+    if (tripColumn < 0 || routeColumn < 0) {
+        return fail("trips.txt needs trip_id and route_id columns");
+    }
+
+    std::vector<std::string_view> lines, fields;
+    std::string scratch;
+    while (reader.nextChunk(lines)) {
+        for (std::string_view line : lines) {
+            CsvChunkReader::splitLine(line, fields, scratch);
+            std::string_view id = field(fields, tripColumn);
+            auto route = m_routeIndex.find(field(fields, routeColumn));
+            if (id.empty() || route == m_routeIndex.end() || m_tripIndex.count(id)) {
+                continue;
+            }
+            m_tripIndex.emplace(keep(id), static_cast<uint32_t>(m_tripRoute.size()));
+            m_tripRoute.push_back(route->second);
+        }
+    }
+    m_tripFinished.assign(m_tripRoute.size(), false);
+    m_tripSplit.assign(m_tripRoute.size(), false);
+    return true;
+}
+
+void GtfsImporter::parseRows(const std::vector<std::string_view>& lines, std::vector<StopTimeRow>& rows,
+                             int tripColumn, int sequenceColumn, int stopColumn, int arrivalColumn,
+                             int departureColumn) const {
+    rows.resize(lines.size());
+    // Lines are independent, so a chunk is parsed in parallel; the ID maps are only read here
+    TaskScheduler::global().parallelFor(0, lines.size(), 0, [&](size_t first, size_t last) {
+        std::vector<std::string_view> fields;
+        std::string scratch;
+        for (size_t i = first; i < last; ++i) {
+            CsvChunkReader::splitLine(lines[i], fields, scratch);
+            StopTimeRow& row = rows[i];
+            auto trip = m_tripIndex.find(field(fields, tripColumn));
+            auto stop = m_stopIndex.find(field(fields, stopColumn));
+            if (trip == m_tripIndex.end() || stop == m_stopIndex.end()) {
+                row.trip = UINT32_MAX;
+                continue;
+            }
+            row.trip = trip->second;
+            row.stop = stop->second;
+            row.sequence = parseIndex(field(fields, sequenceColumn));
+            row.arrival = parseGtfsTime(field(fields, arrivalColumn));
+            row.departure = parseGtfsTime(field(fields, departureColumn));
+        }
+    });
+}
+
+bool GtfsImporter::readStopTimes(GtfsImportReport& report) {
+    CsvChunkReader reader(m_options.chunkBytes);
+    if (!reader.open(path("stop_times.txt"))) {
+        return fail("cannot read " + path("stop_times.txt"));
+    }
+    int tripColumn = reader.column("trip_id");
+    int sequenceColumn = reader.column("stop_sequence");
+    int stopColumn = reader.column("stop_id");
+    int arrivalColumn = reader.column("arrival_time");
+    int departureColumn = reader.column("departure_time");
+    if (tripColumn < 0 || sequenceColumn < 0 || stopColumn < 0 || (arrivalColumn < 0 && departureColumn < 0)) {
+        return fail("stop_times.txt needs trip_id, stop_id, stop_sequence and time columns");
+    }
+
+    std::unordered_map<uint32_t, OpenTrip> open;
+    std::vector<std::string_view> lines;
+    std::vector<StopTimeRow> rows;
+    for (size_t chunk = 1; reader.nextChunk(lines); ++chunk) {
+        parseRows(lines, rows, tripColumn, sequenceColumn, stopColumn, arrivalColumn, departureColumn);
+        report.stopTimeRows += rows.size();
+
+        for (const StopTimeRow& row : rows) {
+            if (row.trip == UINT32_MAX) {
+                ++report.unknownReferences;
+            } else if (m_tripFinished[row.trip]) {
+                if (!m_tripSplit[row.trip]) {
+                    m_tripSplit[row.trip] = true;
+                    ++report.splitTrips;
+                }
+            } else {
+                OpenTrip& trip = open[row.trip];
+                trip.rows.push_back(row);
+                trip.lastChunk = chunk;
+            }
+        }
+
+        // Trips without rows in this chunk are complete
+        for (auto it = open.begin(); it != open.end();) {
+            if (it->second.lastChunk != chunk) {
+                finishTrip(it->first, it->second, report);
+                it = open.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        if (m_pendingRoutes.size() >= m_options.routesPerBatch && !flushRoutes(report)) {
+            return false;
+        }
+    }
+
+    // Whatever is still open at the end of the file, in trips.txt order
+    std::vector<std::pair<uint32_t, OpenTrip*>> remaining;
+    for (auto& entry : open) {
+        remaining.emplace_back(entry.first, &entry.second);
+    }
+    std::sort(remaining.begin(), remaining.end(),
+              [](const auto& a, const auto& b) { return a.first < b.first; });
+    for (auto& entry : remaining) {
+        finishTrip(entry.first, *entry.second, report);
+    }
+    report.bytesRead = reader.getBytesRead();
+    return true;
+}
+
+void GtfsImporter::finishTrip(uint32_t trip, OpenTrip& open, GtfsImportReport& report) {
+    m_tripFinished[trip] = true;
+    std::vector<StopTimeRow>& rows = open.rows;
+    std::stable_sort(rows.begin(), rows.end(),
+                     [](const StopTimeRow& a, const StopTimeRow& b) { return a.sequence < b.sequence; });
+
+    // Consecutive stops at one station (two platforms of it) are one call
+    std::vector<std::string> stops;
+    std::vector<StationId> stationIds;
+    for (const StopTimeRow& row : rows) {
+        StationId station = m_stopStationId[row.stop];
+        if (stationIds.empty() || stationIds.back() != station) {
+            stationIds.push_back(station);
+            stops.push_back(m_stopStation[row.stop]);
+        }
+    }
+    int32_t departure = rows.front().departure >= 0 ? rows.front().departure : rows.front().arrival;
+    int32_t arrival = rows.back().arrival >= 0 ? rows.back().arrival : rows.back().departure;
+    int duration = (arrival - departure) / 60;
+    if (stops.size() < 2 || departure < 0 || arrival < 0 || duration <= 0) {
+        ++report.skippedTrips;
+        return;
+    }
+
+    // The database identifies a route by its end stations and departure time;
+    // station IDs are dense, so 24 bits each is plenty
+    int depMinute = (departure / 60) % (24 * 60);
+    int arrMinute = (arrival / 60) % (24 * 60);
+    uint64_t key = (static_cast<uint64_t>(stationIds.front()) << 35) |
+                   (static_cast<uint64_t>(stationIds.back()) << 11) | static_cast<uint64_t>(depMinute);
+    if (!m_departures.insert(key).second) {
+        ++report.duplicateTrips;
+        return;
+    }
+
+    m_pendingRoutes.emplace_back(depMinute / 60, depMinute % 60, arrMinute / 60, arrMinute % 60, duration,
+                                 m_trainPtrs[m_tripRoute[trip]], nullptr, nullptr, stops);
+}
+
+bool GtfsImporter::flushRoutes(GtfsImportReport& report) {
+    if (m_pendingRoutes.empty()) {
+        return true;
+    }
+    bool imported = importBatch({}, {}, m_pendingRoutes, report);
+    m_pendingRoutes.clear();
+    return imported;
+}
+
+bool GtfsImporter::importBatch(const std::vector<Train>& trains, const std::vector<Station>& stations,
+                               const std::vector<Route>& routes, GtfsImportReport& report) {
+    ImportReport batch;
+    if (!Management::importBatch(trains, stations, routes, batch)) {
+        return fail("batch of " + std::to_string(trains.size() + stations.size() + routes.size()) +
+                    " rows was not committed");
+    }
+    report.trainsImported += batch.trainsImported;
+    report.stationsImported += batch.stationsImported;
+    report.routesImported += batch.routesImported;
+    report.failures += batch.failures.size();
+    if (report.firstFailure.empty() && !batch.failures.empty()) {
+        report.firstFailure = batch.failures.front().entity + ": " + batch.failures.front().message;
+    }
+    return true;
+}
+
+} // namespace CJ
@@ -0,0 +1,629 @@
+#include "../include/HttpServer.hpp"
+#include "../include/Metrics.hpp"
+#include <cerrno>
+#include <cstring>
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace CJ {
+
+namespace {
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+} // namespace
+
+std::string HttpRequest::decode(std::string_view text, bool plusIsSpace) {
+    std::string decoded;
+    decoded.reserve(text.size());
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] == '%' && i + 2 < text.size() && hexValue(text[i + 1]) >= 0 && hexValue(text[i + 2]) >= 0) {
+            decoded += static_cast<char>(hexValue(text[i + 1]) * 16 + hexValue(text[i + 2]));
+            i += 2;
+        } else if (text[i] == '+' && plusIsSpace) {
+            decoded += ' ';
+        } else {
+            decoded += text[i];
+        }
+    }
+    return decoded;
+}
+
+bool HttpRequest::findParameter(std::string_view name, std::string* value) const {
+    std::string_view rest = query;
+    while (!rest.empty()) {
+        size_t amp = rest.find('&');
+        std::string_view pair = rest.substr(0, amp);
+        size_t equals = pair.find('=');
+        if (decode(pair.substr(0, equals), true) == name) {
+            if (value) {
+                *value = equals == std::string_view::npos ? std::string() : decode(pair.substr(equals + 1), true);
+            }
+            return true;
+        }
+        rest = amp == std::string_view::npos ? std::string_view() : rest.substr(amp + 1);
+    }
+    return false;
+}
+
+std::string HttpRequest::parameter(std::string_view name, const std::string& fallback) const {
+    std::string value;
+    return findParameter(name, &value) ? value : fallback;
+}
+
+bool HttpRequest::hasParameter(std::string_view name) const {
+    return findParameter(name, nullptr);
+}
+
+const char* HttpServer::reasonPhrase(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 413: return "Payload Too Large";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 501: return "Not Implemented";
+        case 505: return "HTTP Version Not Supported";
+        default: return "Unknown";
+    }
+}
+
+#ifdef __linux__
+
+namespace {
+
+constexpr size_t READ_BYTES = 64u << 10;
+constexpr int MAX_EVENTS = 256;
+
+bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        char x = a[i] >= 'A' && a[i] <= 'Z' ? static_cast<char>(a[i] + 32) : a[i];
+        char y = b[i] >= 'A' && b[i] <= 'Z' ? static_cast<char>(b[i] + 32) : b[i];
+        if (x != y) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool containsToken(std::string_view value, std::string_view token) {
+    while (!value.empty()) {
+        size_t comma = value.find(',');
+        std::string_view item = value.substr(0, comma);
+        while (!item.empty() && item.front() == ' ') {
+            item.remove_prefix(1);
+        }
+        while (!item.empty() && item.back() == ' ') {
+            item.remove_suffix(1);
+        }
+        if (equalsIgnoreCase(item, token)) {
+            return true;
+        }
+        value = comma == std::string_view::npos ? std::string_view() : value.substr(comma + 1);
+    }
+    return false;
+}
+
+void wake(int fd) {
+    uint64_t one = 1;
+    // Only fails if the counter is saturated, and then the loop wakes anyway
+    ssize_t written = ::write(fd, &one, sizeof(one));
+    (void)written;
+}
+
+} // namespace
+
+HttpServer::HttpServer(Handler handler, const HttpServerOptions& options)
+    : m_handler(std::move(handler)), m_options(options) {
+}
+
+HttpServer::~HttpServer() {
+    if (m_workers) {
+        m_workers->wait();
+    }
+    for (auto& entry : m_connections) {
+        ::close(entry.first);
+    }
+    for (int fd : {m_listenFd, m_epollFd, m_wakeFd}) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+}
+
+bool HttpServer::start() {
+    m_listenFd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (m_listenFd < 0) {
+        m_error = std::string("socket: ") + std::strerror(errno);
+        return false;
+    }
+    int enable = 1;
+    ::setsockopt(m_listenFd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(m_options.port);
+    if (::inet_pton(AF_INET, m_options.address.c_str(), &address.sin_addr) != 1) {
+        m_error = "invalid address " + m_options.address;
+        return false;
+    }
+    if (::bind(m_listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        m_error = "bind " + m_options.address + ":" + std::to_string(m_options.port) + ": " + std::strerror(errno);
+        return false;
+    }
+    if (::listen(m_listenFd, SOMAXCONN) < 0) {
+        m_error = std::string("listen: ") + std::strerror(errno);
+        return false;
+    }
+    socklen_t length = sizeof(address);
+    ::getsockname(m_listenFd, reinterpret_cast<sockaddr*>(&address), &length);
+    m_port = ntohs(address.sin_port);
+
+    m_epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+    m_wakeFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_epollFd < 0 || m_wakeFd < 0) {
+        m_error = std::string("epoll: ") + std::strerror(errno);
+        return false;
+    }
+    for (int fd : {m_listenFd, m_wakeFd}) {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        ::epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &event);
+    }
+
+    m_workers = std::make_unique<TaskGroup>(TaskScheduler::global());
+    return true;
+}
+
+void HttpServer::stop() {
+    m_stopping.store(true);
+    if (m_wakeFd >= 0) {
+        wake(m_wakeFd);
+    }
+}
+
+void HttpServer::run() {
+    epoll_event events[MAX_EVENTS];
+    while (!m_stopping.load()) {
+        int ready = ::epoll_wait(m_epollFd, events, MAX_EVENTS, -1);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        for (int i = 0; i < ready; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == m_listenFd) {
+                acceptConnections();
+                continue;
+            }
+            if (fd == m_wakeFd) {
+                uint64_t count;
+                while (::read(m_wakeFd, &count, sizeof(count)) > 0) {
+                }
+                drainCompletions();
+                continue;
+            }
+
+            auto found = m_connections.find(fd);
+            if (found == m_connections.end()) {
+                continue;
+            }
+            Connection& connection = *found->second;
+            // Hang-up means both directions are gone, so there is nobody to answer
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                closeConnection(fd);
+                continue;
+            }
+            if ((events[i].events & (EPOLLIN | EPOLLRDHUP)) && !readFrom(connection)) {
+                continue;
+            }
+            if (events[i].events & EPOLLOUT) {
+                flush(connection);
+            }
+        }
+    }
+
+    // Handlers still running post completions nobody reads; let them finish
+    m_workers->wait();
+    while (!m_connections.empty()) {
+        closeConnection(m_connections.begin()->first);
+    }
+}
+
+void HttpServer::acceptConnections() {
+    while (true) {
+        int fd = ::accept4(m_listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            // EAGAIN once the backlog is empty; out of descriptors is retried
+            // on the next readiness event
+            return;
+        }
+        if (m_connections.size() >= m_options.maxConnections) {
+            ::close(fd);
+            continue;
+        }
+        int enable = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+        auto connection = std::make_unique<Connection>();
+        connection->fd = fd;
+        connection->serial = m_nextSerial++;
+        connection->events = EPOLLIN | EPOLLRDHUP;
+        epoll_event event{};
+        event.events = connection->events;
+        event.data.fd = fd;
+        if (::epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+            ::close(fd);
+            continue;
+        }
+        m_connections[fd] = std::move(connection);
+        CJ_COUNT("http.connections", 1);
+    }
+}
+
+bool HttpServer::readFrom(Connection& connection) {
+    bool peerClosed = false;
+    while (connection.reading) {
+        size_t used = connection.input.size();
+        connection.input.resize(used + READ_BYTES);
+        ssize_t received = ::recv(connection.fd, &connection.input[used], READ_BYTES, 0);
+        connection.input.resize(used + (received > 0 ? static_cast<size_t>(received) : 0));
+        if (received > 0) {
+            // Stop reading from a client that sends faster than its batches
+            // are handled; reading resumes when the batch completes
+            if (connection.busy && connection.input.size() > m_options.maxHeaderBytes + m_options.maxBodyBytes) {
+                connection.reading = false;
+            }
+            continue;
+        }
+        if (received == 0) {
+            peerClosed = true;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            closeConnection(connection.fd);
+            return false;
+        }
+        break;
+    }
+    if (peerClosed) {
+        // Requests already received are still answered
+        connection.reading = false;
+        connection.closing = true;
+    }
+    if (!dispatch(connection)) {
+        return false;
+    }
+    if (connection.closing && !connection.busy && connection.output.empty()) {
+        closeConnection(connection.fd);
+        return false;
+    }
+    updateInterest(connection);
+    return true;
+}
+
+HttpServer::ParseResult HttpServer::parseRequest(const std::string& input, size_t& offset, HttpRequest& request,
+                                                 int& errorStatus) const {
+    // Empty lines between pipelined requests are allowed
+    size_t start = offset;
+    while (input.compare(start, 2, "\r\n") == 0) {
+        start += 2;
+    }
+    size_t headerEnd = input.find("\r\n\r\n", start);
+    if (headerEnd == std::string::npos) {
+        if (input.size() - start > m_options.maxHeaderBytes) {
+            errorStatus = 431;
+            return ParseResult::Invalid;
+        }
+        return ParseResult::Incomplete;
+    }
+    if (headerEnd - start > m_options.maxHeaderBytes) {
+        errorStatus = 431;
+        return ParseResult::Invalid;
+    }
+
+    std::string_view head(input.data() + start, headerEnd - start);
+    size_t lineEnd = head.find("\r\n");
+    std::string_view requestLine = head.substr(0, lineEnd);
+    size_t space1 = requestLine.find(' ');
+    size_t space2 = space1 == std::string_view::npos ? space1 : requestLine.find(' ', space1 + 1);
+    if (space2 == std::string_view::npos) {
+        errorStatus = 400;
+        return ParseResult::Invalid;
+    }
+    request.method = std::string(requestLine.substr(0, space1));
+    std::string_view target = requestLine.substr(space1 + 1, space2 - space1 - 1);
+    request.version = std::string(requestLine.substr(space2 + 1));
+    if (request.version != "HTTP/1.1" && request.version != "HTTP/1.0") {
+        errorStatus = request.version.compare(0, 5, "HTTP/") == 0 ? 505 : 400;
+        return ParseResult::Invalid;
+    }
+    if (target.empty() || target.front() != '/') {
+        errorStatus = 400;
+        return ParseResult::Invalid;
+    }
+    size_t question = target.find('?');
+    request.path = HttpRequest::decode(target.substr(0, question), false);
+    request.query = question == std::string_view::npos ? std::string() : std::string(target.substr(question + 1));
+
+    bool http10 = request.version == "HTTP/1.0";
+    request.keepAlive = !http10;
+    size_t contentLength = 0;
+    std::string_view headers = lineEnd == std::string_view::npos ? std::string_view() : head.substr(lineEnd + 2);
+    while (!headers.empty()) {
+        size_t end = headers.find("\r\n");
+        std::string_view line = headers.substr(0, end);
+        headers = end == std::string_view::npos ? std::string_view() : headers.substr(end + 2);
+
+        size_t colon = line.find(':');
+        if (colon == std::string_view::npos) {
+            errorStatus = 400;
+            return ParseResult::Invalid;
+        }
+        std::string_view name = line.substr(0, colon);
+        std::string_view value = line.substr(colon + 1);
+        while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+            value.remove_prefix(1);
+        }
+        if (equalsIgnoreCase(name, "Content-Length")) {
+            contentLength = 0;
+            for (char c : value) {
+                if (c < '0' || c > '9' || contentLength > m_options.maxBodyBytes) {
+                    errorStatus = c < '0' || c > '9' ? 400 : 413;
+                    return ParseResult::Invalid;
+                }
+                contentLength = contentLength * 10 + static_cast<size_t>(c - '0');
+            }
+        } else if (equalsIgnoreCase(name, "Transfer-Encoding")) {
+            errorStatus = 501;
+            return ParseResult::Invalid;
+        } else if (equalsIgnoreCase(name, "Connection")) {
+            if (containsToken(value, "close")) {
+                request.keepAlive = false;
+            } else if (http10 && containsToken(value, "keep-alive")) {
+                request.keepAlive = true;
+            }
+        }
+    }
+    if (contentLength > m_options.maxBodyBytes) {
+        errorStatus = 413;
+        return ParseResult::Invalid;
+    }
+
+    size_t bodyStart = headerEnd + 4;
+    if (input.size() - bodyStart < contentLength) {
+        return ParseResult::Incomplete;
+    }
+    request.body.assign(input, bodyStart, contentLength);
+    offset = bodyStart + contentLength;
+    return ParseResult::Complete;
+}
+
+void HttpServer::writeResponse(std::string& output, const HttpRequest& request, const HttpResponse& response) {
+    output += "HTTP/1.1 ";
+    output += std::to_string(response.status);
+    output += ' ';
+    output += reasonPhrase(response.status);
+    output += "\r\nContent-Type: ";
+    output += response.contentType;
+    output += "\r\nContent-Length: ";
+    output += std::to_string(response.body.size());
+    if (!request.keepAlive) {
+        output += "\r\nConnection: close";
+    } else if (request.version == "HTTP/1.0") {
+        output += "\r\nConnection: keep-alive";
+    }
+    output += "\r\n\r\n";
+    if (request.method != "HEAD") {
+        output += response.body;
+    }
+}
+
+bool HttpServer::dispatch(Connection& connection) {
+    if (connection.busy) {
+        return true;
+    }
+
+    std::vector<HttpRequest> batch;
+    size_t offset = 0;
+    int errorStatus = 400;
+    ParseResult result = ParseResult::Incomplete;
+    while (batch.size() < m_options.maxPipelined) {
+        HttpRequest request;
+        result = parseRequest(connection.input, offset, request, errorStatus);
+        if (result != ParseResult::Complete) {
+            break;
+        }
+        batch.push_back(std::move(request));
+        if (!batch.back().keepAlive) {
+            break;
+        }
+    }
+    // A bad request after good ones stays in the input and is answered once
+    // the good ones have been
+    connection.input.erase(0, offset);
+    if (batch.empty()) {
+        return result == ParseResult::Invalid ? fail(connection, errorStatus) : true;
+    }
+
+    bool close = !batch.back().keepAlive;
+    if (close) {
+        // Nothing after a "Connection: close" request is answered
+        connection.input.clear();
+        connection.reading = false;
+        connection.closing = true;
+    }
+    connection.busy = true;
+
+    int fd = connection.fd;
+    uint64_t serial = connection.serial;
+    m_workers->run([this, fd, serial, close, batch = std::move(batch)]() {
+        std::string output;
+        for (const auto& request : batch) {
+            HttpResponse response;
+            {
+                CJ_TIMED("http.request");
+                try {
+                    m_handler(request, response);
+                } catch (const std::exception& e) {
+                    response = HttpResponse();
+                    response.status = 500;
+                    response.contentType = "text/plain";
+                    response.body = e.what();
+                }
+            }
+            writeResponse(output, request, response);
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_completionMutex);
+            m_completions.push_back({fd, serial, std::move(output), close});
+        }
+        wake(m_wakeFd);
+    });
+    return true;
+}
+
+void HttpServer::drainCompletions() {
+    std::vector<Completion> completions;
+    {
+        std::lock_guard<std::mutex> lock(m_completionMutex);
+        completions.swap(m_completions);
+    }
+    for (auto& completion : completions) {
+        auto found = m_connections.find(completion.fd);
+        if (found == m_connections.end() || found->second->serial != completion.serial) {
+            continue;
+        }
+        Connection& connection = *found->second;
+        connection.busy = false;
+        if (connection.output.empty()) {
+            connection.output = std::move(completion.output);
+        } else {
+            connection.output += completion.output;
+        }
+        if (completion.close) {
+            connection.closing = true;
+        } else if (!connection.closing) {
+            // Reading may have been paused while the batch ran
+            connection.reading = true;
+        }
+        // Requests that arrived while the batch was running go out next;
+        // flush closes the connection if it is done
+        if (dispatch(connection)) {
+            flush(connection);
+        }
+    }
+}
+
+bool HttpServer::flush(Connection& connection) {
+    while (connection.outputSent < connection.output.size()) {
+        ssize_t sent = ::send(connection.fd, connection.output.data() + connection.outputSent,
+                              connection.output.size() - connection.outputSent, MSG_NOSIGNAL);
+        if (sent > 0) {
+            connection.outputSent += static_cast<size_t>(sent);
+        } else if (sent < 0 && errno == EINTR) {
+            continue;
+        } else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            closeConnection(connection.fd);
+            return false;
+        }
+    }
+    if (connection.outputSent == connection.output.size()) {
+        connection.output.clear();
+        connection.outputSent = 0;
+        if (connection.closing && !connection.busy) {
+            closeConnection(connection.fd);
+            return false;
+        }
+    }
+    updateInterest(connection);
+    return true;
+}
+
+void HttpServer::updateInterest(Connection& connection) {
+    uint32_t events = (connection.reading ? static_cast<uint32_t>(EPOLLIN | EPOLLRDHUP) : 0u) |
+                      (connection.output.empty() ? 0u : static_cast<uint32_t>(EPOLLOUT));
+    if (events == connection.events) {
+        return;
+    }
+    epoll_event event{};
+    event.events = events;
+    event.data.fd = connection.fd;
+    ::epoll_ctl(m_epollFd, EPOLL_CTL_MOD, connection.fd, &event);
+    connection.events = events;
+}
+
+bool HttpServer::fail(Connection& connection, int status) {
+    CJ_COUNT("http.bad_requests", 1);
+    HttpRequest request;
+    request.keepAlive = false;
+    HttpResponse response;
+    response.status = status;
+    response.contentType = "text/plain";
+    response.body = reasonPhrase(status);
+    writeResponse(connection.output, request, response);
+    connection.input.clear();
+    connection.reading = false;
+    connection.closing = true;
+    return flush(connection);
+}
+
+void HttpServer::closeConnection(int fd) {
+    ::epoll_ctl(m_epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    ::close(fd);
+    m_connections.erase(fd);
+}
+
+#else
+
+// Only Linux has epoll; elsewhere the server reports that it cannot start
+
+HttpServer::HttpServer(Handler handler, const HttpServerOptions& options)
+    : m_handler(std::move(handler)), m_options(options) {
+}
+
+HttpServer::~HttpServer() = default;
+
+bool HttpServer::start() {
+    m_error = "the HTTP server needs Linux (epoll)";
+    return false;
+}
+
+void HttpServer::run() {
+}
+
+void HttpServer::stop() {
+}
+
+#endif
+
+} // namespace CJ
@@ -0,0 +1,166 @@
+#include "../include/JourneyPlanner.hpp"
+#include "../include/TaskScheduler.hpp"
+#include "../include/Metrics.hpp"
+#include <algorithm>
+#include <limits>
+
+namespace CJ {
+
+namespace {
+
+constexpr int UNREACHED = std::numeric_limits<int>::max();
+constexpr uint32_t NO_CONNECTION = std::numeric_limits<uint32_t>::max();
+
+// Per-thread query state, reset through the touched lists rather than cleared,
+// so a query costs what it scans and not the size of the network
+struct ScanState {
+    std::vector<int> arrival;
+    std::vector<uint32_t> arrivedBy;    // connection that set arrival
+    std::vector<uint32_t> boardedAt;    // connection where that trip was boarded
+    std::vector<uint32_t> tripBoarded;
+    std::vector<StationId> touchedStations;
+    std::vector<uint32_t> touchedTrips;
+
+    void prepare(size_t stations, size_t trips) {
+        if (arrival.size() < stations) {
+            arrival.resize(stations, UNREACHED);
+            arrivedBy.resize(stations, NO_CONNECTION);
+            boardedAt.resize(stations, NO_CONNECTION);
+        }
+        if (tripBoarded.size() < trips) {
+            tripBoarded.resize(trips, NO_CONNECTION);
+        }
+    }
+
+    void reset() {
+        for (StationId station : touchedStations) {
+            arrival[station] = UNREACHED;
+            arrivedBy[station] = NO_CONNECTION;
+            boardedAt[station] = NO_CONNECTION;
+        }
+        for (uint32_t trip : touchedTrips) {
+            tripBoarded[trip] = NO_CONNECTION;
+        }
+        touchedStations.clear();
+        touchedTrips.clear();
+    }
+};
+
+} // namespace
+
+JourneyPlanner::JourneyPlanner(const std::vector<Route>& routes) {
+    size_t connectionCount = 0;
+    for (const auto& route : routes) {
+        if (route.getStopIds().size() > 1) {
+            connectionCount += route.getStopIds().size() - 1;
+        }
+    }
+    m_connections.reserve(connectionCount);
+
+    for (uint32_t trip = 0; trip < routes.size(); ++trip) {
+        const std::vector<StationId>& stops = routes[trip].getStopIds();
+        std::vector<StopTime> times = routes[trip].calculateStopTimes();
+        for (size_t i = 0; i + 1 < stops.size(); ++i) {
+            m_connections.push_back(Connection{times[i].departure, times[i + 1].arrival,
+                                               stops[i], stops[i + 1], trip});
+            m_stationLimit = std::max({m_stationLimit, stops[i] + 1, stops[i + 1] + 1});
+        }
+    }
+    m_tripCount = routes.size();
+
+    std::sort(m_connections.begin(), m_connections.end(), [](const Connection& a, const Connection& b) {
+        return a.departure != b.departure ? a.departure < b.departure : a.arrival < b.arrival;
+    });
+}
+
+bool JourneyPlanner::earliestArrival(StationId from, StationId to, int departAfter, Journey& journey,
+                                     int minChangeSeconds) const {
+    CJ_TIMED("routing.csa_query");
+    journey.legs.clear();
+    if (from >= m_stationLimit || to >= m_stationLimit || from == to) {
+        return false;
+    }
+
+    thread_local ScanState state;
+    state.prepare(m_stationLimit, m_tripCount);
+    state.arrival[from] = departAfter;
+    state.touchedStations.push_back(from);
+
+    auto first = std::lower_bound(m_connections.begin(), m_connections.end(), departAfter,
+                                  [](const Connection& c, int time) { return c.departure < time; });
+
+    for (auto it = first; it != m_connections.end(); ++it) {
+        const Connection& c = *it;
+        if (c.departure >= state.arrival[to]) {
+            break;  // nothing later can arrive earlier
+        }
+
+        // A trip already boarded has also reached c.from, so an unreached station
+        // rules the connection out without touching the (much larger) trip array
+        int ready = state.arrival[c.from];
+        if (ready == UNREACHED) {
+            continue;
+        }
+
+        uint32_t index = static_cast<uint32_t>(it - m_connections.begin());
+        if (state.tripBoarded[c.trip] == NO_CONNECTION) {
+            if (c.from != from) {
+                ready += minChangeSeconds;
+            }
+            if (ready > c.departure) {
+                continue;
+            }
+            state.tripBoarded[c.trip] = index;
+            state.touchedTrips.push_back(c.trip);
+        }
+
+        if (c.arrival < state.arrival[c.to]) {
+            if (state.arrival[c.to] == UNREACHED) {
+                state.touchedStations.push_back(c.to);
+            }
+            state.arrival[c.to] = c.arrival;
+            state.arrivedBy[c.to] = index;
+            state.boardedAt[c.to] = state.tripBoarded[c.trip];
+        }
+    }
+
+    bool found = state.arrival[to] != UNREACHED;
+    if (found) {
+        for (StationId station = to; station != from;) {
+            const Connection& exit = m_connections[state.arrivedBy[station]];
+            const Connection& board = m_connections[state.boardedAt[station]];
+            journey.legs.push_back(JourneyLeg{exit.trip, board.from, exit.to, board.departure, exit.arrival});
+            station = board.from;
+        }
+        std::reverse(journey.legs.begin(), journey.legs.end());
+    }
+
+    state.reset();
+    return found;
+}
+
+std::vector<Journey> JourneyPlanner::earliestArrivals(const std::vector<JourneyRequest>& requests,
+                                                     int minChangeSeconds) const {
+    std::vector<Journey> journeys(requests.size());
+    TaskScheduler::global().parallelFor(0, requests.size(), 0, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i) {
+            earliestArrival(requests[i].from, requests[i].to, requests[i].departAfter, journeys[i],
+                            minChangeSeconds);
+        }
+    });
+    return journeys;
+}
+
+size_t JourneyPlanner::getConnectionCount() const {
+    return m_connections.size();
+}
+
+size_t JourneyPlanner::getTripCount() const {
+    return m_tripCount;
+}
+
+const std::vector<JourneyPlanner::Connection>& JourneyPlanner::getConnections() const {
+    return m_connections;
+}
+
+} // namespace CJ
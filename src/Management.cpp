@@ -1,14 +1,38 @@
 #include "../include/Management.hpp"
+#include "../include/Snapshot.hpp"
+#include "../include/Metrics.hpp"
 #include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <sstream>
 
 namespace CJ {
     Management* Management::instance = nullptr;
-    std::vector<Train> Management::m_trains;
-    std::vector<Station> Management::m_stations;
+    EntityStore<int, Train> Management::m_trains;
+    EntityStore<StationId, Station> Management::m_stations;
     std::vector<Route> Management::m_routes;
+    PlatformConflictChecker Management::m_platforms;
+    DepartureBoard Management::m_departureBoard;
+    std::mutex Management::m_writeMutex;
+    std::shared_ptr<const NetworkSnapshot> Management::m_current;
+    uint64_t Management::m_version = 0;
+    uint64_t Management::m_snapshotStamp = 0;
     DatabaseManager Management::m_dbManager;
+    std::unique_ptr<PersistenceWorker> Management::m_writeBehind;
+
+    namespace {
+        // Same key as the UNIQUE constraint on the routes table
+        bool sameDeparture(const Route& a, const Route& b) {
+            const std::vector<StationId>& stopsA = a.getStopIds();
+            const std::vector<StationId>& stopsB = b.getStopIds();
+            return !stopsA.empty() && !stopsB.empty() &&
+                   stopsA.front() == stopsB.front() && stopsA.back() == stopsB.back() &&
+                   a.getDepartureTimeHour() == b.getDepartureTimeHour() &&
+                   a.getDepartureTimeMinute() == b.getDepartureTimeMinute();
+        }
+    }
 
     void Management::addRoute(int depHour, int depMin, int arrHour, int arrMin,
                       Train& train, int duration,
@@ -25,18 +49,73 @@ namespace CJ {
     }
 
     auto trainPtr = std::make_shared<Train>(train);
-    Route newRoute(depHour, depMin, arrHour, arrMin,
-                calculatedDuration, trainPtr, nullptr, nullptr, intermediateStops);
+    addRoute(Route(depHour, depMin, arrHour, arrMin,
+                   calculatedDuration, trainPtr, nullptr, nullptr, intermediateStops));
+}
+
+    void Management::addRoute(const Route& newRoute) {
+    CJ_TIMED("management.add_route");
+    std::lock_guard<std::mutex> lock(m_writeMutex);
+
+    if (m_writeBehind) {
+        // The worker writes the route after it is published, so a duplicate
+        // has to be caught here rather than by the database
+        for (const auto& route : m_routes) {
+            if (sameDeparture(route, newRoute)) {
+                std::ostringstream message;
+                message << "Route from '" << newRoute.getStartStation() << "' to '" << newRoute.getEndStation()
+                        << "' departing at " << std::setfill('0') << std::setw(2)
+                        << newRoute.getDepartureTimeHour() << ":" << std::setw(2)
+                        << newRoute.getDepartureTimeMinute() << " already exists";
+                throw std::runtime_error(message.str());
+            }
+        }
+    }
 
-    if (m_dbManager.saveRoute(newRoute)) {
+    uint32_t trip = m_platforms.addRoute(newRoute);
+    std::vector<PlatformConflict> conflicts = m_platforms.checkTrip(trip);
+    if (!conflicts.empty()) {
+        m_platforms.removeLastRoute();
+        throw std::runtime_error("Not enough platforms at " + conflicts.front().describe());
+    }
+
+    std::shared_ptr<Train> train = newRoute.getAssignedTrain();
+    int trainId = train ? train->getId() : 0;
+    if (m_writeBehind) {
         m_routes.push_back(newRoute);
-        m_dbManager.assignTrainToRoute(train.getId(), intermediateStops);
-    } else {
+        m_departureBoard.addRoute(newRoute);
+        publish(TimetableChanged);
+        m_writeBehind->enqueue([newRoute, trainId](DatabaseManager& db) {
+            int routeId;
+            return db.saveRoute(newRoute, routeId) && (trainId == 0 || db.assignTrainToRoute(trainId, routeId));
+        }, "add route " + newRoute.getStartStation() + " -> " + newRoute.getEndStation());
+        return;
+    }
+
+    // saveRoute throws on a duplicate, so the trip is taken back out on every failure
+    int routeId;
+    bool saved;
+    try {
+        saved = m_dbManager.saveRoute(newRoute, routeId);
+    } catch (...) {
+        m_platforms.removeLastRoute();
+        throw;
+    }
+    if (!saved) {
+        m_platforms.removeLastRoute();
         throw std::runtime_error("Failed to save route to database");
     }
+    m_routes.push_back(newRoute);
+    m_departureBoard.addRoute(newRoute);
+    publish(TimetableChanged);
+    if (trainId != 0) {
+        m_dbManager.assignTrainToRoute(trainId, routeId);
+    }
 }
 
     void Management::displayAllRoutes() {
+        syncWriteBehind();
+
         std::vector<Route> routes;
         if (!m_dbManager.loadRoutes(routes)) {
             std::cout << "Failed to load routes from database.\n";
@@ -69,10 +148,23 @@ namespace CJ {
 
     bool Management::addTrain(const std::string& trainName, int speed, int capacity, 
                         int id, int wagonCount) {
+    CJ_TIMED("management.add_train");
+    std::lock_guard<std::mutex> lock(m_writeMutex);
     try {
         Train newTrain(trainName, speed, capacity, id, wagonCount);
+        if (m_trains.contains(id)) {
+            throw std::runtime_error("Train with ID " + std::to_string(id) + " already exists");
+        }
+        if (m_writeBehind) {
+            m_trains.insert(id, newTrain);
+            publish(TrainsChanged);
+            m_writeBehind->enqueue([newTrain](DatabaseManager& db) { return db.saveTrain(newTrain); },
+                                   "add train " + std::to_string(id));
+            return true;
+        }
         if (m_dbManager.saveTrain(newTrain)) {
-            m_trains.push_back(newTrain);
+            m_trains.insert(id, newTrain);
+            publish(TrainsChanged);
             return true;
         }
     } catch (const std::exception& e) {
@@ -82,20 +174,37 @@ namespace CJ {
 }
 
     bool Management::deleteTrain(int id) {
+        CJ_TIMED("management.delete_train");
+        std::lock_guard<std::mutex> lock(m_writeMutex);
 
-        if (m_dbManager.deleteTrain(id)) {
+        EntityHandle handle = m_trains.handleOf(id);
+        if (!handle.isValid()) {
+            return false;
+        }
 
-            auto it = std::find_if(m_trains.begin(), m_trains.end(),
-                                [id](const Train& train) { return train.getId() == id; });
-            if (it != m_trains.end()) {
-                m_trains.erase(it);
-                return true;
-            }
+        if (m_writeBehind) {
+            m_trains.erase(handle);
+            publish(TrainsChanged);
+            m_writeBehind->enqueue([id](DatabaseManager& db) { return db.deleteTrain(id); },
+                                   "delete train " + std::to_string(id));
+            return true;
+        }
+
+        if (m_dbManager.deleteTrain(id)) {
+            m_trains.erase(handle);
+            publish(TrainsChanged);
+            return true;
         }
         return false;
     }
 
+    const Train* Management::findTrain(int id) {
+        return m_trains.find(id);
+    }
+
     void Management::displayTrainInfo(int id) {
+        syncWriteBehind();
+
         Train train;
         if (!m_dbManager.getTrainById(id, train)) {
             std::cout << "Train with ID " << id << " not found.\n";
@@ -129,6 +238,8 @@ namespace CJ {
                          const std::vector<std::shared_ptr<Route>>& intermediateStops,
                          std::shared_ptr<Train> startStation, std::shared_ptr<Train> endStation,
                          const std::string& name) {
+    CJ_TIMED("management.add_station");
+    std::lock_guard<std::mutex> lock(m_writeMutex);
     try {
         // Format station name
         std::string formattedName = formatStationName(name);
@@ -136,9 +247,25 @@ namespace CJ {
         // Create new station with validated platform count
         Station newStation(trainName, std::max(1, platformCount), intermediateStops,
                          startStation, endStation, formattedName);
+
+        if (m_writeBehind) {
+            StationId stationId = StationRegistry::global().intern(formattedName);
+            if (m_stations.contains(stationId)) {
+                throw std::runtime_error("Station '" + formattedName + "' already exists");
+            }
+            m_stations.insert(stationId, newStation);
+            m_platforms.setPlatformCount(stationId, newStation.getPlatformCount());
+            publish(StationsChanged);
+            m_writeBehind->enqueue([newStation](DatabaseManager& db) { return db.saveStation(newStation); },
+                                   "add station " + formattedName);
+            return;
+        }
         
         if (m_dbManager.saveStation(newStation)) {
-            m_stations.push_back(newStation);
+            StationId stationId = StationRegistry::global().intern(formattedName);
+            m_stations.insert(stationId, newStation);
+            m_platforms.setPlatformCount(stationId, newStation.getPlatformCount());
+            publish(StationsChanged);
         } else {
             throw std::runtime_error("Failed to save station to database");
         }
@@ -148,43 +275,214 @@ namespace CJ {
 }
 
     bool Management::removeStation(const std::string& name) {
+        CJ_TIMED("management.remove_station");
+        std::lock_guard<std::mutex> lock(m_writeMutex);
 
-        if (m_dbManager.deleteStation(name)) {
+        EntityHandle handle = m_stations.handleOf(StationRegistry::global().find(name));
+        const Station* station = m_stations.get(handle);
+        if (!station) {
+            return false;
+        }
+        std::string storedName = station->getName();
 
-            auto it = std::find_if(m_stations.begin(), m_stations.end(),
-                                [&name](const Station& station) {
-                                    return station.getName() == name;
-                                });
-            if (it != m_stations.end()) {
-                m_stations.erase(it);
-                return true;
-            }
+        if (m_writeBehind) {
+            m_stations.erase(handle);
+            publish(StationsChanged);
+            m_writeBehind->enqueue([storedName](DatabaseManager& db) { return db.deleteStation(storedName); },
+                                   "remove station " + storedName);
+            return true;
+        }
+
+        if (m_dbManager.deleteStation(storedName)) {
+            m_stations.erase(handle);
+            publish(StationsChanged);
+            return true;
         }
         return false;
     }
 
+    const Station* Management::findStation(const std::string& name) {
+        StationId id = StationRegistry::global().find(name);
+        return id == INVALID_STATION_ID ? nullptr : m_stations.find(id);
+    }
+
+    void Management::replaceTrains(std::vector<Train>& trains) {
+        m_trains.clear();
+        m_trains.reserve(trains.size());
+        for (auto& train : trains) {
+            int id = train.getId();
+            m_trains.insert(id, std::move(train));
+        }
+    }
+
+    void Management::replaceStations(std::vector<Station>& stations) {
+        m_stations.clear();
+        m_stations.reserve(stations.size());
+        for (auto& station : stations) {
+            StationId id = StationRegistry::global().intern(station.getName());
+            m_stations.insert(id, std::move(station));
+        }
+    }
+
     void Management::displayStationInfo(const std::string& name) {
         if (name.empty()) {
             std::cout << "Error: Station name cannot be empty\n";
             return;
         }
 
-        auto it = std::find_if(m_stations.begin(), m_stations.end(),
-                              [&name](const Station& s) {
-                                  return compareStationNames(s.getName(), name);
-                              });
-
-        if (it == m_stations.end()) {
+        const Station* found = findStation(name);
+        if (!found) {
             std::cout << "Station '" << name << "' not found.\n";
             return;
         }
 
-        const Station& station = *it;
+        const Station& station = *found;
         std::cout << "\nStation Information:\n"
                   << "Name: " << station.getName() << "\n"
                   << "Platform Count: " << station.getPlatformCount() << "\n";
     }
 
+    bool Management::assignTrain(int trainId, size_t routeIndex) {
+        CJ_TIMED("management.assign_train");
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        const Train* train = m_trains.find(trainId);
+        if (!train || routeIndex >= m_routes.size()) {
+            return false;
+        }
+
+        const Route& route = m_routes[routeIndex];
+        if (m_writeBehind) {
+            m_writeBehind->enqueue([route, trainId](DatabaseManager& db) {
+                int routeId;
+                return db.getRouteId(route, routeId) && db.assignTrainToRoute(trainId, routeId);
+            }, "assign train " + std::to_string(trainId));
+        } else {
+            int routeId;
+            if (!m_dbManager.getRouteId(route, routeId) || !m_dbManager.assignTrainToRoute(trainId, routeId)) {
+                return false;
+            }
+        }
+        m_routes[routeIndex].setTrainAssignment(std::make_shared<Train>(*train));
+        publish(TimetableChanged);
+        return true;
+    }
+
+    bool Management::importBatch(const std::vector<Train>& trains,
+                                 const std::vector<Station>& stations,
+                                 const std::vector<Route>& routes,
+                                 ImportReport& report) {
+        CJ_TIMED("management.import_batch");
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        // The batch goes through the main connection, after anything still queued
+        flushLocked();
+        std::vector<Station> formattedStations;
+        formattedStations.reserve(stations.size());
+        for (const auto& station : stations) {
+            formattedStations.emplace_back(station.getTrainName(), std::max(1, station.getPlatformCount()),
+                                           station.getIntermediateStops(), station.getStartStation(),
+                                           station.getEndStation(), formatStationName(station.getName()));
+        }
+
+        // Routes are checked against the platforms before anything is written,
+        // each against the timetable and the routes of the batch accepted before it
+        StationRegistry& registry = StationRegistry::global();
+        // Backwards, so a name given twice gets the count of its first row, as in the database
+        for (size_t i = formattedStations.size(); i-- > 0;) {
+            StationId id = registry.find(formattedStations[i].getName());
+            if (id != INVALID_STATION_ID && !m_stations.contains(id)) {
+                m_platforms.setPlatformCount(id, formattedStations[i].getPlatformCount());
+            }
+        }
+        uint32_t firstTrip = m_platforms.addRoutes(routes);
+        std::vector<bool> counted(firstTrip + routes.size(), true);
+        std::vector<ImportFailure> conflicts;
+        std::vector<size_t> acceptedIndexes;
+        acceptedIndexes.reserve(routes.size());
+        for (size_t i = 0; i < routes.size(); ++i) {
+            counted[firstTrip + i] = false;
+        }
+        for (size_t i = 0; i < routes.size(); ++i) {
+            std::vector<PlatformConflict> found = m_platforms.checkTrip(firstTrip + static_cast<uint32_t>(i), counted);
+            if (!found.empty()) {
+                conflicts.push_back({"route", i, "Not enough platforms: " + found.front().describe()});
+                continue;
+            }
+            counted[firstTrip + i] = true;
+            acceptedIndexes.push_back(i);
+        }
+        // The batch is only copied when some of its routes are left out
+        std::vector<Route> accepted;
+        if (!conflicts.empty()) {
+            accepted.reserve(acceptedIndexes.size());
+            for (size_t i : acceptedIndexes) {
+                accepted.push_back(routes[i]);
+            }
+        }
+
+        if (!m_dbManager.importBatch(trains, formattedStations, conflicts.empty() ? routes : accepted, report)) {
+            // Nothing was written: new stations go back to one platform
+            m_platforms.keepRoutes(firstTrip, {});
+            for (const auto& station : formattedStations) {
+                StationId id = registry.find(station.getName());
+                if (id != INVALID_STATION_ID && !m_stations.contains(id)) {
+                    m_platforms.setPlatformCount(id, 1);
+                }
+            }
+            return false;
+        }
+
+        // Only rows that made it into the database are mirrored in memory
+        std::vector<bool> failedTrains(trains.size()), failedStations(stations.size()), failedRoutes(routes.size());
+        for (auto& failure : report.failures) {
+            if (failure.entity == "train") {
+                failedTrains[failure.index] = true;
+            } else if (failure.entity == "station") {
+                failedStations[failure.index] = true;
+            } else {
+                failure.index = acceptedIndexes[failure.index];
+                failedRoutes[failure.index] = true;
+            }
+        }
+        for (const auto& conflict : conflicts) {
+            failedRoutes[conflict.index] = true;
+        }
+        report.failures.insert(report.failures.end(), conflicts.begin(), conflicts.end());
+
+        m_trains.reserve(m_trains.size() + report.trainsImported);
+        for (size_t i = 0; i < trains.size(); ++i) {
+            if (!failedTrains[i]) {
+                m_trains.insert(trains[i].getId(), trains[i]);
+            }
+        }
+        m_stations.reserve(m_stations.size() + report.stationsImported);
+        for (size_t i = 0; i < formattedStations.size(); ++i) {
+            if (!failedStations[i]) {
+                StationId id = registry.intern(formattedStations[i].getName());
+                m_platforms.setPlatformCount(id, formattedStations[i].getPlatformCount());
+                m_stations.insert(id, std::move(formattedStations[i]));
+            } else {
+                StationId id = registry.find(formattedStations[i].getName());
+                if (id != INVALID_STATION_ID && !m_stations.contains(id)) {
+                    m_platforms.setPlatformCount(id, 1);
+                }
+            }
+        }
+
+        std::vector<bool> keep(routes.size());
+        size_t firstRoute = m_routes.size();
+        m_routes.reserve(m_routes.size() + report.routesImported);
+        for (size_t i = 0; i < routes.size(); ++i) {
+            if (!failedRoutes[i]) {
+                keep[i] = true;
+                m_routes.push_back(routes[i]);
+            }
+        }
+        m_platforms.keepRoutes(firstTrip, keep);
+        m_departureBoard.addRoutes(m_routes, firstRoute);
+        publish(EverythingChanged);
+        return true;
+    }
+
     bool Management::initializeSystem() {
         try {
             if (!m_dbManager.connect()) {
@@ -193,8 +491,9 @@ namespace CJ {
                 return false;
             }
 
-            m_dbManager.loadTrains(m_trains);
-            m_dbManager.loadStations(m_stations);
+            if (!loadNetworkFromSnapshot(getSnapshotPath())) {
+                loadNetworkFromDatabase();
+            }
 
             if (m_trains.empty() && m_stations.empty()) {
                 try {
@@ -202,6 +501,14 @@ namespace CJ {
                     addStation(nullptr, 5, {}, nullptr, nullptr, "Warsaw Central");
                     addStation(nullptr, 4, {}, nullptr, nullptr, "Krakow Main");
                     addStation(nullptr, 3, {}, nullptr, nullptr, "Gdansk Central");
+                    // Intermediate stops of the default routes
+                    addStation(nullptr, 2, {}, nullptr, nullptr, "Lodz Widzew");
+                    addStation(nullptr, 2, {}, nullptr, nullptr, "Czestochowa");
+                    addStation(nullptr, 2, {}, nullptr, nullptr, "Bydgoszcz");
+                    addStation(nullptr, 3, {}, nullptr, nullptr, "Poznan");
+                    addStation(nullptr, 3, {}, nullptr, nullptr, "Wroclaw Main");
+                    addStation(nullptr, 2, {}, nullptr, nullptr, "Radom");
+                    addStation(nullptr, 2, {}, nullptr, nullptr, "Kielce");
 
                     // Add trains
                     Train express("Express_101", 160, 400, 1001, 8);
@@ -240,6 +547,525 @@ namespace CJ {
         }
     }
 
+    void Management::shutdownSystem() {
+        disableWriteBehind();
+        if (m_dbManager.isConnected()) {
+            saveSnapshot();
+        }
+    }
+
+    std::string Management::getDatabasePath() {
+        return m_dbManager.getDatabasePath();
+    }
+
+    std::string Management::getSnapshotPath() {
+        std::filesystem::path dbPath = m_dbManager.getDatabasePath();
+        if (dbPath.empty()) {
+            dbPath = std::filesystem::current_path() / "database" / "train_system.db";
+        }
+        return dbPath.replace_extension(".snapshot").string();
+    }
+
+    std::string Management::getHierarchyPath() {
+        return std::filesystem::path(getSnapshotPath()).replace_extension(".ch").string();
+    }
+
+    bool Management::saveSnapshot(const std::string& path) {
+        CJ_TIMED("management.save_snapshot");
+        flush();
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        std::string target = path.empty() ? getSnapshotPath() : path;
+        bool defaultPath = target == getSnapshotPath();
+        uint64_t stamp = Snapshot::fileStamp(m_dbManager.getDatabasePath());
+        if (defaultPath && stamp != 0 && stamp == m_snapshotStamp && std::filesystem::exists(target)) {
+            // Nothing was written since the snapshot was loaded or saved
+            return true;
+        }
+
+        // With the queue flushed memory matches the database, so the image is
+        // taken from it along with the timetable indexes. A deleted train loses
+        // its assignments in the database but not on the routes in memory.
+        std::vector<std::pair<int, size_t>> assignments;
+        for (size_t i = 0; i < m_routes.size(); ++i) {
+            auto train = m_routes[i].getAssignedTrain();
+            if (train && m_trains.contains(train->getId())) {
+                assignments.emplace_back(train->getId(), i);
+            }
+        }
+        SnapshotIndexes indexes{m_platforms.getWindowsByStation(), m_platforms.getWindowsByTrip(),
+                                m_departureBoard.getDepartures(), m_departureBoard.getArrivals()};
+        if (!Snapshot::write(target, m_trains.values(), m_stations.values(), m_routes, assignments, stamp,
+                             &indexes)) {
+            return false;
+        }
+        if (defaultPath) {
+            m_snapshotStamp = stamp;
+        }
+        return true;
+    }
+
+    void Management::loadNetworkFromDatabase() {
+        CJ_TIMED("management.load_database");
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        reloadFromDatabase();
+    }
+
+    void Management::reloadFromDatabase() {
+        std::vector<Train> trains;
+        std::vector<Station> stations;
+        m_routes.clear();
+        m_dbManager.loadTrains(trains);
+        m_dbManager.loadStations(stations);
+        m_dbManager.loadRoutes(m_routes);
+        replaceTrains(trains);
+        replaceStations(stations);
+        rebuildTimetableIndexes();
+
+        std::vector<std::pair<int, size_t>> assignments;
+        if (m_dbManager.loadAssignments(assignments)) {
+            applyAssignments(assignments);
+        }
+        publish(EverythingChanged);
+    }
+
+    bool Management::loadNetworkFromSnapshot(const std::string& path) {
+        CJ_TIMED("management.load_snapshot");
+        Snapshot snapshot;
+        if (!snapshot.open(path)) {
+            return false;
+        }
+        if (snapshot.getSourceStamp() != Snapshot::fileStamp(m_dbManager.getDatabasePath())) {
+            // Database changed since the snapshot was taken
+            return false;
+        }
+
+        // Names go into the registry in ID order first. In an empty registry
+        // they keep their IDs, so the stops and indexes are used as stored.
+        StationRegistry& registry = StationRegistry::global();
+        std::vector<StationId> ids(snapshot.getNameCount());
+        bool sameIds = true;
+        for (StationId id = 0; id < ids.size(); ++id) {
+            ids[id] = registry.intern(snapshot.getName(id));
+            sameIds = sameIds && ids[id] == id;
+        }
+
+        std::vector<Train> trains;
+        std::vector<Station> stations;
+        std::vector<Route> routes;
+        trains.reserve(snapshot.getTrainCount());
+        stations.reserve(snapshot.getStationCount());
+        routes.reserve(snapshot.getRouteCount());
+
+        try {
+            for (size_t i = 0; i < snapshot.getTrainCount(); ++i) {
+                TrainView train = snapshot.getTrain(i);
+                trains.emplace_back(std::string(train.name), train.speed, train.capacity,
+                                    train.id, train.wagonCount);
+            }
+            for (size_t i = 0; i < snapshot.getStationCount(); ++i) {
+                StationView station = snapshot.getStation(i);
+                stations.emplace_back(nullptr, station.platformCount, std::vector<std::shared_ptr<Route>>{},
+                                      nullptr, nullptr, std::string(station.name));
+            }
+            for (size_t i = 0; i < snapshot.getRouteCount(); ++i) {
+                RouteView route = snapshot.getRoute(i);
+                std::vector<StationId> stops(route.stopCount);
+                for (uint32_t stop = 0; stop < route.stopCount; ++stop) {
+                    stops[stop] = ids[snapshot.getRouteStop(route, stop)];
+                }
+                routes.emplace_back(route.depHour, route.depMinute, route.arrHour, route.arrMinute,
+                                    route.duration, nullptr, nullptr, nullptr, std::vector<std::string>{});
+                routes.back().setStopIds(std::move(stops));
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Snapshot contains invalid data: " << e.what() << std::endl;
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        replaceTrains(trains);
+        replaceStations(stations);
+        m_routes = std::move(routes);
+        if (sameIds && snapshot.hasIndexes()) {
+            resetTimetableIndexes();
+            m_platforms.restoreWindows(snapshot.getWindowsByStation(), snapshot.getWindowsByTrip(),
+                                       snapshot.getWindowCount(), m_routes.size());
+            m_departureBoard.restore(m_routes, snapshot.getDepartures(), snapshot.getDepartureCount(),
+                                     snapshot.getArrivals(), snapshot.getArrivalCount());
+        } else {
+            rebuildTimetableIndexes();
+        }
+
+        std::vector<std::pair<int, size_t>> assignments;
+        assignments.reserve(snapshot.getAssignmentCount());
+        for (size_t i = 0; i < snapshot.getAssignmentCount(); ++i) {
+            AssignmentView assignment = snapshot.getAssignment(i);
+            assignments.emplace_back(assignment.trainId, assignment.routeIndex);
+        }
+        applyAssignments(assignments);
+        m_snapshotStamp = snapshot.getSourceStamp();
+        publish(EverythingChanged);
+        return true;
+    }
+
+    void Management::applyAssignments(const std::vector<std::pair<int, size_t>>& assignments) {
+        for (const auto& assignment : assignments) {
+            const Train* train = m_trains.find(assignment.first);
+            if (!train || assignment.second >= m_routes.size()) {
+                continue;
+            }
+            Route& route = m_routes[assignment.second];
+            if (!route.getAssignedTrain()) {
+                route.setTrainAssignment(std::make_shared<Train>(*train));
+            }
+        }
+    }
+
+    bool Management::enableWriteBehind() {
+        if (m_writeBehind) {
+            return true;
+        }
+
+        // The worker needs the same file as the main connection
+        std::string path = getDatabasePath();
+        if (path.empty() || path == DatabaseManager::IN_MEMORY) {
+            std::cerr << "Write-behind needs a database file" << std::endl;
+            return false;
+        }
+
+        auto worker = std::make_unique<PersistenceWorker>();
+        if (!worker->start(path)) {
+            return false;
+        }
+        m_writeBehind = std::move(worker);
+        return true;
+    }
+
+    void Management::disableWriteBehind() {
+        if (m_writeBehind) {
+            flush();
+            m_writeBehind->stop();
+            size_t failed = m_writeBehind->getFailedCount();
+            if (failed > 0) {
+                std::cerr << "Write-behind failed to save " << failed << (failed == 1 ? " change" : " changes")
+                          << " this session" << std::endl;
+            }
+            m_writeBehind.reset();
+        }
+    }
+
+    bool Management::isWriteBehindEnabled() {
+        return m_writeBehind != nullptr;
+    }
+
+    bool Management::flush() {
+        if (!m_writeBehind) {
+            return true;
+        }
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        return flushLocked();
+    }
+
+    bool Management::flushLocked() {
+        if (!m_writeBehind) {
+            return true;
+        }
+        m_writeBehind->flush();
+        size_t failed = m_writeBehind->takeErrors().size();
+        if (failed == 0) {
+            return true;
+        }
+
+        // Memory already shows the changes the worker could not save. Nothing
+        // new is queued while m_writeMutex is held, so reloading makes memory
+        // and the next snapshots match the database exactly again.
+        std::cerr << "Write-behind failed to save " << failed << (failed == 1 ? " change" : " changes")
+                  << "; reloading the network from the database" << std::endl;
+        reloadFromDatabase();
+        return false;
+    }
+
+    uint64_t Management::durabilityBarrier() {
+        return m_writeBehind ? m_writeBehind->lastTicket() : 0;
+    }
+
+    bool Management::waitForDurability(uint64_t barrier) {
+        if (!m_writeBehind) {
+            return true;
+        }
+        m_writeBehind->waitFor(barrier);
+        return !m_writeBehind->hasErrors() || flush();
+    }
+
+    void Management::syncWriteBehind() {
+        // Reads go to SQLite through another connection, so queued writes must land first
+        flush();
+    }
+
+    void Management::publish(unsigned changes) {
+        CJ_TIMED("management.publish");
+        // Called with m_writeMutex held. Only the parts that changed are copied;
+        // the rest is shared with the snapshot being replaced.
+        std::shared_ptr<const NetworkSnapshot> previous = std::atomic_load(&m_current);
+
+        std::shared_ptr<const NetworkSnapshot::TrainStore> trains;
+        std::shared_ptr<const NetworkSnapshot::StationStore> stations;
+        std::shared_ptr<const Timetable> timetable;
+        if (previous && !(changes & TrainsChanged)) {
+            trains = previous->shareTrains();
+        } else {
+            trains = std::make_shared<const NetworkSnapshot::TrainStore>(m_trains);
+        }
+        if (previous && !(changes & StationsChanged)) {
+            stations = previous->shareStations();
+        } else {
+            stations = std::make_shared<const NetworkSnapshot::StationStore>(m_stations);
+        }
+        if (previous && !(changes & TimetableChanged)) {
+            timetable = previous->shareTimetable();
+        } else {
+            timetable = std::make_shared<const Timetable>(m_routes, m_departureBoard, getHierarchyPath());
+        }
+
+        std::atomic_store(&m_current, std::shared_ptr<const NetworkSnapshot>(
+            std::make_shared<NetworkSnapshot>(++m_version, std::move(trains), std::move(stations),
+                                              std::move(timetable))));
+    }
+
+    std::shared_ptr<const NetworkSnapshot> Management::snapshot() {
+        std::shared_ptr<const NetworkSnapshot> current = std::atomic_load(&m_current);
+        if (!current) {
+            // Nothing published yet: an empty network
+            std::lock_guard<std::mutex> lock(m_writeMutex);
+            current = std::atomic_load(&m_current);
+            if (!current) {
+                publish(EverythingChanged);
+                current = std::atomic_load(&m_current);
+            }
+        }
+        return current;
+    }
+
+    void Management::resetTimetableIndexes() {
+        m_platforms.clear();
+        const std::vector<StationId>& stationIds = m_stations.keys();
+        for (size_t i = 0; i < stationIds.size(); ++i) {
+            m_platforms.setPlatformCount(stationIds[i], m_stations.values()[i].getPlatformCount());
+        }
+        m_departureBoard.clear();
+    }
+
+    void Management::rebuildTimetableIndexes() {
+        resetTimetableIndexes();
+        m_platforms.addRoutes(m_routes);
+        m_departureBoard.addRoutes(m_routes);
+    }
+
+    std::vector<PlatformConflict> Management::validatePlatforms() {
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        return m_platforms.validateAll();
+    }
+
+    void Management::printPlatformConflicts(const std::vector<PlatformConflict>& conflicts) {
+        if (conflicts.empty()) {
+            std::cout << "No platform conflicts.\n";
+            return;
+        }
+        std::shared_ptr<const NetworkSnapshot> network = snapshot();
+        const std::vector<Route>& routes = network->getRoutes();
+        std::cout << conflicts.size() << " platform conflict(s):\n";
+        for (const auto& conflict : conflicts) {
+            std::cout << "- " << conflict.describe() << "\n";
+            for (uint32_t trip : conflict.trips) {
+                if (trip < routes.size()) {
+                    const Route& route = routes[trip];
+                    std::cout << "    " << route.getStartStation() << " -> " << route.getEndStation() << " "
+                              << (route.getDepartureTimeHour() < 10 ? "0" : "") << route.getDepartureTimeHour() << ":"
+                              << (route.getDepartureTimeMinute() < 10 ? "0" : "") << route.getDepartureTimeMinute() << "\n";
+                }
+            }
+        }
+    }
+
+    bool Management::planJourney(const std::string& from, const std::string& to,
+                                 int departHour, int departMinute, Journey& journey) {
+        const StationRegistry& registry = StationRegistry::global();
+        StationId fromId = registry.find(from);
+        StationId toId = registry.find(to);
+        if (fromId == INVALID_STATION_ID || toId == INVALID_STATION_ID) {
+            journey.legs.clear();
+            return false;
+        }
+
+        return snapshot()->getTimetable().getJourneyPlanner().earliestArrival(fromId, toId, (departHour * 60 + departMinute) * 60, journey);
+    }
+
+    std::vector<Journey> Management::planJourneyOptions(const std::string& from, const std::string& to,
+                                                        int departHour, int departMinute) {
+        const StationRegistry& registry = StationRegistry::global();
+        StationId fromId = registry.find(from);
+        StationId toId = registry.find(to);
+        if (fromId == INVALID_STATION_ID || toId == INVALID_STATION_ID) {
+            return {};
+        }
+
+        return snapshot()->getTimetable().getRaptorRouter().query(fromId, toId, (departHour * 60 + departMinute) * 60);
+    }
+
+    std::vector<BoardEntry> Management::nextDepartures(const std::string& station, int hour, int minute,
+                                                       size_t count) {
+        StationId id = StationRegistry::global().find(station);
+        if (id == INVALID_STATION_ID) {
+            return {};
+        }
+        return snapshot()->getTimetable().getDepartureBoard().nextDepartures(id, (hour * 60 + minute) * 60, count);
+    }
+
+    std::vector<BoardEntry> Management::nextArrivals(const std::string& station, int hour, int minute,
+                                                     size_t count) {
+        StationId id = StationRegistry::global().find(station);
+        if (id == INVALID_STATION_ID) {
+            return {};
+        }
+        return snapshot()->getTimetable().getDepartureBoard().nextArrivals(id, (hour * 60 + minute) * 60, count);
+    }
+
+    void Management::printBoard(const std::vector<BoardEntry>& entries, bool departures) {
+        if (entries.empty()) {
+            std::cout << (departures ? "No departures.\n" : "No arrivals.\n");
+            return;
+        }
+        std::shared_ptr<const NetworkSnapshot> network = snapshot();
+        const std::vector<Route>& routes = network->getRoutes();
+        const StationRegistry& registry = StationRegistry::global();
+        for (const auto& entry : entries) {
+            if (entry.trip >= routes.size()) {
+                continue;
+            }
+            const Route& route = routes[entry.trip];
+            const std::vector<StationId>& stops = route.getStopIds();
+            int minutes = entry.time / 60;
+            std::cout << ((minutes / 60) % 24 < 10 ? "0" : "") << (minutes / 60) % 24 << ":"
+                      << (minutes % 60 < 10 ? "0" : "") << minutes % 60 << "  "
+                      << (departures ? "to " : "from ")
+                      << registry.getName(departures ? stops.back() : stops.front());
+            if (std::shared_ptr<Train> train = route.getAssignedTrain()) {
+                std::cout << " (" << train->getTrainName() << ")";
+            }
+            std::cout << "\n";
+        }
+    }
+
+    int Management::shortestRunningTime(const std::string& from, const std::string& to,
+                                        std::vector<std::string>* path) {
+        const StationRegistry& registry = StationRegistry::global();
+        StationId fromId = registry.find(from);
+        StationId toId = registry.find(to);
+        if (path) {
+            path->clear();
+        }
+        if (fromId == INVALID_STATION_ID || toId == INVALID_STATION_ID) {
+            return RailGraph::UNREACHABLE;
+        }
+
+        std::vector<StationId> stations;
+        int seconds = snapshot()->getTimetable().getRailGraph().shortestPath(fromId, toId,
+                                                                             path ? &stations : nullptr);
+        if (path) {
+            for (StationId station : stations) {
+                path->push_back(registry.getName(station));
+            }
+        }
+        return seconds;
+    }
+
+    void Management::printJourney(const Journey& journey) {
+        const StationRegistry& registry = StationRegistry::global();
+        auto clock = [](int seconds) {
+            int minutes = seconds / 60;
+            std::ostringstream out;
+            out << ((minutes / 60) % 24 < 10 ? "0" : "") << (minutes / 60) % 24 << ":"
+                << (minutes % 60 < 10 ? "0" : "") << minutes % 60;
+            return out.str();
+        };
+
+        std::shared_ptr<const NetworkSnapshot> network = snapshot();
+        const std::vector<Route>& routes = network->getRoutes();
+        for (const auto& leg : journey.legs) {
+            std::shared_ptr<Train> train = leg.trip < routes.size() ? routes[leg.trip].getAssignedTrain() : nullptr;
+            std::cout << clock(leg.departure) << " " << registry.getName(leg.from) << " -> "
+                      << clock(leg.arrival) << " " << registry.getName(leg.to);
+            if (train) {
+                std::cout << " (" << train->getTrainName() << ")";
+            }
+            std::cout << "\n";
+        }
+        std::cout << "Arrival " << clock(journey.arrival()) << ", " << journey.transfers()
+                  << (journey.transfers() == 1 ? " transfer" : " transfers") << "\n";
+    }
+
+    SimulationStats Management::runSimulation(EventStream* events) {
+        std::shared_ptr<const NetworkSnapshot> network = snapshot();
+        Simulation simulation(network->getRoutes());
+        if (events && events->hasSinks()) {
+            events->start(simulation);
+            simulation.setEventCallback([events](const SimulationEvent& event) { events->publish(event); });
+        }
+        SimulationStats stats = simulation.run();
+        if (events) {
+            events->finish();
+        }
+
+        std::cout << "\nSimulated " << stats.tripsRun << " trips of " << network->getTrains().size() << " trains\n"
+                  << "Events processed: " << stats.eventsProcessed << "\n";
+        for (size_t type = 0; type < stats.eventsByType.size(); ++type) {
+            std::cout << "  " << Simulation::eventTypeName(static_cast<SimulationEventType>(type))
+                      << ": " << stats.eventsByType[type] << "\n";
+        }
+        std::cout << "Peak trains in service: " << stats.peakTrainsInService << "\n"
+                  << "Wall time: " << stats.elapsedSeconds * 1000.0 << " ms ("
+                  << static_cast<uint64_t>(stats.eventsPerSecond) << " events/s)\n";
+        if (events) {
+            for (const auto& sink : events->getStats()) {
+                std::cout << "Event sink " << sink.name << " (" << EventStream::policyName(sink.policy) << "): "
+                          << sink.delivered << " delivered, " << sink.dropped << " dropped\n";
+                if (!sink.error.empty()) {
+                    std::cout << "  Error: " << sink.error << "\n";
+                }
+            }
+            if (events->getProducerWaits() > 0) {
+                std::cout << "Simulation waited for a full event ring " << events->getProducerWaits() << " times\n";
+            }
+        }
+        return stats;
+    }
+
+    void Management::setStatementProfiling(bool enabled) {
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        m_dbManager.setProfiling(enabled);
+    }
+
+    bool Management::isStatementProfiling() {
+        return m_dbManager.isProfiling();
+    }
+
+    std::vector<StatementProfile> Management::getStatementProfiles(size_t topN) {
+        return m_dbManager.getStatementProfiles(topN);
+    }
+
+    void Management::resetStatementProfiles() {
+        m_dbManager.resetStatementProfiles();
+    }
+
+    bool Management::writeStatementProfiles(const std::string& path, size_t topN) {
+        std::ofstream out(path);
+        if (!out) {
+            return false;
+        }
+        DatabaseManager::printStatementProfiles(out, getStatementProfiles(topN));
+        return static_cast<bool>(out);
+    }
+
     std::string Management::formatStationName(const std::string& name) {
         if (name.empty()) return name;
         
@@ -268,8 +1094,6 @@ namespace CJ {
     }
 
     bool Management::compareStationNames(const std::string& name1, const std::string& name2) {
-        std::string formattedName1 = formatStationName(name1);
-        std::string formattedName2 = formatStationName(name2);
-        return formattedName1 == formattedName2;
+        return StationRegistry::equalNames(name1, name2);
     }
 }
\ No newline at end of file
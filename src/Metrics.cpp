@@ -0,0 +1,306 @@
+#include "../include/Metrics.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace CJ {
+
+size_t HistogramLayout::bucketOf(uint64_t value) {
+    if (value < static_cast<uint64_t>(SUB_BUCKETS)) {
+        return static_cast<size_t>(value);
+    }
+    int exponent = 63 - __builtin_clzll(value);
+    if (exponent >= MAX_EXPONENT) {
+        return BUCKETS - 1;
+    }
+    size_t sub = static_cast<size_t>(value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+    return static_cast<size_t>(exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+uint64_t HistogramLayout::lowerBound(size_t bucket) {
+    if (bucket < static_cast<size_t>(SUB_BUCKETS)) {
+        return bucket;
+    }
+    int shift = static_cast<int>(bucket / SUB_BUCKETS) - 1;
+    return (static_cast<uint64_t>(SUB_BUCKETS) + bucket % SUB_BUCKETS) << shift;
+}
+
+uint64_t HistogramLayout::upperBound(size_t bucket) {
+    if (bucket < static_cast<size_t>(SUB_BUCKETS)) {
+        return bucket;
+    }
+    int shift = static_cast<int>(bucket / SUB_BUCKETS) - 1;
+    return lowerBound(bucket) + (uint64_t{1} << shift) - 1;
+}
+
+double MetricSummary::mean() const {
+    return count ? static_cast<double>(sum) / static_cast<double>(count) : 0.0;
+}
+
+uint64_t MetricSummary::percentile(double fraction) const {
+    if (count == 0) {
+        return 0;
+    }
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(fraction * static_cast<double>(count) + 0.5));
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < buckets.size(); ++bucket) {
+        seen += buckets[bucket];
+        if (seen >= rank) {
+            return std::clamp(HistogramLayout::upperBound(bucket), min, max);
+        }
+    }
+    return max;
+}
+
+// Hands the thread's shard back to the registry when the thread exits. The
+// pointers have no destructors, so they stay usable for code that records
+// after the owner is gone, such as destructors of statics running at exit.
+struct ShardOwner {
+    static thread_local MetricsRegistry* registry;
+    static thread_local MetricsRegistry::Shard* shard;
+    ~ShardOwner() {
+        if (shard) {
+            registry->retire(shard);
+            shard = nullptr;
+        }
+    }
+};
+
+thread_local MetricsRegistry* ShardOwner::registry = nullptr;
+thread_local MetricsRegistry::Shard* ShardOwner::shard = nullptr;
+
+MetricsRegistry::Shard::~Shard() {
+    for (auto& histogram : histograms) {
+        delete histogram.load(std::memory_order_relaxed);
+    }
+}
+
+MetricsRegistry& MetricsRegistry::global() {
+    // Never destroyed: threads may still retire their shards during exit
+    static MetricsRegistry* registry = new MetricsRegistry();
+    return *registry;
+}
+
+MetricsRegistry::MetricId MetricsRegistry::define(const std::string& name, bool histogram) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (size_t id = 0; id < m_definitions.size(); ++id) {
+        if (m_definitions[id].name == name) {
+            if (m_definitions[id].histogram != histogram) {
+                throw std::invalid_argument("Metric '" + name + "' is already registered with another type");
+            }
+            return id;
+        }
+    }
+    if (m_definitions.size() == MAX_METRICS) {
+        throw std::length_error("Too many metrics registered");
+    }
+    m_definitions.push_back({name, histogram});
+    return m_definitions.size() - 1;
+}
+
+MetricsRegistry::MetricId MetricsRegistry::counter(const std::string& name) {
+    return define(name, false);
+}
+
+MetricsRegistry::MetricId MetricsRegistry::histogram(const std::string& name) {
+    return define(name, true);
+}
+
+MetricsRegistry::Shard& MetricsRegistry::localShard() {
+    if (!ShardOwner::shard) {
+        // Constructed once per thread; a shard created after the owner has
+        // run is never retired and stays registered until the process ends
+        thread_local ShardOwner owner;
+        (void)owner;
+        ShardOwner::registry = this;
+        ShardOwner::shard = new Shard();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_shards.push_back(ShardOwner::shard);
+    }
+    return *ShardOwner::shard;
+}
+
+void MetricsRegistry::add(MetricId id, uint64_t amount) {
+    std::atomic<uint64_t>& value = localShard().counters[id];
+    value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+void MetricsRegistry::record(MetricId id, uint64_t nanoseconds) {
+    Shard& shard = localShard();
+    HistogramShard* histogram = shard.histograms[id].load(std::memory_order_relaxed);
+    if (!histogram) {
+        histogram = new HistogramShard();
+        shard.histograms[id].store(histogram, std::memory_order_release);
+    }
+    auto bump = [](std::atomic<uint64_t>& value, uint64_t amount) {
+        value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    };
+    bump(histogram->count, 1);
+    bump(histogram->sum, nanoseconds);
+    bump(histogram->buckets[HistogramLayout::bucketOf(nanoseconds)], 1);
+    if (nanoseconds < histogram->min.load(std::memory_order_relaxed)) {
+        histogram->min.store(nanoseconds, std::memory_order_relaxed);
+    }
+    if (nanoseconds > histogram->max.load(std::memory_order_relaxed)) {
+        histogram->max.store(nanoseconds, std::memory_order_relaxed);
+    }
+}
+
+void MetricsRegistry::mergeInto(const Shard& shard, std::vector<MetricSummary>& totals) const {
+    for (size_t id = 0; id < totals.size(); ++id) {
+        MetricSummary& total = totals[id];
+        if (!total.histogram) {
+            total.count += shard.counters[id].load(std::memory_order_relaxed);
+            continue;
+        }
+        const HistogramShard* histogram = shard.histograms[id].load(std::memory_order_acquire);
+        if (!histogram) {
+            continue;
+        }
+        uint64_t count = histogram->count.load(std::memory_order_relaxed);
+        if (count == 0) {
+            continue;
+        }
+        total.min = total.count ? std::min(total.min, histogram->min.load(std::memory_order_relaxed))
+                                : histogram->min.load(std::memory_order_relaxed);
+        total.max = std::max(total.max, histogram->max.load(std::memory_order_relaxed));
+        total.count += count;
+        total.sum += histogram->sum.load(std::memory_order_relaxed);
+        for (size_t bucket = 0; bucket < HistogramLayout::BUCKETS; ++bucket) {
+            total.buckets[bucket] += histogram->buckets[bucket].load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void MetricsRegistry::retire(Shard* shard) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_shards.erase(std::remove(m_shards.begin(), m_shards.end(), shard), m_shards.end());
+        size_t defined = m_definitions.size();
+        while (m_retired.size() < defined) {
+            const Definition& definition = m_definitions[m_retired.size()];
+            MetricSummary summary;
+            summary.name = definition.name;
+            summary.histogram = definition.histogram;
+            if (summary.histogram) {
+                summary.buckets.assign(HistogramLayout::BUCKETS, 0);
+            }
+            m_retired.push_back(std::move(summary));
+        }
+        mergeInto(*shard, m_retired);
+    }
+    delete shard;
+}
+
+std::vector<MetricSummary> MetricsRegistry::collect() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<MetricSummary> totals(m_retired.begin(), m_retired.end());
+    for (size_t id = totals.size(); id < m_definitions.size(); ++id) {
+        MetricSummary summary;
+        summary.name = m_definitions[id].name;
+        summary.histogram = m_definitions[id].histogram;
+        if (summary.histogram) {
+            summary.buckets.assign(HistogramLayout::BUCKETS, 0);
+        }
+        totals.push_back(std::move(summary));
+    }
+    for (const Shard* shard : m_shards) {
+        mergeInto(*shard, totals);
+    }
+    return totals;
+}
+
+// Approximate while other threads are recording: an update racing the reset
+// may survive it
+void MetricsRegistry::reset() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_retired.clear();
+    for (Shard* shard : m_shards) {
+        for (auto& value : shard->counters) {
+            value.store(0, std::memory_order_relaxed);
+        }
+        for (auto& slot : shard->histograms) {
+            HistogramShard* histogram = slot.load(std::memory_order_acquire);
+            if (!histogram) {
+                continue;
+            }
+            histogram->count.store(0, std::memory_order_relaxed);
+            histogram->sum.store(0, std::memory_order_relaxed);
+            histogram->min.store(UINT64_MAX, std::memory_order_relaxed);
+            histogram->max.store(0, std::memory_order_relaxed);
+            for (auto& bucket : histogram->buckets) {
+                bucket.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+void MetricsRegistry::writeText(std::ostream& out) const {
+    std::vector<MetricSummary> metrics = collect();
+    std::ostringstream text;
+    text << std::left << std::setw(34) << "metric" << std::right << std::setw(10) << "count"
+         << std::setw(12) << "mean us" << std::setw(12) << "p50 us" << std::setw(12) << "p90 us"
+         << std::setw(12) << "p99 us" << std::setw(12) << "max us" << "\n";
+    text << std::fixed << std::setprecision(1);
+    for (const auto& metric : metrics) {
+        text << std::left << std::setw(34) << metric.name << std::right << std::setw(10) << metric.count;
+        if (metric.histogram && metric.count) {
+            text << std::setw(12) << metric.mean() / 1000.0
+                 << std::setw(12) << metric.percentile(0.50) / 1000.0
+                 << std::setw(12) << metric.percentile(0.90) / 1000.0
+                 << std::setw(12) << metric.percentile(0.99) / 1000.0
+                 << std::setw(12) << metric.max / 1000.0;
+        }
+        text << "\n";
+    }
+    out << text.str();
+}
+
+void MetricsRegistry::writeJson(std::ostream& out) const {
+    std::vector<MetricSummary> metrics = collect();
+    std::ostringstream json;
+    json << std::fixed << std::setprecision(1) << "{\n  \"counters\": {";
+    bool first = true;
+    for (const auto& metric : metrics) {
+        if (!metric.histogram) {
+            json << (first ? "\n" : ",\n") << "    \"" << metric.name << "\": " << metric.count;
+            first = false;
+        }
+    }
+    json << "\n  },\n  \"histograms\": {";
+    first = true;
+    for (const auto& metric : metrics) {
+        if (!metric.histogram) {
+            continue;
+        }
+        json << (first ? "\n" : ",\n") << "    \"" << metric.name << "\": {\"count\": " << metric.count
+             << ", \"sum_ns\": " << metric.sum << ", \"mean_ns\": " << metric.mean()
+             << ", \"min_ns\": " << (metric.count ? metric.min : 0)
+             << ", \"p50_ns\": " << metric.percentile(0.50) << ", \"p90_ns\": " << metric.percentile(0.90)
+             << ", \"p99_ns\": " << metric.percentile(0.99) << ", \"p999_ns\": " << metric.percentile(0.999)
+             << ", \"max_ns\": " << metric.max << "}";
+        first = false;
+    }
+    json << "\n  }\n}\n";
+    out << json.str();
+}
+
+bool MetricsRegistry::writeFile(const std::string& path) const {
+    std::ofstream out(path);
+    if (!out) {
+        return false;
+    }
+    bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+    if (json) {
+        writeJson(out);
+    } else {
+        writeText(out);
+    }
+    return static_cast<bool>(out);
+}
+
+} // namespace CJ
@@ -0,0 +1,287 @@
+#include "../include/NetworkGenerator.hpp"
+#include "../include/PlatformConflictChecker.hpp"
+#include "../include/Snapshot.hpp"
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <set>
+#include <tuple>
+#include <unordered_set>
+
+namespace CJ {
+
+namespace {
+
+// splitmix64; the standard distributions differ between library
+// implementations, so everything random is derived from this by hand
+uint64_t nextRandom(uint64_t& state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Uniform in [low, high]
+int uniform(uint64_t& state, int low, int high) {
+    return low + static_cast<int>(nextRandom(state) % static_cast<uint64_t>(high - low + 1));
+}
+
+double unit(uint64_t& state) {
+    return static_cast<double>(nextRandom(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+double normal(uint64_t& state, double mean, double deviation) {
+    double u1 = std::max(unit(state), 1e-12);
+    double u2 = unit(state);
+    return mean + deviation * std::sqrt(-2.0 * std::log(u1)) * std::cos(6.283185307179586 * u2);
+}
+
+// Minute of the day: a third around each peak, the rest spread over the service day
+int departureMinute(uint64_t& state) {
+    double roll = unit(state);
+    double minute;
+    if (roll < 0.33) {
+        minute = normal(state, 8 * 60, 60);
+    } else if (roll < 0.66) {
+        minute = normal(state, 17 * 60, 75);
+    } else {
+        minute = 5 * 60 + unit(state) * 18 * 60;
+    }
+    return std::clamp(static_cast<int>(minute), 0, 24 * 60 - 1);
+}
+
+const char* const NAME_STARTS[] = {
+    "Bor", "Kra", "Wis", "Lub", "Gor", "Pol", "Sta", "Dab", "Ost", "Zel", "Mir", "Bial",
+    "Czar", "Now", "Rad", "Sos", "Kal", "Tar", "Gli", "Ple", "Brze", "Sie", "Wol", "Ole",
+};
+const char* const NAME_ENDS[] = {
+    "ow", "in", "ice", "awa", "ek", "no", "sko", "yn", "owo", "ica", "any", "ewo",
+};
+const char* const HUB_SUFFIXES[] = {" Central", " Main"};
+const char* const LOCAL_SUFFIXES[] = {" East", " West", " North", " South", " Junction", " Town"};
+
+template <typename T, size_t N>
+const T& pick(uint64_t& state, const T (&items)[N]) {
+    return items[nextRandom(state) % N];
+}
+
+std::string lowercase(std::string text) {
+    std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return std::tolower(c); });
+    return text;
+}
+
+} // namespace
+
+NetworkGenerator::NetworkGenerator(const GeneratorOptions& options) : m_options(options) {}
+
+std::vector<std::string> NetworkGenerator::makeStationNames(uint64_t& state, size_t hubs) const {
+    std::vector<std::string> names;
+    std::unordered_set<std::string> used;
+    names.reserve(m_options.stations);
+
+    for (size_t i = 0; i < m_options.stations; ++i) {
+        std::string name = std::string(pick(state, NAME_STARTS)) + pick(state, NAME_ENDS);
+        if (i < hubs) {
+            name += pick(state, HUB_SUFFIXES);
+        } else if (unit(state) < 0.2) {
+            name += pick(state, LOCAL_SUFFIXES);
+        }
+        // Station names match case-insensitively, so uniqueness is checked that way
+        std::string unique = name;
+        for (int n = 2; !used.insert(lowercase(unique)).second; ++n) {
+            unique = name + " " + std::to_string(n);
+        }
+        names.push_back(unique);
+    }
+    return names;
+}
+
+std::vector<NetworkGenerator::Line> NetworkGenerator::makeLines(uint64_t& state, size_t hubs) const {
+    const size_t stations = m_options.stations;
+    std::vector<std::vector<size_t>> regions(hubs);
+    for (size_t station = hubs; station < stations; ++station) {
+        regions[(station - hubs) % hubs].push_back(station);
+    }
+
+    std::vector<Line> lines;
+    for (size_t hub = 0; hub < hubs; ++hub) {
+        std::vector<size_t>& members = regions[hub];
+        for (size_t i = members.size(); i > 1; --i) {
+            std::swap(members[i - 1], members[nextRandom(state) % i]);
+        }
+        // Branch lines radiate from the hub, 3 to 10 stations each
+        for (size_t first = 0; first < members.size();) {
+            size_t length = std::min<size_t>(uniform(state, 3, 10), members.size() - first);
+            Line line{{hub}, {}, false};
+            for (size_t i = 0; i < length; ++i) {
+                line.stops.push_back(members[first + i]);
+                line.legMinutes.push_back(uniform(state, 4, 12));
+            }
+            lines.push_back(std::move(line));
+            first += length;
+        }
+    }
+
+    // Trunk lines: a ring through all hubs plus chords, calling at a few
+    // stations of the origin's region on the way out
+    if (hubs > 1) {
+        std::set<std::pair<size_t, size_t>> joined;
+        auto addTrunk = [&](size_t from, size_t to) {
+            if (from == to || !joined.insert({std::min(from, to), std::max(from, to)}).second) {
+                return;
+            }
+            Line line{{from}, {}, true};
+            const std::vector<size_t>& members = regions[from];
+            size_t calls = std::min<size_t>(uniform(state, 0, 2), members.size());
+            for (size_t i = 0; i < calls; ++i) {
+                line.stops.push_back(members[i]);
+                line.legMinutes.push_back(uniform(state, 8, 20));
+            }
+            line.stops.push_back(to);
+            line.legMinutes.push_back(uniform(state, 20, 60));
+            lines.push_back(std::move(line));
+        };
+        for (size_t hub = 0; hub < hubs; ++hub) {
+            addTrunk(hub, (hub + 1) % hubs);
+        }
+        for (size_t chord = 0; chord < hubs / 2; ++chord) {
+            size_t from = nextRandom(state) % hubs;
+            addTrunk(from, nextRandom(state) % hubs);
+        }
+    }
+    return lines;
+}
+
+GeneratedNetwork NetworkGenerator::generate() const {
+    GeneratedNetwork network;
+    if (m_options.stations < 2) {
+        return network;
+    }
+    uint64_t state = m_options.seed;
+    const size_t hubs = std::min(m_options.stations,
+                                 m_options.hubs ? m_options.hubs : std::max<size_t>(1, m_options.stations / 40));
+
+    std::vector<std::string> names = makeStationNames(state, hubs);
+    std::vector<Line> lines = makeLines(state, hubs);
+
+    // Trains: a fifth express, three tenths InterCity, the rest regional
+    enum TrainClass { Express, InterCity, Regional };
+    std::vector<size_t> pools[3];
+    network.trains.reserve(m_options.trains);
+    for (size_t i = 0; i < m_options.trains; ++i) {
+        TrainClass type = i % 10 < 2 ? Express : (i % 10 < 5 ? InterCity : Regional);
+        int id = m_options.firstTrainId + static_cast<int>(i);
+        int speed, wagons;
+        std::string prefix;
+        switch (type) {
+            case Express: prefix = "Express_"; speed = uniform(state, 160, 200); wagons = uniform(state, 6, 12); break;
+            case InterCity: prefix = "InterCity_"; speed = uniform(state, 130, 160); wagons = uniform(state, 5, 9); break;
+            default: prefix = "Regional_"; speed = uniform(state, 90, 120); wagons = uniform(state, 2, 5); break;
+        }
+        network.trains.emplace_back(prefix + std::to_string(id), speed, wagons * uniform(state, 50, 70), id, wagons);
+        pools[type].push_back(i);
+    }
+    std::vector<std::shared_ptr<Train>> trainPtrs;
+    for (const auto& train : network.trains) {
+        trainPtrs.push_back(std::make_shared<Train>(train));
+    }
+    size_t nextInPool[3] = {0, 0, 0};
+    auto assignTrain = [&](TrainClass type) -> std::shared_ptr<Train> {
+        for (int attempt = 0; attempt < 3; ++attempt) {
+            const std::vector<size_t>& pool = pools[(type + attempt) % 3];
+            if (!pool.empty()) {
+                size_t& next = nextInPool[(type + attempt) % 3];
+                return trainPtrs[pool[next++ % pool.size()]];
+            }
+        }
+        return nullptr;
+    };
+
+    // Trunk lines run three times as often as branch lines
+    std::vector<size_t> cumulative;
+    size_t totalWeight = 0;
+    for (const auto& line : lines) {
+        totalWeight += line.trunk ? 3 : 1;
+        cumulative.push_back(totalWeight);
+    }
+
+    // (origin, destination, departure minute) is the route's identity in the database
+    std::set<std::tuple<size_t, size_t, int>> taken;
+    network.routes.reserve(m_options.routes);
+    size_t trunkServices = 0;
+    for (size_t attempt = 0; network.routes.size() < m_options.routes && attempt < m_options.routes * 4; ++attempt) {
+        size_t pickWeight = nextRandom(state) % totalWeight;
+        const Line& line = lines[std::upper_bound(cumulative.begin(), cumulative.end(), pickWeight) - cumulative.begin()];
+        bool reverse = nextRandom(state) & 1;
+
+        std::vector<size_t> stops = line.stops;
+        std::vector<int> legs = line.legMinutes;
+        if (reverse) {
+            std::reverse(stops.begin(), stops.end());
+            std::reverse(legs.begin(), legs.end());
+        }
+
+        int departure = departureMinute(state);
+        int tries = 0;
+        while (!taken.insert({stops.front(), stops.back(), departure}).second && tries++ < 60) {
+            departure = (departure + 1) % (24 * 60);
+        }
+        if (tries > 60) {
+            continue;
+        }
+
+        int duration = static_cast<int>(stops.size() - 2) * (Route::DWELL_SECONDS / 60);
+        for (int leg : legs) {
+            duration += leg;
+        }
+        int arrival = (departure + duration) % (24 * 60);
+
+        std::vector<std::string> stopNames;
+        for (size_t stop : stops) {
+            stopNames.push_back(names[stop]);
+        }
+        std::shared_ptr<Train> train;
+        if (line.trunk) {
+            train = assignTrain(trunkServices++ % 2 ? InterCity : Express);
+        } else {
+            train = assignTrain(Regional);
+        }
+        network.routes.emplace_back(departure / 60, departure % 60, arrival / 60, arrival % 60, duration,
+                                    train, nullptr, nullptr, stopNames);
+        if (train) {
+            network.assignments.emplace_back(train->getId(), network.routes.size() - 1);
+        }
+    }
+
+    // Platforms: a base count by station size, raised to the most trains ever
+    // present at once so the timetable validates cleanly
+    std::vector<int> platforms(names.size());
+    for (size_t i = 0; i < names.size(); ++i) {
+        platforms[i] = i < hubs ? uniform(state, 6, 12) : uniform(state, 1, 3);
+    }
+    PlatformConflictChecker checker;
+    for (const auto& name : names) {
+        checker.setPlatformCount(StationRegistry::global().intern(name), 1);
+    }
+    for (const auto& route : network.routes) {
+        checker.addRoute(route);
+    }
+    std::vector<int> peak(StationRegistry::global().size(), 1);
+    for (const auto& conflict : checker.validateAll()) {
+        peak[conflict.station] = std::max(peak[conflict.station], conflict.trainsPresent);
+    }
+
+    network.stations.reserve(names.size());
+    for (size_t i = 0; i < names.size(); ++i) {
+        int count = std::max(platforms[i], peak[StationRegistry::global().find(names[i])]);
+        network.stations.emplace_back(nullptr, count, std::vector<std::shared_ptr<Route>>{}, nullptr, nullptr,
+                                      names[i]);
+    }
+    return network;
+}
+
+bool NetworkGenerator::writeSnapshot(const GeneratedNetwork& network, const std::string& path) {
+    return Snapshot::write(path, network.trains, network.stations, network.routes, network.assignments, 0);
+}
+
+} // namespace CJ
@@ -0,0 +1,45 @@
+#include "../include/NetworkSnapshot.hpp"
+
+namespace CJ {
+
+Timetable::Timetable(std::vector<Route> routes, DepartureBoard departureBoard, std::string hierarchyPath)
+    : m_routes(std::move(routes)),
+      m_departureBoard(std::move(departureBoard)),
+      m_hierarchyPath(std::move(hierarchyPath)) {}
+
+const JourneyPlanner& Timetable::getJourneyPlanner() const {
+    std::call_once(m_journeyPlannerOnce, [this] {
+        m_journeyPlanner = std::make_unique<JourneyPlanner>(m_routes);
+    });
+    return *m_journeyPlanner;
+}
+
+const RaptorRouter& Timetable::getRaptorRouter() const {
+    std::call_once(m_raptorRouterOnce, [this] {
+        m_raptorRouter = std::make_unique<RaptorRouter>(m_routes);
+    });
+    return *m_raptorRouter;
+}
+
+const RailGraph& Timetable::getRailGraph() const {
+    std::call_once(m_railGraphOnce, [this] {
+        auto graph = std::make_unique<RailGraph>(m_routes);
+        // A stale file fails the fingerprint check and is rebuilt
+        if (!graph->loadHierarchy(m_hierarchyPath)) {
+            graph->buildContractionHierarchy();
+            graph->saveHierarchy(m_hierarchyPath);
+        }
+        m_railGraph = std::move(graph);
+    });
+    return *m_railGraph;
+}
+
+NetworkSnapshot::NetworkSnapshot(uint64_t version, std::shared_ptr<const TrainStore> trains,
+                                 std::shared_ptr<const StationStore> stations,
+                                 std::shared_ptr<const Timetable> timetable)
+    : m_version(version),
+      m_trains(std::move(trains)),
+      m_stations(std::move(stations)),
+      m_timetable(std::move(timetable)) {}
+
+} // namespace CJ
@@ -0,0 +1,161 @@
+#include "../include/PersistenceWorker.hpp"
+#include "../include/Metrics.hpp"
+#include <iostream>
+
+namespace CJ {
+
+PersistenceWorker::PersistenceWorker()
+    : m_nextTicket(1), m_completedTicket(0), m_running(false), m_stopping(false), m_failedCount(0) {
+}
+
+PersistenceWorker::~PersistenceWorker() {
+    stop();
+}
+
+bool PersistenceWorker::start(const std::string& dbPath) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_running) {
+        return true;
+    }
+
+    if (!m_database.connect(dbPath)) {
+        std::cerr << "Write-behind worker failed to connect to database" << std::endl;
+        return false;
+    }
+
+    m_stopping = false;
+    m_running = true;
+    m_thread = std::thread(&PersistenceWorker::run, this);
+    return true;
+}
+
+void PersistenceWorker::stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_running) {
+            return;
+        }
+        m_stopping = true;
+    }
+    m_workAvailable.notify_one();
+    m_thread.join();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_running = false;
+    m_database.disconnect();
+}
+
+bool PersistenceWorker::isRunning() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_running;
+}
+
+uint64_t PersistenceWorker::enqueue(Operation operation, const std::string& description) {
+    uint64_t ticket;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ticket = m_nextTicket++;
+        m_queue.push_back({ticket, std::move(operation), description});
+    }
+    m_workAvailable.notify_one();
+    return ticket;
+}
+
+void PersistenceWorker::waitFor(uint64_t ticket) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_batchCommitted.wait(lock, [this, ticket] {
+        return m_completedTicket >= ticket || !m_running;
+    });
+}
+
+void PersistenceWorker::flush() {
+    waitFor(lastTicket());
+}
+
+uint64_t PersistenceWorker::lastTicket() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_nextTicket - 1;
+}
+
+size_t PersistenceWorker::getFailedCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_failedCount;
+}
+
+bool PersistenceWorker::hasErrors() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return !m_errors.empty();
+}
+
+std::vector<std::string> PersistenceWorker::takeErrors() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<std::string> errors;
+    errors.swap(m_errors);
+    return errors;
+}
+
+void PersistenceWorker::run() {
+    std::vector<PendingWrite> batch;
+    batch.reserve(MAX_BATCH_SIZE);
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_workAvailable.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+            if (m_queue.empty()) {
+                return;  // stopping and fully drained
+            }
+
+            while (!m_queue.empty() && batch.size() < MAX_BATCH_SIZE) {
+                batch.push_back(std::move(m_queue.front()));
+                m_queue.pop_front();
+            }
+        }
+
+        applyBatch(batch);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_completedTicket = batch.back().ticket;
+        }
+        m_batchCommitted.notify_all();
+        batch.clear();
+    }
+}
+
+void PersistenceWorker::applyBatch(std::vector<PendingWrite>& batch) {
+    CJ_TIMED("writebehind.apply_batch");
+    std::vector<std::string> errors;
+    bool inTransaction = m_database.beginTransaction();
+
+    for (auto& write : batch) {
+        try {
+            if (!write.operation(m_database)) {
+                errors.push_back(write.description + ": database write failed");
+            }
+        } catch (const std::exception& e) {
+            errors.push_back(write.description + ": " + e.what());
+        }
+    }
+
+    if (inTransaction && !m_database.commitTransaction()) {
+        m_database.rollbackTransaction();
+        errors.clear();
+        for (const auto& write : batch) {
+            errors.push_back(write.description + ": transaction commit failed");
+        }
+    }
+
+    CJ_COUNT("writebehind.writes", batch.size());
+    CJ_COUNT("writebehind.failures", errors.size());
+    if (!errors.empty()) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_failedCount += errors.size();
+        for (auto& error : errors) {
+            std::cerr << "Write-behind error: " << error << std::endl;
+            m_errors.push_back(std::move(error));
+        }
+    }
+}
+
+} // namespace CJ
@@ -0,0 +1,366 @@
+#include "../include/PlatformConflictChecker.hpp"
+#include "../include/TaskScheduler.hpp"
+#include "../include/Metrics.hpp"
+#include <algorithm>
+#include <iomanip>
+#include <iterator>
+#include <limits>
+#include <sstream>
+
+namespace CJ {
+
+namespace {
+
+constexpr int DAY_SECONDS = 24 * 60 * 60;
+
+std::string formatClock(int seconds) {
+    int minutes = seconds / 60;
+    std::ostringstream out;
+    out << std::setw(2) << std::setfill('0') << (minutes / 60) % 24 << ":"
+        << std::setw(2) << std::setfill('0') << minutes % 60;
+    if (seconds % 60 != 0) {
+        out << ":" << std::setw(2) << std::setfill('0') << seconds % 60;
+    }
+    return out.str();
+}
+
+// Heap of occupied windows ordered by end time, earliest on top
+struct EndsLater {
+    template <typename T>
+    bool operator()(const T& a, const T& b) const { return a.end > b.end; }
+};
+
+} // namespace
+
+std::string PlatformConflict::describe() const {
+    std::ostringstream out;
+    out << StationRegistry::global().getName(station) << ": " << trainsPresent << " trains on "
+        << platformCount << (platformCount == 1 ? " platform" : " platforms") << " between "
+        << formatClock(start) << " and " << formatClock(end) << " (" << doubleBooked
+        << " double-booked)";
+    return out.str();
+}
+
+void PlatformConflictChecker::clear() {
+    m_stations.clear();
+    m_trips.clear();
+}
+
+PlatformConflictChecker::StationTimeline& PlatformConflictChecker::timeline(StationId station) {
+    if (station >= m_stations.size()) {
+        m_stations.resize(station + 1);
+    }
+    return m_stations[station];
+}
+
+void PlatformConflictChecker::setPlatformCount(StationId station, int platformCount) {
+    timeline(station).platformCount = std::max(1, platformCount);
+}
+
+int PlatformConflictChecker::getPlatformCount(StationId station) const {
+    return station < m_stations.size() ? m_stations[station].platformCount : 1;
+}
+
+uint32_t PlatformConflictChecker::addRoute(const Route& route) {
+    return appendRoute(route, true);
+}
+
+uint32_t PlatformConflictChecker::addRoutes(const std::vector<Route>& routes) {
+    CJ_TIMED("platforms.add_routes");
+    uint32_t first = static_cast<uint32_t>(m_trips.size());
+    std::vector<size_t> sortedSizes(m_stations.size());
+    for (size_t station = 0; station < m_stations.size(); ++station) {
+        sortedSizes[station] = m_stations[station].windows.size();
+    }
+
+    m_trips.reserve(m_trips.size() + routes.size());
+    for (const auto& route : routes) {
+        appendRoute(route, false);
+    }
+
+    // The appended windows are sorted on their own and merged behind the ones
+    // already there; both sorts are stable, so equal starts keep trip order
+    auto byStart = [](const Occupancy& a, const Occupancy& b) { return a.start < b.start; };
+    TaskScheduler::global().parallelFor(0, m_stations.size(), 64, [&](size_t firstStation, size_t lastStation) {
+        for (size_t station = firstStation; station < lastStation; ++station) {
+            auto& windows = m_stations[station].windows;
+            size_t sorted = station < sortedSizes.size() ? sortedSizes[station] : 0;
+            if (windows.size() > sorted) {
+                std::stable_sort(windows.begin() + sorted, windows.end(), byStart);
+                std::inplace_merge(windows.begin(), windows.begin() + sorted, windows.end(), byStart);
+            }
+        }
+    });
+    return first;
+}
+
+uint32_t PlatformConflictChecker::appendRoute(const Route& route, bool keepSorted) {
+    uint32_t trip = static_cast<uint32_t>(m_trips.size());
+    m_trips.emplace_back();
+
+    const std::vector<StationId>& stops = route.getStopIds();
+    std::vector<StopTime> times = route.calculateStopTimes();
+    m_trips.back().reserve(stops.size());
+
+    for (size_t i = 0; i < stops.size(); ++i) {
+        int start = times[i].arrival;
+        int end = times[i].departure;
+        if (i == 0) {
+            start -= Route::DWELL_SECONDS;
+        }
+        if (i + 1 == stops.size()) {
+            end += Route::DWELL_SECONDS;
+        }
+        if (end <= start) {
+            continue;
+        }
+
+        // Windows are kept within one day, as the departure board does: the
+        // dwell before a 00:00 departure wraps to the evening, and a window
+        // that crosses midnight is split so it meets the early morning trains
+        int length = std::min(end - start, DAY_SECONDS);
+        start = (start % DAY_SECONDS + DAY_SECONDS) % DAY_SECONDS;
+        end = start + length;
+        insertWindow(stops[i], Occupancy{start, std::min(end, DAY_SECONDS), trip}, keepSorted);
+        if (end > DAY_SECONDS) {
+            insertWindow(stops[i], Occupancy{0, end - DAY_SECONDS, trip}, keepSorted);
+        }
+    }
+    return trip;
+}
+
+void PlatformConflictChecker::insertWindow(StationId stationId, const Occupancy& window, bool keepSorted) {
+    StationTimeline& station = timeline(stationId);
+    if (keepSorted) {
+        auto position = std::upper_bound(station.windows.begin(), station.windows.end(), window.start,
+                                         [](int value, const Occupancy& o) { return value < o.start; });
+        station.windows.insert(position, window);
+    } else {
+        station.windows.push_back(window);
+    }
+    station.longestWindow = std::max(station.longestWindow, window.end - window.start);
+    m_trips.back().emplace_back(stationId, window);
+}
+
+void PlatformConflictChecker::removeLastRoute() {
+    if (m_trips.empty()) {
+        return;
+    }
+    for (const auto& [stationId, window] : m_trips.back()) {
+        auto& windows = m_stations[stationId].windows;
+        auto it = std::lower_bound(windows.begin(), windows.end(), window.start,
+                                   [](const Occupancy& o, int value) { return o.start < value; });
+        while (it != windows.end() && it->start == window.start && it->trip != window.trip) {
+            ++it;
+        }
+        if (it != windows.end() && it->trip == window.trip) {
+            windows.erase(it);
+        }
+    }
+    m_trips.pop_back();
+}
+
+void PlatformConflictChecker::keepRoutes(uint32_t firstTrip, const std::vector<bool>& keep) {
+    const uint32_t removed = std::numeric_limits<uint32_t>::max();
+    std::vector<uint32_t> renumbered(m_trips.size() - firstTrip);
+    uint32_t next = firstTrip;
+    for (size_t i = 0; i < renumbered.size(); ++i) {
+        renumbered[i] = i < keep.size() && keep[i] ? next++ : removed;
+    }
+    if (next == m_trips.size()) {
+        return;
+    }
+
+    std::vector<bool> touched(m_stations.size());
+    for (size_t trip = firstTrip; trip < m_trips.size(); ++trip) {
+        for (const auto& entry : m_trips[trip]) {
+            touched[entry.first] = true;
+        }
+    }
+    // Renumbering keeps the order of the trips, so the windows stay sorted.
+    // longestWindow is left as it is: it only has to be an upper bound.
+    auto renumber = [&](Occupancy& window) {
+        if (window.trip >= firstTrip) {
+            window.trip = renumbered[window.trip - firstTrip];
+        }
+    };
+    for (size_t station = 0; station < touched.size(); ++station) {
+        if (!touched[station]) {
+            continue;
+        }
+        auto& windows = m_stations[station].windows;
+        for (auto& window : windows) {
+            renumber(window);
+        }
+        windows.erase(std::remove_if(windows.begin(), windows.end(),
+                                     [&](const Occupancy& o) { return o.trip == removed; }),
+                      windows.end());
+    }
+
+    for (size_t trip = firstTrip; trip < m_trips.size(); ++trip) {
+        uint32_t number = renumbered[trip - firstTrip];
+        if (number == removed) {
+            continue;
+        }
+        for (auto& entry : m_trips[trip]) {
+            renumber(entry.second);
+        }
+        if (number != trip) {
+            m_trips[number] = std::move(m_trips[trip]);
+        }
+    }
+    m_trips.resize(next);
+}
+
+size_t PlatformConflictChecker::getTripCount() const {
+    return m_trips.size();
+}
+
+std::vector<PlatformWindow> PlatformConflictChecker::getWindowsByStation() const {
+    std::vector<PlatformWindow> windows;
+    for (size_t station = 0; station < m_stations.size(); ++station) {
+        for (const auto& window : m_stations[station].windows) {
+            windows.push_back({static_cast<StationId>(station), window.start, window.end, window.trip});
+        }
+    }
+    return windows;
+}
+
+std::vector<PlatformWindow> PlatformConflictChecker::getWindowsByTrip() const {
+    std::vector<PlatformWindow> windows;
+    for (const auto& trip : m_trips) {
+        for (const auto& [station, window] : trip) {
+            windows.push_back({station, window.start, window.end, window.trip});
+        }
+    }
+    return windows;
+}
+
+void PlatformConflictChecker::restoreWindows(const PlatformWindow* byStation, const PlatformWindow* byTrip,
+                                             size_t windowCount, size_t tripCount) {
+    m_trips.resize(tripCount);
+    for (size_t i = 0; i < windowCount; ++i) {
+        const PlatformWindow& window = byStation[i];
+        StationTimeline& station = timeline(window.station);
+        station.windows.push_back(Occupancy{window.start, window.end, window.trip});
+        station.longestWindow = std::max(station.longestWindow, window.end - window.start);
+    }
+    for (size_t i = 0; i < windowCount; ++i) {
+        const PlatformWindow& window = byTrip[i];
+        m_trips[window.trip].emplace_back(window.station, Occupancy{window.start, window.end, window.trip});
+    }
+}
+
+std::vector<PlatformConflict> PlatformConflictChecker::checkTrip(uint32_t trip) const {
+    return checkTrip(trip, nullptr);
+}
+
+std::vector<PlatformConflict> PlatformConflictChecker::checkTrip(uint32_t trip,
+                                                                  const std::vector<bool>& counted) const {
+    return checkTrip(trip, &counted);
+}
+
+std::vector<PlatformConflict> PlatformConflictChecker::checkTrip(uint32_t trip,
+                                                                  const std::vector<bool>* counted) const {
+    CJ_TIMED("platforms.check_trip");
+    std::vector<PlatformConflict> conflicts;
+    if (trip >= m_trips.size()) {
+        return conflicts;
+    }
+
+    std::vector<Occupancy> overlapping;
+    for (const auto& [stationId, window] : m_trips[trip]) {
+        const StationTimeline& station = m_stations[stationId];
+
+        // Nothing starting before this can still be open when the window starts
+        int earliest = window.start - station.longestWindow;
+        auto it = std::lower_bound(station.windows.begin(), station.windows.end(), earliest,
+                                   [](const Occupancy& o, int value) { return o.start < value; });
+
+        overlapping.clear();
+        for (; it != station.windows.end() && it->start < window.end; ++it) {
+            bool present = it->trip == trip || !counted || (it->trip < counted->size() && (*counted)[it->trip]);
+            if (present && it->end > window.start) {
+                // Clipped, so every conflict found lies inside this trip's window
+                overlapping.push_back(Occupancy{std::max(it->start, window.start),
+                                                std::min(it->end, window.end), it->trip});
+            }
+        }
+        if (static_cast<int>(overlapping.size()) > station.platformCount) {
+            std::sort(overlapping.begin(), overlapping.end(),
+                      [](const Occupancy& a, const Occupancy& b) { return a.start < b.start; });
+            sweep(stationId, overlapping, conflicts);
+        }
+    }
+    return conflicts;
+}
+
+std::vector<PlatformConflict> PlatformConflictChecker::validateAll() const {
+    CJ_TIMED("platforms.validate_all");
+    // Stations are independent: each chunk of them is swept on the scheduler
+    // into its own list, and the lists are joined in station order
+    const size_t grain = 64;
+    std::vector<std::vector<PlatformConflict>> chunks((m_stations.size() + grain - 1) / grain);
+    TaskScheduler::global().parallelFor(0, m_stations.size(), grain, [&](size_t first, size_t last) {
+        std::vector<PlatformConflict>& found = chunks[first / grain];
+        for (size_t station = first; station < last; ++station) {
+            const StationTimeline& timeline = m_stations[station];
+            if (static_cast<int>(timeline.windows.size()) > timeline.platformCount) {
+                sweep(static_cast<StationId>(station), timeline.windows, found);
+            }
+        }
+    });
+
+    std::vector<PlatformConflict> conflicts;
+    for (auto& found : chunks) {
+        std::move(found.begin(), found.end(), std::back_inserter(conflicts));
+    }
+    return conflicts;
+}
+
+void PlatformConflictChecker::sweep(StationId station, const std::vector<Occupancy>& windows,
+                                    std::vector<PlatformConflict>& conflicts) const {
+    const int platforms = m_stations[station].platformCount;
+    std::vector<Occupancy> active;
+    bool inConflict = false;
+
+    auto release = [&](int until) {
+        while (!active.empty() && active.front().end <= until) {
+            int end = active.front().end;
+            std::pop_heap(active.begin(), active.end(), EndsLater());
+            active.pop_back();
+            if (inConflict && static_cast<int>(active.size()) <= platforms) {
+                conflicts.back().end = end;
+                inConflict = false;
+            }
+        }
+    };
+
+    for (const auto& window : windows) {
+        release(window.start);
+        active.push_back(window);
+        std::push_heap(active.begin(), active.end(), EndsLater());
+
+        int present = static_cast<int>(active.size());
+        if (present <= platforms) {
+            continue;
+        }
+        if (!inConflict) {
+            PlatformConflict conflict{station, window.start, window.end, present, platforms,
+                                      present - platforms, {}};
+            for (const auto& occupied : active) {
+                conflict.trips.push_back(occupied.trip);
+            }
+            conflicts.push_back(std::move(conflict));
+            inConflict = true;
+        } else {
+            PlatformConflict& conflict = conflicts.back();
+            conflict.trips.push_back(window.trip);
+            conflict.trainsPresent = std::max(conflict.trainsPresent, present);
+            conflict.doubleBooked = conflict.trainsPresent - platforms;
+        }
+    }
+    release(std::numeric_limits<int>::max());
+}
+
+} // namespace CJ
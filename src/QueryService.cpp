@@ -0,0 +1,349 @@
+#include "../include/QueryService.hpp"
+#include "../include/Management.hpp"
+#include "../include/Metrics.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+
+namespace CJ {
+
+namespace {
+
+void appendString(std::string& out, std::string_view text) {
+    static const char HEX[] = "0123456789abcdef";
+    out += '"';
+    for (char c : text) {
+        unsigned char byte = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (byte < 0x20) {
+            out += "\\u00";
+            out += HEX[byte >> 4];
+            out += HEX[byte & 15];
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+// Seconds since midnight as "HH:MM", wrapping past midnight
+void appendClock(std::string& out, int seconds) {
+    int minutes = seconds / 60;
+    int hour = (minutes / 60) % 24;
+    out += '"';
+    out += static_cast<char>('0' + hour / 10);
+    out += static_cast<char>('0' + hour % 10);
+    out += ':';
+    out += static_cast<char>('0' + minutes % 60 / 10);
+    out += static_cast<char>('0' + minutes % 10);
+    out += '"';
+}
+
+void appendTrain(std::string& out, const std::shared_ptr<Train>& train) {
+    if (train) {
+        appendString(out, train->getTrainName());
+    } else {
+        out += "null";
+    }
+}
+
+bool parseClock(const std::string& text, int& seconds) {
+    int hour = 0, minute = 0;
+    char colon = 0;
+    std::istringstream in(text);
+    if (!(in >> hour >> colon >> minute) || colon != ':' || hour < 0 || hour > 23 || minute < 0 || minute > 59) {
+        return false;
+    }
+    seconds = (hour * 60 + minute) * 60;
+    return true;
+}
+
+size_t parseCount(const std::string& text, size_t fallback, size_t limit) {
+    if (text.empty()) {
+        return fallback;
+    }
+    long value = std::strtol(text.c_str(), nullptr, 10);
+    return std::clamp<size_t>(value > 0 ? static_cast<size_t>(value) : 1, 1, limit);
+}
+
+void error(HttpResponse& response, int status, const std::string& message) {
+    response.status = status;
+    response.body.clear();
+    response.body += "{\"error\":";
+    appendString(response.body, message);
+    response.body += '}';
+}
+
+StationId stationParameter(const HttpRequest& request, const char* name, HttpResponse& response) {
+    std::string value = request.parameter(name);
+    if (value.empty()) {
+        error(response, 400, std::string("missing parameter '") + name + "'");
+        return INVALID_STATION_ID;
+    }
+    StationId id = StationRegistry::global().find(value);
+    if (id == INVALID_STATION_ID) {
+        error(response, 404, "no station named '" + value + "'");
+    }
+    return id;
+}
+
+void appendStation(std::string& out, const Station& station) {
+    out += "{\"name\":";
+    appendString(out, station.getName());
+    out += ",\"platforms\":";
+    out += std::to_string(station.getPlatformCount());
+    out += '}';
+}
+
+void appendTrainInfo(std::string& out, const Train& train) {
+    out += "{\"id\":";
+    out += std::to_string(train.getId());
+    out += ",\"name\":";
+    appendString(out, train.getTrainName());
+    out += ",\"speed\":";
+    out += std::to_string(train.getSpeed());
+    out += ",\"capacity\":";
+    out += std::to_string(train.getCapacity());
+    out += ",\"wagons\":";
+    out += std::to_string(train.getWagonCount());
+    out += '}';
+}
+
+void appendJourney(std::string& out, const Journey& journey, const std::vector<Route>& routes) {
+    const StationRegistry& registry = StationRegistry::global();
+    out += "{\"departure\":";
+    appendClock(out, journey.departure());
+    out += ",\"arrival\":";
+    appendClock(out, journey.arrival());
+    out += ",\"transfers\":";
+    out += std::to_string(journey.transfers());
+    out += ",\"legs\":[";
+    for (size_t i = 0; i < journey.legs.size(); ++i) {
+        const JourneyLeg& leg = journey.legs[i];
+        out += i ? ",{\"route\":" : "{\"route\":";
+        out += std::to_string(leg.trip + 1);
+        out += ",\"from\":";
+        appendString(out, registry.getName(leg.from));
+        out += ",\"to\":";
+        appendString(out, registry.getName(leg.to));
+        out += ",\"departure\":";
+        appendClock(out, leg.departure);
+        out += ",\"arrival\":";
+        appendClock(out, leg.arrival);
+        out += ",\"train\":";
+        appendTrain(out, leg.trip < routes.size() ? routes[leg.trip].getAssignedTrain() : nullptr);
+        out += '}';
+    }
+    out += "]}";
+}
+
+} // namespace
+
+void QueryService::handle(const HttpRequest& request, HttpResponse& response) const {
+    if (request.method != "GET" && request.method != "HEAD") {
+        error(response, 405, "only GET and HEAD are supported");
+        return;
+    }
+
+    std::shared_ptr<const NetworkSnapshot> network = Management::snapshot();
+    const std::string& path = request.path;
+    auto below = [&path](const char* prefix, std::string& rest) {
+        size_t length = std::char_traits<char>::length(prefix);
+        if (path.compare(0, length, prefix) != 0 || (path.size() > length && path[length] != '/')) {
+            return false;
+        }
+        rest = path.size() > length + 1 ? path.substr(length + 1) : std::string();
+        return true;
+    };
+
+    std::string rest;
+    if (path == "/health") {
+        response.body = "{\"status\":\"ok\",\"version\":" + std::to_string(network->getVersion()) + "}";
+    } else if (below("/stations", rest)) {
+        stations(*network, rest, response);
+    } else if (below("/trains", rest)) {
+        trains(*network, rest, response);
+    } else if (path == "/routes") {
+        routes(*network, request, response);
+    } else if (path == "/departures" || path == "/arrivals") {
+        board(*network, request, path == "/departures", response);
+    } else if (path == "/journey" || path == "/journeys") {
+        journey(*network, request, path == "/journeys", response);
+    } else if (path == "/metrics") {
+        std::ostringstream json;
+        MetricsRegistry::global().writeJson(json);
+        response.body = json.str();
+    } else {
+        error(response, 404, "no endpoint " + path);
+    }
+}
+
+void QueryService::stations(const NetworkSnapshot& network, const std::string& name, HttpResponse& response) const {
+    std::string& out = response.body;
+    if (name.empty()) {
+        const std::vector<Station>& stations = network.getStations();
+        out += '[';
+        for (size_t i = 0; i < stations.size(); ++i) {
+            if (i) {
+                out += ',';
+            }
+            appendStation(out, stations[i]);
+        }
+        out += ']';
+        return;
+    }
+
+    StationId id = StationRegistry::global().find(name);
+    const Station* station = id == INVALID_STATION_ID ? nullptr : network.findStation(id);
+    if (!station) {
+        error(response, 404, "no station named '" + name + "'");
+        return;
+    }
+    appendStation(out, *station);
+}
+
+void QueryService::trains(const NetworkSnapshot& network, const std::string& id, HttpResponse& response) const {
+    std::string& out = response.body;
+    if (id.empty()) {
+        const std::vector<Train>& trains = network.getTrains();
+        out += '[';
+        for (size_t i = 0; i < trains.size(); ++i) {
+            if (i) {
+                out += ',';
+            }
+            appendTrainInfo(out, trains[i]);
+        }
+        out += ']';
+        return;
+    }
+
+    char* end = nullptr;
+    long trainId = std::strtol(id.c_str(), &end, 10);
+    const Train* train = *end == '\0' ? network.findTrain(static_cast<int>(trainId)) : nullptr;
+    if (!train) {
+        error(response, 404, "no train " + id);
+        return;
+    }
+    appendTrainInfo(out, *train);
+}
+
+void QueryService::routes(const NetworkSnapshot& network, const HttpRequest& request, HttpResponse& response) const {
+    const std::vector<Route>& routes = network.getRoutes();
+    size_t offset = std::min(static_cast<size_t>(std::strtoul(request.parameter("offset", "0").c_str(), nullptr, 10)),
+                             routes.size());
+    size_t limit = parseCount(request.parameter("limit"), 100, 10000);
+    size_t last = std::min(routes.size(), offset + limit);
+
+    const StationRegistry& registry = StationRegistry::global();
+    std::string& out = response.body;
+    out += "{\"total\":" + std::to_string(routes.size()) + ",\"routes\":[";
+    for (size_t i = offset; i < last; ++i) {
+        const Route& route = routes[i];
+        out += i > offset ? ",{\"route\":" : "{\"route\":";
+        out += std::to_string(i + 1);
+        out += ",\"departure\":";
+        appendClock(out, (route.getDepartureTimeHour() * 60 + route.getDepartureTimeMinute()) * 60);
+        out += ",\"arrival\":";
+        appendClock(out, (route.getArrivalTimeHour() * 60 + route.getArrivalTimeMinute()) * 60);
+        out += ",\"duration\":";
+        out += std::to_string(route.getDuration());
+        out += ",\"train\":";
+        appendTrain(out, route.getAssignedTrain());
+        out += ",\"stops\":[";
+        const std::vector<StationId>& stops = route.getStopIds();
+        for (size_t stop = 0; stop < stops.size(); ++stop) {
+            if (stop) {
+                out += ',';
+            }
+            appendString(out, registry.getName(stops[stop]));
+        }
+        out += "]}";
+    }
+    out += "]}";
+}
+
+void QueryService::board(const NetworkSnapshot& network, const HttpRequest& request, bool departures,
+                         HttpResponse& response) const {
+    StationId station = stationParameter(request, "station", response);
+    if (station == INVALID_STATION_ID) {
+        return;
+    }
+    int time = 0;
+    if (!parseClock(request.parameter("time"), time)) {
+        error(response, 400, "expected time=HH:MM");
+        return;
+    }
+    size_t count = parseCount(request.parameter("count"), 10, 1000);
+
+    const DepartureBoard& board = network.getTimetable().getDepartureBoard();
+    std::vector<BoardEntry> entries = departures ? board.nextDepartures(station, time, count)
+                                                 : board.nextArrivals(station, time, count);
+    const std::vector<Route>& routes = network.getRoutes();
+    const StationRegistry& registry = StationRegistry::global();
+    std::string& out = response.body;
+    out += '[';
+    bool first = true;
+    for (const auto& entry : entries) {
+        if (entry.trip >= routes.size()) {
+            continue;
+        }
+        const Route& route = routes[entry.trip];
+        const std::vector<StationId>& stops = route.getStopIds();
+        out += first ? "{\"time\":" : ",{\"time\":";
+        first = false;
+        appendClock(out, entry.time);
+        out += ",\"next_day\":";
+        out += entry.time >= 24 * 3600 ? "true" : "false";
+        out += ",\"route\":";
+        out += std::to_string(entry.trip + 1);
+        out += departures ? ",\"destination\":" : ",\"origin\":";
+        appendString(out, registry.getName(departures ? stops.back() : stops.front()));
+        out += ",\"train\":";
+        appendTrain(out, route.getAssignedTrain());
+        out += '}';
+    }
+    out += ']';
+}
+
+void QueryService::journey(const NetworkSnapshot& network, const HttpRequest& request, bool allOptions,
+                           HttpResponse& response) const {
+    StationId from = stationParameter(request, "from", response);
+    if (from == INVALID_STATION_ID) {
+        return;
+    }
+    StationId to = stationParameter(request, "to", response);
+    if (to == INVALID_STATION_ID) {
+        return;
+    }
+    int time = 0;
+    if (!parseClock(request.parameter("time"), time)) {
+        error(response, 400, "expected time=HH:MM");
+        return;
+    }
+
+    const std::vector<Route>& routes = network.getRoutes();
+    std::string& out = response.body;
+    if (allOptions) {
+        std::vector<Journey> journeys = network.getTimetable().getRaptorRouter().query(from, to, time);
+        out += '[';
+        for (size_t i = 0; i < journeys.size(); ++i) {
+            if (i) {
+                out += ',';
+            }
+            appendJourney(out, journeys[i], routes);
+        }
+        out += ']';
+        return;
+    }
+
+    Journey journey;
+    if (!network.getTimetable().getJourneyPlanner().earliestArrival(from, to, time, journey)) {
+        error(response, 404, "no journey found");
+        return;
+    }
+    appendJourney(out, journey, routes);
+}
+
+} // namespace CJ
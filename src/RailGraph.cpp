@@ -0,0 +1,608 @@
+#include "../include/RailGraph.hpp"
+#include "../include/Metrics.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <queue>
+
+namespace CJ {
+
+namespace {
+
+constexpr int INFINITE = std::numeric_limits<int>::max();
+constexpr uint32_t NONE = UINT32_MAX;
+// Witness searches give up after this many settled nodes; estimating a
+// node's priority can afford to be rougher than actually contracting it
+constexpr size_t WITNESS_SETTLE_LIMIT = 500;
+constexpr size_t ESTIMATE_SETTLE_LIMIT = 50;
+
+struct Edge {
+    uint32_t from;
+    uint32_t to;
+    int weight;
+    uint32_t middle;
+};
+
+uint64_t fnv1a(uint64_t hash, const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+constexpr uint64_t FNV_OFFSET = 14695981039346656037ULL;
+
+// Dijkstra state reused across queries on the same thread
+struct SearchSpace {
+    using Entry = std::pair<int, uint32_t>;
+
+    std::vector<int> distance;
+    std::vector<uint32_t> parent;
+    std::vector<uint32_t> parentMiddle;
+    std::vector<uint32_t> touched;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+
+    void prepare(size_t nodes) {
+        if (distance.size() < nodes) {
+            distance.resize(nodes, INFINITE);
+            parent.resize(nodes, NONE);
+            parentMiddle.resize(nodes, NONE);
+        }
+    }
+
+    void reach(uint32_t node, int dist, uint32_t from, uint32_t middle) {
+        if (distance[node] == INFINITE) {
+            touched.push_back(node);
+        }
+        distance[node] = dist;
+        parent[node] = from;
+        parentMiddle[node] = middle;
+        queue.emplace(dist, node);
+    }
+
+    void reset() {
+        for (uint32_t node : touched) {
+            distance[node] = INFINITE;
+            parent[node] = NONE;
+            parentMiddle[node] = NONE;
+        }
+        touched.clear();
+        queue = decltype(queue)();
+    }
+};
+
+void buildCsr(size_t nodes, std::vector<Edge>& edges, bool byTarget,
+              std::vector<uint32_t>& offsets, std::vector<uint32_t>& targets,
+              std::vector<int>& weights, std::vector<uint32_t>& middles) {
+    std::sort(edges.begin(), edges.end(), [byTarget](const Edge& a, const Edge& b) {
+        uint32_t keyA = byTarget ? a.to : a.from;
+        uint32_t keyB = byTarget ? b.to : b.from;
+        return keyA != keyB ? keyA < keyB : (byTarget ? a.from < b.from : a.to < b.to);
+    });
+    offsets.assign(nodes + 1, 0);
+    targets.clear();
+    weights.clear();
+    middles.clear();
+    for (const auto& edge : edges) {
+        ++offsets[(byTarget ? edge.to : edge.from) + 1];
+        targets.push_back(byTarget ? edge.from : edge.to);
+        weights.push_back(edge.weight);
+        middles.push_back(edge.middle);
+    }
+    for (size_t n = 1; n < offsets.size(); ++n) {
+        offsets[n] += offsets[n - 1];
+    }
+}
+
+// Keeps the cheapest of parallel edges
+void dropParallelEdges(std::vector<Edge>& edges) {
+    std::sort(edges.begin(), edges.end(), [](const Edge& a, const Edge& b) {
+        if (a.from != b.from) return a.from < b.from;
+        if (a.to != b.to) return a.to < b.to;
+        return a.weight < b.weight;
+    });
+    edges.erase(std::unique(edges.begin(), edges.end(), [](const Edge& a, const Edge& b) {
+        return a.from == b.from && a.to == b.to;
+    }), edges.end());
+}
+
+struct HierarchyHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t fingerprint;
+    uint32_t nodeCount;
+    uint32_t upwardEdges;
+    uint32_t downwardEdges;
+    uint32_t shortcutCount;
+    uint64_t checksum;
+};
+
+const char HIERARCHY_MAGIC[4] = {'C', 'J', 'C', 'H'};
+
+} // namespace
+
+void RailGraph::Csr::clear() {
+    offsets.clear();
+    targets.clear();
+    weights.clear();
+    middles.clear();
+}
+
+RailGraph::RailGraph(const std::vector<Route>& routes) {
+    std::vector<Edge> edges;
+    for (const auto& route : routes) {
+        const std::vector<StationId>& stops = route.getStopIds();
+        if (stops.size() < 2) {
+            continue;
+        }
+        std::vector<StopTime> times = route.calculateStopTimes();
+        for (size_t i = 0; i < stops.size(); ++i) {
+            if (stops[i] >= m_nodes.size()) {
+                m_nodes.resize(stops[i] + 1, NO_NODE);
+            }
+            if (m_nodes[stops[i]] == NO_NODE) {
+                m_nodes[stops[i]] = static_cast<uint32_t>(m_stations.size());
+                m_stations.push_back(stops[i]);
+            }
+            if (i > 0 && stops[i - 1] != stops[i]) {
+                int weight = std::max(0, times[i].arrival - times[i - 1].departure);
+                edges.push_back(Edge{m_nodes[stops[i - 1]], m_nodes[stops[i]], weight, NO_NODE});
+            }
+        }
+    }
+    dropParallelEdges(edges);
+    buildCsr(m_stations.size(), edges, false, m_graph.offsets, m_graph.targets, m_graph.weights, m_graph.middles);
+
+    const StationRegistry& registry = StationRegistry::global();
+    m_fingerprint = FNV_OFFSET;
+    for (StationId station : m_stations) {
+        const std::string& name = registry.getName(station);
+        m_fingerprint = fnv1a(m_fingerprint, name.data(), name.size() + 1);
+    }
+    m_fingerprint = fnv1a(m_fingerprint, m_graph.offsets.data(), m_graph.offsets.size() * sizeof(uint32_t));
+    m_fingerprint = fnv1a(m_fingerprint, m_graph.targets.data(), m_graph.targets.size() * sizeof(uint32_t));
+    m_fingerprint = fnv1a(m_fingerprint, m_graph.weights.data(), m_graph.weights.size() * sizeof(int));
+}
+
+size_t RailGraph::getNodeCount() const {
+    return m_stations.size();
+}
+
+size_t RailGraph::getEdgeCount() const {
+    return m_graph.targets.size();
+}
+
+size_t RailGraph::getShortcutCount() const {
+    return m_shortcutCount;
+}
+
+uint64_t RailGraph::getFingerprint() const {
+    return m_fingerprint;
+}
+
+bool RailGraph::hasContractionHierarchy() const {
+    return !m_rank.empty();
+}
+
+uint32_t RailGraph::nodeOf(StationId station) const {
+    return station < m_nodes.size() ? m_nodes[station] : NO_NODE;
+}
+
+int RailGraph::dijkstra(StationId from, StationId to, std::vector<StationId>* path) const {
+    if (path) {
+        path->clear();
+    }
+    uint32_t source = nodeOf(from);
+    uint32_t target = nodeOf(to);
+    if (source == NO_NODE || target == NO_NODE) {
+        return UNREACHABLE;
+    }
+
+    thread_local SearchSpace search;
+    search.prepare(m_stations.size());
+    search.reach(source, 0, NONE, NONE);
+
+    while (!search.queue.empty()) {
+        auto [dist, node] = search.queue.top();
+        search.queue.pop();
+        if (dist > search.distance[node]) {
+            continue;
+        }
+        if (node == target) {
+            break;
+        }
+        for (uint32_t e = m_graph.offsets[node]; e < m_graph.offsets[node + 1]; ++e) {
+            int next = dist + m_graph.weights[e];
+            if (next < search.distance[m_graph.targets[e]]) {
+                search.reach(m_graph.targets[e], next, node, NONE);
+            }
+        }
+    }
+
+    int result = search.distance[target] == INFINITE ? UNREACHABLE : search.distance[target];
+    if (path && result != UNREACHABLE) {
+        for (uint32_t node = target; node != NONE; node = search.parent[node]) {
+            path->push_back(m_stations[node]);
+        }
+        std::reverse(path->begin(), path->end());
+    }
+    search.reset();
+    return result;
+}
+
+int RailGraph::shortestPath(StationId from, StationId to, std::vector<StationId>* path) const {
+    CJ_TIMED("routing.graph_query");
+    if (!hasContractionHierarchy()) {
+        return dijkstra(from, to, path);
+    }
+    if (path) {
+        path->clear();
+    }
+    uint32_t source = nodeOf(from);
+    uint32_t target = nodeOf(to);
+    if (source == NO_NODE || target == NO_NODE) {
+        return UNREACHABLE;
+    }
+    return hierarchyQuery(source, target, path);
+}
+
+int RailGraph::hierarchyQuery(uint32_t source, uint32_t target, std::vector<StationId>* path) const {
+    thread_local SearchSpace forward;
+    thread_local SearchSpace backward;
+    forward.prepare(m_stations.size());
+    backward.prepare(m_stations.size());
+    forward.reach(source, 0, NONE, NONE);
+    backward.reach(target, 0, NONE, NONE);
+
+    int best = INFINITE;
+    uint32_t meeting = NONE;
+
+    // Both searches only climb the hierarchy, so they may stop once their
+    // smallest key is no better than the best meeting point found
+    auto step = [&](SearchSpace& self, const SearchSpace& other, const Csr& edges) {
+        auto [dist, node] = self.queue.top();
+        self.queue.pop();
+        if (dist > self.distance[node]) {
+            return;
+        }
+        if (other.distance[node] != INFINITE && dist + other.distance[node] < best) {
+            best = dist + other.distance[node];
+            meeting = node;
+        }
+        for (uint32_t e = edges.offsets[node]; e < edges.offsets[node + 1]; ++e) {
+            int next = dist + edges.weights[e];
+            if (next < self.distance[edges.targets[e]]) {
+                self.reach(edges.targets[e], next, node, edges.middles[e]);
+            }
+        }
+    };
+
+    while (true) {
+        bool forwardOpen = !forward.queue.empty() && forward.queue.top().first < best;
+        bool backwardOpen = !backward.queue.empty() && backward.queue.top().first < best;
+        if (!forwardOpen && !backwardOpen) {
+            break;
+        }
+        if (forwardOpen && (!backwardOpen || forward.queue.top().first <= backward.queue.top().first)) {
+            step(forward, backward, m_upward);
+        } else {
+            step(backward, forward, m_downward);
+        }
+    }
+
+    int result = best == INFINITE ? UNREACHABLE : best;
+    if (path && meeting != NONE) {
+        std::vector<uint32_t> nodes;
+        std::vector<uint32_t> chain;
+        for (uint32_t node = meeting; forward.parent[node] != NONE; node = forward.parent[node]) {
+            chain.push_back(node);
+        }
+        nodes.push_back(source);
+        for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+            unpackEdge(forward.parent[*it], *it, forward.parentMiddle[*it], nodes);
+        }
+        for (uint32_t node = meeting; backward.parent[node] != NONE; node = backward.parent[node]) {
+            unpackEdge(node, backward.parent[node], backward.parentMiddle[node], nodes);
+        }
+        for (uint32_t node : nodes) {
+            path->push_back(m_stations[node]);
+        }
+    }
+
+    forward.reset();
+    backward.reset();
+    return result;
+}
+
+void RailGraph::unpackEdge(uint32_t from, uint32_t to, uint32_t middle, std::vector<uint32_t>& nodes) const {
+    if (middle == NO_NODE) {
+        nodes.push_back(to);
+        return;
+    }
+    // The skipped node ranks below both ends: from -> middle is stored with the
+    // downward edges of middle, middle -> to with its upward edges
+    uint32_t firstMiddle = NO_NODE;
+    for (uint32_t e = m_downward.offsets[middle]; e < m_downward.offsets[middle + 1]; ++e) {
+        if (m_downward.targets[e] == from) {
+            firstMiddle = m_downward.middles[e];
+            break;
+        }
+    }
+    uint32_t secondMiddle = NO_NODE;
+    for (uint32_t e = m_upward.offsets[middle]; e < m_upward.offsets[middle + 1]; ++e) {
+        if (m_upward.targets[e] == to) {
+            secondMiddle = m_upward.middles[e];
+            break;
+        }
+    }
+    unpackEdge(from, middle, firstMiddle, nodes);
+    unpackEdge(middle, to, secondMiddle, nodes);
+}
+
+void RailGraph::buildContractionHierarchy() {
+    CJ_TIMED("routing.ch_build");
+    const size_t nodes = m_stations.size();
+    struct WorkEdge {
+        uint32_t node;
+        int weight;
+        uint32_t middle;
+    };
+    std::vector<std::vector<WorkEdge>> out(nodes), in(nodes);
+    std::vector<Edge> edges;
+    for (uint32_t u = 0; u < nodes; ++u) {
+        for (uint32_t e = m_graph.offsets[u]; e < m_graph.offsets[u + 1]; ++e) {
+            out[u].push_back(WorkEdge{m_graph.targets[e], m_graph.weights[e], NO_NODE});
+            in[m_graph.targets[e]].push_back(WorkEdge{u, m_graph.weights[e], NO_NODE});
+            edges.push_back(Edge{u, m_graph.targets[e], m_graph.weights[e], NO_NODE});
+        }
+    }
+
+    std::vector<char> contracted(nodes, 0);
+    std::vector<int> contractedNeighbours(nodes, 0);
+    SearchSpace witness;
+    witness.prepare(nodes);
+
+    // Bounded search from `source` that avoids `skipped`
+    auto findWitnesses = [&](uint32_t source, uint32_t skipped, int limit, size_t settleLimit) {
+        witness.reach(source, 0, NONE, NONE);
+        size_t settled = 0;
+        while (!witness.queue.empty() && settled < settleLimit) {
+            auto [dist, node] = witness.queue.top();
+            witness.queue.pop();
+            if (dist > witness.distance[node]) {
+                continue;
+            }
+            if (dist > limit) {
+                break;
+            }
+            ++settled;
+            for (const auto& edge : out[node]) {
+                if (contracted[edge.node] || edge.node == skipped) {
+                    continue;
+                }
+                int next = dist + edge.weight;
+                if (next < witness.distance[edge.node]) {
+                    witness.reach(edge.node, next, node, NONE);
+                }
+            }
+        }
+    };
+
+    // Shortcuts contracting v would need; added to the graph when apply is set
+    auto contract = [&](uint32_t v, bool apply) {
+        int shortcuts = 0;
+        int maxOut = 0;
+        for (const auto& edge : out[v]) {
+            if (!contracted[edge.node]) {
+                maxOut = std::max(maxOut, edge.weight);
+            }
+        }
+        for (const auto& incoming : in[v]) {
+            uint32_t u = incoming.node;
+            if (contracted[u]) {
+                continue;
+            }
+            findWitnesses(u, v, incoming.weight + maxOut, apply ? WITNESS_SETTLE_LIMIT : ESTIMATE_SETTLE_LIMIT);
+            for (const auto& outgoing : out[v]) {
+                uint32_t x = outgoing.node;
+                if (contracted[x] || x == u) {
+                    continue;
+                }
+                int viaV = incoming.weight + outgoing.weight;
+                if (witness.distance[x] <= viaV) {
+                    continue;
+                }
+                ++shortcuts;
+                if (!apply) {
+                    continue;
+                }
+                auto existing = std::find_if(out[u].begin(), out[u].end(),
+                                             [x](const WorkEdge& e) { return e.node == x; });
+                if (existing != out[u].end()) {
+                    existing->weight = viaV;
+                    existing->middle = v;
+                    auto reverse = std::find_if(in[x].begin(), in[x].end(),
+                                                [u](const WorkEdge& e) { return e.node == u; });
+                    reverse->weight = viaV;
+                    reverse->middle = v;
+                } else {
+                    out[u].push_back(WorkEdge{x, viaV, v});
+                    in[x].push_back(WorkEdge{u, viaV, v});
+                }
+                edges.push_back(Edge{u, x, viaV, v});
+            }
+            witness.reset();
+        }
+        return shortcuts;
+    };
+
+    auto priority = [&](uint32_t v) {
+        int degree = 0;
+        for (const auto& edge : out[v]) degree += !contracted[edge.node];
+        for (const auto& edge : in[v]) degree += !contracted[edge.node];
+        return contract(v, false) - degree + contractedNeighbours[v];
+    };
+
+    using Entry = std::pair<int, uint32_t>;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> order;
+    for (uint32_t v = 0; v < nodes; ++v) {
+        order.emplace(priority(v), v);
+    }
+
+    m_rank.assign(nodes, 0);
+    m_shortcutCount = 0;
+    uint32_t nextRank = 0;
+    while (!order.empty()) {
+        uint32_t v = order.top().second;
+        order.pop();
+        if (contracted[v]) {
+            continue;
+        }
+        // Lazy update: contract only if v is still the cheapest
+        int current = priority(v);
+        if (!order.empty() && current > order.top().first) {
+            order.emplace(current, v);
+            continue;
+        }
+
+        m_shortcutCount += contract(v, true);
+        contracted[v] = 1;
+        m_rank[v] = nextRank++;
+        // Drop v from its neighbours' lists so later searches do not skip over it
+        auto isV = [v](const WorkEdge& e) { return e.node == v; };
+        for (const auto& edge : out[v]) {
+            contractedNeighbours[edge.node]++;
+            auto& list = in[edge.node];
+            list.erase(std::remove_if(list.begin(), list.end(), isV), list.end());
+        }
+        for (const auto& edge : in[v]) {
+            contractedNeighbours[edge.node]++;
+            auto& list = out[edge.node];
+            list.erase(std::remove_if(list.begin(), list.end(), isV), list.end());
+        }
+    }
+
+    dropParallelEdges(edges);
+    std::vector<Edge> upward, downward;
+    for (const auto& edge : edges) {
+        (m_rank[edge.to] > m_rank[edge.from] ? upward : downward).push_back(edge);
+    }
+    buildCsr(nodes, upward, false, m_upward.offsets, m_upward.targets, m_upward.weights, m_upward.middles);
+    buildCsr(nodes, downward, true, m_downward.offsets, m_downward.targets, m_downward.weights, m_downward.middles);
+}
+
+bool RailGraph::saveHierarchy(const std::string& path) const {
+    if (!hasContractionHierarchy()) {
+        return false;
+    }
+
+    std::vector<char> payload;
+    auto append = [&payload](const auto& values) {
+        const char* bytes = reinterpret_cast<const char*>(values.data());
+        payload.insert(payload.end(), bytes, bytes + values.size() * sizeof(values[0]));
+    };
+    append(m_rank);
+    for (const Csr* csr : {&m_upward, &m_downward}) {
+        append(csr->offsets);
+        append(csr->targets);
+        append(csr->weights);
+        append(csr->middles);
+    }
+
+    HierarchyHeader header{};
+    std::copy(std::begin(HIERARCHY_MAGIC), std::end(HIERARCHY_MAGIC), header.magic);
+    header.version = FORMAT_VERSION;
+    header.fingerprint = m_fingerprint;
+    header.nodeCount = static_cast<uint32_t>(m_stations.size());
+    header.upwardEdges = static_cast<uint32_t>(m_upward.targets.size());
+    header.downwardEdges = static_cast<uint32_t>(m_downward.targets.size());
+    header.shortcutCount = static_cast<uint32_t>(m_shortcutCount);
+    header.checksum = fnv1a(FNV_OFFSET, payload.data(), payload.size());
+
+    std::string tempPath = path + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            std::cerr << "Cannot write hierarchy file: " << tempPath << std::endl;
+            return false;
+        }
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(payload.data(), payload.size());
+        if (!file) {
+            std::cerr << "Failed to write hierarchy file: " << tempPath << std::endl;
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tempPath, path, error);
+    if (error) {
+        std::cerr << "Failed to replace hierarchy file: " << error.message() << std::endl;
+        std::filesystem::remove(tempPath, error);
+        return false;
+    }
+    return true;
+}
+
+bool RailGraph::loadHierarchy(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+
+    HierarchyHeader header{};
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        !std::equal(std::begin(HIERARCHY_MAGIC), std::end(HIERARCHY_MAGIC), header.magic) ||
+        header.version != FORMAT_VERSION || header.fingerprint != m_fingerprint ||
+        header.nodeCount != m_stations.size()) {
+        return false;
+    }
+
+    const size_t nodes = header.nodeCount;
+    size_t expected = nodes * sizeof(uint32_t) + 2 * (nodes + 1) * sizeof(uint32_t) +
+                      (header.upwardEdges + header.downwardEdges) * (2 * sizeof(uint32_t) + sizeof(int));
+    std::vector<char> payload(expected);
+    if (!file.read(payload.data(), payload.size()) || file.peek() != std::ifstream::traits_type::eof() ||
+        fnv1a(FNV_OFFSET, payload.data(), payload.size()) != header.checksum) {
+        return false;
+    }
+
+    size_t position = 0;
+    auto take = [&payload, &position](auto& values, size_t count) {
+        values.resize(count);
+        std::copy_n(payload.data() + position, count * sizeof(values[0]), reinterpret_cast<char*>(values.data()));
+        position += count * sizeof(values[0]);
+    };
+    std::vector<uint32_t> rank;
+    Csr upward, downward;
+    take(rank, nodes);
+    for (auto [csr, count] : {std::pair<Csr*, size_t>{&upward, header.upwardEdges},
+                              std::pair<Csr*, size_t>{&downward, header.downwardEdges}}) {
+        take(csr->offsets, nodes + 1);
+        take(csr->targets, count);
+        take(csr->weights, count);
+        take(csr->middles, count);
+        if (csr->offsets.front() != 0 || csr->offsets.back() != count ||
+            !std::is_sorted(csr->offsets.begin(), csr->offsets.end())) {
+            return false;
+        }
+        for (size_t e = 0; e < count; ++e) {
+            if (csr->targets[e] >= nodes || (csr->middles[e] != NO_NODE && csr->middles[e] >= nodes)) {
+                return false;
+            }
+        }
+    }
+
+    m_rank = std::move(rank);
+    m_upward = std::move(upward);
+    m_downward = std::move(downward);
+    m_shortcutCount = header.shortcutCount;
+    return true;
+}
+
+} // namespace CJ
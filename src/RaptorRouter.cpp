@@ -0,0 +1,385 @@
+#include "../include/RaptorRouter.hpp"
+#include "../include/TaskScheduler.hpp"
+#include "../include/Metrics.hpp"
+#include <algorithm>
+#include <limits>
+#include <map>
+
+namespace CJ {
+
+namespace {
+
+constexpr int UNREACHED = std::numeric_limits<int>::max();
+constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+// Trip leg that set a label; kept apart from the arrival times the scan reads
+struct Parent {
+    uint32_t pattern;
+    uint32_t trip;      // within the pattern
+    uint32_t board;     // stop indices within the pattern
+    uint32_t alight;
+};
+
+bool dominates(const Journey& a, const Journey& b) {
+    return a.departure() >= b.departure() && a.arrival() <= b.arrival() && a.transfers() <= b.transfers();
+}
+
+} // namespace
+
+// Scratch state for one thread. Labels are kept per round; round k starts as the
+// better of round k and k - 1, which keeps them valid across the iterations of a
+// profile query (run from the latest departure to the earliest). A carried label
+// remembers the round that set it, and that round's parent describes the leg.
+struct RaptorScan {
+    const RaptorRouter& router;
+    size_t stationCount;
+    uint32_t rounds;
+    std::vector<int> arrivals;
+    std::vector<uint32_t> setInRound;
+    std::vector<Parent> parents;
+    std::vector<uint32_t> patternStart;
+    std::vector<uint32_t> queuedPatterns;
+    std::vector<char> marked;
+    std::vector<StationId> markedStations;
+    std::vector<StationId> improved;
+
+    RaptorScan(const RaptorRouter& owner, uint32_t maxTransfers)
+        : router(owner), stationCount(owner.getStationLimit()), rounds(maxTransfers + 1),
+          arrivals((rounds + 1) * stationCount, UNREACHED), setInRound((rounds + 1) * stationCount, 0),
+          parents((rounds + 1) * stationCount), patternStart(owner.getPatternCount(), NONE),
+          marked(stationCount, 0) {}
+
+    int& arrival(uint32_t round, StationId station) { return arrivals[round * stationCount + station]; }
+    uint32_t& origin(uint32_t round, StationId station) { return setInRound[round * stationCount + station]; }
+
+    void reset() {
+        std::fill(arrivals.begin(), arrivals.end(), UNREACHED);
+    }
+
+    // Runs all rounds for one departure from `from`; onRound(k) sees `improved`
+    template <typename OnRound>
+    void iterate(StationId from, int departure, StationId target, int minChangeSeconds, OnRound onRound) {
+        arrival(0, from) = departure;
+        origin(0, from) = 0;
+        markedStations.assign(1, from);
+
+        for (uint32_t k = 1; k <= rounds && !markedStations.empty(); ++k) {
+            const int* previous = &arrivals[(k - 1) * stationCount];
+            int* current = &arrivals[k * stationCount];
+            for (StationId s = 0; s < stationCount; ++s) {
+                if (previous[s] < current[s]) {
+                    current[s] = previous[s];
+                    origin(k, s) = origin(k - 1, s);
+                }
+            }
+
+            for (StationId station : markedStations) {
+                for (uint32_t i = router.m_stationOffsets[station]; i < router.m_stationOffsets[station + 1]; ++i) {
+                    const RaptorRouter::PatternStop& entry = router.m_stationPatterns[i];
+                    if (patternStart[entry.pattern] == NONE) {
+                        queuedPatterns.push_back(entry.pattern);
+                        patternStart[entry.pattern] = entry.stopIndex;
+                    } else {
+                        patternStart[entry.pattern] = std::min(patternStart[entry.pattern], entry.stopIndex);
+                    }
+                }
+            }
+
+            // In memory order, so pattern data is read front to back
+            std::sort(queuedPatterns.begin(), queuedPatterns.end());
+            improved.clear();
+            for (uint32_t p : queuedPatterns) {
+                scanPattern(p, k, from, target, minChangeSeconds);
+                patternStart[p] = NONE;
+            }
+            queuedPatterns.clear();
+            for (StationId station : improved) {
+                marked[station] = 0;
+            }
+
+            onRound(k);
+            markedStations.assign(improved.begin(), improved.end());
+        }
+    }
+
+    void scanPattern(uint32_t p, uint32_t k, StationId from, StationId target, int minChangeSeconds) {
+        const RaptorRouter::Pattern& pattern = router.m_patterns[p];
+        const StationId* stops = &router.m_patternStops[pattern.firstStop];
+        const int* previous = &arrivals[(k - 1) * stationCount];
+        int* current = &arrivals[k * stationCount];
+        uint32_t trip = NONE;
+        uint32_t board = 0;
+
+        for (uint32_t i = patternStart[p]; i < pattern.stopCount; ++i) {
+            StationId station = stops[i];
+
+            if (trip != NONE) {
+                int reached = router.timeAt(pattern, trip, i).arrival;
+                int bound = current[station];
+                if (target != NONE) {
+                    bound = std::min(bound, current[target]);
+                }
+                if (reached < bound) {
+                    current[station] = reached;
+                    origin(k, station) = k;
+                    parents[k * stationCount + station] = Parent{p, trip, board, i};
+                    if (!marked[station]) {
+                        marked[station] = 1;
+                        improved.push_back(station);
+                    }
+                }
+            }
+
+            if (previous[station] == UNREACHED || i + 1 == pattern.stopCount) {
+                continue;
+            }
+            int ready = station == from ? previous[station] : previous[station] + minChangeSeconds;
+            if (trip != NONE && ready > router.timeAt(pattern, trip, i).departure) {
+                continue;
+            }
+
+            // Earliest trip leaving here at or after `ready`; departures are sorted per stop
+            uint32_t low = 0;
+            uint32_t high = trip == NONE ? pattern.tripCount : trip;
+            while (low < high) {
+                uint32_t mid = low + (high - low) / 2;
+                if (router.timeAt(pattern, mid, i).departure < ready) {
+                    low = mid + 1;
+                } else {
+                    high = mid;
+                }
+            }
+            if (low < (trip == NONE ? pattern.tripCount : trip)) {
+                trip = low;
+                board = i;
+            }
+        }
+    }
+
+    // Set in round k of the current iteration rather than carried over
+    bool reachedIn(uint32_t k, StationId station) {
+        return arrival(k, station) != UNREACHED && origin(k, station) == k;
+    }
+
+    Journey reconstruct(uint32_t round, StationId station) {
+        Journey journey;
+        for (uint32_t guard = 0; guard <= rounds; ++guard) {
+            round = origin(round, station);
+            if (round == 0) {
+                break;
+            }
+            const Parent& parent = parents[round * stationCount + station];
+            const RaptorRouter::Pattern& pattern = router.m_patterns[parent.pattern];
+            const StationId* stops = &router.m_patternStops[pattern.firstStop];
+            journey.legs.push_back(JourneyLeg{router.m_patternTrips[pattern.firstTrip + parent.trip],
+                                              stops[parent.board], stops[parent.alight],
+                                              router.timeAt(pattern, parent.trip, parent.board).departure,
+                                              router.timeAt(pattern, parent.trip, parent.alight).arrival});
+            station = stops[parent.board];
+            --round;
+        }
+        std::reverse(journey.legs.begin(), journey.legs.end());
+        return journey;
+    }
+};
+
+RaptorRouter::RaptorRouter(const std::vector<Route>& routes) {
+    // Trips that share a stop sequence, in route order
+    std::map<std::vector<StationId>, std::vector<uint32_t>> bySequence;
+    StationId stationLimit = 0;
+    for (uint32_t i = 0; i < routes.size(); ++i) {
+        const std::vector<StationId>& stops = routes[i].getStopIds();
+        if (stops.size() < 2) {
+            continue;
+        }
+        bySequence[stops].push_back(i);
+        for (StationId stop : stops) {
+            stationLimit = std::max(stationLimit, stop + 1);
+        }
+    }
+
+    std::vector<std::vector<StopTime>> times;
+    for (auto& [stops, trips] : bySequence) {
+        times.clear();
+        for (uint32_t trip : trips) {
+            times.push_back(routes[trip].calculateStopTimes());
+        }
+        std::vector<uint32_t> order(trips.size());
+        for (uint32_t i = 0; i < order.size(); ++i) {
+            order[i] = i;
+        }
+        std::stable_sort(order.begin(), order.end(), [&times](uint32_t a, uint32_t b) {
+            return times[a][0].departure < times[b][0].departure;
+        });
+
+        // Each trip joins the first pattern it does not overtake
+        std::vector<std::vector<uint32_t>> groups;
+        for (uint32_t candidate : order) {
+            auto fits = [&](const std::vector<uint32_t>& group) {
+                const std::vector<StopTime>& last = times[group.back()];
+                const std::vector<StopTime>& next = times[candidate];
+                for (size_t s = 0; s < next.size(); ++s) {
+                    if (next[s].arrival < last[s].arrival || next[s].departure < last[s].departure) {
+                        return false;
+                    }
+                }
+                return true;
+            };
+            auto group = std::find_if(groups.begin(), groups.end(), fits);
+            if (group == groups.end()) {
+                groups.emplace_back(1, candidate);
+            } else {
+                group->push_back(candidate);
+            }
+        }
+
+        for (const auto& group : groups) {
+            Pattern pattern{static_cast<uint32_t>(m_patternStops.size()), static_cast<uint32_t>(stops.size()),
+                            static_cast<uint32_t>(m_patternTrips.size()), static_cast<uint32_t>(group.size()),
+                            static_cast<uint32_t>(m_times.size())};
+            m_patternStops.insert(m_patternStops.end(), stops.begin(), stops.end());
+            for (uint32_t member : group) {
+                m_patternTrips.push_back(trips[member]);
+            }
+            for (size_t stop = 0; stop < stops.size(); ++stop) {
+                for (uint32_t member : group) {
+                    m_times.push_back(times[member][stop]);
+                }
+            }
+            m_patterns.push_back(pattern);
+        }
+    }
+
+    m_stationOffsets.assign(stationLimit + 1, 0);
+    for (const auto& pattern : m_patterns) {
+        for (uint32_t i = 0; i < pattern.stopCount; ++i) {
+            ++m_stationOffsets[m_patternStops[pattern.firstStop + i] + 1];
+        }
+    }
+    for (size_t s = 1; s < m_stationOffsets.size(); ++s) {
+        m_stationOffsets[s] += m_stationOffsets[s - 1];
+    }
+    m_stationPatterns.resize(m_stationOffsets.back());
+    std::vector<uint32_t> fill(m_stationOffsets.begin(), m_stationOffsets.end() - 1);
+    for (uint32_t p = 0; p < m_patterns.size(); ++p) {
+        for (uint32_t i = 0; i < m_patterns[p].stopCount; ++i) {
+            StationId station = m_patternStops[m_patterns[p].firstStop + i];
+            m_stationPatterns[fill[station]++] = PatternStop{p, i};
+        }
+    }
+}
+
+std::vector<Journey> RaptorRouter::query(StationId from, StationId to, int departAfter,
+                                         uint32_t maxTransfers, int minChangeSeconds) const {
+    CJ_TIMED("routing.raptor_query");
+    std::vector<Journey> journeys;
+    if (from >= getStationLimit() || to >= getStationLimit() || from == to) {
+        return journeys;
+    }
+
+    RaptorScan scan(*this, maxTransfers);
+    scan.iterate(from, departAfter, to, minChangeSeconds, [&](uint32_t k) {
+        if (scan.reachedIn(k, to)) {
+            journeys.push_back(scan.reconstruct(k, to));
+        }
+    });
+    return journeys;
+}
+
+std::vector<Journey> RaptorRouter::profile(StationId from, StationId to, int windowStart, int windowEnd,
+                                           uint32_t maxTransfers, int minChangeSeconds) const {
+    CJ_TIMED("routing.raptor_profile");
+    std::vector<Journey> found;
+    if (from >= getStationLimit() || to >= getStationLimit() || from == to) {
+        return found;
+    }
+
+    RaptorScan scan(*this, maxTransfers);
+    for (int departure : departuresFrom(from, windowStart, windowEnd)) {
+        scan.iterate(from, departure, to, minChangeSeconds, [&](uint32_t k) {
+            if (scan.reachedIn(k, to) &&
+                std::find(scan.improved.begin(), scan.improved.end(), to) != scan.improved.end()) {
+                found.push_back(scan.reconstruct(k, to));
+            }
+        });
+    }
+
+    // Later iterations may rebuild a journey found before; keep one copy of each non-dominated one
+    std::vector<Journey> journeys;
+    for (size_t i = 0; i < found.size(); ++i) {
+        bool beaten = false;
+        for (size_t j = 0; j < found.size() && !beaten; ++j) {
+            if (i == j || !dominates(found[j], found[i])) {
+                continue;
+            }
+            beaten = !dominates(found[i], found[j]) || j < i;
+        }
+        if (!beaten) {
+            journeys.push_back(found[i]);
+        }
+    }
+    std::sort(journeys.begin(), journeys.end(), [](const Journey& a, const Journey& b) {
+        return a.departure() != b.departure() ? a.departure() > b.departure() : a.transfers() < b.transfers();
+    });
+    return journeys;
+}
+
+void RaptorRouter::runProfiles(const std::vector<ProfileQuery>& queries, const ProfileSink& sink,
+                               unsigned threadCount, uint32_t maxTransfers, int minChangeSeconds) const {
+    // One chunk of queries per task, each with its own scan state
+    TaskScheduler::global().parallelFor(0, queries.size(), 0, [&](size_t first, size_t last) {
+        RaptorScan scan(*this, maxTransfers);
+        StationProfiles profiles;
+        profiles.entries.resize(getStationLimit());
+
+        for (size_t q = first; q < last; ++q) {
+            const ProfileQuery& query = queries[q];
+            for (auto& entries : profiles.entries) {
+                entries.clear();
+            }
+            profiles.origin = query.origin;
+            if (query.origin < getStationLimit()) {
+                scan.reset();
+                for (int departure : departuresFrom(query.origin, query.windowStart, query.windowEnd)) {
+                    scan.iterate(query.origin, departure, NONE, minChangeSeconds, [&](uint32_t k) {
+                        for (StationId station : scan.improved) {
+                            profiles.entries[station].push_back(
+                                ProfileEntry{departure, scan.arrival(k, station), k - 1});
+                        }
+                    });
+                }
+            }
+            sink(q, profiles);
+        }
+    }, threadCount);
+}
+
+std::vector<int> RaptorRouter::departuresFrom(StationId origin, int windowStart, int windowEnd) const {
+    std::vector<int> departures;
+    for (uint32_t i = m_stationOffsets[origin]; i < m_stationOffsets[origin + 1]; ++i) {
+        const Pattern& pattern = m_patterns[m_stationPatterns[i].pattern];
+        uint32_t stop = m_stationPatterns[i].stopIndex;
+        if (stop + 1 == pattern.stopCount) {
+            continue;
+        }
+        for (uint32_t trip = 0; trip < pattern.tripCount; ++trip) {
+            int departure = timeAt(pattern, trip, stop).departure;
+            if (departure >= windowStart && departure <= windowEnd) {
+                departures.push_back(departure);
+            }
+        }
+    }
+    std::sort(departures.begin(), departures.end(), std::greater<int>());
+    departures.erase(std::unique(departures.begin(), departures.end()), departures.end());
+    return departures;
+}
+
+size_t RaptorRouter::getPatternCount() const {
+    return m_patterns.size();
+}
+
+size_t RaptorRouter::getStationLimit() const {
+    return m_stationOffsets.empty() ? 0 : m_stationOffsets.size() - 1;
+}
+
+} // namespace CJ
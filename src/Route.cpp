@@ -2,6 +2,7 @@
 #include "../include/Train.hpp"
 #include "../include/Station.hpp"
 #include <stdexcept>
+#include <algorithm>
 
 namespace CJ {
 
@@ -15,9 +16,9 @@ namespace CJ {
         m_arrivalTimeHour(arrHour), m_arrivalTimeMinute(arrMin),
         m_duration(duration),
         m_assignedTrain(trainPtr), m_startStation(startStation),
-        m_endStation(endStation),
-        m_intermediateStops(intermediateStops)  {
-    // Validate time values
+        m_endStation(endStation) {
+    // Validate time values before the stops are interned, so a rejected route
+    // leaves nothing behind in the station registry
     if (depHour < 0 || depHour > 23) {
         throw std::invalid_argument("Departure hour must be between 0 and 23");
     }
@@ -33,6 +34,7 @@ namespace CJ {
     if (duration <= 0) {
         throw std::invalid_argument("Duration must be greater than 0");
     }
+    setIntermediateStops(intermediateStops);
 }
 
 void Route::setDepartureTimeHour(int departureTimeHour) {
@@ -71,7 +73,16 @@ void Route::setDuration(int duration) {
 }
 
 void Route::setIntermediateStops(const std::vector<std::string>& intermediateStops) {
-    m_intermediateStops = intermediateStops;
+    StationRegistry& registry = StationRegistry::global();
+    m_stopIds.clear();
+    m_stopIds.reserve(intermediateStops.size());
+    for (const auto& stop : intermediateStops) {
+        m_stopIds.push_back(registry.intern(stop));
+    }
+}
+
+void Route::setStopIds(std::vector<StationId> stopIds) {
+    m_stopIds = std::move(stopIds);
 }
 
 void Route::setTrainAssignment(std::shared_ptr<Train> train) {
@@ -102,24 +113,67 @@ std::shared_ptr<Train> Route::getAssignedTrain() const {
     return m_assignedTrain;
 }
 
-const std::vector<std::string>& Route::getIntermediateStops() const {
-    return m_intermediateStops;
+std::vector<std::string> Route::getIntermediateStops() const {
+    const StationRegistry& registry = StationRegistry::global();
+    std::vector<std::string> stops;
+    stops.reserve(m_stopIds.size());
+    for (StationId id : m_stopIds) {
+        stops.push_back(registry.getName(id));
+    }
+    return stops;
+}
+
+const std::vector<StationId>& Route::getStopIds() const {
+    return m_stopIds;
 }
 
 void Route::addIntermediateStop(const std::string& stationName) {
-    m_intermediateStops.push_back(stationName);
+    m_stopIds.push_back(StationRegistry::global().intern(stationName));
 }
 
 int Route::calculateTravelTime() const {
-    return m_duration + m_intermediateStops.size() * 3; 
+    return m_duration + m_stopIds.size() * 3; 
+}
+
+std::vector<StopTime> Route::calculateStopTimes() const {
+    const int daySeconds = 24 * 60 * 60;
+    int departure = (m_departureTimeHour * 60 + m_departureTimeMinute) * 60;
+    int runTime = (m_arrivalTimeHour * 60 + m_arrivalTimeMinute) * 60 - departure;
+    if (runTime < 0) {
+        runTime += daySeconds;  // arrives after midnight
+    }
+    if (runTime == 0) {
+        runTime = m_duration * 60;
+    }
+
+    std::vector<StopTime> times(m_stopIds.size());
+    if (times.empty()) {
+        return times;
+    }
+    if (times.size() == 1) {
+        times[0] = StopTime{departure, departure};
+        return times;
+    }
+
+    int legs = static_cast<int>(times.size()) - 1;
+    int intermediate = legs - 1;
+    int dwell = intermediate > 0 ? std::min(DWELL_SECONDS, runTime / (2 * intermediate)) : 0;
+    long long moving = runTime - dwell * intermediate;
+
+    for (int i = 0; i <= legs; ++i) {
+        int arrival = departure + static_cast<int>(moving * i / legs) + dwell * std::max(0, i - 1);
+        bool dwells = i > 0 && i < legs;
+        times[i] = StopTime{arrival, dwells ? arrival + dwell : arrival};
+    }
+    return times;
 }
 
 std::string Route::getStartStation() const {
-    return !m_intermediateStops.empty() ? m_intermediateStops.front() : "";
+    return !m_stopIds.empty() ? StationRegistry::global().getName(m_stopIds.front()) : "";
 }
 
 std::string Route::getEndStation() const {
-    return !m_intermediateStops.empty() ? m_intermediateStops.back() : "";
+    return !m_stopIds.empty() ? StationRegistry::global().getName(m_stopIds.back()) : "";
 }
 
 } 
\ No newline at end of file
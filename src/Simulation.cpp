@@ -0,0 +1,158 @@
+#include "../include/Simulation.hpp"
+#include "../include/Train.hpp"
+#include "../include/TaskScheduler.hpp"
+#include "../include/Metrics.hpp"
+#include <algorithm>
+#include <chrono>
+
+namespace CJ {
+
+namespace {
+
+// Min-heap order: earlier first; at the same second arrivals come before
+// departures, then lower trip index, so runs are deterministic
+struct LaterEvent {
+    bool operator()(const SimulationEvent& a, const SimulationEvent& b) const {
+        if (a.time != b.time) return a.time > b.time;
+        if (a.type != b.type) return a.type > b.type;
+        return a.trip > b.trip;
+    }
+};
+
+} // namespace
+
+Simulation::Simulation(const std::vector<Route>& routes) {
+    m_tripOffsets.reserve(routes.size() + 1);
+    m_trainIds.reserve(routes.size());
+    m_tripOffsets.push_back(0);
+
+    for (const auto& route : routes) {
+        m_tripOffsets.push_back(m_tripOffsets.back() + static_cast<uint32_t>(route.getStopIds().size()));
+        std::shared_ptr<Train> train = route.getAssignedTrain();
+        m_trainIds.push_back(train ? train->getId() : 0);
+    }
+
+    // Each trip fills its own slice, so the stop times are computed in parallel
+    m_stopTimes.resize(m_tripOffsets.back());
+    m_stopStations.resize(m_tripOffsets.back());
+    TaskScheduler::global().parallelFor(0, routes.size(), 0, [&](size_t first, size_t last) {
+        for (size_t trip = first; trip < last; ++trip) {
+            std::vector<StopTime> times = routes[trip].calculateStopTimes();
+            std::copy(times.begin(), times.end(), m_stopTimes.begin() + m_tripOffsets[trip]);
+            const std::vector<StationId>& stops = routes[trip].getStopIds();
+            std::copy(stops.begin(), stops.end(), m_stopStations.begin() + m_tripOffsets[trip]);
+        }
+    });
+}
+
+void Simulation::setEventCallback(EventCallback callback) {
+    m_callback = std::move(callback);
+}
+
+SimulationStats Simulation::run(int startTime, int endTime) {
+    CJ_TIMED("simulation.run");
+    SimulationStats stats;
+    auto started = std::chrono::steady_clock::now();
+
+    std::vector<SimulationEvent> queue;
+    queue.reserve(getTripCount());
+    for (uint32_t trip = 0; trip < getTripCount(); ++trip) {
+        if (getStopCount(trip) < 2) {
+            continue;
+        }
+        int departure = getStopTime(trip, 0).departure;
+        if (departure >= startTime && departure < endTime) {
+            queue.push_back(SimulationEvent{departure, trip, 0, SimulationEventType::Departure});
+        }
+    }
+    std::make_heap(queue.begin(), queue.end(), LaterEvent());
+    stats.tripsRun = queue.size();
+    stats.peakQueueSize = queue.size();
+    if (!queue.empty()) {
+        stats.firstEventTime = queue.front().time;
+    }
+
+    size_t inService = 0;
+    SimulationEvent next;
+    while (!queue.empty()) {
+        std::pop_heap(queue.begin(), queue.end(), LaterEvent());
+        SimulationEvent event = queue.back();
+        queue.pop_back();
+
+        ++stats.eventsProcessed;
+        ++stats.eventsByType[static_cast<size_t>(event.type)];
+        stats.lastEventTime = event.time;
+        if (event.type == SimulationEventType::Departure) {
+            stats.peakTrainsInService = std::max(stats.peakTrainsInService, ++inService);
+        } else if (event.type == SimulationEventType::Arrival) {
+            --inService;
+        }
+
+        if (m_callback) {
+            m_callback(event);
+        }
+
+        if (nextEvent(event, next)) {
+            queue.push_back(next);
+            std::push_heap(queue.begin(), queue.end(), LaterEvent());
+        }
+    }
+
+    stats.elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    stats.eventsPerSecond = stats.elapsedSeconds > 0.0 ? stats.eventsProcessed / stats.elapsedSeconds : 0.0;
+    CJ_COUNT("simulation.events", stats.eventsProcessed);
+    return stats;
+}
+
+bool Simulation::nextEvent(const SimulationEvent& event, SimulationEvent& next) const {
+    uint32_t last = getStopCount(event.trip) - 1;
+    next.trip = event.trip;
+
+    switch (event.type) {
+        case SimulationEventType::Stop:
+            next.stop = event.stop;
+            next.type = SimulationEventType::Dwell;
+            next.time = getStopTime(event.trip, event.stop).departure;
+            return true;
+        case SimulationEventType::Departure:
+        case SimulationEventType::Dwell:
+            next.stop = event.stop + 1;
+            next.type = next.stop == last ? SimulationEventType::Arrival : SimulationEventType::Stop;
+            next.time = getStopTime(event.trip, next.stop).arrival;
+            return true;
+        default:
+            return false;
+    }
+}
+
+size_t Simulation::getTripCount() const {
+    return m_trainIds.size();
+}
+
+int Simulation::getTrainId(uint32_t trip) const {
+    return m_trainIds.at(trip);
+}
+
+StationId Simulation::getStation(uint32_t trip, uint32_t stop) const {
+    return m_stopStations[m_tripOffsets[trip] + stop];
+}
+
+const StopTime& Simulation::getStopTime(uint32_t trip, uint32_t stop) const {
+    return m_stopTimes[m_tripOffsets[trip] + stop];
+}
+
+uint32_t Simulation::getStopCount(uint32_t trip) const {
+    return m_tripOffsets[trip + 1] - m_tripOffsets[trip];
+}
+
+const char* Simulation::eventTypeName(SimulationEventType type) {
+    switch (type) {
+        case SimulationEventType::Arrival: return "arrival";
+        case SimulationEventType::Stop: return "stop";
+        case SimulationEventType::Dwell: return "dwell";
+        case SimulationEventType::Departure: return "departure";
+        default: return "unknown";
+    }
+}
+
+} // namespace CJ
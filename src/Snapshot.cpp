@@ -0,0 +1,583 @@
+#include "../include/Snapshot.hpp"
+#include "../include/Metrics.hpp"
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+#include <tuple>
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace CJ {
+
+namespace {
+    constexpr char SNAPSHOT_MAGIC[8] = {'C', 'J', 'S', 'N', 'A', 'P', '\0', '\0'};
+
+    // On-disk records; fixed size so a section is a plain array in the mapping
+    struct TrainRecord {
+        int32_t id;
+        int32_t speed;
+        int32_t capacity;
+        int32_t wagonCount;
+        uint32_t nameOffset;
+        uint32_t nameLength;
+    };
+
+    struct StationRecord {
+        uint32_t nameOffset;
+        uint32_t nameLength;
+        int32_t platformCount;
+        uint32_t reserved;
+    };
+
+    struct RouteRecord {
+        int32_t depHour;
+        int32_t depMinute;
+        int32_t arrHour;
+        int32_t arrMinute;
+        int32_t duration;
+        uint32_t firstStop;
+        uint32_t stopCount;
+        uint32_t reserved;
+    };
+
+    struct NameRecord {
+        uint32_t nameOffset;
+        uint32_t nameLength;
+    };
+
+    struct AssignmentRecord {
+        int32_t trainId;
+        uint32_t routeIndex;
+    };
+
+    // Index entries are stored as they are in memory
+    static_assert(sizeof(PlatformWindow) == 16, "PlatformWindow is a snapshot record");
+    static_assert(sizeof(StationBoardEntry) == 16, "StationBoardEntry is a snapshot record");
+
+    uint64_t fnv1a(const unsigned char* data, size_t size) {
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < size; ++i) {
+            hash ^= data[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    size_t alignUp(size_t value) {
+        return (value + 7) & ~static_cast<size_t>(7);
+    }
+
+    // Station names repeat across routes, so each distinct string is stored once
+    class StringTable {
+    public:
+        std::pair<uint32_t, uint32_t> add(const std::string& value) {
+            auto it = m_offsets.find(value);
+            if (it != m_offsets.end()) {
+                return {it->second, static_cast<uint32_t>(value.size())};
+            }
+            uint32_t offset = static_cast<uint32_t>(m_blob.size());
+            m_blob += value;
+            m_offsets.emplace(value, offset);
+            return {offset, static_cast<uint32_t>(value.size())};
+        }
+
+        const std::string& blob() const { return m_blob; }
+
+    private:
+        std::unordered_map<std::string, uint32_t> m_offsets;
+        std::string m_blob;
+    };
+
+    template <typename T>
+    const T* section(const unsigned char* base, uint64_t offset) {
+        return reinterpret_cast<const T*>(base + offset);
+    }
+}
+
+struct Snapshot::Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t sourceStamp;
+    uint64_t payloadSize;
+    uint64_t checksum;
+    uint32_t trainCount;
+    uint32_t stationCount;
+    uint32_t routeCount;
+    uint32_t stopCount;
+    uint32_t assignmentCount;
+    uint32_t nameCount;
+    uint32_t windowCount;
+    uint32_t departureCount;
+    uint32_t arrivalCount;
+    uint32_t hasIndexes;
+    uint64_t trainsOffset;
+    uint64_t stationsOffset;
+    uint64_t routesOffset;
+    uint64_t stopsOffset;
+    uint64_t assignmentsOffset;
+    uint64_t namesOffset;
+    uint64_t windowsByStationOffset;
+    uint64_t windowsByTripOffset;
+    uint64_t departuresOffset;
+    uint64_t arrivalsOffset;
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+};
+
+Snapshot::Snapshot()
+    : m_data(nullptr), m_size(0)
+#ifdef _WIN32
+    , m_file(nullptr), m_mapping(nullptr)
+#else
+    , m_fd(-1)
+#endif
+{
+}
+
+Snapshot::~Snapshot() {
+    close();
+}
+
+bool Snapshot::write(const std::string& path,
+                     const std::vector<Train>& trains,
+                     const std::vector<Station>& stations,
+                     const std::vector<Route>& routes,
+                     const std::vector<std::pair<int, size_t>>& assignments,
+                     uint64_t sourceStamp,
+                     const SnapshotIndexes* indexes) {
+    CJ_TIMED("snapshot.write");
+    StringTable strings;
+
+    std::vector<TrainRecord> trainRecords;
+    trainRecords.reserve(trains.size());
+    for (const auto& train : trains) {
+        auto name = strings.add(train.getTrainName());
+        trainRecords.push_back({train.getId(), train.getSpeed(), train.getCapacity(),
+                                train.getWagonCount(), name.first, name.second});
+    }
+
+    std::vector<StationRecord> stationRecords;
+    stationRecords.reserve(stations.size());
+    for (const auto& station : stations) {
+        auto name = strings.add(station.getName());
+        stationRecords.push_back({name.first, name.second, station.getPlatformCount(), 0});
+    }
+
+    std::vector<RouteRecord> routeRecords;
+    std::vector<StationId> stopRecords;
+    routeRecords.reserve(routes.size());
+    for (const auto& route : routes) {
+        const auto& stops = route.getStopIds();
+        routeRecords.push_back({route.getDepartureTimeHour(), route.getDepartureTimeMinute(),
+                                route.getArrivalTimeHour(), route.getArrivalTimeMinute(),
+                                route.getDuration(), static_cast<uint32_t>(stopRecords.size()),
+                                static_cast<uint32_t>(stops.size()), 0});
+        stopRecords.insert(stopRecords.end(), stops.begin(), stops.end());
+    }
+
+    const StationRegistry& registry = StationRegistry::global();
+    std::vector<NameRecord> nameRecords;
+    nameRecords.reserve(registry.size());
+    for (StationId id = 0; id < registry.size(); ++id) {
+        auto name = strings.add(registry.getName(id));
+        nameRecords.push_back({name.first, name.second});
+    }
+    const SnapshotIndexes noIndexes;
+    const SnapshotIndexes& saved = indexes ? *indexes : noIndexes;
+
+    std::vector<AssignmentRecord> assignmentRecords;
+    assignmentRecords.reserve(assignments.size());
+    for (const auto& assignment : assignments) {
+        assignmentRecords.push_back({assignment.first, static_cast<uint32_t>(assignment.second)});
+    }
+
+    Header header{};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.version = FORMAT_VERSION;
+    header.headerSize = sizeof(Header);
+    header.sourceStamp = sourceStamp;
+    header.trainCount = static_cast<uint32_t>(trainRecords.size());
+    header.stationCount = static_cast<uint32_t>(stationRecords.size());
+    header.routeCount = static_cast<uint32_t>(routeRecords.size());
+    header.stopCount = static_cast<uint32_t>(stopRecords.size());
+    header.assignmentCount = static_cast<uint32_t>(assignmentRecords.size());
+    header.nameCount = static_cast<uint32_t>(nameRecords.size());
+    header.windowCount = static_cast<uint32_t>(saved.windowsByStation.size());
+    header.departureCount = static_cast<uint32_t>(saved.departures.size());
+    header.arrivalCount = static_cast<uint32_t>(saved.arrivals.size());
+    header.hasIndexes = indexes != nullptr;
+
+    size_t offset = alignUp(sizeof(Header));
+    auto place = [&offset](uint64_t& sectionOffset, size_t bytes) {
+        sectionOffset = offset;
+        offset = alignUp(offset + bytes);
+    };
+    place(header.trainsOffset, trainRecords.size() * sizeof(TrainRecord));
+    place(header.stationsOffset, stationRecords.size() * sizeof(StationRecord));
+    place(header.routesOffset, routeRecords.size() * sizeof(RouteRecord));
+    place(header.stopsOffset, stopRecords.size() * sizeof(StationId));
+    place(header.assignmentsOffset, assignmentRecords.size() * sizeof(AssignmentRecord));
+    place(header.namesOffset, nameRecords.size() * sizeof(NameRecord));
+    place(header.windowsByStationOffset, saved.windowsByStation.size() * sizeof(PlatformWindow));
+    place(header.windowsByTripOffset, saved.windowsByTrip.size() * sizeof(PlatformWindow));
+    place(header.departuresOffset, saved.departures.size() * sizeof(StationBoardEntry));
+    place(header.arrivalsOffset, saved.arrivals.size() * sizeof(StationBoardEntry));
+    header.stringsOffset = offset;
+    header.stringsSize = strings.blob().size();
+    offset += strings.blob().size();
+
+    std::vector<unsigned char> image(offset, 0);
+    auto copySection = [&image](uint64_t at, const void* data, size_t bytes) {
+        if (bytes > 0) {
+            std::memcpy(image.data() + at, data, bytes);
+        }
+    };
+    copySection(header.trainsOffset, trainRecords.data(), trainRecords.size() * sizeof(TrainRecord));
+    copySection(header.stationsOffset, stationRecords.data(), stationRecords.size() * sizeof(StationRecord));
+    copySection(header.routesOffset, routeRecords.data(), routeRecords.size() * sizeof(RouteRecord));
+    copySection(header.stopsOffset, stopRecords.data(), stopRecords.size() * sizeof(StationId));
+    copySection(header.assignmentsOffset, assignmentRecords.data(),
+                assignmentRecords.size() * sizeof(AssignmentRecord));
+    copySection(header.namesOffset, nameRecords.data(), nameRecords.size() * sizeof(NameRecord));
+    copySection(header.windowsByStationOffset, saved.windowsByStation.data(),
+                saved.windowsByStation.size() * sizeof(PlatformWindow));
+    copySection(header.windowsByTripOffset, saved.windowsByTrip.data(),
+                saved.windowsByTrip.size() * sizeof(PlatformWindow));
+    copySection(header.departuresOffset, saved.departures.data(),
+                saved.departures.size() * sizeof(StationBoardEntry));
+    copySection(header.arrivalsOffset, saved.arrivals.data(), saved.arrivals.size() * sizeof(StationBoardEntry));
+    copySection(header.stringsOffset, strings.blob().data(), strings.blob().size());
+
+    header.payloadSize = image.size() - sizeof(Header);
+    header.checksum = fnv1a(image.data() + sizeof(Header), header.payloadSize);
+    std::memcpy(image.data(), &header, sizeof(Header));
+
+    // Write next to the target and rename so readers never see a torn file
+    std::string tempPath = path + ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cerr << "Failed to create snapshot file: " << tempPath << std::endl;
+            return false;
+        }
+        out.write(reinterpret_cast<const char*>(image.data()), static_cast<std::streamsize>(image.size()));
+        if (!out) {
+            std::cerr << "Failed to write snapshot file: " << tempPath << std::endl;
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tempPath, path, ec);
+    if (ec) {
+        std::cerr << "Failed to move snapshot into place: " << ec.message() << std::endl;
+        std::filesystem::remove(tempPath, ec);
+        return false;
+    }
+    return true;
+}
+
+uint64_t Snapshot::fileStamp(const std::string& path) {
+    std::error_code ec;
+    auto size = std::filesystem::file_size(path, ec);
+    if (ec) {
+        return 0;
+    }
+    auto modified = std::filesystem::last_write_time(path, ec);
+    if (ec) {
+        return 0;
+    }
+    uint64_t ticks = static_cast<uint64_t>(modified.time_since_epoch().count());
+    return (ticks * 1099511628211ull) ^ static_cast<uint64_t>(size);
+}
+
+bool Snapshot::open(const std::string& path) {
+    CJ_TIMED("snapshot.open");
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        CloseHandle(file);
+        return false;
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    m_file = file;
+    m_mapping = mapping;
+    m_data = static_cast<const unsigned char*>(view);
+    m_size = static_cast<size_t>(fileSize.QuadPart);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    if (view == MAP_FAILED) {
+        ::close(fd);
+        return false;
+    }
+    m_fd = fd;
+    m_data = static_cast<const unsigned char*>(view);
+    m_size = static_cast<size_t>(info.st_size);
+#endif
+
+    if (!validate()) {
+        std::cerr << "Snapshot file is corrupt or from another version: " << path << std::endl;
+        close();
+        return false;
+    }
+    return true;
+}
+
+void Snapshot::close() {
+    if (!m_data) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(m_data);
+    CloseHandle(static_cast<HANDLE>(m_mapping));
+    CloseHandle(static_cast<HANDLE>(m_file));
+    m_mapping = nullptr;
+    m_file = nullptr;
+#else
+    munmap(const_cast<unsigned char*>(m_data), m_size);
+    ::close(m_fd);
+    m_fd = -1;
+#endif
+    m_data = nullptr;
+    m_size = 0;
+}
+
+bool Snapshot::isOpen() const {
+    return m_data != nullptr;
+}
+
+const Snapshot::Header* Snapshot::header() const {
+    return reinterpret_cast<const Header*>(m_data);
+}
+
+bool Snapshot::validate() const {
+    if (m_size < sizeof(Header)) {
+        return false;
+    }
+    const Header* h = header();
+    if (std::memcmp(h->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 ||
+        h->version != FORMAT_VERSION || h->headerSize != sizeof(Header) ||
+        h->payloadSize != m_size - sizeof(Header)) {
+        return false;
+    }
+
+    auto fits = [this](uint64_t offset, uint64_t count, size_t recordSize) {
+        return offset % 8 == 0 && offset <= m_size && count <= (m_size - offset) / recordSize;
+    };
+    if (!fits(h->trainsOffset, h->trainCount, sizeof(TrainRecord)) ||
+        !fits(h->stationsOffset, h->stationCount, sizeof(StationRecord)) ||
+        !fits(h->routesOffset, h->routeCount, sizeof(RouteRecord)) ||
+        !fits(h->stopsOffset, h->stopCount, sizeof(StationId)) ||
+        !fits(h->assignmentsOffset, h->assignmentCount, sizeof(AssignmentRecord)) ||
+        !fits(h->namesOffset, h->nameCount, sizeof(NameRecord)) ||
+        !fits(h->windowsByStationOffset, h->windowCount, sizeof(PlatformWindow)) ||
+        !fits(h->windowsByTripOffset, h->windowCount, sizeof(PlatformWindow)) ||
+        !fits(h->departuresOffset, h->departureCount, sizeof(StationBoardEntry)) ||
+        !fits(h->arrivalsOffset, h->arrivalCount, sizeof(StationBoardEntry)) ||
+        h->stringsOffset > m_size || h->stringsSize > m_size - h->stringsOffset) {
+        return false;
+    }
+
+    if (fnv1a(m_data + sizeof(Header), h->payloadSize) != h->checksum) {
+        return false;
+    }
+
+    // Check every cross reference once so the accessors can index without bounds checks
+    auto stringFits = [h](uint32_t offset, uint32_t length) {
+        return static_cast<uint64_t>(offset) + length <= h->stringsSize;
+    };
+    const auto* trains = section<TrainRecord>(m_data, h->trainsOffset);
+    for (uint32_t i = 0; i < h->trainCount; ++i) {
+        if (!stringFits(trains[i].nameOffset, trains[i].nameLength)) return false;
+    }
+    const auto* stations = section<StationRecord>(m_data, h->stationsOffset);
+    for (uint32_t i = 0; i < h->stationCount; ++i) {
+        if (!stringFits(stations[i].nameOffset, stations[i].nameLength)) return false;
+    }
+    const auto* routes = section<RouteRecord>(m_data, h->routesOffset);
+    for (uint32_t i = 0; i < h->routeCount; ++i) {
+        if (static_cast<uint64_t>(routes[i].firstStop) + routes[i].stopCount > h->stopCount) return false;
+    }
+    const auto* stops = section<StationId>(m_data, h->stopsOffset);
+    for (uint32_t i = 0; i < h->stopCount; ++i) {
+        if (stops[i] >= h->nameCount) return false;
+    }
+    const auto* assignments = section<AssignmentRecord>(m_data, h->assignmentsOffset);
+    for (uint32_t i = 0; i < h->assignmentCount; ++i) {
+        if (assignments[i].routeIndex >= h->routeCount) return false;
+    }
+    const auto* names = section<NameRecord>(m_data, h->namesOffset);
+    for (uint32_t i = 0; i < h->nameCount; ++i) {
+        if (!stringFits(names[i].nameOffset, names[i].nameLength)) return false;
+    }
+
+    // The indexes are taken back without sorting, so their order is checked too
+    if (!h->hasIndexes) {
+        return h->windowCount == 0 && h->departureCount == 0 && h->arrivalCount == 0;
+    }
+    const auto* byStation = section<PlatformWindow>(m_data, h->windowsByStationOffset);
+    const auto* byTrip = section<PlatformWindow>(m_data, h->windowsByTripOffset);
+    for (uint32_t i = 0; i < h->windowCount; ++i) {
+        for (const PlatformWindow* window : {&byStation[i], &byTrip[i]}) {
+            if (window->station >= h->nameCount || window->trip >= h->routeCount || window->start >= window->end) {
+                return false;
+            }
+        }
+        if (i > 0 && (byStation[i].station < byStation[i - 1].station ||
+                      (byStation[i].station == byStation[i - 1].station &&
+                       byStation[i].start < byStation[i - 1].start))) {
+            return false;
+        }
+        if (i > 0 && byTrip[i].trip < byTrip[i - 1].trip) {
+            return false;
+        }
+    }
+    auto boardValid = [&](const StationBoardEntry* entries, uint32_t count) {
+        for (uint32_t i = 0; i < count; ++i) {
+            const StationBoardEntry& e = entries[i];
+            if (e.station >= h->nameCount || e.entry.trip >= h->routeCount ||
+                routes[e.entry.trip].stopCount < 2 || e.entry.stop >= routes[e.entry.trip].stopCount) {
+                return false;
+            }
+            if (i > 0) {
+                const StationBoardEntry& p = entries[i - 1];
+                if (std::make_tuple(e.station, e.entry.time, e.entry.trip, e.entry.stop) <=
+                    std::make_tuple(p.station, p.entry.time, p.entry.trip, p.entry.stop)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    };
+    return boardValid(section<StationBoardEntry>(m_data, h->departuresOffset), h->departureCount) &&
+           boardValid(section<StationBoardEntry>(m_data, h->arrivalsOffset), h->arrivalCount);
+}
+
+std::string_view Snapshot::stringAt(uint32_t offset, uint32_t length) const {
+    return std::string_view(reinterpret_cast<const char*>(m_data + header()->stringsOffset + offset), length);
+}
+
+uint64_t Snapshot::getSourceStamp() const {
+    return header()->sourceStamp;
+}
+
+size_t Snapshot::getTrainCount() const {
+    return header()->trainCount;
+}
+
+size_t Snapshot::getStationCount() const {
+    return header()->stationCount;
+}
+
+size_t Snapshot::getRouteCount() const {
+    return header()->routeCount;
+}
+
+size_t Snapshot::getAssignmentCount() const {
+    return header()->assignmentCount;
+}
+
+size_t Snapshot::getNameCount() const {
+    return header()->nameCount;
+}
+
+TrainView Snapshot::getTrain(size_t index) const {
+    const TrainRecord& record = section<TrainRecord>(m_data, header()->trainsOffset)[index];
+    return {record.id, record.speed, record.capacity, record.wagonCount,
+            stringAt(record.nameOffset, record.nameLength)};
+}
+
+StationView Snapshot::getStation(size_t index) const {
+    const StationRecord& record = section<StationRecord>(m_data, header()->stationsOffset)[index];
+    return {stringAt(record.nameOffset, record.nameLength), record.platformCount};
+}
+
+RouteView Snapshot::getRoute(size_t index) const {
+    const RouteRecord& record = section<RouteRecord>(m_data, header()->routesOffset)[index];
+    return {record.depHour, record.depMinute, record.arrHour, record.arrMinute,
+            record.duration, record.firstStop, record.stopCount};
+}
+
+StationId Snapshot::getRouteStop(const RouteView& route, size_t stop) const {
+    return section<StationId>(m_data, header()->stopsOffset)[route.firstStop + stop];
+}
+
+AssignmentView Snapshot::getAssignment(size_t index) const {
+    const AssignmentRecord& record = section<AssignmentRecord>(m_data, header()->assignmentsOffset)[index];
+    return {record.trainId, record.routeIndex};
+}
+
+std::string_view Snapshot::getName(StationId id) const {
+    const NameRecord& record = section<NameRecord>(m_data, header()->namesOffset)[id];
+    return stringAt(record.nameOffset, record.nameLength);
+}
+
+bool Snapshot::hasIndexes() const {
+    return header()->hasIndexes != 0;
+}
+
+size_t Snapshot::getWindowCount() const {
+    return header()->windowCount;
+}
+
+const PlatformWindow* Snapshot::getWindowsByStation() const {
+    return section<PlatformWindow>(m_data, header()->windowsByStationOffset);
+}
+
+const PlatformWindow* Snapshot::getWindowsByTrip() const {
+    return section<PlatformWindow>(m_data, header()->windowsByTripOffset);
+}
+
+size_t Snapshot::getDepartureCount() const {
+    return header()->departureCount;
+}
+
+const StationBoardEntry* Snapshot::getDepartures() const {
+    return section<StationBoardEntry>(m_data, header()->departuresOffset);
+}
+
+size_t Snapshot::getArrivalCount() const {
+    return header()->arrivalCount;
+}
+
+const StationBoardEntry* Snapshot::getArrivals() const {
+    return section<StationBoardEntry>(m_data, header()->arrivalsOffset);
+}
+
+} // namespace CJ
@@ -0,0 +1,156 @@
+#include "../include/StationRegistry.hpp"
+#include <cctype>
+#include <mutex>
+#include <stdexcept>
+
+namespace CJ {
+
+namespace {
+    // Walks a name word by word, lowercased, yielding single spaces between words
+    class NormalizedChars {
+    public:
+        explicit NormalizedChars(std::string_view text) : m_text(text), m_pos(0), m_pendingSpace(false) {
+            skipSpaces();
+            m_pendingSpace = false;
+        }
+
+        // Returns '\0' at the end of the name
+        char next() {
+            if (m_pendingSpace) {
+                m_pendingSpace = false;
+                return ' ';
+            }
+            if (m_pos >= m_text.size()) {
+                return '\0';
+            }
+            char c = static_cast<char>(std::tolower(static_cast<unsigned char>(m_text[m_pos++])));
+            if (m_pos < m_text.size() && std::isspace(static_cast<unsigned char>(m_text[m_pos]))) {
+                skipSpaces();
+                m_pendingSpace = m_pos < m_text.size();
+            }
+            return c;
+        }
+
+    private:
+        void skipSpaces() {
+            while (m_pos < m_text.size() && std::isspace(static_cast<unsigned char>(m_text[m_pos]))) {
+                ++m_pos;
+            }
+        }
+
+        std::string_view m_text;
+        size_t m_pos;
+        bool m_pendingSpace;
+    };
+}
+
+StationRegistry::StationRegistry() : m_slots(1024, INVALID_STATION_ID) {
+}
+
+StationRegistry& StationRegistry::global() {
+    static StationRegistry registry;
+    return registry;
+}
+
+bool StationRegistry::equalNames(std::string_view name1, std::string_view name2) {
+    NormalizedChars a(name1);
+    NormalizedChars b(name2);
+    while (true) {
+        char c1 = a.next();
+        char c2 = b.next();
+        if (c1 != c2) {
+            return false;
+        }
+        if (c1 == '\0') {
+            return true;
+        }
+    }
+}
+
+uint64_t StationRegistry::hashName(std::string_view name) {
+    NormalizedChars chars(name);
+    uint64_t hash = 14695981039346656037ull;
+    for (char c = chars.next(); c != '\0'; c = chars.next()) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+StationId StationRegistry::findLocked(std::string_view name, uint64_t hash) const {
+    size_t mask = m_slots.size() - 1;
+    for (size_t slot = hash & mask; ; slot = (slot + 1) & mask) {
+        StationId id = m_slots[slot];
+        if (id == INVALID_STATION_ID) {
+            return INVALID_STATION_ID;
+        }
+        if (m_hashes[id] == hash && equalNames(m_names[id], name)) {
+            return id;
+        }
+    }
+}
+
+void StationRegistry::insertSlot(StationId id, uint64_t hash) {
+    size_t mask = m_slots.size() - 1;
+    size_t slot = hash & mask;
+    while (m_slots[slot] != INVALID_STATION_ID) {
+        slot = (slot + 1) & mask;
+    }
+    m_slots[slot] = id;
+}
+
+void StationRegistry::grow() {
+    m_slots.assign(m_slots.size() * 2, INVALID_STATION_ID);
+    for (StationId id = 0; id < m_names.size(); ++id) {
+        insertSlot(id, m_hashes[id]);
+    }
+}
+
+StationId StationRegistry::intern(std::string_view name) {
+    uint64_t hash = hashName(name);
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        StationId id = findLocked(name, hash);
+        if (id != INVALID_STATION_ID) {
+            return id;
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    StationId id = findLocked(name, hash);  // another thread may have added it
+    if (id != INVALID_STATION_ID) {
+        return id;
+    }
+
+    id = static_cast<StationId>(m_names.size());
+    m_names.emplace_back(name);
+    m_hashes.push_back(hash);
+    // Keep the load factor under 0.7 so probe sequences stay short
+    if ((m_names.size() * 10) > (m_slots.size() * 7)) {
+        grow();
+    } else {
+        insertSlot(id, hash);
+    }
+    return id;
+}
+
+StationId StationRegistry::find(std::string_view name) const {
+    uint64_t hash = hashName(name);
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    return findLocked(name, hash);
+}
+
+const std::string& StationRegistry::getName(StationId id) const {
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    if (id >= m_names.size()) {
+        throw std::out_of_range("Unknown station id " + std::to_string(id));
+    }
+    return m_names[id];
+}
+
+size_t StationRegistry::size() const {
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    return m_names.size();
+}
+
+} // namespace CJ
@@ -0,0 +1,209 @@
+#include "../include/TaskScheduler.hpp"
+#include <algorithm>
+#include <chrono>
+
+namespace CJ {
+
+namespace {
+
+constexpr unsigned NOT_A_WORKER = ~0u;
+
+// Which pool, if any, the current thread works for
+thread_local const TaskScheduler* t_scheduler = nullptr;
+thread_local unsigned t_workerIndex = NOT_A_WORKER;
+
+} // namespace
+
+TaskScheduler::TaskScheduler(unsigned threadCount) {
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (unsigned i = 0; i < threadCount; ++i) {
+        m_workers.push_back(std::make_unique<Worker>());
+    }
+    for (unsigned i = 0; i < threadCount; ++i) {
+        m_threads.emplace_back(&TaskScheduler::workerLoop, this, i);
+    }
+}
+
+TaskScheduler::~TaskScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    for (auto& thread : m_threads) {
+        thread.join();
+    }
+}
+
+TaskScheduler& TaskScheduler::global() {
+    static TaskScheduler scheduler;
+    return scheduler;
+}
+
+unsigned TaskScheduler::getThreadCount() const {
+    return static_cast<unsigned>(m_threads.size());
+}
+
+void TaskScheduler::submit(Job job) {
+    m_queued.fetch_add(1);
+    if (t_scheduler == this) {
+        Worker& worker = *m_workers[t_workerIndex];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.jobs.push_back(std::move(job));
+    } else {
+        std::lock_guard<std::mutex> lock(m_injectMutex);
+        m_inject.push_back(std::move(job));
+    }
+    // Taking the lock orders this with a worker that is about to sleep
+    { std::lock_guard<std::mutex> lock(m_sleepMutex); }
+    m_wake.notify_one();
+}
+
+bool TaskScheduler::takeJob(unsigned self, Job& job) {
+    if (m_queued.load() == 0) {
+        return false;
+    }
+    // Newest own task first: it is the one most likely still in cache
+    if (self != NOT_A_WORKER) {
+        Worker& worker = *m_workers[self];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (!worker.jobs.empty()) {
+            job = std::move(worker.jobs.back());
+            worker.jobs.pop_back();
+            m_queued.fetch_sub(1);
+            return true;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_injectMutex);
+        if (!m_inject.empty()) {
+            job = std::move(m_inject.front());
+            m_inject.pop_front();
+            m_queued.fetch_sub(1);
+            return true;
+        }
+    }
+    // Steal the oldest task of another worker
+    unsigned count = static_cast<unsigned>(m_workers.size());
+    unsigned start = self == NOT_A_WORKER ? 0 : self + 1;
+    for (unsigned i = 0; i < count; ++i) {
+        Worker& victim = *m_workers[(start + i) % count];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.jobs.empty()) {
+            job = std::move(victim.jobs.front());
+            victim.jobs.pop_front();
+            m_queued.fetch_sub(1);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TaskScheduler::runOne(unsigned self) {
+    Job job;
+    if (!takeJob(self, job)) {
+        return false;
+    }
+    execute(job);
+    return true;
+}
+
+void TaskScheduler::execute(Job& job) {
+    std::exception_ptr error;
+    try {
+        job.task();
+    } catch (...) {
+        error = std::current_exception();
+    }
+    job.group->finished(error);
+}
+
+void TaskScheduler::workerLoop(unsigned index) {
+    t_scheduler = this;
+    t_workerIndex = index;
+    while (true) {
+        if (runOne(index)) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_wake.wait(lock, [this] { return m_stopping || m_queued.load() > 0; });
+        if (m_stopping && m_queued.load() == 0) {
+            return;
+        }
+    }
+}
+
+void TaskScheduler::parallelFor(size_t begin, size_t end, size_t grain,
+                                const std::function<void(size_t, size_t)>& body, size_t maxTasks) {
+    if (begin >= end) {
+        return;
+    }
+    size_t count = end - begin;
+    if (grain == 0) {
+        grain = std::max<size_t>(1, count / ((getThreadCount() + 1) * 4));
+    }
+    if (maxTasks > 0 && (count + grain - 1) / grain > maxTasks) {
+        grain = (count + maxTasks - 1) / maxTasks;
+    }
+    if (grain >= count) {
+        body(begin, end);
+        return;
+    }
+
+    TaskGroup group(*this);
+    for (size_t first = begin; first < end; first += grain) {
+        size_t last = std::min(end, first + grain);
+        group.run([&body, first, last] { body(first, last); });
+    }
+    group.wait();
+}
+
+TaskGroup::TaskGroup(TaskScheduler& scheduler) : m_scheduler(scheduler) {}
+
+TaskGroup::~TaskGroup() {
+    try {
+        wait();
+    } catch (...) {
+        // Errors are only reported through an explicit wait()
+    }
+}
+
+void TaskGroup::run(TaskScheduler::Task task) {
+    m_pending.fetch_add(1);
+    m_scheduler.submit(TaskScheduler::Job{std::move(task), this});
+}
+
+void TaskGroup::wait() {
+    unsigned self = t_scheduler == &m_scheduler ? t_workerIndex : NOT_A_WORKER;
+    while (m_pending.load() > 0) {
+        if (m_scheduler.runOne(self)) {
+            continue;
+        }
+        // The rest is running elsewhere; it may still queue more work, so
+        // look again shortly rather than sleeping until the group is done
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait_for(lock, std::chrono::microseconds(200), [this] { return m_pending.load() == 0; });
+    }
+
+    // Wait for the last finished() to let go of the mutex before the group can be destroyed
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_error) {
+        std::exception_ptr error = m_error;
+        m_error = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+void TaskGroup::finished(std::exception_ptr error) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (error && !m_error) {
+        m_error = error;
+    }
+    if (m_pending.fetch_sub(1) == 1) {
+        m_done.notify_all();
+    }
+}
+
+} // namespace CJ
@@ -1,15 +1,157 @@
 #include <iostream>
 #include <stdexcept>
 #include <filesystem>
+#include <sstream>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
 #include "../include/Train.hpp"
 #include "../include/Route.hpp"
 #include "../include/Station.hpp"
 #include "../include/CLI.hpp"
 #include "../include/Management.hpp"
 #include "../include/DatabaseManager.hpp"
+#include "../include/NetworkGenerator.hpp"
+#include "../include/Metrics.hpp"
+#include "../include/BatchRunner.hpp"
+#include "../include/GtfsImporter.hpp"
+#include "../include/Exporter.hpp"
+#include "../include/HttpServer.hpp"
+#include "../include/QueryService.hpp"
+#include "../include/EventStream.hpp"
+#include <fstream>
+#include <csignal>
+#include <cerrno>
 
-int main() {
+namespace {
+    // Server stopped by SIGINT/SIGTERM in --serve mode
+    CJ::HttpServer* activeServer = nullptr;
+
+    void stopServer(int) {
+        if (activeServer) {
+            activeServer->stop();
+        }
+    }
+
+    // Whole argument as a base-10 number within [min, max]
+    bool parseNumber(const char* text, long min, long max, long& value) {
+        char* end = nullptr;
+        errno = 0;
+        value = std::strtol(text, &end, 10);
+        return end != text && *end == '\0' && errno == 0 && value >= min && value <= max;
+    }
+}
+
+int main(int argc, char* argv[]) {
     try {
+        bool simulate = false;
+        bool validate = false;
+        bool writeBehind = false;
+        bool generate = false;
+        std::string generateSnapshot;
+        std::string metricsPath;
+        std::string sqlProfilePath;
+        std::string batchPath;
+        std::string gtfsDirectory;
+        CJ::ExportOptions exportOptions;
+        int servePort = -1;
+        std::string eventLogPath;
+        bool tailEvents = false;
+        CJ::OverflowPolicy eventOverflow = CJ::OverflowPolicy::Block;
+        CJ::GeneratorOptions generatorOptions;
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--simulate") {
+                simulate = true;
+            } else if (arg == "--validate") {
+                validate = true;
+            } else if (arg == "--write-behind") {
+                writeBehind = true;
+            } else if (arg == "--generate" && i + 1 < argc) {
+                // STATIONS,TRAINS,ROUTES
+                char separator1 = 0, separator2 = 0;
+                std::istringstream counts(argv[++i]);
+                if (!(counts >> generatorOptions.stations >> separator1 >> generatorOptions.trains
+                             >> separator2 >> generatorOptions.routes) ||
+                    separator1 != ',' || separator2 != ',') {
+                    std::cerr << "Expected --generate STATIONS,TRAINS,ROUTES" << std::endl;
+                    return 1;
+                }
+                generate = true;
+            } else if (arg == "--seed" && i + 1 < argc) {
+                generatorOptions.seed = std::stoull(argv[++i]);
+            } else if (arg == "--generate-snapshot" && i + 1 < argc) {
+                generateSnapshot = argv[++i];
+            } else if (arg == "--metrics" && i + 1 < argc) {
+                metricsPath = argv[++i];
+            } else if (arg == "--import-gtfs" && i + 1 < argc) {
+                gtfsDirectory = argv[++i];
+            } else if (arg == "--export" && i + 1 < argc) {
+                exportOptions.directory = argv[++i];
+            } else if (arg == "--export-format" && i + 1 < argc) {
+                if (!CJ::Exporter::parseFormat(argv[++i], exportOptions.format)) {
+                    std::cerr << "Expected --export-format csv|ndjson" << std::endl;
+                    return 1;
+                }
+            } else if (arg == "--export-chunks" && i + 1 < argc) {
+                long chunks = 0;
+                if (!parseNumber(argv[++i], 1, 4096, chunks)) {
+                    std::cerr << "Expected --export-chunks N (1-4096)" << std::endl;
+                    return 1;
+                }
+                exportOptions.chunks = static_cast<unsigned>(chunks);
+            } else if (arg == "--serve" && i + 1 < argc) {
+                long port = 0;
+                if (!parseNumber(argv[++i], 0, 65535, port)) {
+                    std::cerr << "Expected --serve PORT" << std::endl;
+                    return 1;
+                }
+                servePort = static_cast<int>(port);
+            } else if (arg == "--events" && i + 1 < argc) {
+                eventLogPath = argv[++i];
+            } else if (arg == "--tail-events") {
+                tailEvents = true;
+            } else if (arg == "--event-overflow" && i + 1 < argc) {
+                if (!CJ::EventStream::parsePolicy(argv[++i], eventOverflow)) {
+                    std::cerr << "Expected --event-overflow block|drop" << std::endl;
+                    return 1;
+                }
+            } else if (arg == "--batch" && i + 1 < argc) {
+                batchPath = argv[++i];
+            } else if (arg == "--profile-sql" && i + 1 < argc) {
+                sqlProfilePath = argv[++i];
+            } else {
+                std::cerr << "Unknown option: " << arg << std::endl;
+                return 1;
+            }
+        }
+
+        if (!generateSnapshot.empty()) {
+            CJ::GeneratedNetwork network = CJ::NetworkGenerator(generatorOptions).generate();
+            if (!CJ::NetworkGenerator::writeSnapshot(network, generateSnapshot)) {
+                std::cerr << "Failed to write snapshot to " << generateSnapshot << std::endl;
+                return 1;
+            }
+            std::cout << "Wrote " << network.stations.size() << " stations, " << network.trains.size()
+                      << " trains and " << network.routes.size() << " routes to " << generateSnapshot << std::endl;
+            return 0;
+        }
+
+        // Written once the system has shut down, so the final flush is included
+        auto writeMetrics = [&metricsPath, &sqlProfilePath]() {
+            if (!metricsPath.empty() && !CJ::MetricsRegistry::global().writeFile(metricsPath)) {
+                std::cerr << "Failed to write metrics to " << metricsPath << std::endl;
+            }
+            if (!sqlProfilePath.empty() && !CJ::Management::writeStatementProfiles(sqlProfilePath)) {
+                std::cerr << "Failed to write SQL profile to " << sqlProfilePath << std::endl;
+            }
+        };
+
+        // Before start-up, so loading the network is profiled too
+        if (!sqlProfilePath.empty()) {
+            CJ::Management::setStatementProfiling(true);
+        }
+
         std::cout << "Starting Train Simulation System..." << std::endl;
         
         if (!CJ::Management::initializeSystem()) {
@@ -17,6 +159,127 @@ int main() {
             return 1;
         }
 
+        if (writeBehind && !CJ::Management::enableWriteBehind()) {
+            std::cerr << "Failed to start write-behind persistence!" << std::endl;
+            return 1;
+        }
+
+        if (generate) {
+            auto started = std::chrono::steady_clock::now();
+            CJ::GeneratedNetwork network = CJ::NetworkGenerator(generatorOptions).generate();
+            CJ::ImportReport report;
+            bool committed = CJ::Management::importBatch(network.trains, network.stations, network.routes, report);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+            std::cout << "Generated network (seed " << generatorOptions.seed << "): imported "
+                      << report.stationsImported << " stations, " << report.trainsImported << " trains, "
+                      << report.routesImported << " routes in " << seconds << " s";
+            if (!report.failures.empty()) {
+                std::cout << ", " << report.failures.size() << " rows failed";
+            }
+            std::cout << std::endl;
+            if (!committed) {
+                std::cerr << "Import of the generated network failed!" << std::endl;
+                CJ::Management::shutdownSystem();
+                return 1;
+            }
+        }
+
+        if (!gtfsDirectory.empty()) {
+            CJ::GtfsImportOptions options;
+            options.directory = gtfsDirectory;
+            CJ::GtfsImporter importer(options);
+            CJ::GtfsImportReport report;
+            if (!importer.run(report)) {
+                std::cerr << "GTFS import failed: " << importer.getError() << std::endl;
+                CJ::Management::shutdownSystem();
+                return 1;
+            }
+            CJ::GtfsImporter::printReport(std::cout, report);
+        }
+
+        // After any imports, so they are part of the dump
+        if (!exportOptions.directory.empty()) {
+            CJ::Exporter exporter(exportOptions);
+            CJ::ExportReport report;
+            bool exported = exporter.run(report);
+            if (exported) {
+                CJ::Exporter::printReport(std::cout, report);
+            } else {
+                std::cerr << "Export failed: " << exporter.getError() << std::endl;
+            }
+            CJ::Management::shutdownSystem();
+            writeMetrics();
+            return exported ? 0 : 1;
+        }
+
+        if (!batchPath.empty()) {
+            // "-" reads the commands from stdin
+            std::ifstream file;
+            if (batchPath != "-") {
+                file.open(batchPath);
+                if (!file) {
+                    std::cerr << "Cannot open batch file " << batchPath << std::endl;
+                    CJ::Management::shutdownSystem();
+                    return 1;
+                }
+            }
+            CJ::BatchRunner runner;
+            bool succeeded = runner.run(batchPath == "-" ? std::cin : file);
+            CJ::Management::shutdownSystem();
+            writeMetrics();
+            return succeeded ? 0 : 1;
+        }
+
+        if (servePort >= 0) {
+            CJ::QueryService service;
+            CJ::HttpServerOptions options;
+            options.port = static_cast<uint16_t>(servePort);
+            CJ::HttpServer server([&service](const CJ::HttpRequest& request, CJ::HttpResponse& response) {
+                service.handle(request, response);
+            }, options);
+            if (!server.start()) {
+                std::cerr << "Cannot start the HTTP server: " << server.getError() << std::endl;
+                CJ::Management::shutdownSystem();
+                return 1;
+            }
+            activeServer = &server;
+            std::signal(SIGINT, stopServer);
+            std::signal(SIGTERM, stopServer);
+            std::cout << "Serving on http://" << options.address << ":" << server.getPort()
+                      << " (Ctrl+C to stop)" << std::endl;
+            server.run();
+            activeServer = nullptr;
+            std::cout << "Server stopped" << std::endl;
+            CJ::Management::shutdownSystem();
+            writeMetrics();
+            return 0;
+        }
+
+        if (simulate || validate) {
+            if (validate) {
+                CJ::Management::printPlatformConflicts(CJ::Management::validatePlatforms());
+            }
+            if (simulate) {
+                CJ::EventStream events;
+                if (!eventLogPath.empty()) {
+                    auto sink = std::make_unique<CJ::NdjsonEventSink>(eventLogPath);
+                    if (!sink->open()) {
+                        std::cerr << "Failed to create event log " << eventLogPath << std::endl;
+                        CJ::Management::shutdownSystem();
+                        return 1;
+                    }
+                    events.addSink(std::move(sink), eventOverflow);
+                }
+                if (tailEvents) {
+                    events.addSink(std::make_unique<CJ::ConsoleEventSink>(), eventOverflow);
+                }
+                CJ::Management::runSimulation(&events);
+            }
+            CJ::Management::shutdownSystem();
+            writeMetrics();
+            return 0;
+        }
+
         std::filesystem::path dbPath = std::filesystem::current_path() / "database" / "train_system.db";
         if (!std::filesystem::exists(dbPath)) {
             std::cerr << "Database file was not created at: " << dbPath << std::endl;
@@ -35,9 +298,12 @@ int main() {
         }
         CJ::CLI Cli;
         Cli.run();
+        CJ::Management::shutdownSystem();
+        writeMetrics();
     }
     catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
+        CJ::Management::shutdownSystem();
         return 1;
     }
     return 0;